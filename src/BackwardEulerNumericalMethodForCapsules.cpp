@@ -0,0 +1,347 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "BackwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleOrientation.hpp"
+#include "Exception.hpp"
+#include "LinearSystem.hpp"
+#include "NodeBasedCellPopulation.hpp"
+#include "PetscTools.hpp"
+#include "ReplicatableVector.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "UblasCustomFunctions.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+
+/*
+ * Each capsule has SPACE_DIM translational unknowns followed by its rotational unknowns: the angle theta in 2D, and
+ * the three components of a rotation vector in 3D. Torques are held as 3-vectors in both cases, with only the z
+ * component used in 2D.
+ */
+
+/** @return the number of rotational unknowns of a 2D capsule */
+inline unsigned GetNumRotations(const c_vector<double, 2>&)
+{
+    return 1u;
+}
+
+/** @return the number of rotational unknowns of a 3D capsule */
+inline unsigned GetNumRotations(const c_vector<double, 3>&)
+{
+    return 3u;
+}
+
+/** @return the component of a torque 3-vector that is a 2D capsule's rotational unknown */
+inline unsigned GetTorqueComponent(const c_vector<double, 2>&, unsigned)
+{
+    return 2u;
+}
+
+/** @return the component of a torque 3-vector that is a 3D capsule's given rotational unknown */
+inline unsigned GetTorqueComponent(const c_vector<double, 3>&, unsigned rotation)
+{
+    return rotation;
+}
+
+/** @return the 2D axis turned through the z component of a small rotation vector, renormalised */
+inline c_vector<double, 2> TurnAxis(const c_vector<double, 2>& rAxis, const c_vector<double, 3>& rRotation)
+{
+    c_vector<double, 2> axis;
+    axis[0] = rAxis[0] - rRotation[2] * rAxis[1];
+    axis[1] = rAxis[1] + rRotation[2] * rAxis[0];
+    return axis / norm_2(axis);
+}
+
+/** @return the 3D axis turned by a small rotation vector, renormalised */
+inline c_vector<double, 3> TurnAxis(const c_vector<double, 3>& rAxis, const c_vector<double, 3>& rRotation)
+{
+    c_vector<double, 3> axis = rAxis + VectorProduct(rRotation, rAxis);
+    return axis / norm_2(axis);
+}
+
+/** @return the moment, along z, of a unit normal at rArm from the centre of a 2D capsule */
+inline c_vector<double, 3> CalculateMoment(const c_vector<double, 2>& rArm, const c_vector<double, 2>& rNormal)
+{
+    c_vector<double, 3> moment = zero_vector<double>(3);
+    moment[2] = rArm[0] * rNormal[1] - rArm[1] * rNormal[0];
+    return moment;
+}
+
+/** @return the moment of a unit normal at rArm from the centre of a 3D capsule */
+inline c_vector<double, 3> CalculateMoment(const c_vector<double, 3>& rArm, const c_vector<double, 3>& rNormal)
+{
+    return VectorProduct(rArm, rNormal);
+}
+
+/** Turn a 2D capsule through the z component of a rotation vector, exactly in theta unless it holds a director. */
+inline void TurnCapsule(Node<2>& rNode, const c_vector<double, 3>& rRotation, bool useDirector)
+{
+    std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    if (useDirector)
+    {
+        c_vector<double, 2> axis;
+        CapsuleOrientation::GetAxis(r_attributes, axis);
+        CapsuleOrientation::SetDirector(r_attributes, TurnAxis(axis, rRotation));
+    }
+    else
+    {
+        r_attributes[NA_THETA] += rRotation[2];
+        CapsuleOrientation::ClearDirector(r_attributes);
+    }
+}
+
+/** Turn a 3D capsule by a rotation vector, keeping its angles in step and clearing its director if it is not to hold one. */
+inline void TurnCapsule(Node<3>& rNode, const c_vector<double, 3>& rRotation, bool useDirector)
+{
+    std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    c_vector<double, 3> axis;
+    CapsuleOrientation::GetAxis(r_attributes, axis);
+    CapsuleOrientation::SetDirector(r_attributes, TurnAxis(axis, rRotation));
+    if (!useDirector)
+    {
+        CapsuleOrientation::ClearDirector(r_attributes);
+    }
+}
+
+} // namespace
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+BackwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::BackwardEulerNumericalMethodForCapsules()
+    : ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>(),
+      mNumContactsInJacobian(0u)
+{
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void BackwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::UpdateAllNodePositions(double dt)
+{
+    if (this->GetUseSleeping() || this->GetUseAdaptiveTimeStepping())
+    {
+        EXCEPTION("BackwardEulerNumericalMethodForCapsules does not support sleeping or adaptive time stepping");
+    }
+
+    auto p_population = dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(this->mpCellPopulation);
+    if (p_population == nullptr)
+    {
+        EXCEPTION("BackwardEulerNumericalMethodForCapsules needs a NodeBasedCellPopulation");
+    }
+
+    // The Jacobian holds the contact stiffness of a single CapsuleForce, so a second one would be left explicit
+    boost::shared_ptr<CapsuleForce<ELEMENT_DIM,SPACE_DIM> > p_capsule_force;
+    for (auto& rp_force : *(this->mpForceCollection))
+    {
+        auto p_force = boost::dynamic_pointer_cast<CapsuleForce<ELEMENT_DIM,SPACE_DIM> >(rp_force);
+        if (p_force && p_capsule_force)
+        {
+            EXCEPTION("BackwardEulerNumericalMethodForCapsules supports only one CapsuleForce in the force collection");
+        }
+        if (p_force)
+        {
+            p_capsule_force = p_force;
+        }
+    }
+    if (!p_capsule_force)
+    {
+        EXCEPTION("BackwardEulerNumericalMethodForCapsules needs a CapsuleForce in the force collection");
+    }
+
+    std::vector<double> growth_rates;
+    this->UpdateCapsuleLengths(dt, growth_rates);
+    this->UpdateMobilities();
+
+    // Apply forces to each cell, and save a vector of net forces F
+    this->ComputeForcesIncludingDamping();
+
+    // Number the capsules contiguously, in the order of the mesh
+    std::vector<Node<SPACE_DIM>*> nodes;
+    std::map<unsigned, unsigned> capsule_of_index;
+    for (auto node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+         node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        capsule_of_index[node_iter->GetIndex()] = nodes.size();
+        nodes.push_back(&(*node_iter));
+    }
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    const c_vector<double, SPACE_DIM> dimension_tag = zero_vector<double>(SPACE_DIM);
+    const unsigned num_rotations = GetNumRotations(dimension_tag);
+    const unsigned num_capsule_unknowns = SPACE_DIM + num_rotations;
+    const unsigned num_unknowns = num_capsule_unknowns * nodes.size();
+
+    // Each row couples a capsule to itself and to every capsule it may touch
+    std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& r_node_pairs = p_population->rGetNodePairs();
+    std::vector<unsigned> num_neighbours(nodes.size(), 0u);
+    for (auto& r_pair : r_node_pairs)
+    {
+        num_neighbours[capsule_of_index[r_pair.first->GetIndex()]]++;
+        num_neighbours[capsule_of_index[r_pair.second->GetIndex()]]++;
+    }
+    const unsigned max_num_neighbours = *std::max_element(num_neighbours.begin(), num_neighbours.end());
+
+    LinearSystem linear_system(num_unknowns, num_capsule_unknowns * (max_num_neighbours + 1u));
+
+    // The mass and moment of inertia matrix over dt, and the forces and torques at the start of the step
+    for (unsigned capsule = 0; capsule < nodes.size(); capsule++)
+    {
+        const double mass = 1.0 / nodes[capsule]->rGetNodeAttributes()[NA_TRANSLATIONAL_MOBILITY];
+        const double moment_of_inertia = 1.0 / nodes[capsule]->rGetNodeAttributes()[NA_ROTATIONAL_MOBILITY];
+        const c_vector<double, SPACE_DIM>& r_force = nodes[capsule]->rGetAppliedForce();
+        const c_vector<double, 3> torque = CapsuleOrientation::GetAppliedTorque<SPACE_DIM>(nodes[capsule]->rGetNodeAttributes());
+
+        const unsigned first_row = capsule * num_capsule_unknowns;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            linear_system.AddToMatrixElement(first_row + dim, first_row + dim, mass / dt);
+            linear_system.SetRhsVectorElement(first_row + dim, r_force[dim]);
+        }
+        for (unsigned rotation = 0; rotation < num_rotations; rotation++)
+        {
+            const unsigned row = first_row + SPACE_DIM + rotation;
+            linear_system.AddToMatrixElement(row, row, moment_of_inertia / dt);
+            linear_system.SetRhsVectorElement(row, torque[GetTorqueComponent(dimension_tag, rotation)]);
+        }
+    }
+
+    /*
+     * Minus the Jacobian of the contact forces and torques. A contact with stiffness k and normal n changes its force
+     * on capsule A by -k n and its torque by -k (r_A x n) for every unit increase in overlap, and the overlap changes
+     * at the rate g.dq/dt with g = (n, r_A x n, -n, -r_B x n) over the unknowns of the two capsules, so each contact
+     * adds k g g^T.
+     */
+    mNumContactsInJacobian = 0u;
+    for (auto& r_pair : r_node_pairs)
+    {
+        c_vector<double, SPACE_DIM> direction_a_to_b;
+        double contact_dist_a;
+        double contact_dist_b;
+        double stiffness;
+        if (!p_capsule_force->CalculateContactStiffness(*(r_pair.first), *(r_pair.second), direction_a_to_b,
+                                                        contact_dist_a, contact_dist_b, stiffness))
+        {
+            continue;
+        }
+        mNumContactsInJacobian++;
+
+        c_vector<double, SPACE_DIM> axis_a;
+        c_vector<double, SPACE_DIM> axis_b;
+        CapsuleOrientation::GetAxis(r_pair.first->rGetNodeAttributes(), axis_a);
+        CapsuleOrientation::GetAxis(r_pair.second->rGetNodeAttributes(), axis_b);
+        const c_vector<double, 3> moment_a = CalculateMoment(c_vector<double, SPACE_DIM>(contact_dist_a * axis_a), direction_a_to_b);
+        const c_vector<double, 3> moment_b = CalculateMoment(c_vector<double, SPACE_DIM>(contact_dist_b * axis_b), direction_a_to_b);
+
+        std::vector<unsigned> columns;
+        std::vector<double> g;
+        const unsigned first_column_a = capsule_of_index[r_pair.first->GetIndex()] * num_capsule_unknowns;
+        const unsigned first_column_b = capsule_of_index[r_pair.second->GetIndex()] * num_capsule_unknowns;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            columns.push_back(first_column_a + dim);
+            g.push_back(direction_a_to_b[dim]);
+        }
+        for (unsigned rotation = 0; rotation < num_rotations; rotation++)
+        {
+            columns.push_back(first_column_a + SPACE_DIM + rotation);
+            g.push_back(moment_a[GetTorqueComponent(dimension_tag, rotation)]);
+        }
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            columns.push_back(first_column_b + dim);
+            g.push_back(-direction_a_to_b[dim]);
+        }
+        for (unsigned rotation = 0; rotation < num_rotations; rotation++)
+        {
+            columns.push_back(first_column_b + SPACE_DIM + rotation);
+            g.push_back(-moment_b[GetTorqueComponent(dimension_tag, rotation)]);
+        }
+
+        for (unsigned row = 0; row < columns.size(); row++)
+        {
+            for (unsigned column = 0; column < columns.size(); column++)
+            {
+                linear_system.AddToMatrixElement(columns[row], columns[column], stiffness * g[row] * g[column]);
+            }
+        }
+    }
+
+    // The matrix is symmetric positive definite
+    linear_system.SetMatrixIsSymmetric(true);
+    linear_system.SetKspType("cg");
+    linear_system.AssembleFinalLinearSystem();
+    Vec solution = linear_system.Solve();
+    ReplicatableVector replicated_solution(solution);
+
+    const bool use_director = this->GetUseDirectorOrientation();
+    for (unsigned capsule = 0; capsule < nodes.size(); capsule++)
+    {
+        const unsigned first_row = capsule * num_capsule_unknowns;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            nodes[capsule]->rGetModifiableLocation()[dim] += replicated_solution[first_row + dim];
+        }
+
+        c_vector<double, 3> rotation = zero_vector<double>(3);
+        for (unsigned unknown = 0; unknown < num_rotations; unknown++)
+        {
+            rotation[GetTorqueComponent(dimension_tag, unknown)] = replicated_solution[first_row + SPACE_DIM + unknown];
+        }
+        TurnCapsule(*nodes[capsule], rotation, use_director);
+    }
+
+    PetscTools::Destroy(solution);
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned BackwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetNumContactsInJacobian()
+{
+    return mNumContactsInJacobian;
+}
+
+// Explicit instantiation
+template class BackwardEulerNumericalMethodForCapsules<2,2>;
+template class BackwardEulerNumericalMethodForCapsules<3,3>;
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapperForCpp.hpp"
+EXPORT_TEMPLATE_CLASS2(BackwardEulerNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(BackwardEulerNumericalMethodForCapsules, 3, 3)
@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef BACKWARDEULERNUMERICALMETHODFORCAPSULES_HPP_
+#define BACKWARDEULERNUMERICALMETHODFORCAPSULES_HPP_
+
+#include "ChasteSerialization.hpp"
+#include <boost/serialization/base_object.hpp>
+
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+
+/**
+ * Linearly implicit (backward Euler) time stepping for capsules, where the position and orientation of every capsule
+ * are updated together by solving
+ *
+ * (D / dt - J) dq = F,
+ *
+ * in which q holds each capsule's centre and orientation (an angle in 2D, a rotation vector in 3D), F the forces and
+ * torques at the start of the step, D the diagonal of capsule masses and moments of inertia used by the forward
+ * Euler method, and J the Jacobian of the contact forces and torques of the single CapsuleForce in the force
+ * collection, which must go with a NodeBasedCellPopulation.
+ * J keeps only the stiffness of each contact along its normal, from CapsuleForce::CalculateContactStiffness(), so
+ * D / dt - J is sparse, symmetric and positive definite, and is assembled into a LinearSystem and solved by
+ * conjugate gradients with PETSc. The stiff Hertz contacts are then stable at steps many times larger than the
+ * explicit method allows.
+ *
+ * Growth and director orientations are handled as in the forward Euler method; sleeping and adaptive substeps are
+ * not supported. In 3D the whole torque turns each capsule.
+ */
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class BackwardEulerNumericalMethodForCapsules : public ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>
+{
+private:
+
+    /** Needed for serialization. */
+    friend class boost::serialization::access;
+
+    /**
+     * Save or restore the simulation.
+     *
+     * @param archive the archive
+     * @param version the current version of this class
+     */
+    template<class Archive>
+    void serialize(Archive & archive, const unsigned int version)
+    {
+        archive & boost::serialization::base_object<ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM> >(*this);
+    }
+
+    /** The number of capsule pairs in contact in the Jacobian of the last call to UpdateAllNodePositions(). */
+    unsigned mNumContactsInJacobian;
+
+public:
+
+    /**
+     * Constructor.
+     */
+    BackwardEulerNumericalMethodForCapsules();
+
+    /**
+     * Destructor.
+     */
+    virtual ~BackwardEulerNumericalMethodForCapsules() = default;
+
+    /**
+     * Overridden UpdateAllNodePositions() method.
+     *
+     * @param dt Time step size
+     */
+    void UpdateAllNodePositions(double dt);
+
+    /**
+     * @return the number of capsule pairs in contact in the Jacobian of the last call to UpdateAllNodePositions()
+     */
+    unsigned GetNumContactsInJacobian();
+};
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapper.hpp"
+EXPORT_TEMPLATE_CLASS2(BackwardEulerNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(BackwardEulerNumericalMethodForCapsules, 3, 3)
+
+#endif /*BACKWARDEULERNUMERICALMETHODFORCAPSULES_HPP_*/
@@ -13,6 +13,9 @@ template<unsigned ELEMENT_DIM, unsigned SPACE_DIM> class AbstractCentreBasedDivi
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
 class CapsuleBasedDivisionRule : public AbstractCentreBasedDivisionRule<ELEMENT_DIM, SPACE_DIM>
 {
+    static_assert((ELEMENT_DIM == 2u && SPACE_DIM == 2u) || (ELEMENT_DIM == 3u && SPACE_DIM == 3u),
+                  "CapsuleBasedDivisionRule is only defined for 2D capsules in 2D or 3D capsules in 3D");
+
 private:
 	   /**
 	     * The specified location of the new daughter cell.
@@ -77,6 +80,7 @@ public:
 };
 
 #include "SerializationExportWrapper.hpp"
-EXPORT_TEMPLATE_CLASS_ALL_DIMS(CapsuleBasedDivisionRule)
+EXPORT_TEMPLATE_CLASS2(CapsuleBasedDivisionRule, 2, 2)
+EXPORT_TEMPLATE_CLASS2(CapsuleBasedDivisionRule, 3, 3)
 
 #endif // CAPSULEBASEDDIVISIONRULE_HPP_
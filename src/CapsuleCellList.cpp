@@ -0,0 +1,300 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleCellList.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+template<unsigned SPACE_DIM>
+CapsuleCellList<SPACE_DIM>::CapsuleCellList()
+    : mSampleSpacing(1.0),
+      mCellSize(0.0)
+{
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        mLowerCorner[dim] = 0.0;
+        mNumCellsInDirection[dim] = 0u;
+    }
+}
+
+template<unsigned SPACE_DIM>
+unsigned CapsuleCellList<SPACE_DIM>::GetLinearCellIndex(const unsigned* pCellIndices) const
+{
+    unsigned linear_index = 0u;
+    unsigned stride = 1u;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        linear_index += pCellIndices[dim] * stride;
+        stride *= mNumCellsInDirection[dim];
+    }
+    return linear_index;
+}
+
+template<unsigned SPACE_DIM>
+void CapsuleCellList<SPACE_DIM>::Build(NodesOnlyMesh<SPACE_DIM>& rMesh,
+                                       const CapsuleGeometryCache<SPACE_DIM>& rGeometry,
+                                       double extraReach)
+{
+    mNodes.clear();
+    mNodePairs.clear();
+    for (auto node_iter = rMesh.GetNodeIteratorBegin();
+         node_iter != rMesh.GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        mNodes.push_back(&(*node_iter));
+    }
+
+    const unsigned num_capsules = mNodes.size();
+    if (num_capsules == 0u)
+    {
+        for (unsigned dim=0; dim<SPACE_DIM; dim++)
+        {
+            mNumCellsInDirection[dim] = 0u;
+        }
+        return;
+    }
+
+    // Work out how many samples each capsule needs, and the extent of the samples
+    double max_radius = 0.0;
+    c_vector<double, SPACE_DIM> upper_corner;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        mLowerCorner[dim] = DBL_MAX;
+        upper_corner[dim] = -DBL_MAX;
+    }
+
+    std::vector<unsigned> num_intervals(num_capsules);
+    unsigned num_samples = 0u;
+    for (unsigned capsule=0; capsule<num_capsules; capsule++)
+    {
+        const unsigned index = mNodes[capsule]->GetIndex();
+        max_radius = std::max(max_radius, rGeometry.GetRadius(index));
+
+        num_intervals[capsule] = unsigned(std::ceil(2.0 * rGeometry.GetHalfLength(index) / mSampleSpacing));
+        num_samples += num_intervals[capsule] + 1u;
+
+        // Every sample lies between the two end points
+        for (unsigned dim=0; dim<SPACE_DIM; dim++)
+        {
+            const double end_one = rGeometry.rGetEndPointsOne(dim)[index];
+            const double end_two = rGeometry.rGetEndPointsTwo(dim)[index];
+            mLowerCorner[dim] = std::min(mLowerCorner[dim], std::min(end_one, end_two));
+            upper_corner[dim] = std::max(upper_corner[dim], std::max(end_one, end_two));
+        }
+    }
+
+    // The smallest cells that still find every pair, coarsened if the capsules are too sparse for that to pay
+    mCellSize = 2.0 * max_radius + extraReach + mSampleSpacing;
+    const double max_num_cells = 4.0 * num_samples;
+    while (true)
+    {
+        double num_cells = 1.0;
+        for (unsigned dim=0; dim<SPACE_DIM; dim++)
+        {
+            num_cells *= std::floor((upper_corner[dim] - mLowerCorner[dim]) / mCellSize) + 1.0;
+        }
+        if (num_cells <= max_num_cells)
+        {
+            break;
+        }
+        mCellSize *= std::max(1.01, std::pow(num_cells / max_num_cells, 1.0 / SPACE_DIM));
+    }
+
+    unsigned num_cells = 1u;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        mNumCellsInDirection[dim] = unsigned(std::floor((upper_corner[dim] - mLowerCorner[dim]) / mCellSize)) + 1u;
+        num_cells *= mNumCellsInDirection[dim];
+    }
+
+    // Find the distinct cells holding samples of each capsule
+    mCapsuleCellOffsets.assign(1u, 0u);
+    mCapsuleCells.clear();
+    std::vector<unsigned> capsule_cells;
+    for (unsigned capsule=0; capsule<num_capsules; capsule++)
+    {
+        const unsigned index = mNodes[capsule]->GetIndex();
+        const unsigned capsule_intervals = num_intervals[capsule];
+
+        capsule_cells.clear();
+        for (unsigned sample=0; sample<=capsule_intervals; sample++)
+        {
+            const double fraction = (capsule_intervals > 0u) ? double(sample) / double(capsule_intervals) : 0.5;
+
+            unsigned cell_indices[SPACE_DIM];
+            for (unsigned dim=0; dim<SPACE_DIM; dim++)
+            {
+                const double end_one = rGeometry.rGetEndPointsOne(dim)[index];
+                const double end_two = rGeometry.rGetEndPointsTwo(dim)[index];
+                const double coordinate = end_two + fraction * (end_one - end_two);
+                const unsigned cell_index = unsigned(std::max(0.0, (coordinate - mLowerCorner[dim]) / mCellSize));
+                cell_indices[dim] = std::min(cell_index, mNumCellsInDirection[dim] - 1u);
+            }
+            capsule_cells.push_back(GetLinearCellIndex(cell_indices));
+        }
+
+        std::sort(capsule_cells.begin(), capsule_cells.end());
+        capsule_cells.erase(std::unique(capsule_cells.begin(), capsule_cells.end()), capsule_cells.end());
+        mCapsuleCells.insert(mCapsuleCells.end(), capsule_cells.begin(), capsule_cells.end());
+        mCapsuleCellOffsets.push_back(mCapsuleCells.size());
+    }
+
+    // Sort the capsules into the grid cells by counting
+    mCellOffsets.assign(num_cells + 1u, 0u);
+    for (unsigned entry=0; entry<mCapsuleCells.size(); entry++)
+    {
+        mCellOffsets[mCapsuleCells[entry] + 1u]++;
+    }
+    for (unsigned cell=0; cell<num_cells; cell++)
+    {
+        mCellOffsets[cell + 1u] += mCellOffsets[cell];
+    }
+
+    mCellCapsules.resize(mCapsuleCells.size());
+    std::vector<unsigned> next_slot(mCellOffsets.begin(), mCellOffsets.end() - 1);
+    for (unsigned capsule=0; capsule<num_capsules; capsule++)
+    {
+        for (unsigned entry=mCapsuleCellOffsets[capsule]; entry<mCapsuleCellOffsets[capsule + 1u]; entry++)
+        {
+            mCellCapsules[next_slot[mCapsuleCells[entry]]++] = capsule;
+        }
+    }
+
+    // Pair each capsule with the later capsules in its cells and their neighbours, listing each partner once
+    unsigned num_neighbours = 1u;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        num_neighbours *= 3u;
+    }
+
+    mLastPartner.assign(num_capsules, UINT_MAX);
+    std::vector<unsigned> partners;
+    for (unsigned capsule=0; capsule<num_capsules; capsule++)
+    {
+        partners.clear();
+        for (unsigned entry=mCapsuleCellOffsets[capsule]; entry<mCapsuleCellOffsets[capsule + 1u]; entry++)
+        {
+            unsigned cell_indices[SPACE_DIM];
+            unsigned remainder = mCapsuleCells[entry];
+            for (unsigned dim=0; dim<SPACE_DIM; dim++)
+            {
+                cell_indices[dim] = remainder % mNumCellsInDirection[dim];
+                remainder /= mNumCellsInDirection[dim];
+            }
+
+            for (unsigned neighbour=0; neighbour<num_neighbours; neighbour++)
+            {
+                unsigned neighbour_indices[SPACE_DIM];
+                unsigned offset_code = neighbour;
+                bool in_grid = true;
+                for (unsigned dim=0; dim<SPACE_DIM; dim++)
+                {
+                    const int neighbour_index = int(cell_indices[dim]) + int(offset_code % 3u) - 1;
+                    offset_code /= 3u;
+                    in_grid = in_grid && (neighbour_index >= 0) && (neighbour_index < int(mNumCellsInDirection[dim]));
+                    neighbour_indices[dim] = unsigned(std::max(neighbour_index, 0));
+                }
+                if (!in_grid)
+                {
+                    continue;
+                }
+
+                const unsigned neighbour_cell = GetLinearCellIndex(neighbour_indices);
+                for (unsigned slot=mCellOffsets[neighbour_cell]; slot<mCellOffsets[neighbour_cell + 1u]; slot++)
+                {
+                    const unsigned other = mCellCapsules[slot];
+                    if (other > capsule && mLastPartner[other] != capsule)
+                    {
+                        mLastPartner[other] = capsule;
+                        partners.push_back(other);
+                    }
+                }
+            }
+        }
+
+        std::sort(partners.begin(), partners.end());
+        for (unsigned i=0; i<partners.size(); i++)
+        {
+            mNodePairs.push_back(std::make_pair(mNodes[capsule], mNodes[partners[i]]));
+        }
+    }
+}
+
+template<unsigned SPACE_DIM>
+std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& CapsuleCellList<SPACE_DIM>::rGetNodePairs()
+{
+    return mNodePairs;
+}
+
+template<unsigned SPACE_DIM>
+void CapsuleCellList<SPACE_DIM>::SetSampleSpacing(double sampleSpacing)
+{
+    if (sampleSpacing <= 0.0)
+    {
+        EXCEPTION("The sample spacing of a capsule cell list must be positive.");
+    }
+    mSampleSpacing = sampleSpacing;
+}
+
+template<unsigned SPACE_DIM>
+double CapsuleCellList<SPACE_DIM>::GetSampleSpacing() const
+{
+    return mSampleSpacing;
+}
+
+template<unsigned SPACE_DIM>
+double CapsuleCellList<SPACE_DIM>::GetCellSize() const
+{
+    return mCellSize;
+}
+
+template<unsigned SPACE_DIM>
+unsigned CapsuleCellList<SPACE_DIM>::GetNumCells() const
+{
+    unsigned num_cells = 1u;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        num_cells *= mNumCellsInDirection[dim];
+    }
+    return num_cells;
+}
+
+// Explicit instantiation
+template class CapsuleCellList<2>;
+template class CapsuleCellList<3>;
@@ -0,0 +1,167 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULECELLLIST_HPP_
+#define CAPSULECELLLIST_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "CapsuleGeometryCache.hpp"
+#include "ChasteSerialization.hpp"
+#include "NodesOnlyMesh.hpp"
+
+/**
+ * A broad phase for capsule contacts that, unlike the box collection of NodesOnlyMesh, does not treat each capsule
+ * as a point at its centre.
+ *
+ * Points are sampled along each capsule's line segment no more than the sample spacing apart, and the capsule is
+ * entered in every cell of a uniform grid that holds one of its samples. If two capsules are within extraReach of
+ * touching, the closest points of their segments are less than 2 * max radius + extraReach apart, and each lies
+ * within half the sample spacing of a sample, so with cells of side 2 * max radius + extraReach + sample spacing
+ * the two capsules have samples in the same or neighbouring cells. The cell size therefore depends on the capsule
+ * radii rather than their lengths, and long thin capsules only pull in the capsules alongside them.
+ *
+ * Each candidate pair is listed once, in a form CapsuleForce can use in place of rGetNodePairs(). Building the list
+ * takes time proportional to the number of capsules plus the number of grid cells, and the grid is coarsened if
+ * it would otherwise have many more cells than samples.
+ */
+template<unsigned SPACE_DIM>
+class CapsuleCellList
+{
+    static_assert(SPACE_DIM == 2u || SPACE_DIM == 3u, "Capsules are only defined in 2D and 3D");
+
+private:
+
+    /** Needed for serialization. */
+    friend class boost::serialization::access;
+
+    /**
+     * Archive the sample spacing; the grid and pairs are rebuilt on every call to Build().
+     *
+     * @param archive the archive
+     * @param version the current version of this class
+     */
+    template<class Archive>
+    void serialize(Archive & archive, const unsigned int version)
+    {
+        archive & mSampleSpacing;
+    }
+
+    /** The largest distance between consecutive samples along a capsule's segment. Defaults to 1.0. */
+    double mSampleSpacing;
+
+    /** The side of each grid cell used by the last call to Build(). */
+    double mCellSize;
+
+    /** The corner of the grid with the smallest coordinates. */
+    c_vector<double, SPACE_DIM> mLowerCorner;
+
+    /** The number of grid cells in each direction. */
+    unsigned mNumCellsInDirection[SPACE_DIM];
+
+    /** The nodes, in the order they are numbered within the cell list. */
+    std::vector<Node<SPACE_DIM>*> mNodes;
+
+    /** Entries mCapsuleCellOffsets[i] to mCapsuleCellOffsets[i+1] of mCapsuleCells are the grid cells of capsule i. */
+    std::vector<unsigned> mCapsuleCellOffsets;
+
+    /** The distinct grid cells holding samples of each capsule. */
+    std::vector<unsigned> mCapsuleCells;
+
+    /** Entries mCellOffsets[c] to mCellOffsets[c+1] of mCellCapsules are the capsules in grid cell c. */
+    std::vector<unsigned> mCellOffsets;
+
+    /** The capsules in each grid cell, in ascending order. */
+    std::vector<unsigned> mCellCapsules;
+
+    /** For each capsule, the last capsule that listed it as a partner; used to remove duplicate pairs. */
+    std::vector<unsigned> mLastPartner;
+
+    /** The candidate pairs found by the last call to Build(). */
+    std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> > mNodePairs;
+
+    /**
+     * @param pCellIndices the grid cell in each direction
+     * @return the index of a grid cell
+     */
+    unsigned GetLinearCellIndex(const unsigned* pCellIndices) const;
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleCellList();
+
+    /**
+     * Find the candidate pairs of the capsules in a mesh.
+     *
+     * @param rMesh the nodes-only mesh holding the capsules
+     * @param rGeometry the capsule geometry, indexed by node index and up to date with rMesh
+     * @param extraReach how far apart beyond touching two capsules may be and still be listed
+     */
+    void Build(NodesOnlyMesh<SPACE_DIM>& rMesh, const CapsuleGeometryCache<SPACE_DIM>& rGeometry, double extraReach);
+
+    /**
+     * @return the candidate pairs found by the last call to Build(), each listed once
+     */
+    std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rGetNodePairs();
+
+    /**
+     * Set the largest distance between consecutive samples along a capsule's segment. Smaller spacings give smaller
+     * cells and fewer candidates, at the cost of more samples per capsule.
+     *
+     * @param sampleSpacing the sample spacing (positive)
+     */
+    void SetSampleSpacing(double sampleSpacing);
+
+    /**
+     * @return the largest distance between consecutive samples along a capsule's segment
+     */
+    double GetSampleSpacing() const;
+
+    /**
+     * @return the side of each grid cell used by the last call to Build()
+     */
+    double GetCellSize() const;
+
+    /**
+     * @return the number of grid cells used by the last call to Build()
+     */
+    unsigned GetNumCells() const;
+};
+
+#endif /*CAPSULECELLLIST_HPP_*/
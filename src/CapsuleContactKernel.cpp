@@ -0,0 +1,438 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleContactKernel.hpp"
+
+#include <cassert>
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+/** Below this the segments are treated as parallel, and closest point parameters are rounded to zero. */
+const double SMALL_NUM = 1e-9;
+
+
+/**
+ * Branchless operations on a single pair, used when no vector instruction set is available.
+ */
+struct ScalarLanes
+{
+    typedef double Real;
+    typedef bool Mask;
+    static const unsigned WIDTH = 1u;
+
+    static const bool USE_CROSS_PRODUCTS = false;
+    static inline Real Load(const double* p) { return *p; }
+    static inline void Store(double* p, Real x) { *p = x; }
+    static inline Real Set(double x) { return x; }
+    static inline Real Add(Real a, Real b) { return a + b; }
+    static inline Real Sub(Real a, Real b) { return a - b; }
+    static inline Real Mul(Real a, Real b) { return a * b; }
+    static inline Real Div(Real a, Real b) { return a / b; }
+    static inline Real Negate(Real a) { return -a; }
+    static inline Real Abs(Real a) { return std::fabs(a); }
+    static inline Real Sqrt(Real a) { return std::sqrt(a); }
+    static inline Mask Less(Real a, Real b) { return a < b; }
+    static inline Mask Greater(Real a, Real b) { return a > b; }
+    static inline Mask And(Mask a, Mask b) { return a && b; }
+    static inline Mask AndNot(Mask a, Mask b) { return a && !b; }
+    static inline Mask Or(Mask a, Mask b) { return a || b; }
+    static inline Real Select(Mask m, Real a, Real b) { return m ? a : b; }
+};
+
+#ifdef __AVX2__
+/**
+ * Four pairs at a time in 256-bit registers.
+ */
+struct Avx2Lanes
+{
+    typedef __m256d Real;
+    typedef __m256d Mask;
+    static const unsigned WIDTH = 4u;
+
+    static const bool USE_CROSS_PRODUCTS = false;
+    static inline Real Load(const double* p) { return _mm256_loadu_pd(p); }
+    static inline void Store(double* p, Real x) { _mm256_storeu_pd(p, x); }
+    static inline Real Set(double x) { return _mm256_set1_pd(x); }
+    static inline Real Add(Real a, Real b) { return _mm256_add_pd(a, b); }
+    static inline Real Sub(Real a, Real b) { return _mm256_sub_pd(a, b); }
+    static inline Real Mul(Real a, Real b) { return _mm256_mul_pd(a, b); }
+    static inline Real Div(Real a, Real b) { return _mm256_div_pd(a, b); }
+    static inline Real Negate(Real a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+    static inline Real Abs(Real a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static inline Real Sqrt(Real a) { return _mm256_sqrt_pd(a); }
+    static inline Mask Less(Real a, Real b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static inline Mask Greater(Real a, Real b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static inline Mask And(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+    static inline Mask AndNot(Mask a, Mask b) { return _mm256_andnot_pd(b, a); }
+    static inline Mask Or(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+    static inline Real Select(Mask m, Real a, Real b) { return _mm256_blendv_pd(b, a, m); }
+};
+#endif // __AVX2__
+
+#ifdef __AVX512F__
+/**
+ * Eight pairs at a time in 512-bit registers, using AVX-512F instructions only.
+ */
+struct Avx512Lanes
+{
+    typedef __m512d Real;
+    typedef __mmask8 Mask;
+    static const unsigned WIDTH = 8u;
+
+    static const bool USE_CROSS_PRODUCTS = false;
+    static inline Real Load(const double* p) { return _mm512_loadu_pd(p); }
+    static inline void Store(double* p, Real x) { _mm512_storeu_pd(p, x); }
+    static inline Real Set(double x) { return _mm512_set1_pd(x); }
+    static inline Real Add(Real a, Real b) { return _mm512_add_pd(a, b); }
+    static inline Real Sub(Real a, Real b) { return _mm512_sub_pd(a, b); }
+    static inline Real Mul(Real a, Real b) { return _mm512_mul_pd(a, b); }
+    static inline Real Div(Real a, Real b) { return _mm512_div_pd(a, b); }
+    static inline Real Negate(Real a)
+    {
+        return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(0x8000000000000000LL)));
+    }
+    static inline Real Abs(Real a) { return _mm512_abs_pd(a); }
+    static inline Real Sqrt(Real a) { return _mm512_sqrt_pd(a); }
+    static inline Mask Less(Real a, Real b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static inline Mask Greater(Real a, Real b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static inline Mask And(Mask a, Mask b) { return static_cast<Mask>(a & b); }
+    static inline Mask AndNot(Mask a, Mask b) { return static_cast<Mask>(a & ~b); }
+    static inline Mask Or(Mask a, Mask b) { return static_cast<Mask>(a | b); }
+    static inline Real Select(Mask m, Real a, Real b) { return _mm512_mask_blend_pd(m, b, a); }
+};
+#endif // __AVX512F__
+
+/**
+ * A single pair in single precision, used for the single precision path when no vector instruction set is
+ * available. Inputs are rounded to float as they are loaded, and outputs widened back to double as they are stored.
+ */
+struct ScalarFloatLanes
+{
+    typedef float Real;
+    typedef bool Mask;
+    static const unsigned WIDTH = 1u;
+
+    static const bool USE_CROSS_PRODUCTS = true;
+    static inline Real Load(const double* p) { return static_cast<float>(*p); }
+    static inline void Store(double* p, Real x) { *p = x; }
+    static inline Real Set(double x) { return static_cast<float>(x); }
+    static inline Real Add(Real a, Real b) { return a + b; }
+    static inline Real Sub(Real a, Real b) { return a - b; }
+    static inline Real Mul(Real a, Real b) { return a * b; }
+    static inline Real Div(Real a, Real b) { return a / b; }
+    static inline Real Negate(Real a) { return -a; }
+    static inline Real Abs(Real a) { return std::fabs(a); }
+    static inline Real Sqrt(Real a) { return std::sqrt(a); }
+    static inline Mask Less(Real a, Real b) { return a < b; }
+    static inline Mask Greater(Real a, Real b) { return a > b; }
+    static inline Mask And(Mask a, Mask b) { return a && b; }
+    static inline Mask AndNot(Mask a, Mask b) { return a && !b; }
+    static inline Mask Or(Mask a, Mask b) { return a || b; }
+    static inline Real Select(Mask m, Real a, Real b) { return m ? a : b; }
+};
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+/**
+ * Eight pairs at a time in single precision in 256-bit registers, which holds the whole batch with AVX2 alone.
+ */
+struct Avx2FloatLanes
+{
+    typedef __m256 Real;
+    typedef __m256 Mask;
+    static const unsigned WIDTH = 8u;
+
+    static const bool USE_CROSS_PRODUCTS = true;
+    static inline Real Load(const double* p)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(p))),
+                                    _mm256_cvtpd_ps(_mm256_loadu_pd(p + 4)), 1);
+    }
+    static inline void Store(double* p, Real x)
+    {
+        _mm256_storeu_pd(p, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+        _mm256_storeu_pd(p + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+    }
+    static inline Real Set(double x) { return _mm256_set1_ps(static_cast<float>(x)); }
+    static inline Real Add(Real a, Real b) { return _mm256_add_ps(a, b); }
+    static inline Real Sub(Real a, Real b) { return _mm256_sub_ps(a, b); }
+    static inline Real Mul(Real a, Real b) { return _mm256_mul_ps(a, b); }
+    static inline Real Div(Real a, Real b) { return _mm256_div_ps(a, b); }
+    static inline Real Negate(Real a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static inline Real Abs(Real a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static inline Real Sqrt(Real a) { return _mm256_sqrt_ps(a); }
+    static inline Mask Less(Real a, Real b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline Mask Greater(Real a, Real b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static inline Mask AndNot(Mask a, Mask b) { return _mm256_andnot_ps(b, a); }
+    static inline Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    static inline Real Select(Mask m, Real a, Real b) { return _mm256_blendv_ps(b, a, m); }
+};
+#endif
+
+/**
+ * The Dan Sunday closest point routine (see CapsuleForce::CalculateShortestDistanceBetweenSegments()) with every
+ * branch replaced by a select, applied to LANES::WIDTH pairs of a batch starting at lane offset.
+ *
+ * @param rBatch the batch
+ * @param offset the first lane to process
+ */
+template<class LANES, unsigned SPACE_DIM>
+inline void CalculateLanes(CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned offset)
+{
+    typedef typename LANES::Real Real;
+    typedef typename LANES::Mask Mask;
+
+    const Real zero = LANES::Set(0.0);
+    const Real half = LANES::Set(0.5);
+    const Real one = LANES::Set(1.0);
+    const Real small_num = LANES::Set(SMALL_NUM);
+
+    // u = A2 - A1, v = B2 - B1, w = A1 - B1
+    Real u[SPACE_DIM];
+    Real v[SPACE_DIM];
+    Real w[SPACE_DIM];
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        const Real point_a1 = LANES::Load(&rBatch.mPointA1[dim][offset]);
+        const Real point_b1 = LANES::Load(&rBatch.mPointB1[dim][offset]);
+        u[dim] = LANES::Sub(LANES::Load(&rBatch.mPointA2[dim][offset]), point_a1);
+        v[dim] = LANES::Sub(LANES::Load(&rBatch.mPointB2[dim][offset]), point_b1);
+        w[dim] = LANES::Sub(point_a1, point_b1);
+    }
+
+    Real a = LANES::Mul(u[0], u[0]);
+    Real b = LANES::Mul(u[0], v[0]);
+    Real c = LANES::Mul(v[0], v[0]);
+    Real d = LANES::Mul(u[0], w[0]);
+    Real e = LANES::Mul(v[0], w[0]);
+    for (unsigned dim=1; dim<SPACE_DIM; dim++)
+    {
+        a = LANES::Add(a, LANES::Mul(u[dim], u[dim]));
+        b = LANES::Add(b, LANES::Mul(u[dim], v[dim]));
+        c = LANES::Add(c, LANES::Mul(v[dim], v[dim]));
+        d = LANES::Add(d, LANES::Mul(u[dim], w[dim]));
+        e = LANES::Add(e, LANES::Mul(v[dim], w[dim]));
+    }
+    Real det = LANES::Sub(LANES::Mul(a, c), LANES::Mul(b, b));
+    Real s_num = LANES::Sub(LANES::Mul(b, e), LANES::Mul(c, d));
+    Real t_num = LANES::Sub(LANES::Mul(a, e), LANES::Mul(b, d));
+
+    /*
+     * For nearly parallel segments these differences of products cancel badly, which in single precision is enough
+     * to put the closest point at the wrong end. By Lagrange's identity they are also the dot products
+     * (u x v).(u x v), (u x v).(v x w) and (u x v).(u x w), which do not cancel.
+     */
+    if (LANES::USE_CROSS_PRODUCTS)
+    {
+        const unsigned num_components = (SPACE_DIM == 2u) ? 1u : 3u;
+        for (unsigned component=0; component<num_components; component++)
+        {
+            const unsigned i = (SPACE_DIM == 2u) ? 0u : (component + 1u) % 3u;
+            const unsigned j = (SPACE_DIM == 2u) ? 1u : (component + 2u) % 3u;
+            const Real u_cross_v = LANES::Sub(LANES::Mul(u[i], v[j]), LANES::Mul(u[j], v[i]));
+            const Real v_cross_w = LANES::Sub(LANES::Mul(v[i], w[j]), LANES::Mul(v[j], w[i]));
+            const Real u_cross_w = LANES::Sub(LANES::Mul(u[i], w[j]), LANES::Mul(u[j], w[i]));
+            if (component == 0u)
+            {
+                det = LANES::Mul(u_cross_v, u_cross_v);
+                s_num = LANES::Mul(u_cross_v, v_cross_w);
+                t_num = LANES::Mul(u_cross_v, u_cross_w);
+            }
+            else
+            {
+                det = LANES::Add(det, LANES::Mul(u_cross_v, u_cross_v));
+                s_num = LANES::Add(s_num, LANES::Mul(u_cross_v, v_cross_w));
+                t_num = LANES::Add(t_num, LANES::Mul(u_cross_v, u_cross_w));
+            }
+        }
+    }
+
+    // Closest points on the infinite lines, clamped to the ends of segment A
+    const Mask s_low = LANES::Less(s_num, zero);
+    const Mask s_high = LANES::AndNot(LANES::Greater(s_num, det), s_low);
+    const Mask s_clamped = LANES::Or(s_low, s_high);
+    s_num = LANES::Select(s_low, zero, LANES::Select(s_high, det, s_num));
+    t_num = LANES::Select(s_low, e, LANES::Select(s_high, LANES::Add(e, b), t_num));
+    Real s_den = det;
+    Real t_den = LANES::Select(s_clamped, c, det);
+
+    // Parallel lines: use the first point of segment A, or the midpoints if they are level with one another
+    const Mask parallel = LANES::Less(det, small_num);
+    const Mask level = LANES::Less(LANES::Abs(e), small_num);
+    s_num = LANES::Select(parallel, LANES::Select(level, half, zero), s_num);
+    s_den = LANES::Select(parallel, one, s_den);
+    t_num = LANES::Select(parallel, LANES::Select(level, LANES::Mul(half, c), e), t_num);
+    t_den = LANES::Select(parallel, c, t_den);
+
+    // Clamp to the ends of segment B, recomputing the closest point on segment A when we do
+    const Mask t_low = LANES::Less(t_num, zero);
+    const Mask t_high = LANES::AndNot(LANES::Greater(t_num, t_den), t_low);
+    const Real minus_d = LANES::Negate(d);
+    const Real r = LANES::Select(t_low, minus_d, LANES::Add(minus_d, b));
+    const Mask r_low = LANES::Less(r, zero);
+    const Mask r_high = LANES::AndNot(LANES::Greater(r, a), r_low);
+    const Mask t_clamped = LANES::Or(t_low, t_high);
+    const Real s_num_clamped = LANES::Select(r_low, zero, LANES::Select(r_high, s_den, r));
+    const Real s_den_clamped = LANES::Select(LANES::Or(r_low, r_high), s_den, a);
+    s_num = LANES::Select(t_clamped, s_num_clamped, s_num);
+    s_den = LANES::Select(t_clamped, s_den_clamped, s_den);
+    t_num = LANES::Select(t_low, zero, LANES::Select(t_high, t_den, t_num));
+
+    // Closest point parameters; lanes where the numerator is tiny may divide by zero, but are discarded
+    const Real sc = LANES::Select(LANES::Less(LANES::Abs(s_num), small_num), zero, LANES::Div(s_num, s_den));
+    const Real tc = LANES::Select(LANES::Less(LANES::Abs(t_num), small_num), zero, LANES::Div(t_num, t_den));
+
+    // Vector between the two closest points, and its length
+    Real vec[SPACE_DIM];
+    Real distance_squared = zero;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        vec[dim] = LANES::Negate(LANES::Sub(LANES::Add(w[dim], LANES::Mul(sc, u[dim])), LANES::Mul(tc, v[dim])));
+        distance_squared = LANES::Add(distance_squared, LANES::Mul(vec[dim], vec[dim]));
+    }
+    const Real distance = LANES::Sqrt(distance_squared);
+
+    // A zero vector is OK if they are intersecting; we produce a unit vector if not
+    const Mask separated = LANES::Greater(distance, small_num);
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        LANES::Store(&rBatch.mDirection[dim][offset], LANES::Select(separated, LANES::Div(vec[dim], distance), vec[dim]));
+    }
+    LANES::Store(&rBatch.mDistance[offset], distance);
+    LANES::Store(&rBatch.mContactDistA[offset],
+                 LANES::Mul(LANES::Negate(LANES::Sub(sc, half)), LANES::Load(&rBatch.mLengthA[offset])));
+    LANES::Store(&rBatch.mContactDistB[offset],
+                 LANES::Mul(LANES::Negate(LANES::Sub(tc, half)), LANES::Load(&rBatch.mLengthB[offset])));
+}
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+/**
+ * Copy the inputs of the first pair into any unused lanes, so that full-width loads only ever see valid data.
+ *
+ * @param rBatch the batch
+ * @param numPairs the number of lanes in use
+ */
+template<unsigned SPACE_DIM>
+inline void PadBatch(CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned numPairs)
+{
+    for (unsigned lane=numPairs; lane<CAPSULE_CONTACT_BATCH_SIZE; lane++)
+    {
+        for (unsigned dim=0; dim<SPACE_DIM; dim++)
+        {
+            rBatch.mPointA1[dim][lane] = rBatch.mPointA1[dim][0];
+            rBatch.mPointA2[dim][lane] = rBatch.mPointA2[dim][0];
+            rBatch.mPointB1[dim][lane] = rBatch.mPointB1[dim][0];
+            rBatch.mPointB2[dim][lane] = rBatch.mPointB2[dim][0];
+        }
+        rBatch.mLengthA[lane] = rBatch.mLengthA[0];
+        rBatch.mLengthB[lane] = rBatch.mLengthB[0];
+    }
+}
+#endif
+
+} // anonymous namespace
+
+template<unsigned SPACE_DIM>
+void CapsuleContactKernel<SPACE_DIM>::CalculateBatch(CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned numPairs)
+{
+    assert(numPairs >= 1u && numPairs <= CAPSULE_CONTACT_BATCH_SIZE);
+
+#if defined(__AVX512F__)
+    PadBatch(rBatch, numPairs);
+    CalculateLanes<Avx512Lanes>(rBatch, 0u);
+#elif defined(__AVX2__)
+    PadBatch(rBatch, numPairs);
+    for (unsigned offset=0; offset<numPairs; offset+=Avx2Lanes::WIDTH)
+    {
+        CalculateLanes<Avx2Lanes>(rBatch, offset);
+    }
+#else
+    for (unsigned lane=0; lane<numPairs; lane++)
+    {
+        CalculateLanes<ScalarLanes>(rBatch, lane);
+    }
+#endif
+}
+
+template<unsigned SPACE_DIM>
+void CapsuleContactKernel<SPACE_DIM>::CalculateBatchInSinglePrecision(CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned numPairs)
+{
+    assert(numPairs >= 1u && numPairs <= CAPSULE_CONTACT_BATCH_SIZE);
+
+    // Rounding absolute positions to float would lose far more than rounding positions relative to the pair
+    for (unsigned lane=0; lane<numPairs; lane++)
+    {
+        for (unsigned dim=0; dim<SPACE_DIM; dim++)
+        {
+            const double origin = rBatch.mPointA1[dim][lane];
+            rBatch.mPointA1[dim][lane] = 0.0;
+            rBatch.mPointA2[dim][lane] -= origin;
+            rBatch.mPointB1[dim][lane] -= origin;
+            rBatch.mPointB2[dim][lane] -= origin;
+        }
+    }
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+    PadBatch(rBatch, numPairs);
+    CalculateLanes<Avx2FloatLanes>(rBatch, 0u);
+#else
+    for (unsigned lane=0; lane<numPairs; lane++)
+    {
+        CalculateLanes<ScalarFloatLanes>(rBatch, lane);
+    }
+#endif
+}
+
+template<unsigned SPACE_DIM>
+const char* CapsuleContactKernel<SPACE_DIM>::GetInstructionSet()
+{
+#if defined(__AVX512F__)
+    return "AVX-512";
+#elif defined(__AVX2__)
+    return "AVX2";
+#else
+    return "scalar";
+#endif
+}
+
+// Explicit instantiation
+template class CapsuleContactKernel<2>;
+template class CapsuleContactKernel<3>;
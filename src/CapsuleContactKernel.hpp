@@ -0,0 +1,125 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULECONTACTKERNEL_HPP_
+#define CAPSULECONTACTKERNEL_HPP_
+
+/** Number of capsule pairs held in a CapsuleContactBatch; one AVX-512 register of doubles. */
+#define CAPSULE_CONTACT_BATCH_SIZE 8u
+
+/**
+ * Inputs and outputs for a batch of capsule pairs, laid out lane by lane so that the kernel can load each
+ * quantity for all pairs with a single vector load.
+ */
+template<unsigned SPACE_DIM>
+struct CapsuleContactBatch
+{
+    /** End point of capsule A at centre + half-length * axis. */
+    double mPointA1[SPACE_DIM][CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** End point of capsule A at centre - half-length * axis. */
+    double mPointA2[SPACE_DIM][CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** End point of capsule B at centre + half-length * axis. */
+    double mPointB1[SPACE_DIM][CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** End point of capsule B at centre - half-length * axis. */
+    double mPointB2[SPACE_DIM][CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** Length of capsule A. */
+    double mLengthA[CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** Length of capsule B. */
+    double mLengthB[CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** Filled in with the shortest distance between the two line segments. */
+    double mDistance[CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** Filled in with the unit vector from the contact point on A to that on B (zero if the segments intersect). */
+    double mDirection[SPACE_DIM][CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** Filled in with the distance from the centre of mass of A to its contact point. */
+    double mContactDistA[CAPSULE_CONTACT_BATCH_SIZE];
+
+    /** Filled in with the distance from the centre of mass of B to its contact point. */
+    double mContactDistB[CAPSULE_CONTACT_BATCH_SIZE];
+};
+
+/**
+ * A branchless, batched version of the Dan Sunday segment-segment closest point routine used by CapsuleForce.
+ *
+ * Every branch of the scalar routine (the parallel-line special case and the clamping of the closest point
+ * parameters to the ends of the segments) is replaced by a comparison and a blend, so that up to
+ * CAPSULE_CONTACT_BATCH_SIZE pairs are processed together. When the compiler targets AVX-512 the whole batch is one
+ * set of 8-wide operations, with AVX2 it is two sets of 4-wide operations, and otherwise the same branchless
+ * sequence is run one pair at a time.
+ *
+ * The results agree with CapsuleForce::CalculateShortestDistanceBetweenSegments() for each pair.
+ */
+template<unsigned SPACE_DIM>
+class CapsuleContactKernel
+{
+    static_assert(SPACE_DIM == 2u || SPACE_DIM == 3u, "Capsules are only defined in 2D and 3D");
+
+public:
+
+    /**
+     * Calculate the shortest distance, unit direction and contact distances for the first numPairs pairs of a batch.
+     * Lanes beyond numPairs are filled with copies of the first pair; their outputs are meaningless.
+     *
+     * @param rBatch the batch, whose inputs must be filled in for the first numPairs lanes
+     * @param numPairs the number of pairs in the batch, between 1 and CAPSULE_CONTACT_BATCH_SIZE
+     */
+    static void CalculateBatch(CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned numPairs);
+
+    /**
+     * As CalculateBatch(), but in single precision, which processes the whole batch in one set of 8-wide operations
+     * with AVX2. The end points are first translated, in double precision, so that the first end point of capsule A
+     * is at the origin; the outputs do not depend on this. The determinant and the closest point numerators are
+     * found from cross products, which unlike the differences of dot products used in double precision do not cancel
+     * for nearly parallel segments.
+     *
+     * @param rBatch the batch, whose inputs must be filled in for the first numPairs lanes
+     * @param numPairs the number of pairs in the batch, between 1 and CAPSULE_CONTACT_BATCH_SIZE
+     */
+    static void CalculateBatchInSinglePrecision(CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned numPairs);
+
+    /**
+     * @return the name of the instruction set the kernel was compiled for ("AVX-512", "AVX2" or "scalar")
+     */
+    static const char* GetInstructionSet();
+};
+
+#endif /*CAPSULECONTACTKERNEL_HPP_*/
@@ -0,0 +1,266 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULECONTACTLAWS_HPP_
+#define CAPSULECONTACTLAWS_HPP_
+
+#include <cmath>
+
+/*
+ * Force laws between two capsules, used by CapsuleForce as template parameters of its pair loop so that the law is
+ * inlined rather than chosen pair by pair. Each law gives the magnitude of the force along the contact normal as a
+ * function of the overlap (positive when repulsive), split into a prefactor that depends only on the two radii and
+ * is worked out once per distinct pair of radii, and a cheap function of the overlap, which may be evaluated in
+ * double or single precision. GetInteractionRange() is how far apart two capsules may be and still interact.
+ */
+
+/**
+ * Hertz repulsion between two capsules (Farrell et al):
+ *
+ * F = 4/3 E sqrt(R_eff) overlap^(3/2), with R_eff = 2 R_A R_B / (R_A + R_B).
+ */
+class HertzContactLaw
+{
+private:
+
+    /** The elastic modulus of both cells. */
+    double mYoungModulus;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param youngModulus the elastic modulus of both cells
+     */
+    explicit HertzContactLaw(double youngModulus)
+        : mYoungModulus(youngModulus)
+    {
+    }
+
+    /**
+     * @return how far apart two capsules may be and still interact
+     */
+    double GetInteractionRange() const
+    {
+        return 0.0;
+    }
+
+    /**
+     * @param radiusA the radius of capsule A
+     * @param radiusB the radius of capsule B
+     * @return the part of the force that depends only on the radii
+     */
+    double CalculatePrefactor(double radiusA, double radiusB) const
+    {
+        const double effective_radius = 2.0 * radiusA * radiusB / (radiusA + radiusB);
+        return 4.0 * mYoungModulus * std::sqrt(effective_radius) / 3.0;
+    }
+
+    /**
+     * @param overlap the overlap, which is positive
+     * @param prefactor the prefactor for the radii of the two capsules
+     * @return the magnitude of the repulsion force
+     */
+    template<typename REAL>
+    REAL CalculateForceMagnitude(REAL overlap, REAL prefactor) const
+    {
+        return prefactor * overlap * std::sqrt(overlap);
+    }
+
+    /**
+     * @param overlap the overlap, which is positive
+     * @param prefactor the prefactor for the radii of the two capsules
+     * @return the derivative of the force magnitude with respect to the overlap
+     */
+    double CalculateStiffness(double overlap, double prefactor) const
+    {
+        return 1.5 * prefactor * std::sqrt(overlap);
+    }
+};
+
+/**
+ * A linear spring repulsion between two capsules, F = k overlap, whatever their radii.
+ */
+class LinearSpringContactLaw
+{
+private:
+
+    /** The spring stiffness k. */
+    double mSpringStiffness;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param springStiffness the spring stiffness
+     */
+    explicit LinearSpringContactLaw(double springStiffness)
+        : mSpringStiffness(springStiffness)
+    {
+    }
+
+    /**
+     * @return how far apart two capsules may be and still interact
+     */
+    double GetInteractionRange() const
+    {
+        return 0.0;
+    }
+
+    /**
+     * The spring does not depend on the radii of the capsules.
+     *
+     * @return the part of the force that depends only on the radii
+     */
+    double CalculatePrefactor(double, double) const
+    {
+        return mSpringStiffness;
+    }
+
+    /**
+     * @param overlap the overlap, which is positive
+     * @param prefactor the prefactor for the radii of the two capsules
+     * @return the magnitude of the repulsion force
+     */
+    template<typename REAL>
+    REAL CalculateForceMagnitude(REAL overlap, REAL prefactor) const
+    {
+        return prefactor * overlap;
+    }
+
+    /**
+     * The spring has the same stiffness at every overlap.
+     *
+     * @param prefactor the prefactor for the radii of the two capsules
+     * @return the derivative of the force magnitude with respect to the overlap
+     */
+    double CalculateStiffness(double, double prefactor) const
+    {
+        return prefactor;
+    }
+};
+
+/**
+ * Hertz repulsion between overlapping capsules, as in HertzContactLaw, plus an attraction between capsules separated
+ * by a gap g smaller than the adhesion range d:
+ *
+ * F = -4 A g (d - g) / d^2,
+ *
+ * which vanishes on touching and at the edge of the range, and peaks at the adhesion strength A halfway between.
+ */
+class HertzWithAdhesionContactLaw
+{
+private:
+
+    /** The Hertz repulsion between overlapping capsules. */
+    HertzContactLaw mHertzContactLaw;
+
+    /** The adhesion strength A. */
+    double mAdhesionStrength;
+
+    /** The adhesion range d. */
+    double mAdhesionRange;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param youngModulus the elastic modulus of both cells
+     * @param adhesionStrength the largest attractive force
+     * @param adhesionRange the largest gap at which capsules attract
+     */
+    HertzWithAdhesionContactLaw(double youngModulus, double adhesionStrength, double adhesionRange)
+        : mHertzContactLaw(youngModulus),
+          mAdhesionStrength(adhesionStrength),
+          mAdhesionRange(adhesionRange)
+    {
+    }
+
+    /**
+     * @return how far apart two capsules may be and still interact
+     */
+    double GetInteractionRange() const
+    {
+        return mAdhesionRange;
+    }
+
+    /**
+     * @param radiusA the radius of capsule A
+     * @param radiusB the radius of capsule B
+     * @return the part of the repulsion that depends only on the radii
+     */
+    double CalculatePrefactor(double radiusA, double radiusB) const
+    {
+        return mHertzContactLaw.CalculatePrefactor(radiusA, radiusB);
+    }
+
+    /**
+     * @param overlap the overlap, which is negative across a gap
+     * @param prefactor the prefactor for the radii of the two capsules
+     * @return the magnitude of the force, negative if attractive
+     */
+    template<typename REAL>
+    REAL CalculateForceMagnitude(REAL overlap, REAL prefactor) const
+    {
+        if (overlap > REAL(0))
+        {
+            return mHertzContactLaw.CalculateForceMagnitude(overlap, prefactor);
+        }
+        const REAL gap = -overlap;
+        const REAL range = static_cast<REAL>(mAdhesionRange);
+        return REAL(-4) * static_cast<REAL>(mAdhesionStrength) * gap * (range - gap) / (range * range);
+    }
+
+    /**
+     * @param overlap the overlap, which is negative across a gap
+     * @param prefactor the prefactor for the radii of the two capsules
+     * @return the derivative of the force magnitude with respect to the overlap, negative where the attraction
+     *     weakens as the capsules close the gap
+     */
+    double CalculateStiffness(double overlap, double prefactor) const
+    {
+        if (overlap > 0.0)
+        {
+            return mHertzContactLaw.CalculateStiffness(overlap, prefactor);
+        }
+        const double gap = -overlap;
+        return 4.0 * mAdhesionStrength * (mAdhesionRange - 2.0 * gap) / (mAdhesionRange * mAdhesionRange);
+    }
+};
+
+#endif /*CAPSULECONTACTLAWS_HPP_*/
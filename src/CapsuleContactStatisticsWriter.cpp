@@ -0,0 +1,84 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleContactStatisticsWriter.hpp"
+#include "AbstractCellPopulation.hpp"
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+CapsuleContactStatisticsWriter<ELEMENT_DIM, SPACE_DIM>::CapsuleContactStatisticsWriter()
+    : AbstractCellWriter<ELEMENT_DIM, SPACE_DIM>("capsulecontactstatistics.dat")
+{
+    this->mVtkCellDataName = "Contact count";
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleContactStatisticsWriter<ELEMENT_DIM, SPACE_DIM>::GetCellDataForVtkOutput(
+        CellPtr pCell, AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>* pCellPopulation)
+{
+    return pCell->GetCellData()->GetItem("contact_count");
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleContactStatisticsWriter<ELEMENT_DIM, SPACE_DIM>::VisitCell(
+        CellPtr pCell, AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>* pCellPopulation)
+{
+    const char axis_names[] = "xyz";
+
+    unsigned location_index = pCellPopulation->GetLocationIndexUsingCell(pCell);
+    unsigned cell_id = pCell->GetCellId();
+
+    *this->mpOutStream << location_index << " " << cell_id << " ";
+    *this->mpOutStream << pCell->GetCellData()->GetItem("contact_count") << " ";
+    *this->mpOutStream << pCell->GetCellData()->GetItem("total_overlap") << " ";
+    for (unsigned i=0; i<SPACE_DIM; i++)
+    {
+        for (unsigned j=0; j<SPACE_DIM; j++)
+        {
+            *this->mpOutStream << pCell->GetCellData()->GetItem(std::string("virial_") + axis_names[i] + axis_names[j]) << " ";
+        }
+    }
+}
+
+// Explicit instantiation
+template class CapsuleContactStatisticsWriter<1,1>;
+template class CapsuleContactStatisticsWriter<1,2>;
+template class CapsuleContactStatisticsWriter<2,2>;
+template class CapsuleContactStatisticsWriter<1,3>;
+template class CapsuleContactStatisticsWriter<2,3>;
+template class CapsuleContactStatisticsWriter<3,3>;
+
+#include "SerializationExportWrapperForCpp.hpp"
+// Declare identifier for the serializer
+EXPORT_TEMPLATE_CLASS_ALL_DIMS(CapsuleContactStatisticsWriter)
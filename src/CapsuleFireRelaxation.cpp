@@ -0,0 +1,482 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleFireRelaxation.hpp"
+#include "CapsuleOrientation.hpp"
+#include "Exception.hpp"
+#include "UblasCustomFunctions.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+/** The number of iterations with positive power before the step may grow. */
+const unsigned FIRE_N_MIN = 5u;
+
+/** The factor the step grows by. */
+const double FIRE_F_INC = 1.1;
+
+/** The factor the step shrinks by when the power turns negative. */
+const double FIRE_F_DEC = 0.5;
+
+/** The mixing parameter at the start, and after the power turns negative. */
+const double FIRE_ALPHA_START = 0.1;
+
+/** The factor the mixing parameter shrinks by. */
+const double FIRE_F_ALPHA = 0.99;
+
+/** The shortest step, as a fraction of the initial step. */
+const double FIRE_MIN_TIME_STEP_FRACTION = 0.02;
+
+/** The step, mixing parameter and run of iterations with positive power of one block of degrees of freedom. */
+struct FireBlockState
+{
+    /** The step. */
+    double mTimeStep;
+
+    /** The weight of the direction of the force in the mixed velocity. */
+    double mAlpha;
+
+    /** The number of iterations in a row with positive power. */
+    unsigned mNumPositiveSteps;
+};
+
+/**
+ * Adapt the step and mixing parameter of a block to the power of its forces on its velocities.
+ *
+ * @param rState the state of the block
+ * @param power the power
+ * @param initialTimeStep the initial step, of which the shortest step is a fraction
+ * @param maxTimeStep the longest step
+ * @return whether the power has turned negative, so that the block must stop
+ */
+inline bool AdaptFireBlock(FireBlockState& rState, double power, double initialTimeStep, double maxTimeStep)
+{
+    if (power > 0.0)
+    {
+        rState.mNumPositiveSteps++;
+        if (rState.mNumPositiveSteps > FIRE_N_MIN)
+        {
+            rState.mTimeStep = std::min(rState.mTimeStep * FIRE_F_INC, maxTimeStep);
+            rState.mAlpha *= FIRE_F_ALPHA;
+        }
+        return false;
+    }
+    rState.mNumPositiveSteps = 0u;
+    rState.mTimeStep = std::max(rState.mTimeStep * FIRE_F_DEC, FIRE_MIN_TIME_STEP_FRACTION * initialTimeStep);
+    rState.mAlpha = FIRE_ALPHA_START;
+    return true;
+}
+
+/** Turn a 2D capsule by the z component of rRotation, keeping any director in step with the angle theta. */
+inline void Rotate(Node<2>& rNode, const c_vector<double, 3>& rRotation)
+{
+    std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    r_attributes[NA_THETA] += rRotation[2];
+    if (CapsuleOrientation::HasDirector(r_attributes))
+    {
+        c_vector<double, 2> axis;
+        axis[0] = cos(r_attributes[NA_THETA]);
+        axis[1] = sin(r_attributes[NA_THETA]);
+        CapsuleOrientation::SetDirector(r_attributes, axis);
+    }
+}
+
+/** Turn the axis of a 3D capsule by the rotation vector rRotation, to first order, and renormalise it. */
+inline void Rotate(Node<3>& rNode, const c_vector<double, 3>& rRotation)
+{
+    std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    const bool has_director = CapsuleOrientation::HasDirector(r_attributes);
+    c_vector<double, 3> axis;
+    CapsuleOrientation::GetAxis(r_attributes, axis);
+    CapsuleOrientation::SetDirector(r_attributes, c_vector<double, 3>(axis + VectorProduct(rRotation, axis)));
+    if (!has_director)
+    {
+        CapsuleOrientation::ClearDirector(r_attributes);
+    }
+}
+
+/** @return the distance from the centre of a capsule to its tips */
+inline double GetTipDistance(const std::vector<double>& rAttributes)
+{
+    return 0.5 * rAttributes[NA_LENGTH] + rAttributes[NA_RADIUS];
+}
+
+} // namespace
+
+template<unsigned DIM>
+CapsuleFireRelaxation<DIM>::CapsuleFireRelaxation()
+    : mForceTolerance(1e-3),
+      mMaxNumIterations(10000u),
+      mMaxStep(0.05),
+      mInitialTimeStep(0.05),
+      mMaxTimeStep(0.5),
+      mNumForceEvaluations(0u),
+      mNumIterations(0u),
+      mNumNeighbourUpdates(0u),
+      mMaxForce(0.0)
+{
+}
+
+template<unsigned DIM>
+void CapsuleFireRelaxation<DIM>::CalculateForces(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation,
+                                                 CapsuleForce<DIM,DIM>& rForce)
+{
+    for (auto node_iter = rPopulation.rGetMesh().GetNodeIteratorBegin();
+         node_iter != rPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        node_iter->ClearAppliedForce();
+    }
+
+    // A packing may start with capsules overlapping by more than half a radius, which would end the force pass, so
+    // their forces are capped there as in overlap recovery, but the relaxation rather than the force pushes them apart
+    if (rForce.GetUseGatherForces())
+    {
+        rForce.AddForceContribution(rPopulation);
+    }
+    else
+    {
+        const bool use_overlap_recovery = rForce.GetUseOverlapRecovery();
+        const unsigned max_num_relaxation_iterations = rForce.GetMaxNumOverlapRelaxationIterations();
+        rForce.SetUseOverlapRecovery(true);
+        rForce.SetMaxNumOverlapRelaxationIterations(0u);
+        rForce.AddForceContribution(rPopulation);
+        rForce.SetUseOverlapRecovery(use_overlap_recovery);
+        rForce.SetMaxNumOverlapRelaxationIterations(max_num_relaxation_iterations);
+    }
+    mNumForceEvaluations++;
+}
+
+template<unsigned DIM>
+bool CapsuleFireRelaxation<DIM>::Relax(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation,
+                                       CapsuleForce<DIM,DIM>& rForce)
+{
+    std::vector<Node<DIM>*> nodes;
+    for (auto node_iter = rPopulation.rGetMesh().GetNodeIteratorBegin();
+         node_iter != rPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        nodes.push_back(&(*node_iter));
+    }
+    return RelaxNodes(rPopulation, rForce, nodes);
+}
+
+template<unsigned DIM>
+bool CapsuleFireRelaxation<DIM>::Relax(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation,
+                                       CapsuleForce<DIM,DIM>& rForce,
+                                       const std::set<unsigned>& rNodeIndices)
+{
+    std::vector<Node<DIM>*> nodes;
+    for (auto node_iter = rPopulation.rGetMesh().GetNodeIteratorBegin();
+         node_iter != rPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        if (rNodeIndices.count(node_iter->GetIndex()) > 0u)
+        {
+            nodes.push_back(&(*node_iter));
+        }
+    }
+    if (nodes.size() != rNodeIndices.size())
+    {
+        EXCEPTION("Some of the capsules to relax are not in the population");
+    }
+    return RelaxNodes(rPopulation, rForce, nodes);
+}
+
+template<unsigned DIM>
+bool CapsuleFireRelaxation<DIM>::RelaxNodes(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation,
+                                            CapsuleForce<DIM,DIM>& rForce,
+                                            const std::vector<Node<DIM>*>& rNodes)
+{
+    if (rForce.GetUseSleeping())
+    {
+        EXCEPTION("CapsuleFireRelaxation does not support a CapsuleForce that puts capsules to sleep");
+    }
+
+    mNumForceEvaluations = 0u;
+    mNumIterations = 0u;
+    mNumNeighbourUpdates = 0u;
+
+    // How far the capsules may move in total before a pair left out of the node pairs could come into contact
+    double max_half_extent = 0.0;
+    for (auto node_iter = rPopulation.rGetMesh().GetNodeIteratorBegin();
+         node_iter != rPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        max_half_extent = std::max(max_half_extent, GetTipDistance(node_iter->rGetNodeAttributes()));
+    }
+    const double interaction_range = (rForce.GetContactLaw() == CCL_HERTZ_WITH_ADHESION) ? rForce.GetAdhesionRange() : 0.0;
+    const double cutoff_excess = rPopulation.rGetMesh().GetMaximumInteractionDistance() - 2.0 * max_half_extent - interaction_range;
+
+    const unsigned num_nodes = rNodes.size();
+    std::vector<double> tip_distances(num_nodes);
+    for (unsigned i = 0; i < num_nodes; i++)
+    {
+        tip_distances[i] = GetTipDistance(rNodes[i]->rGetNodeAttributes());
+    }
+
+    // Velocities of the centres and of the tips, and the last move of each, to retreat by when the power turns negative
+    std::vector<c_vector<double, DIM> > velocities(num_nodes, zero_vector<double>(DIM));
+    std::vector<c_vector<double, 3> > tip_velocities(num_nodes, zero_vector<double>(3));
+    std::vector<c_vector<double, DIM> > last_displacements(num_nodes, zero_vector<double>(DIM));
+    std::vector<c_vector<double, 3> > last_rotations(num_nodes, zero_vector<double>(3));
+    std::vector<c_vector<double, DIM> > forces(num_nodes);
+    std::vector<c_vector<double, 3> > tip_forces(num_nodes);
+
+    /*
+     * The centres and the orientations are relaxed as two blocks, each with its own step and mixing. The torque
+     * between two nearly parallel capsules flips sign as they turn through parallel, so the orientations overshoot
+     * far more often than the centres, which would otherwise be stopped each time they did.
+     */
+    FireBlockState translation = {mInitialTimeStep, FIRE_ALPHA_START, 0u};
+    FireBlockState rotation = {mInitialTimeStep, FIRE_ALPHA_START, 0u};
+    double distance_since_neighbour_update = 0.0;
+    double last_max_tip_displacement = 0.0;
+
+    rPopulation.NodeBasedCellPopulation<DIM>::Update(false);
+    mNumNeighbourUpdates++;
+    CalculateForces(rPopulation, rForce);
+
+    while (true)
+    {
+        // The generalised forces, with the torque spread over the distance to the tips
+        mMaxForce = 0.0;
+        double translational_power = 0.0;
+        double rotational_power = 0.0;
+        double force_norm_squared = 0.0;
+        double tip_force_norm_squared = 0.0;
+        for (unsigned i = 0; i < num_nodes; i++)
+        {
+            forces[i] = rNodes[i]->rGetAppliedForce();
+            tip_forces[i] = CapsuleOrientation::GetAppliedTorque<DIM>(rNodes[i]->rGetNodeAttributes()) / tip_distances[i];
+
+            const double force_squared = inner_prod(forces[i], forces[i]);
+            const double tip_force_squared = inner_prod(tip_forces[i], tip_forces[i]);
+            mMaxForce = std::max(mMaxForce, sqrt(force_squared + tip_force_squared));
+            force_norm_squared += force_squared;
+            tip_force_norm_squared += tip_force_squared;
+            translational_power += inner_prod(forces[i], velocities[i]);
+            rotational_power += inner_prod(tip_forces[i], tip_velocities[i]);
+        }
+
+        if (mMaxForce < mForceTolerance)
+        {
+            return true;
+        }
+        if (mNumIterations >= mMaxNumIterations)
+        {
+            return false;
+        }
+        mNumIterations++;
+
+        // A block whose power has turned negative stops, and goes back half of the last step, which overshot
+        const bool stop_translation = AdaptFireBlock(translation, translational_power, mInitialTimeStep, mMaxTimeStep);
+        const bool stop_rotation = AdaptFireBlock(rotation, rotational_power, mInitialTimeStep, mMaxTimeStep);
+        if (stop_translation || stop_rotation)
+        {
+            for (unsigned i = 0; i < num_nodes; i++)
+            {
+                if (stop_translation)
+                {
+                    rNodes[i]->rGetModifiableLocation() -= 0.5 * last_displacements[i];
+                    velocities[i] = zero_vector<double>(DIM);
+                }
+                if (stop_rotation)
+                {
+                    Rotate(*rNodes[i], c_vector<double, 3>(-0.5 * last_rotations[i]));
+                    tip_velocities[i] = zero_vector<double>(3);
+                }
+            }
+            distance_since_neighbour_update += 0.5 * last_max_tip_displacement;
+        }
+
+        // Semi-implicit Euler step, with the velocity of each block mixed towards the direction of its force
+        double velocity_norm_squared = 0.0;
+        double tip_velocity_norm_squared = 0.0;
+        for (unsigned i = 0; i < num_nodes; i++)
+        {
+            velocities[i] += translation.mTimeStep * forces[i];
+            tip_velocities[i] += rotation.mTimeStep * tip_forces[i];
+            velocity_norm_squared += inner_prod(velocities[i], velocities[i]);
+            tip_velocity_norm_squared += inner_prod(tip_velocities[i], tip_velocities[i]);
+        }
+        const double mixing = (force_norm_squared > 0.0) ?
+            translation.mAlpha * sqrt(velocity_norm_squared / force_norm_squared) : 0.0;
+        const double tip_mixing = (tip_force_norm_squared > 0.0) ?
+            rotation.mAlpha * sqrt(tip_velocity_norm_squared / tip_force_norm_squared) : 0.0;
+
+        double max_tip_displacement = 0.0;
+        for (unsigned i = 0; i < num_nodes; i++)
+        {
+            velocities[i] = (1.0 - translation.mAlpha) * velocities[i] + mixing * forces[i];
+            tip_velocities[i] = (1.0 - rotation.mAlpha) * tip_velocities[i] + tip_mixing * tip_forces[i];
+
+            c_vector<double, DIM> displacement = translation.mTimeStep * velocities[i];
+            c_vector<double, 3> tip_displacement = rotation.mTimeStep * tip_velocities[i];
+            double tip_move = norm_2(displacement) + norm_2(tip_displacement);
+            if (tip_move > mMaxStep)
+            {
+                displacement *= mMaxStep / tip_move;
+                tip_displacement *= mMaxStep / tip_move;
+                tip_move = mMaxStep;
+            }
+
+            rNodes[i]->rGetModifiableLocation() += displacement;
+            last_displacements[i] = displacement;
+            last_rotations[i] = tip_displacement / tip_distances[i];
+            Rotate(*rNodes[i], last_rotations[i]);
+            max_tip_displacement = std::max(max_tip_displacement, tip_move);
+        }
+        last_max_tip_displacement = max_tip_displacement;
+        distance_since_neighbour_update += max_tip_displacement;
+
+        // Two capsules can close in on each other by twice the furthest either has moved
+        if (2.0 * distance_since_neighbour_update >= cutoff_excess)
+        {
+            rPopulation.NodeBasedCellPopulation<DIM>::Update(false);
+            mNumNeighbourUpdates++;
+            distance_since_neighbour_update = 0.0;
+        }
+        CalculateForces(rPopulation, rForce);
+    }
+}
+
+template<unsigned DIM>
+void CapsuleFireRelaxation<DIM>::SetForceTolerance(double forceTolerance)
+{
+    if (forceTolerance <= 0.0)
+    {
+        EXCEPTION("The force tolerance must be positive.");
+    }
+    mForceTolerance = forceTolerance;
+}
+
+template<unsigned DIM>
+double CapsuleFireRelaxation<DIM>::GetForceTolerance()
+{
+    return mForceTolerance;
+}
+
+template<unsigned DIM>
+void CapsuleFireRelaxation<DIM>::SetMaxNumIterations(unsigned maxNumIterations)
+{
+    mMaxNumIterations = maxNumIterations;
+}
+
+template<unsigned DIM>
+unsigned CapsuleFireRelaxation<DIM>::GetMaxNumIterations()
+{
+    return mMaxNumIterations;
+}
+
+template<unsigned DIM>
+void CapsuleFireRelaxation<DIM>::SetMaxStep(double maxStep)
+{
+    if (maxStep <= 0.0)
+    {
+        EXCEPTION("The maximum step must be positive.");
+    }
+    mMaxStep = maxStep;
+}
+
+template<unsigned DIM>
+double CapsuleFireRelaxation<DIM>::GetMaxStep()
+{
+    return mMaxStep;
+}
+
+template<unsigned DIM>
+void CapsuleFireRelaxation<DIM>::SetInitialTimeStep(double initialTimeStep)
+{
+    if (initialTimeStep <= 0.0)
+    {
+        EXCEPTION("The initial time step must be positive.");
+    }
+    mInitialTimeStep = initialTimeStep;
+    mMaxTimeStep = 10.0 * initialTimeStep;
+}
+
+template<unsigned DIM>
+double CapsuleFireRelaxation<DIM>::GetInitialTimeStep()
+{
+    return mInitialTimeStep;
+}
+
+template<unsigned DIM>
+void CapsuleFireRelaxation<DIM>::SetMaxTimeStep(double maxTimeStep)
+{
+    if (maxTimeStep < mInitialTimeStep)
+    {
+        EXCEPTION("The maximum time step must be no shorter than the initial time step.");
+    }
+    mMaxTimeStep = maxTimeStep;
+}
+
+template<unsigned DIM>
+double CapsuleFireRelaxation<DIM>::GetMaxTimeStep()
+{
+    return mMaxTimeStep;
+}
+
+template<unsigned DIM>
+unsigned CapsuleFireRelaxation<DIM>::GetNumForceEvaluations()
+{
+    return mNumForceEvaluations;
+}
+
+template<unsigned DIM>
+unsigned CapsuleFireRelaxation<DIM>::GetNumIterations()
+{
+    return mNumIterations;
+}
+
+template<unsigned DIM>
+unsigned CapsuleFireRelaxation<DIM>::GetNumNeighbourUpdates()
+{
+    return mNumNeighbourUpdates;
+}
+
+template<unsigned DIM>
+double CapsuleFireRelaxation<DIM>::GetMaxForce()
+{
+    return mMaxForce;
+}
+
+// Explicit instantiation
+template class CapsuleFireRelaxation<2>;
+template class CapsuleFireRelaxation<3>;
@@ -0,0 +1,224 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEFIRERELAXATION_HPP_
+#define CAPSULEFIRERELAXATION_HPP_
+
+#include <set>
+#include <vector>
+
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+
+/**
+ * Relaxes a packing of capsules to a minimum of the contact energy of a CapsuleForce with the fast inertial
+ * relaxation engine (FIRE), rather than by time stepping the overdamped dynamics. This is much cheaper for removing
+ * overlaps from an initial or perturbed configuration, since the Hertz force vanishes as the overlap does and the
+ * overdamped dynamics therefore slow to a crawl near a minimum.
+ *
+ * The minimiser follows FIRE 2.0 (Guenole et al., Comput. Mater. Sci. 175:109584, 2020): semi-implicit Euler steps of
+ * a unit mass dynamics, mixing the velocity towards the force, growing the step while the power stays positive and
+ * stopping dead and retreating half a step when it turns negative. Each capsule has its centre and its orientation
+ * as degrees of freedom; the orientation is measured by the arc moved by the capsule's tips, so that the torque
+ * divided by the distance from the centre to a tip, half the length plus the radius, plays the part of a force. The
+ * centres and the orientations adapt their steps separately, since nearly parallel capsules overshoot in their
+ * orientations much more often than in their centres. No capsule's tips move further than the maximum step in one
+ * iteration.
+ *
+ * The whole population can be relaxed, or only some of its capsules with the rest held still but still pushing on
+ * them. Only the force passed in is applied, and it may not put capsules to sleep. The node pairs of the population
+ * are recalculated whenever the capsules could have moved far enough for a new pair to come into contact.
+ *
+ * Capsules overlapping by more than half a radius have their force capped at that overlap, as in the force's overlap
+ * recovery, and are counted among its overlap violations, but are pushed apart by the relaxation alone. A force that
+ * gathers its contributions cannot cap them, and still throws.
+ */
+template<unsigned DIM>
+class CapsuleFireRelaxation
+{
+    static_assert(DIM == 2u || DIM == 3u, "Capsules are only relaxed in 2D and 3D");
+
+private:
+
+    /** The relaxation stops once no moving capsule has a force, or torque over tip distance, above this. */
+    double mForceTolerance;
+
+    /** The relaxation stops after this many iterations, converged or not. */
+    unsigned mMaxNumIterations;
+
+    /** The furthest a capsule's tips may move in one iteration. */
+    double mMaxStep;
+
+    /** The step at the start of the relaxation, and after which it is shortened or lengthened. */
+    double mInitialTimeStep;
+
+    /** The longest step the relaxation may take. */
+    double mMaxTimeStep;
+
+    /** The number of force passes in the last call to Relax(). */
+    unsigned mNumForceEvaluations;
+
+    /** The number of iterations in the last call to Relax(). */
+    unsigned mNumIterations;
+
+    /** The number of times the node pairs were recalculated in the last call to Relax(). */
+    unsigned mNumNeighbourUpdates;
+
+    /** The largest force, or torque over tip distance, on any moving capsule at the end of the last call to Relax(). */
+    double mMaxForce;
+
+    /**
+     * Clear the applied forces on every node and re-run the force pass, capping overlaps of more than half a radius.
+     *
+     * @param rPopulation the population
+     * @param rForce the force
+     */
+    void CalculateForces(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation, CapsuleForce<DIM,DIM>& rForce);
+
+    /**
+     * Relax the given capsules.
+     *
+     * @param rPopulation the population
+     * @param rForce the force
+     * @param rNodes the nodes of the capsules that move
+     * @return whether the relaxation converged
+     */
+    bool RelaxNodes(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation,
+                    CapsuleForce<DIM,DIM>& rForce,
+                    const std::vector<Node<DIM>*>& rNodes);
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleFireRelaxation();
+
+    /**
+     * Relax every capsule in the population.
+     *
+     * @param rPopulation the population
+     * @param rForce the force whose contact energy is minimised
+     * @return whether the relaxation converged within the maximum number of iterations
+     */
+    bool Relax(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation, CapsuleForce<DIM,DIM>& rForce);
+
+    /**
+     * Relax some of the capsules in the population, holding the rest still.
+     *
+     * @param rPopulation the population
+     * @param rForce the force whose contact energy is minimised
+     * @param rNodeIndices the indices of the nodes of the capsules that move
+     * @return whether the relaxation converged within the maximum number of iterations
+     */
+    bool Relax(NodeBasedCellPopulationWithCapsules<DIM>& rPopulation,
+               CapsuleForce<DIM,DIM>& rForce,
+               const std::set<unsigned>& rNodeIndices);
+
+    /**
+     * @param forceTolerance the largest force, or torque over tip distance, left on a relaxed capsule
+     */
+    void SetForceTolerance(double forceTolerance);
+
+    /**
+     * @return the largest force, or torque over tip distance, left on a relaxed capsule. Defaults to 1e-3.
+     */
+    double GetForceTolerance();
+
+    /**
+     * @param maxNumIterations the most iterations a relaxation may take
+     */
+    void SetMaxNumIterations(unsigned maxNumIterations);
+
+    /**
+     * @return the most iterations a relaxation may take. Defaults to 10000.
+     */
+    unsigned GetMaxNumIterations();
+
+    /**
+     * @param maxStep the furthest a capsule's tips may move in one iteration
+     */
+    void SetMaxStep(double maxStep);
+
+    /**
+     * @return the furthest a capsule's tips may move in one iteration. Defaults to 0.05.
+     */
+    double GetMaxStep();
+
+    /**
+     * Set the initial step, and the longest step to ten times it.
+     *
+     * @param initialTimeStep the step at the start of the relaxation
+     */
+    void SetInitialTimeStep(double initialTimeStep);
+
+    /**
+     * @return the step at the start of the relaxation. Defaults to 0.05.
+     */
+    double GetInitialTimeStep();
+
+    /**
+     * @param maxTimeStep the longest step the relaxation may take, no shorter than the initial step
+     */
+    void SetMaxTimeStep(double maxTimeStep);
+
+    /**
+     * @return the longest step the relaxation may take. Defaults to ten times the initial step.
+     */
+    double GetMaxTimeStep();
+
+    /**
+     * @return the number of force passes in the last call to Relax()
+     */
+    unsigned GetNumForceEvaluations();
+
+    /**
+     * @return the number of iterations in the last call to Relax()
+     */
+    unsigned GetNumIterations();
+
+    /**
+     * @return the number of times the node pairs were recalculated in the last call to Relax()
+     */
+    unsigned GetNumNeighbourUpdates();
+
+    /**
+     * @return the largest force, or torque over tip distance, on any moving capsule at the end of the last call to
+     *     Relax()
+     */
+    double GetMaxForce();
+};
+
+#endif /*CAPSULEFIRERELAXATION_HPP_*/
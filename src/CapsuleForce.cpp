@@ -1,7 +1,12 @@
 
 #include "CapsuleForce.hpp"
+#include "CapsuleContactKernel.hpp"
+#include "CapsuleGeometryCache.hpp"
+#include "CapsuleParallelFor.hpp"
 #include "TypeSixSecretionEnumerations.hpp"
 #include "NodeBasedCellPopulation.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "SimulationTime.hpp"
 
 #ifdef CHASTE_VTK
 #include <vtkLine.h>
@@ -10,11 +15,80 @@
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/segment.hpp>
 #include <boost/geometry/geometries/point.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 
 #include "Debug.hpp"
 
+namespace
+{
+
+/*
+ * The parts of the force calculation that differ between 2D and 3D have one overload per dimension, so that the
+ * compiler picks the right one for each instantiation rather than SPACE_DIM being tested inside the pair loop.
+ */
+
+/** Set the applied angle of a 2D capsule back to zero. */
+inline void ResetAppliedAngles(Node<2>& rNode)
+{
+    rNode.rGetNodeAttributes()[NA_APPLIED_THETA] = 0.0;
+}
+
+/** Set the applied angles and torque of a 3D capsule back to zero. */
+inline void ResetAppliedAngles(Node<3>& rNode)
+{
+    rNode.rGetNodeAttributes()[NA_APPLIED_THETA] = 0.0;
+    rNode.rGetNodeAttributes()[NA_APPLIED_PHI] = 0.0;
+    rNode.rGetNodeAttributes()[NA_APPLIED_TORQUE_Y] = 0.0;
+}
+
+/** Add to the applied angle of a 2D capsule; a 2D capsule has no phi or y torque. */
+inline void AddAppliedAngles(Node<2>& rNode, double appliedTheta, double, double)
+{
+    rNode.rGetNodeAttributes()[NA_APPLIED_THETA] += appliedTheta;
+}
+
+/** Add to the applied angles and y torque of a 3D capsule. */
+inline void AddAppliedAngles(Node<3>& rNode, double appliedTheta, double appliedPhi, double appliedTorqueY)
+{
+    rNode.rGetNodeAttributes()[NA_APPLIED_THETA] += appliedTheta;
+    rNode.rGetNodeAttributes()[NA_APPLIED_PHI] += appliedPhi;
+    rNode.rGetNodeAttributes()[NA_APPLIED_TORQUE_Y] += appliedTorqueY;
+}
+
+/**
+ * The applied angle of a force acting on a 2D capsule at rTorqueArm from its centre: the 2D cross product. A 2D
+ * capsule has no phi or y torque, which are set to zero.
+ */
+inline void CalculateAppliedAngles(const c_vector<double, 2>& rTorqueArm,
+                                   const c_vector<double, 2>& rForce,
+                                   double& rAppliedTheta,
+                                   double& rAppliedPhi,
+                                   double& rAppliedTorqueY)
+{
+    rAppliedTheta = rTorqueArm[0] * rForce[1] - rTorqueArm[1] * rForce[0];
+    rAppliedPhi = 0.0;
+    rAppliedTorqueY = 0.0;
+}
+
+/**
+ * The applied angles of a force acting on a 3D capsule at rTorqueArm from its centre: the z component of the cross
+ * product for theta, and minus its x component for phi. Its y component completes the torque vector, which is what
+ * a director is turned by.
+ */
+inline void CalculateAppliedAngles(const c_vector<double, 3>& rTorqueArm,
+                                   const c_vector<double, 3>& rForce,
+                                   double& rAppliedTheta,
+                                   double& rAppliedPhi,
+                                   double& rAppliedTorqueY)
+{
+    rAppliedTheta = rTorqueArm[0] * rForce[1] - rTorqueArm[1] * rForce[0];
+    rAppliedPhi = -(rTorqueArm[1] * rForce[2] - rTorqueArm[2] * rForce[1]);
+    rAppliedTorqueY = rTorqueArm[2] * rForce[0] - rTorqueArm[0] * rForce[2];
+}
 
+} // namespace
 
 template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetYoungModulus(double youngModulus)
@@ -30,14 +104,418 @@ double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetYoungModulus()
 	return mYoungModulus;
 }
 
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetContactLaw(CapsuleContactLawType contactLaw)
+{
+    mContactLaw = contactLaw;
+    mVerletListIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+CapsuleContactLawType CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetContactLaw()
+{
+    return mContactLaw;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetSpringStiffness(double springStiffness)
+{
+    mSpringStiffness = springStiffness;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetSpringStiffness()
+{
+    return mSpringStiffness;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetAdhesionStrength(double adhesionStrength)
+{
+    mAdhesionStrength = adhesionStrength;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetAdhesionStrength()
+{
+    return mAdhesionStrength;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetAdhesionRange(double adhesionRange)
+{
+    if (adhesionRange <= 0.0)
+    {
+        EXCEPTION("The adhesion range must be positive.");
+    }
+    mAdhesionRange = adhesionRange;
+    mVerletListIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetAdhesionRange()
+{
+    return mAdhesionRange;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetInteractionRange()
+{
+    return (mContactLaw == CCL_HERTZ_WITH_ADHESION) ? mAdhesionRange : 0.0;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetNumThreads(unsigned numThreads)
+{
+    if (numThreads == 0u)
+    {
+        EXCEPTION("The number of threads must be at least one.");
+    }
+    mNumThreads = numThreads;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumThreads()
+{
+    return mNumThreads;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetUseSinglePrecision(bool useSinglePrecision)
+{
+    mUseSinglePrecision = useSinglePrecision;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseSinglePrecision()
+{
+    return mUseSinglePrecision;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetCalculateContactStatistics(bool calculateContactStatistics)
+{
+    mCalculateContactStatistics = calculateContactStatistics;
+    mSleepingCacheIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetCalculateContactStatistics()
+{
+    return mCalculateContactStatistics;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetContactCount(unsigned index)
+{
+    assert(index < mContactCounts.size());
+    return mContactCounts[index];
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetTotalOverlap(unsigned index)
+{
+    assert(index < mTotalOverlaps.size());
+    return mTotalOverlaps[index];
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+const c_matrix<double, SPACE_DIM, SPACE_DIM>& CapsuleForce<ELEMENT_DIM, SPACE_DIM>::rGetVirial(unsigned index)
+{
+    assert(index < mVirials.size());
+    return mVirials[index];
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetUseGatherForces(bool useGatherForces)
+{
+    mUseGatherForces = useGatherForces;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseGatherForces()
+{
+    return mUseGatherForces;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetUseSleeping(bool useSleeping)
+{
+    mUseSleeping = useSleeping;
+    mSleepingCacheIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseSleeping()
+{
+    return mUseSleeping;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetSleepWakeDistance(double wakeDistance)
+{
+    if (wakeDistance <= 0.0)
+    {
+        EXCEPTION("The sleep wake distance must be positive.");
+    }
+    mSleepWakeDistance = wakeDistance;
+    mSleepingCacheIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetSleepWakeDistance()
+{
+    return mSleepWakeDistance;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumPairsSkippedAsleep()
+{
+    return mNumPairsSkippedAsleep;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumSleepingCacheRebuilds()
+{
+    return mNumSleepingCacheRebuilds;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumCapsulesCachedAsleep()
+{
+    return mNumCapsulesCachedAsleep;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumCapsulesUncachedAsleep()
+{
+    return mNumCapsulesUncachedAsleep;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumCapsulesWokenByMovement()
+{
+    return mNumCapsulesWokenByMovement;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetNodeContactWeights(const std::vector<double>& rWeights, const std::vector<char>& rIsActive)
+{
+    if (rWeights.size() != rIsActive.size())
+    {
+        EXCEPTION("There must be one contact weight and one active flag for each node index.");
+    }
+    mUseNodeContactWeights = true;
+    mNodeContactWeights = rWeights;
+    mIsNodeActive = rIsActive;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::ClearNodeContactWeights()
+{
+    mUseNodeContactWeights = false;
+    mNodeContactWeights.clear();
+    mIsNodeActive.clear();
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseNodeContactWeights()
+{
+    return mUseNodeContactWeights;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumPairsSkippedInactive()
+{
+    return mNumPairsSkippedInactive;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetUseVerletList(bool useVerletList)
+{
+    mUseVerletList = useVerletList;
+    mVerletListIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseVerletList()
+{
+    return mUseVerletList;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetVerletSkin(double verletSkin)
+{
+    if (verletSkin < 0.0)
+    {
+        EXCEPTION("The Verlet skin must be non-negative.");
+    }
+    mVerletSkin = verletSkin;
+    mVerletListIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetVerletSkin()
+{
+    return mVerletSkin;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumVerletListRebuilds()
+{
+    return mNumVerletListRebuilds;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumVerletListSteps()
+{
+    return mNumVerletListSteps;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetVerletListSize()
+{
+    return mVerletPairs.size();
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetUseCapsuleCellList(bool useCapsuleCellList)
+{
+    mUseCapsuleCellList = useCapsuleCellList;
+    mVerletListIsValid = false;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseCapsuleCellList()
+{
+    return mUseCapsuleCellList;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+CapsuleCellList<SPACE_DIM>& CapsuleForce<ELEMENT_DIM, SPACE_DIM>::rGetCapsuleCellList()
+{
+    return mCapsuleCellList;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumPairsTested()
+{
+    return mNumPairsTested;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumPairsRejectedByBoundingSpheres()
+{
+    return mNumPairsRejectedByBoundingSpheres;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumPairsOverlapping()
+{
+    return mNumPairsOverlapping;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::ResetPairCounters()
+{
+    mNumPairsTested = 0u;
+    mNumPairsRejectedByBoundingSpheres = 0u;
+    mNumPairsOverlapping = 0u;
+    mNumPairsSkippedAsleep = 0u;
+    mNumPairsSkippedInactive = 0u;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetUseOverlapRecovery(bool useOverlapRecovery)
+{
+    mUseOverlapRecovery = useOverlapRecovery;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetUseOverlapRecovery()
+{
+    return mUseOverlapRecovery;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM, SPACE_DIM>::SetMaxNumOverlapRelaxationIterations(unsigned maxNumIterations)
+{
+    mMaxNumOverlapRelaxationIterations = maxNumIterations;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetMaxNumOverlapRelaxationIterations()
+{
+    return mMaxNumOverlapRelaxationIterations;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumOverlapViolations()
+{
+    return mNumOverlapViolations;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetNumStepsWithOverlapViolations()
+{
+    return mNumStepsWithOverlapViolations;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::GetMaxOverlapViolationRatio()
+{
+    return mMaxOverlapViolationRatio;
+}
+
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+const std::vector<typename CapsuleForce<ELEMENT_DIM, SPACE_DIM>::OverlapViolation>& CapsuleForce<ELEMENT_DIM, SPACE_DIM>::rGetOverlapViolations()
+{
+    return mOverlapViolations;
+}
+
 
 template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 CapsuleForce<ELEMENT_DIM, SPACE_DIM>::CapsuleForce()
         : AbstractForce<ELEMENT_DIM, SPACE_DIM>(),
-          mYoungModulus(100.0)
+          mYoungModulus(100.0),
+          mContactLaw(CCL_HERTZ),
+          mSpringStiffness(100.0),
+          mAdhesionStrength(1.0),
+          mAdhesionRange(0.1),
+          mUseSinglePrecision(false),
+          mNumThreads(1u),
+          mCalculateContactStatistics(false),
+          mUseSleeping(false),
+          mSleepWakeDistance(0.01),
+          mSleepingCacheNumNodeReorderings(0u),
+          mSleepingCacheIsValid(false),
+          mSkipSleepingPairs(false),
+          mNumPairsSkippedAsleep(0u),
+          mNumSleepingCacheRebuilds(0u),
+          mNumCapsulesCachedAsleep(0u),
+          mNumCapsulesUncachedAsleep(0u),
+          mNumCapsulesWokenByMovement(0u),
+          mUseNodeContactWeights(false),
+          mSkipInactivePairs(false),
+          mNumPairsSkippedInactive(0u),
+          mUseGatherForces(false),
+          mUseVerletList(false),
+          mVerletSkin(0.5),
+          mVerletEffectiveSkin(0.0),
+          mVerletListIsValid(false),
+          mVerletTopologyVersion(0u),
+          mNumVerletListRebuilds(0u),
+          mNumVerletListSteps(0u),
+          mUseCapsuleCellList(false),
+          mNumPairsTested(0u),
+          mNumPairsRejectedByBoundingSpheres(0u),
+          mNumPairsOverlapping(0u),
+          mUseOverlapRecovery(false),
+          mMaxNumOverlapRelaxationIterations(10u),
+          mNumOverlapViolations(0u),
+          mNumStepsWithOverlapViolations(0u),
+          mMaxOverlapViolationRatio(0.0)
 {
-    // Has to be either element and space dimensions are both 2 or both 3.
-    assert((ELEMENT_DIM == 2u && SPACE_DIM == 2u) || (ELEMENT_DIM == 3u && SPACE_DIM == 3u));
 }
 
 
@@ -62,77 +540,35 @@ double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::CalculateForceDirectionAndContactPo
                                                                                      double& rContactDistA,
                                                                                      double& rContactDistB)
 {
+	// Store the two capsules in entries 0 and 1 of a local cache, as the nodes need not have distinct indices
+	CapsuleGeometryCache<SPACE_DIM> geometry;
+	geometry.SetCapsule(0u, rNodeA);
+	geometry.SetCapsule(1u, rNodeB);
+
+	double shortest_distance = CalculateShortestDistanceBetweenSegments(geometry.GetEndPointOne(0u),
+	                                                                    geometry.GetEndPointTwo(0u),
+	                                                                    geometry.GetEndPointOne(1u),
+	                                                                    geometry.GetEndPointTwo(1u),
+	                                                                    rNodeA.rGetNodeAttributes()[NA_LENGTH],
+	                                                                    rNodeB.rGetNodeAttributes()[NA_LENGTH],
+	                                                                    rVecAToB,
+	                                                                    rContactDistA,
+	                                                                    rContactDistB);
 
+    return CalculateOverlapBetweenCapsules(rNodeA, rNodeB, shortest_distance); // return the overlap
+}
 
-	auto location_a = rNodeA.rGetLocation();
-	auto location_b = rNodeB.rGetLocation();
-
-	const double angle_theta_a = rNodeA.rGetNodeAttributes()[NA_THETA];
-	const double angle_theta_b = rNodeB.rGetNodeAttributes()[NA_THETA];
-
-	double angle_phi_a;
-	double angle_phi_b;
-
-	const double length_a = rNodeA.rGetNodeAttributes()[NA_LENGTH];
-	const double length_b = rNodeB.rGetNodeAttributes()[NA_LENGTH];
-
-	if (SPACE_DIM==3u)
-	{
-		angle_phi_a = rNodeA.rGetNodeAttributes()[NA_PHI];
-		angle_phi_b = rNodeB.rGetNodeAttributes()[NA_PHI];
-	}
-
-	c_vector<double,SPACE_DIM> segment_a_point_1;
-	c_vector<double,SPACE_DIM> segment_a_point_2;
-	c_vector<double,SPACE_DIM> segment_b_point_1;
-	c_vector<double,SPACE_DIM> segment_b_point_2;
-
-	// The line segments are backwards. If the centre point of a is location_a, then would segment_a_point_1 actually be
-	// calculated by subtracting half the length? Like
-	//segment_a_point_1[0] = location_a[0] - 0.5 * length_a * cos(angle_theta_a) * sin(angle_phi_a);
-	//segment_a_point_1[1] = location_a[1] - 0.5 * length_a * sin(angle_theta_a) * sin(angle_phi_a);
-	//segment_a_point_1[2] = location_a[2] - 0.5 * length_a * cos(angle_phi_a);
-	//And segment_a_point_2 be the one added? This might account for the differing signs in the test for parallels?
-
-	if (SPACE_DIM==3u)
-	{
-		segment_a_point_1[0] = location_a[0] + 0.5 * length_a * cos(angle_theta_a) * sin(angle_phi_a);
-		segment_a_point_1[1] = location_a[1] + 0.5 * length_a * sin(angle_theta_a) * sin(angle_phi_a);
-		segment_a_point_1[2] = location_a[2] + 0.5 * length_a * cos(angle_phi_a);
-	//        PRINT_VECTOR(segment_a_point_1);
-
-		segment_a_point_2[0] = location_a[0] - 0.5 * length_a * cos(angle_theta_a) * sin(angle_phi_a);
-		segment_a_point_2[1] = location_a[1] - 0.5 * length_a * sin(angle_theta_a) * sin(angle_phi_a);
-		segment_a_point_2[2] = location_a[2] - 0.5 * length_a * cos(angle_phi_a);
-	//        PRINT_VECTOR(segment_a_point_2);
-
-		segment_b_point_1[0] = location_b[0] + 0.5 * length_b * cos(angle_theta_b) * sin(angle_phi_b);
-		segment_b_point_1[1] = location_b[1] + 0.5 * length_b * sin(angle_theta_b) * sin(angle_phi_b);
-		segment_b_point_1[2] = location_b[2] + 0.5 * length_b * cos(angle_phi_b);
-	//        PRINT_VECTOR(segment_b_point_1);
-
-		segment_b_point_2[0] = location_b[0] - 0.5 * length_b * cos(angle_theta_b) * sin(angle_phi_b);
-		segment_b_point_2[1] = location_b[1] - 0.5 * length_b * sin(angle_theta_b) * sin(angle_phi_b);
-		segment_b_point_2[2] = location_b[2] - 0.5 * length_b * cos(angle_phi_b);
-	}
-	else
-	{
-		segment_a_point_1[0] = location_a[0] + 0.5 * length_a * cos(angle_theta_a);
-		segment_a_point_1[1] = location_a[1] + 0.5 * length_a * sin(angle_theta_a);
-	//        PRINT_VECTOR(segment_a_point_1);
-
-		segment_a_point_2[0] = location_a[0] - 0.5 * length_a * cos(angle_theta_a);
-		segment_a_point_2[1] = location_a[1] - 0.5 * length_a * sin(angle_theta_a);
-	//        PRINT_VECTOR(segment_a_point_2);
-
-		segment_b_point_1[0] = location_b[0] + 0.5 * length_b * cos(angle_theta_b);
-		segment_b_point_1[1] = location_b[1] + 0.5 * length_b * sin(angle_theta_b);
-	//        PRINT_VECTOR(segment_b_point_1);
-
-		segment_b_point_2[0] = location_b[0] - 0.5 * length_b * cos(angle_theta_b);
-		segment_b_point_2[1] = location_b[1] - 0.5 * length_b * sin(angle_theta_b);
-	}
-//        PRINT_VECTOR(segment_b_point_2);
+template <unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::CalculateShortestDistanceBetweenSegments(const c_vector<double, SPACE_DIM>& rSegmentAPoint1,
+                                                                                      const c_vector<double, SPACE_DIM>& rSegmentAPoint2,
+                                                                                      const c_vector<double, SPACE_DIM>& rSegmentBPoint1,
+                                                                                      const c_vector<double, SPACE_DIM>& rSegmentBPoint2,
+                                                                                      const double lengthA,
+                                                                                      const double lengthB,
+                                                                                      c_vector<double, SPACE_DIM>& rVecAToB,
+                                                                                      double& rContactDistA,
+                                                                                      double& rContactDistB)
+{
 	// Copyright 2001 softSurfer, 2012 Dan Sunday
 	// This code may be freely used, distributed and modified for any purpose
 	// providing that this copyright notice is included with it.
@@ -161,297 +597,1393 @@ double CapsuleForce<ELEMENT_DIM, SPACE_DIM>::CalculateForceDirectionAndContactPo
 	//            Vector   u = S1.P1 - S1.P0;
 	//            Vector   v = S2.P1 - S2.P0;
 	//            Vector   w = S1.P0 - S2.P0;
-	c_vector<double, SPACE_DIM> u = segment_a_point_2 - segment_a_point_1; // distance along here parameterised by 0 <= s <= 1
-	c_vector<double, SPACE_DIM> v = segment_b_point_2 - segment_b_point_1; // distance along here parameterised by 0 <= t <= 1
-	c_vector<double, SPACE_DIM> w = segment_a_point_1 - segment_b_point_1;
+	c_vector<double, SPACE_DIM> u = rSegmentAPoint2 - rSegmentAPoint1; // distance along here parameterised by 0 <= s <= 1
+	c_vector<double, SPACE_DIM> v = rSegmentBPoint2 - rSegmentBPoint1; // distance along here parameterised by 0 <= t <= 1
+	c_vector<double, SPACE_DIM> w = rSegmentAPoint1 - rSegmentBPoint1;
+
+//        PRINT_VECTOR(u);
+//        PRINT_VECTOR(v);
+//        PRINT_VECTOR(w);
+
+	double    a = inner_prod(u,u);         // always >= 0
+	double    b = inner_prod(u,v);
+	double    c = inner_prod(v,v);         // always >= 0
+	double    d = inner_prod(u,w);
+	double    e = inner_prod(v,w);
+	double    D = a*c - b*b;        // always >= 0
+	double    sc, sN, sD = D;       // sc = sN[umerator] / sD[eterminant], default sD (for closest point not on end of segment) = D >= 0
+	double    tc, tN, tD = D;       // tc = tN[umerator] / tD[eterminant], default tD (for closest point not on end of segment) = D >= 0
+
+	const double SMALL_NUM = 1e-9;
+
+	//PRINT_VARIABLE(D);
+
+	if (D < SMALL_NUM)
+	{   // parallel lines
+		sN = 0.0; // force using point P0 on segment S1
+		sD = 1.0; // to prevent possible division by 0.0 later
+		tN = e;
+		tD = c;
+		//std::cout << "TRACE: parallel lines\n" << std::flush;
+
+		// Special case that we have added for parallel lines that
+		if (std::fabs(tN) < SMALL_NUM)
+		{
+			//std::cout << "TRACE: small sN and tN\n" << std::flush;
+			sN = 0.5;
+			tN = 0.5*tD;
+		}
+	}
+	else
+	{   // get the closest points on the infinite lines drawn by the segments
+		sN = (b * e - c * d);
+		tN = (a * e - b * d);
+
+		// Work out if these are off the ends of the segments
+		if (sN < 0) // sc < 0 => the s=0 on segment A is a closest point
+		{
+			sN = 0;
+			tN = e;
+			tD = c;
+		}
+		else if (sN > sD) // sc > 1  => the s=1 on Segment A is closest point
+		{
+			sN = sD;
+			tN = e + b;
+			tD = c;
+		}
+	}
+
+	if (tN < 0) // tc < 0 => the t=0 on Segment B is closest point
+	{
+		tN = 0;
+		if (-d < 0)
+		{
+			sN = 0;
+		}
+		else if (-d > a)
+		{
+			sN = sD;
+		}
+		else
+		{
+			sN = -d;
+			sD = a;
+		}
+	}
+	else if (tN > tD)// tc > 1  => the t=1 on segment B is closest point
+	{
+		tN = tD;
+		if ((-d + b) < 0)
+		{
+			//std::cout << "TRACE: setting sN=0" << std::endl;
+			sN = 0;
+		}
+		else if ((-d + b) > a)
+		{
+			sN = sD;
+		}
+		else
+		{
+			sN = (-d + b);
+			sD = a;
+		}
+	}
+
+	// finally do the division by determinant to get closest point parameters sc and tc
+	if (std::fabs(sN) < SMALL_NUM)
+	{
+		sc = 0;
+	}
+	else
+	{
+		sc = sN / sD;
+	}
+
+	if (std::fabs(tN) < SMALL_NUM)
+	{
+		tc = 0;
+	}
+	else
+	{
+		tc = tN / tD;
+	}
+
+	// vector between the two closest points
+	rVecAToB = -(w + (sc * u) - (tc * v));  // =  Segment_A(sc) - Segment_B(tc)
+
+	rContactDistA = -(sc-0.5)*lengthA;
+	rContactDistB = -(tc-0.5)*lengthB;
+
+	double shortest_distance = norm_2(rVecAToB);   // return the closest distance
+
+	// A zero vector is OK if they are intersecting...
+	// We produce a unit vector if not.
+	if (shortest_distance>SMALL_NUM)
+	{
+		rVecAToB /= shortest_distance; // Turn rVecAToB into a unit vector.
+	}
+
+	return shortest_distance;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculateForceMagnitude(const double overlap,
+                                                                    const double radiusA,
+                                                                    const double radiusB)
+{
+    double force;
+    switch (mContactLaw)
+    {
+        case CCL_LINEAR_SPRING:
+        {
+            LinearSpringContactLaw law(mSpringStiffness);
+            force = law.CalculateForceMagnitude(overlap, law.CalculatePrefactor(radiusA, radiusB));
+            break;
+        }
+        case CCL_HERTZ_WITH_ADHESION:
+        {
+            HertzWithAdhesionContactLaw law(mYoungModulus, mAdhesionStrength, mAdhesionRange);
+            force = law.CalculateForceMagnitude(overlap, law.CalculatePrefactor(radiusA, radiusB));
+            break;
+        }
+        default:
+        {
+            HertzContactLaw law(mYoungModulus);
+            force = law.CalculateForceMagnitude(overlap, law.CalculatePrefactor(radiusA, radiusB));
+        }
+    }
+
+    // Horrific hack to stop explosions after division and before appropriate length is set!
+    if (overlap > radiusA/2.0)
+    {
+    	//return 0.0;
+    	EXCEPTION("Capsules are overlapping too much.");
+    }
+
+    return force;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculateContactStiffness(Node<SPACE_DIM>& rNodeA,
+                                                                    Node<SPACE_DIM>& rNodeB,
+                                                                    c_vector<double, SPACE_DIM>& rVecAToB,
+                                                                    double& rContactDistA,
+                                                                    double& rContactDistB,
+                                                                    double& rStiffness)
+{
+    rStiffness = 0.0;
+    const double overlap = CalculateForceDirectionAndContactPoints(rNodeA, rNodeB, rVecAToB, rContactDistA, rContactDistB);
+    if (overlap <= -GetInteractionRange())
+    {
+        return false;
+    }
+
+    // In recovery mode the pair loop caps an excessive overlap rather than ending the run, so the contact is
+    // linearised about the capped overlap too
+    const double radius_a = rNodeA.rGetNodeAttributes()[NA_RADIUS];
+    const double radius_b = rNodeB.rGetNodeAttributes()[NA_RADIUS];
+    double capped_overlap = overlap;
+    if (overlap > 0.5 * radius_a)
+    {
+        if (!mUseOverlapRecovery)
+        {
+            EXCEPTION("Capsules are overlapping too much.");
+        }
+        capped_overlap = 0.5 * radius_a;
+    }
+
+    double stiffness;
+    switch (mContactLaw)
+    {
+        case CCL_LINEAR_SPRING:
+        {
+            LinearSpringContactLaw law(mSpringStiffness);
+            stiffness = law.CalculateStiffness(capped_overlap, law.CalculatePrefactor(radius_a, radius_b));
+            break;
+        }
+        case CCL_HERTZ_WITH_ADHESION:
+        {
+            HertzWithAdhesionContactLaw law(mYoungModulus, mAdhesionStrength, mAdhesionRange);
+            stiffness = law.CalculateStiffness(capped_overlap, law.CalculatePrefactor(radius_a, radius_b));
+            break;
+        }
+        default:
+        {
+            HertzContactLaw law(mYoungModulus);
+            stiffness = law.CalculateStiffness(capped_overlap, law.CalculatePrefactor(radius_a, radius_b));
+        }
+    }
+    rStiffness = std::max(0.0, stiffness);
+    return true;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::AddForceContribution(AbstractCellPopulation<ELEMENT_DIM,SPACE_DIM>& rCellPopulation)
+{
+    auto p_cell_population = dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(&rCellPopulation);
+
+    if (p_cell_population == nullptr)
+    {
+        EXCEPTION("Capsule force only works with AbstractCentreBasedCellPopulation");
+    }
+    if (mUseGatherForces && (mUseOverlapRecovery || mUseSleeping))
+    {
+        EXCEPTION("Gathered forces in CapsuleForce cannot be combined with overlap recovery or sleeping");
+    }
+    if (mUseNodeContactWeights && (mUseGatherForces || mUseSleeping))
+    {
+        EXCEPTION("Contact weights in CapsuleForce cannot be combined with gathered forces or sleeping");
+    }
+
+    // Set all applied angles back to zero
+    for (auto iter = p_cell_population->rGetMesh().GetNodeIteratorBegin();
+         iter != p_cell_population->rGetMesh().GetNodeIteratorEnd();
+         ++iter)
+    {
+        ResetAppliedAngles(*iter);
+    }
+
+    // Compute the segment end points and axes of every capsule once, so the pair loop does no trigonometry
+    mGeometryCache.Update(p_cell_population->rGetMesh());
+
+    // Contacts come from the candidate pairs, or from the Verlet list if that is in use
+    mSkipInactivePairs = false;
+    if (mUseVerletList)
+    {
+        UpdateVerletList(*p_cell_population);
+    }
+    auto& r_node_pairs = mUseVerletList ? mVerletPairs : rGetCandidatePairs(*p_cell_population, GetInteractionRange());
+
+    // Pairs of capsules in the sleeping cache reuse their cached contributions
+    mSkipSleepingPairs = false;
+    if (mUseSleeping)
+    {
+        UpdateSleepingCapsules(*p_cell_population, r_node_pairs);
+    }
+
+    // Pairs of capsules that are both inactive are left out, and the others weighted
+    if (mUseNodeContactWeights)
+    {
+        if (mNodeContactWeights.size() < mGeometryCache.GetSize())
+        {
+            EXCEPTION("The contact weights do not cover every node index.");
+        }
+        mSkipInactivePairs = true;
+    }
+
+    if (mUseGatherForces)
+    {
+        GatherForceContributions(r_node_pairs);
+        if (mCalculateContactStatistics)
+        {
+            StoreContactStatisticsInCellData(*p_cell_population);
+        }
+        return;
+    }
+
+    // Work out what each pair contributes, in contiguous blocks of pairs on each thread
+    const unsigned num_pairs = r_node_pairs.size();
+    mPairContributions.resize(num_pairs);
+
+    std::atomic<unsigned> num_rejected(0u);
+    CapsuleParallelFor::Run(num_pairs, mNumThreads, CAPSULE_CONTACT_BATCH_SIZE,
+                            [&](unsigned begin, unsigned end)
+                            {
+                                num_rejected += CalculatePairContributions(r_node_pairs, begin, end);
+                            });
+
+    if (mUseOverlapRecovery)
+    {
+        const unsigned long num_violations = mNumOverlapViolations;
+        RecoverFromOverlapViolations(r_node_pairs);
+
+        // Relaxation may have moved sleeping capsules, so every pair is recalculated and the sleeping cache built again
+        if (mSkipSleepingPairs && mNumOverlapViolations > num_violations)
+        {
+            EmptySleepingCache();
+            num_rejected = 0u;
+            CapsuleParallelFor::Run(num_pairs, mNumThreads, CAPSULE_CONTACT_BATCH_SIZE,
+                                    [&](unsigned begin, unsigned end)
+                                    {
+                                        num_rejected += CalculatePairContributions(r_node_pairs, begin, end);
+                                    });
+        }
+    }
+
+    // List the contacts of each node in ascending pair order, so that every node sums its contributions in the same
+    // order as a serial loop over the pairs would, whatever the number of threads
+    const unsigned num_indices = mGeometryCache.GetSize();
+    unsigned num_overlapping = 0;
+    unsigned num_skipped = 0;
+    unsigned num_skipped_inactive = 0;
+    mNodeContactOffsets.assign(num_indices + 1u, 0u);
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        if (mPairContributions[pair].mInContact)
+        {
+            mNodeContactOffsets[r_node_pairs[pair].first->GetIndex() + 1u]++;
+            mNodeContactOffsets[r_node_pairs[pair].second->GetIndex() + 1u]++;
+            num_overlapping++;
+        }
+        else if (mSkipSleepingPairs && mIsInSleepingCache[r_node_pairs[pair].first->GetIndex()] && mIsInSleepingCache[r_node_pairs[pair].second->GetIndex()])
+        {
+            num_skipped++;
+        }
+        else if (mSkipInactivePairs && !mIsNodeActive[r_node_pairs[pair].first->GetIndex()] && !mIsNodeActive[r_node_pairs[pair].second->GetIndex()])
+        {
+            num_skipped_inactive++;
+        }
+    }
+
+    mNumPairsTested += num_pairs;
+    mNumPairsRejectedByBoundingSpheres += num_rejected;
+    mNumPairsOverlapping += num_overlapping;
+    mNumPairsSkippedAsleep += num_skipped;
+    mNumPairsSkippedInactive += num_skipped_inactive;
+    for (unsigned index = 0; index < num_indices; index++)
+    {
+        mNodeContactOffsets[index + 1u] += mNodeContactOffsets[index];
+    }
+
+    std::vector<unsigned> next_contact(mNodeContactOffsets.begin(), mNodeContactOffsets.end() - 1);
+    mNodeContacts.resize(mNodeContactOffsets.back());
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        if (mPairContributions[pair].mInContact)
+        {
+            // Even entries are the first node of a pair, odd entries the second
+            mNodeContacts[next_contact[r_node_pairs[pair].first->GetIndex()]++] = 2u * pair;
+            mNodeContacts[next_contact[r_node_pairs[pair].second->GetIndex()]++] = 2u * pair + 1u;
+        }
+    }
+
+    if (mCalculateContactStatistics)
+    {
+        mContactCounts.resize(num_indices);
+        mTotalOverlaps.resize(num_indices);
+        mVirials.resize(num_indices);
+    }
+    // Each node is only written to by the thread that owns its index
+    CapsuleParallelFor::Run(num_indices, mNumThreads, 1u,
+                            [&](unsigned begin, unsigned end)
+                            {
+                                ApplyPairContributions(r_node_pairs, begin, end);
+                            });
+
+    // The sleeping capsules outside the cache have just cached their contacts with each other and with those in it
+    if (mUseSleeping)
+    {
+        for (unsigned index = 0; index < num_indices; index++)
+        {
+            if (mIsAsleep[index] && !mIsInSleepingCache[index])
+            {
+                mIsInSleepingCache[index] = 1;
+                mSleepingReferenceGeometry.SetCapsule(index, *mNodesByIndex[index]);
+                mNumCapsulesCachedAsleep++;
+            }
+        }
+    }
+
+    if (mCalculateContactStatistics)
+    {
+        StoreContactStatisticsInCellData(*p_cell_population);
+    }
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::UpdateSleepingCapsules(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation,
+                                                                 std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs)
+{
+    auto p_capsule_population = dynamic_cast<NodeBasedCellPopulationWithCapsules<SPACE_DIM>*>(&rCellPopulation);
+    if (p_capsule_population == nullptr)
+    {
+        EXCEPTION("Sleeping in CapsuleForce needs a NodeBasedCellPopulationWithCapsules to track births and deaths");
+    }
+
+    const unsigned num_indices = mGeometryCache.GetSize();
+    mIsAsleep.assign(num_indices, 0);
+    mNodesByIndex.assign(num_indices, nullptr);
+    for (auto iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+         iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++iter)
+    {
+        const unsigned index = iter->GetIndex();
+        mNodesByIndex[index] = &(*iter);
+        const std::vector<double>& r_attributes = iter->rGetNodeAttributes();
+        mIsAsleep[index] = (r_attributes.size() > NA_ASLEEP && r_attributes[NA_ASLEEP] != 0.0);
+    }
+
+    auto wake = [&](unsigned index)
+    {
+        std::vector<double>& r_attributes = mNodesByIndex[index]->rGetNodeAttributes();
+        r_attributes[NA_ASLEEP] = 0.0;
+        r_attributes[NA_NUM_QUIET_STEPS] = 0.0;
+        mIsAsleep[index] = 0;
+        mNumCapsulesWokenByMovement++;
+    };
+
+    // Reordering the nodes moves capsules to other indices, so the whole cache is built again
+    if (!mSleepingCacheIsValid || p_capsule_population->GetNumNodeReorderings() != mSleepingCacheNumNodeReorderings)
+    {
+        EmptySleepingCache();
+        mSleepingCacheNumNodeReorderings = p_capsule_population->GetNumNodeReorderings();
+        mSleepingCacheIsValid = true;
+    }
+
+    // Find the capsules that have moved too far since their reference geometry was taken; capsules that have just
+    // fallen asleep take theirs when they join the cache
+    std::vector<char> has_moved(num_indices, 0);
+    for (unsigned index = 0; index < num_indices; index++)
+    {
+        if (mNodesByIndex[index] == nullptr || (mIsAsleep[index] && !(index < mIsInSleepingCache.size() && mIsInSleepingCache[index])))
+        {
+            continue;
+        }
+        if (index >= mSleepingReferenceGeometry.GetSize())
+        {
+            // A capsule born since the last call
+            mSleepingReferenceGeometry.SetCapsule(index, *mNodesByIndex[index]);
+            continue;
+        }
+
+        double movement_one_squared = 0.0;
+        double movement_two_squared = 0.0;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            const double movement_one = mGeometryCache.rGetEndPointsOne(dim)[index] - mSleepingReferenceGeometry.rGetEndPointsOne(dim)[index];
+            const double movement_two = mGeometryCache.rGetEndPointsTwo(dim)[index] - mSleepingReferenceGeometry.rGetEndPointsTwo(dim)[index];
+            movement_one_squared += movement_one * movement_one;
+            movement_two_squared += movement_two * movement_two;
+        }
+        const double radius_change = std::fabs(mGeometryCache.GetRadius(index) - mSleepingReferenceGeometry.GetRadius(index));
+        has_moved[index] = (sqrt(std::max(movement_one_squared, movement_two_squared)) + radius_change > mSleepWakeDistance);
+
+        if (has_moved[index] && mIsAsleep[index])
+        {
+            wake(index);
+        }
+    }
+
+    // Then wake the sleeping capsules within reach of one of them
+    const double extra_reach = GetInteractionRange() + mSleepWakeDistance;
+    for (unsigned pair = 0; pair < rNodePairs.size(); pair++)
+    {
+        const unsigned index_a = rNodePairs[pair].first->GetIndex();
+        const unsigned index_b = rNodePairs[pair].second->GetIndex();
+        if ((has_moved[index_a] && mIsAsleep[index_b]) || (has_moved[index_b] && mIsAsleep[index_a]))
+        {
+            const double reach = mGeometryCache.GetHalfLength(index_a) + mGeometryCache.GetRadius(index_a)
+                                 + mGeometryCache.GetHalfLength(index_b) + mGeometryCache.GetRadius(index_b) + extra_reach;
+            double centre_distance_squared = 0.0;
+            for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+            {
+                const double difference = mGeometryCache.rGetCentres(dim)[index_b] - mGeometryCache.rGetCentres(dim)[index_a];
+                centre_distance_squared += difference * difference;
+            }
+
+            if (centre_distance_squared <= reach * reach)
+            {
+                wake(mIsAsleep[index_a] ? index_a : index_b);
+            }
+        }
+    }
+
+    // A capsule that has moved too far starts again from where it is now
+    for (unsigned index = 0; index < num_indices; index++)
+    {
+        if (has_moved[index])
+        {
+            mSleepingReferenceGeometry.SetCapsule(index, *mNodesByIndex[index]);
+        }
+    }
+
+    // Capsules in the cache that are no longer asleep, or no longer exist, leave it with their contacts, which are
+    // also dropped by their partners; the rest of the cache stays as it is
+    for (unsigned index = 0; index < mIsInSleepingCache.size(); index++)
+    {
+        if (mIsInSleepingCache[index] && !(index < num_indices && mIsAsleep[index]))
+        {
+            for (const SleepingContact& r_contact : mSleepingContacts[index])
+            {
+                std::vector<SleepingContact>& r_other_contacts = mSleepingContacts[r_contact.mOtherIndex];
+                r_other_contacts.erase(std::remove_if(r_other_contacts.begin(), r_other_contacts.end(),
+                                                      [index](const SleepingContact& rOtherContact)
+                                                      {
+                                                          return rOtherContact.mOtherIndex == index;
+                                                      }),
+                                       r_other_contacts.end());
+            }
+            mSleepingContacts[index].clear();
+            mIsInSleepingCache[index] = 0;
+            mNumCapsulesUncachedAsleep++;
+        }
+    }
+    mIsInSleepingCache.resize(num_indices, 0);
+    mSleepingContacts.resize(num_indices);
+
+    mSkipSleepingPairs = (std::find(mIsInSleepingCache.begin(), mIsInSleepingCache.end(), 1) != mIsInSleepingCache.end());
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::EmptySleepingCache()
+{
+    for (unsigned index = 0; index < mIsInSleepingCache.size(); index++)
+    {
+        if (mIsInSleepingCache[index])
+        {
+            mNumCapsulesUncachedAsleep++;
+        }
+    }
+
+    const unsigned num_indices = mGeometryCache.GetSize();
+    mIsInSleepingCache.assign(num_indices, 0);
+    mSleepingContacts.assign(num_indices, std::vector<SleepingContact>());
+    mSleepingReferenceGeometry = mGeometryCache;
+    mSkipSleepingPairs = false;
+    mNumSleepingCacheRebuilds++;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::UpdateVerletList(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation)
+{
+    auto p_capsule_population = dynamic_cast<NodeBasedCellPopulationWithCapsules<SPACE_DIM>*>(&rCellPopulation);
+    if (p_capsule_population == nullptr)
+    {
+        EXCEPTION("Verlet lists in CapsuleForce need a NodeBasedCellPopulationWithCapsules to track births and deaths");
+    }
+
+    mNumVerletListSteps++;
+
+    // Births and deaths can invalidate the node pointers and renumber the nodes
+    bool rebuild = !mVerletListIsValid || (p_capsule_population->GetTopologyVersion() != mVerletTopologyVersion);
+
+    // Otherwise the list is out of date once two capsules could together have closed the skin
+    double max_movement = 0.0;
+    for (auto iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+         !rebuild && iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++iter)
+    {
+        const unsigned index = iter->GetIndex();
+        if (index >= mVerletReferenceGeometry.GetSize())
+        {
+            rebuild = true;
+            break;
+        }
+
+        double movement_one_squared = 0.0;
+        double movement_two_squared = 0.0;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            const double movement_one = mGeometryCache.rGetEndPointsOne(dim)[index] - mVerletReferenceGeometry.rGetEndPointsOne(dim)[index];
+            const double movement_two = mGeometryCache.rGetEndPointsTwo(dim)[index] - mVerletReferenceGeometry.rGetEndPointsTwo(dim)[index];
+            movement_one_squared += movement_one * movement_one;
+            movement_two_squared += movement_two * movement_two;
+        }
+        const double radius_change = std::fabs(mGeometryCache.GetRadius(index) - mVerletReferenceGeometry.GetRadius(index));
+
+        max_movement = std::max(max_movement, sqrt(std::max(movement_one_squared, movement_two_squared)) + radius_change);
+        rebuild = (2.0 * max_movement > mVerletEffectiveSkin);
+    }
+
+    if (rebuild)
+    {
+        BuildVerletList(rCellPopulation, p_capsule_population->GetTopologyVersion());
+    }
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& CapsuleForce<ELEMENT_DIM,SPACE_DIM>::rGetCandidatePairs(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation,
+                                                                                                                    double extraReach)
+{
+    if (mUseCapsuleCellList)
+    {
+        mCapsuleCellList.Build(rCellPopulation.rGetMesh(), mGeometryCache, extraReach);
+        return mCapsuleCellList.rGetNodePairs();
+    }
+    return rCellPopulation.rGetNodePairs();
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::BuildVerletList(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation,
+                                                          unsigned topologyVersion)
+{
+    double max_half_extent = 0.0;
+    for (auto iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+         iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+         ++iter)
+    {
+        const unsigned index = iter->GetIndex();
+        max_half_extent = std::max(max_half_extent, mGeometryCache.GetHalfLength(index) + mGeometryCache.GetRadius(index));
+    }
+    const double interaction_range = GetInteractionRange();
+    const double cutoff_excess = rCellPopulation.rGetMesh().GetMaximumInteractionDistance() - 2.0 * max_half_extent - interaction_range;
+    mVerletEffectiveSkin = mUseCapsuleCellList ? mVerletSkin : std::max(0.0, std::min(mVerletSkin, cutoff_excess));
+
+    // Keep the candidate pairs, in their original order, that are within the skin of interacting
+    const double reach = interaction_range + mVerletEffectiveSkin;
+    auto& r_node_pairs = rGetCandidatePairs(rCellPopulation, reach);
+
+    mVerletPairs.clear();
+    ForEachCandidateContact(r_node_pairs, 0u, r_node_pairs.size(), reach,
+        [&](unsigned pair, const CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned lane)
+        {
+            const unsigned index_a = r_node_pairs[pair].first->GetIndex();
+            const unsigned index_b = r_node_pairs[pair].second->GetIndex();
+            const double touching_distance = mGeometryCache.GetRadius(index_a) + mGeometryCache.GetRadius(index_b);
+
+            if (rBatch.mDistance[lane] < touching_distance + reach)
+            {
+                mVerletPairs.push_back(r_node_pairs[pair]);
+            }
+        });
+
+    mVerletReferenceGeometry = mGeometryCache;
+    mVerletTopologyVersion = topologyVersion;
+    mVerletListIsValid = true;
+    mNumVerletListRebuilds++;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculateContactBatch(const unsigned* pIndicesA,
+                                                                const unsigned* pIndicesB,
+                                                                unsigned batchSize,
+                                                                CapsuleContactBatch<SPACE_DIM>& rBatch)
+{
+    for (unsigned lane = 0; lane < batchSize; lane++)
+    {
+        const unsigned index_a = pIndicesA[lane];
+        const unsigned index_b = pIndicesB[lane];
+
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            rBatch.mPointA1[dim][lane] = mGeometryCache.rGetEndPointsOne(dim)[index_a];
+            rBatch.mPointA2[dim][lane] = mGeometryCache.rGetEndPointsTwo(dim)[index_a];
+            rBatch.mPointB1[dim][lane] = mGeometryCache.rGetEndPointsOne(dim)[index_b];
+            rBatch.mPointB2[dim][lane] = mGeometryCache.rGetEndPointsTwo(dim)[index_b];
+        }
+        rBatch.mLengthA[lane] = 2.0 * mGeometryCache.GetHalfLength(index_a);
+        rBatch.mLengthB[lane] = 2.0 * mGeometryCache.GetHalfLength(index_b);
+    }
+
+    if (mUseSinglePrecision)
+    {
+        CapsuleContactKernel<SPACE_DIM>::CalculateBatchInSinglePrecision(rBatch, batchSize);
+    }
+    else
+    {
+        CapsuleContactKernel<SPACE_DIM>::CalculateBatch(rBatch, batchSize);
+    }
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+template<class CONTACT_FUNCTION>
+unsigned CapsuleForce<ELEMENT_DIM,SPACE_DIM>::ForEachCandidateContact(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                                                      unsigned firstPair,
+                                                                      unsigned endPair,
+                                                                      double extraReach,
+                                                                      CONTACT_FUNCTION contactFunction)
+{
+    CapsuleContactBatch<SPACE_DIM> batch;
+    unsigned batch_pairs[CAPSULE_CONTACT_BATCH_SIZE];
+    unsigned batch_indices_a[CAPSULE_CONTACT_BATCH_SIZE];
+    unsigned batch_indices_b[CAPSULE_CONTACT_BATCH_SIZE];
+    unsigned batch_size = 0;
+    unsigned num_rejected = 0;
+
+    for (unsigned pair = firstPair; pair < endPair; pair++)
+    {
+        const unsigned index_a = rNodePairs[pair].first->GetIndex();
+        const unsigned index_b = rNodePairs[pair].second->GetIndex();
+
+        // Each capsule lies within a sphere of radius L/2 + R about its centre, and capsules whose spheres are apart
+        // cannot touch, so these pairs skip the closest point calculation, as do pairs of sleeping capsules
+        const double reach = mGeometryCache.GetHalfLength(index_a) + mGeometryCache.GetRadius(index_a)
+                             + mGeometryCache.GetHalfLength(index_b) + mGeometryCache.GetRadius(index_b) + extraReach;
+        double centre_distance_squared = 0.0;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            const double difference = mGeometryCache.rGetCentres(dim)[index_b] - mGeometryCache.rGetCentres(dim)[index_a];
+            centre_distance_squared += difference * difference;
+        }
+
+        if ((mSkipSleepingPairs && mIsInSleepingCache[index_a] && mIsInSleepingCache[index_b])
+            || (mSkipInactivePairs && !mIsNodeActive[index_a] && !mIsNodeActive[index_b]))
+        {
+            // Counted by AddForceContribution()
+        }
+        else if (centre_distance_squared > reach * reach)
+        {
+            num_rejected++;
+        }
+        else
+        {
+            batch_pairs[batch_size] = pair;
+            batch_indices_a[batch_size] = index_a;
+            batch_indices_b[batch_size] = index_b;
+            batch_size++;
+        }
+
+        if (batch_size == CAPSULE_CONTACT_BATCH_SIZE || (pair + 1u == endPair && batch_size > 0u))
+        {
+            CalculateContactBatch(batch_indices_a, batch_indices_b, batch_size, batch);
+            for (unsigned lane = 0; lane < batch_size; lane++)
+            {
+                contactFunction(batch_pairs[lane], batch, lane);
+            }
+            batch_size = 0;
+        }
+    }
 
-//        PRINT_VECTOR(u);
-//        PRINT_VECTOR(v);
-//        PRINT_VECTOR(w);
+    return num_rejected;
+}
 
-	double    a = inner_prod(u,u);         // always >= 0
-	double    b = inner_prod(u,v);
-	double    c = inner_prod(v,v);         // always >= 0
-	double    d = inner_prod(u,w);
-	double    e = inner_prod(v,w);
-	double    D = a*c - b*b;        // always >= 0
-	double    sc, sN, sD = D;       // sc = sN[umerator] / sD[eterminant], default sD (for closest point not on end of segment) = D >= 0
-	double    tc, tN, tD = D;       // tc = tN[umerator] / tD[eterminant], default tD (for closest point not on end of segment) = D >= 0
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculatePairContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                                                         unsigned firstPair,
+                                                                         unsigned endPair)
+{
+    switch (mContactLaw)
+    {
+        case CCL_LINEAR_SPRING:
+            return CalculatePairContributions(rNodePairs, firstPair, endPair, LinearSpringContactLaw(mSpringStiffness));
+        case CCL_HERTZ_WITH_ADHESION:
+            return CalculatePairContributions(rNodePairs, firstPair, endPair,
+                                              HertzWithAdhesionContactLaw(mYoungModulus, mAdhesionStrength, mAdhesionRange));
+        default:
+            return CalculatePairContributions(rNodePairs, firstPair, endPair, HertzContactLaw(mYoungModulus));
+    }
+}
 
-	const double SMALL_NUM = 1e-9;
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+template<class CONTACT_LAW>
+unsigned CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculatePairContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                                                         unsigned firstPair,
+                                                                         unsigned endPair,
+                                                                         const CONTACT_LAW& rContactLaw)
+{
+    // Pairs rejected by the bounding sphere test do not interact
+    for (unsigned pair = firstPair; pair < endPair; pair++)
+    {
+        mPairContributions[pair].mInContact = false;
+        mPairContributions[pair].mIsOverlapViolation = false;
+    }
 
-	//PRINT_VARIABLE(D);
+    // Most populations have few distinct radii, so the law's prefactor is only recalculated when they change
+    const double interaction_range = rContactLaw.GetInteractionRange();
+    double prefactor_radius_a = -1.0;
+    double prefactor_radius_b = -1.0;
+    double prefactor = 0.0;
 
-	if (D < SMALL_NUM)
-	{   // parallel lines
-		sN = 0.0; // force using point P0 on segment S1
-		sD = 1.0; // to prevent possible division by 0.0 later
-		tN = e;
-		tD = c;
-		//std::cout << "TRACE: parallel lines\n" << std::flush;
+    // Find the closest points of the remaining pairs a batch at a time with the vectorised kernel, then work out the
+    // force and applied angle contributions of each interacting pair
+    return ForEachCandidateContact(rNodePairs, firstPair, endPair, interaction_range,
+        [&](unsigned pair, const CapsuleContactBatch<SPACE_DIM>& rBatch, unsigned lane)
+        {
+            const unsigned index_a = rNodePairs[pair].first->GetIndex();
+            const unsigned index_b = rNodePairs[pair].second->GetIndex();
 
-		// Special case that we have added for parallel lines that
-		if (std::fabs(tN) < SMALL_NUM)
-		{
-			//std::cout << "TRACE: small sN and tN\n" << std::flush;
-			sN = 0.5;
-			tN = 0.5*tD;
-		}
-	}
-	else
-	{   // get the closest points on the infinite lines drawn by the segments
-		sN = (b * e - c * d);
-		tN = (a * e - b * d);
+            const double radius_a = mGeometryCache.GetRadius(index_a);
+            const double radius_b = mGeometryCache.GetRadius(index_b);
 
-		// Work out if these are off the ends of the segments
-		if (sN < 0) // sc < 0 => the s=0 on segment A is a closest point
-		{
-			sN = 0;
-			tN = e;
-			tD = c;
-		}
-		else if (sN > sD) // sc > 1  => the s=1 on Segment A is closest point
-		{
-			sN = sD;
-			tN = e + b;
-			tD = c;
-		}
-	}
+            double overlap = radius_a + radius_b - rBatch.mDistance[lane];
 
-	if (tN < 0) // tc < 0 => the t=0 on Segment B is closest point
-	{
-		tN = 0;
-		if (-d < 0)
-		{
-			sN = 0;
-		}
-		else if (-d > a)
-		{
-			sN = sD;
-		}
-		else
-		{
-			sN = -d;
-			sD = a;
-		}
-	}
-	else if (tN > tD)// tc > 1  => the t=1 on segment B is closest point
-	{
-		tN = tD;
-		if ((-d + b) < 0)
-		{
-			//std::cout << "TRACE: setting sN=0" << std::endl;
-			sN = 0;
-		}
-		else if ((-d + b) > a)
-		{
-			sN = sD;
-		}
-		else
-		{
-			sN = (-d + b);
-			sD = a;
-		}
-	}
+            PairContribution& r_contribution = mPairContributions[pair];
+            r_contribution.mInContact = (overlap > -interaction_range);
 
-	// finally do the division by determinant to get closest point parameters sc and tc
-	if (std::fabs(sN) < SMALL_NUM)
-	{
-		sc = 0;
-	}
-	else
-	{
-		sc = sN / sD;
-	}
+            if (r_contribution.mInContact)
+            {
+                r_contribution.mOverlap = overlap;
+                c_vector<double, SPACE_DIM> force_direction_a_to_b;
+                for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+                {
+                    force_direction_a_to_b[dim] = rBatch.mDirection[dim][lane];
+                }
+                const double contact_dist_a = rBatch.mContactDistA[lane];
+                const double contact_dist_b = rBatch.mContactDistB[lane];
+
+                // Horrific hack to stop explosions after division and before appropriate length is set! In recovery
+                // mode an excessive overlap is recorded, and its force capped, rather than ending the run
+                const double max_overlap = 0.5 * radius_a;
+                if (overlap > max_overlap)
+                {
+                    if (!mUseOverlapRecovery)
+                    {
+                        EXCEPTION("Capsules are overlapping too much.");
+                    }
+                    r_contribution.mIsOverlapViolation = true;
+                    overlap = max_overlap;
+                }
+
+                if (radius_a != prefactor_radius_a || radius_b != prefactor_radius_b)
+                {
+                    prefactor = rContactLaw.CalculatePrefactor(radius_a, radius_b);
+                    prefactor_radius_a = radius_a;
+                    prefactor_radius_b = radius_b;
+                }
+                const double force_magnitude = mUseSinglePrecision
+                    ? rContactLaw.CalculateForceMagnitude(static_cast<float>(overlap), static_cast<float>(prefactor))
+                    : rContactLaw.CalculateForceMagnitude(overlap, prefactor);
+
+                c_vector<double, SPACE_DIM> force_a_b = force_direction_a_to_b * force_magnitude;
+                c_vector<double, SPACE_DIM> force_b_a = -1.0 * force_a_b;
+
+                // The torque arms lie along each capsule's axis
+                c_vector<double, SPACE_DIM> torque_vec_a = contact_dist_a * mGeometryCache.GetAxis(index_a);
+                c_vector<double, SPACE_DIM> torque_vec_b = contact_dist_b * mGeometryCache.GetAxis(index_b);
+
+                r_contribution.mContactDistA = contact_dist_a;
+                r_contribution.mContactDistB = contact_dist_b;
+                CalculateAppliedAngles(torque_vec_a, force_b_a, r_contribution.mAppliedThetaA, r_contribution.mAppliedPhiA,
+                                       r_contribution.mAppliedTorqueYA);
+                CalculateAppliedAngles(torque_vec_b, force_a_b, r_contribution.mAppliedThetaB, r_contribution.mAppliedPhiB,
+                                       r_contribution.mAppliedTorqueYB);
+
+                r_contribution.mForceAToB = force_a_b;
+            }
+        });
+}
 
-	if (std::fabs(tN) < SMALL_NUM)
-	{
-		tc = 0;
-	}
-	else
-	{
-		tc = tN / tD;
-	}
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::ApplyPairContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                                                 unsigned firstIndex,
+                                                                 unsigned endIndex)
+{
+    for (unsigned index = firstIndex; index < endIndex; index++)
+    {
+        if (mCalculateContactStatistics)
+        {
+            mContactCounts[index] = 0u;
+            mTotalOverlaps[index] = 0.0;
+            mVirials[index] = zero_matrix<double>(SPACE_DIM, SPACE_DIM);
+        }
 
-	// vector between the two closest points
-	rVecAToB = -(w + (sc * u) - (tc * v));  // =  Segment_A(sc) - Segment_B(tc)
+        const bool is_asleep = (mUseSleeping && mIsAsleep[index]);
+        if (mSkipSleepingPairs && mIsInSleepingCache[index])
+        {
+            // The contacts with other capsules in the sleeping cache were skipped, and are added from it
+            for (const SleepingContact& r_cache : mSleepingContacts[index])
+            {
+                AddAppliedAngles(*mNodesByIndex[index], r_cache.mAppliedTheta, r_cache.mAppliedPhi, r_cache.mAppliedTorqueY);
+                mNodesByIndex[index]->AddAppliedForceContribution(r_cache.mForce);
+                if (mCalculateContactStatistics)
+                {
+                    mContactCounts[index] += r_cache.mContactCount;
+                    mTotalOverlaps[index] += r_cache.mOverlap;
+                    mVirials[index] += r_cache.mVirial;
+                }
+            }
+        }
 
-	rContactDistA = -(sc-0.5)*length_a;
-	rContactDistB = -(tc-0.5)*length_b;
+        for (unsigned contact = mNodeContactOffsets[index]; contact < mNodeContactOffsets[index + 1u]; contact++)
+        {
+            const unsigned pair = mNodeContacts[contact] / 2u;
+            const bool is_first_node = (mNodeContacts[contact] % 2u == 0u);
+            const PairContribution& r_contribution = mPairContributions[pair];
+
+            c_vector<double, SPACE_DIM> force;
+            double applied_theta;
+            double applied_phi;
+            double applied_torque_y;
+            double contact_dist;
+            unsigned other_index;
+            if (is_first_node)
+            {
+                force = -1.0 * r_contribution.mForceAToB;
+                applied_theta = r_contribution.mAppliedThetaA;
+                applied_phi = r_contribution.mAppliedPhiA;
+                applied_torque_y = r_contribution.mAppliedTorqueYA;
+                contact_dist = r_contribution.mContactDistA;
+                other_index = rNodePairs[pair].second->GetIndex();
+            }
+            else
+            {
+                force = r_contribution.mForceAToB;
+                applied_theta = r_contribution.mAppliedThetaB;
+                applied_phi = r_contribution.mAppliedPhiB;
+                applied_torque_y = r_contribution.mAppliedTorqueYB;
+                contact_dist = r_contribution.mContactDistB;
+                other_index = rNodePairs[pair].first->GetIndex();
+            }
 
-	double shortest_distance = norm_2(rVecAToB);   // return the closest distance
+            Node<SPACE_DIM>& r_node = is_first_node ? *(rNodePairs[pair].first) : *(rNodePairs[pair].second);
+            if (mUseNodeContactWeights)
+            {
+                const double weight = std::min(mNodeContactWeights[index], mNodeContactWeights[other_index]);
+                AddAppliedAngles(r_node, weight * applied_theta, weight * applied_phi, weight * applied_torque_y);
+                r_node.AddAppliedForceContribution(c_vector<double, SPACE_DIM>(weight * force));
+            }
+            else
+            {
+                AddAppliedAngles(r_node, applied_theta, applied_phi, applied_torque_y);
+                r_node.AddAppliedForceContribution(force);
+            }
 
-	// A zero vector is OK if they are intersecting...
-	// We produce a unit vector if not.
-	if (shortest_distance>SMALL_NUM)
-	{
-		rVecAToB /= shortest_distance; // Turn rVecAToB into a unit vector.
-	}
+            // Contacts between sleeping capsules are calculated here only when one of them joins the cache
+            const bool is_cached = (is_asleep && mIsAsleep[other_index]);
+            SleepingContact cached_contact;
+            if (is_cached)
+            {
+                cached_contact.mOtherIndex = other_index;
+                cached_contact.mForce = force;
+                cached_contact.mAppliedTheta = applied_theta;
+                cached_contact.mAppliedPhi = applied_phi;
+                cached_contact.mAppliedTorqueY = applied_torque_y;
+                cached_contact.mContactCount = 0u;
+                cached_contact.mOverlap = 0.0;
+                cached_contact.mVirial = zero_matrix<double>(SPACE_DIM, SPACE_DIM);
+            }
 
+            if (mCalculateContactStatistics)
+            {
+                const unsigned contact_count = (r_contribution.mOverlap > 0.0) ? 1u : 0u;
+                const double overlap = (r_contribution.mOverlap > 0.0) ? r_contribution.mOverlap : 0.0;
+
+                const c_matrix<double, SPACE_DIM, SPACE_DIM> virial = CalculateContactVirial(index, contact_dist, r_contribution.mOverlap, force);
+
+                mContactCounts[index] += contact_count;
+                mTotalOverlaps[index] += overlap;
+                mVirials[index] += virial;
+                if (is_cached)
+                {
+                    cached_contact.mContactCount = contact_count;
+                    cached_contact.mOverlap = overlap;
+                    cached_contact.mVirial = virial;
+                }
+            }
 
-    return CalculateOverlapBetweenCapsules(rNodeA, rNodeB, shortest_distance); // return the overlap
+            if (is_cached)
+            {
+                mSleepingContacts[index].push_back(cached_contact);
+            }
+        }
+    }
 }
 
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
-double CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculateForceMagnitude(const double overlap,
-                                                                    const double radiusA,
-                                                                    const double radiusB)
+c_matrix<double, SPACE_DIM, SPACE_DIM> CapsuleForce<ELEMENT_DIM,SPACE_DIM>::CalculateContactVirial(unsigned index,
+                                                                                                 double contactDist,
+                                                                                                 double overlap,
+                                                                                                 const c_vector<double, SPACE_DIM>& rForce)
 {
-    const double effective_radius = 2.0 * radiusA * radiusB / (radiusA + radiusB);
-    const double force = 4.0 * mYoungModulus * pow(overlap, 1.5) * sqrt(effective_radius) / 3.0;
-
-    // Horrific hack to stop explosions after division and before appropriate length is set!
-    if (overlap > radiusA/2.0)
+    // The contact point lies on the capsule's axis, offset outwards by its radius along the force, so the arm from
+    // the centre is the torque arm plus a part parallel to the force, which adds to the virial too
+    const double force_magnitude = norm_2(rForce);
+    c_vector<double, SPACE_DIM> arm = contactDist * mGeometryCache.GetAxis(index);
+    if (force_magnitude > 0.0)
     {
-    	//return 0.0;
-    	EXCEPTION("Capsules are overlapping too much.");
+        // Repulsive forces push the capsule away from the contact point, attractive ones pull towards it
+        const double sign = (overlap > 0.0) ? -1.0 : 1.0;
+        arm += (sign * mGeometryCache.GetRadius(index) / force_magnitude) * rForce;
     }
-
-    return force;
+    return outer_prod(arm, rForce);
 }
 
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
-void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::AddForceContribution(AbstractCellPopulation<ELEMENT_DIM,SPACE_DIM>& rCellPopulation)
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::GatherForceContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs)
 {
-    auto p_cell_population = dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(&rCellPopulation);
+    const unsigned num_pairs = rNodePairs.size();
+    const unsigned num_indices = mGeometryCache.GetSize();
 
-    if (p_cell_population == nullptr)
+    // Compressed rows of neighbour indices, with each node's neighbours in the order of the candidate pairs
+    mNeighbourOffsets.assign(num_indices + 1u, 0u);
+    mNodesByIndex.assign(num_indices, nullptr);
+    for (unsigned pair = 0; pair < num_pairs; pair++)
     {
-        EXCEPTION("Capsule force only works with AbstractCentreBasedCellPopulation");
+        mNeighbourOffsets[rNodePairs[pair].first->GetIndex() + 1u]++;
+        mNeighbourOffsets[rNodePairs[pair].second->GetIndex() + 1u]++;
+        mNodesByIndex[rNodePairs[pair].first->GetIndex()] = rNodePairs[pair].first;
+        mNodesByIndex[rNodePairs[pair].second->GetIndex()] = rNodePairs[pair].second;
+    }
+    for (unsigned index = 0; index < num_indices; index++)
+    {
+        mNeighbourOffsets[index + 1u] += mNeighbourOffsets[index];
     }
 
-    // Set all applied angles back to zero
-    for (auto iter = p_cell_population->rGetMesh().GetNodeIteratorBegin();
-         iter != p_cell_population->rGetMesh().GetNodeIteratorEnd();
-         ++iter)
+    std::vector<unsigned> next_neighbour(mNeighbourOffsets.begin(), mNeighbourOffsets.end() - 1);
+    mNeighbourIndices.resize(mNeighbourOffsets.back());
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        const unsigned index_a = rNodePairs[pair].first->GetIndex();
+        const unsigned index_b = rNodePairs[pair].second->GetIndex();
+        mNeighbourIndices[next_neighbour[index_a]++] = index_b;
+        mNeighbourIndices[next_neighbour[index_b]++] = index_a;
+    }
+
+    mGatheredForces.resize(num_indices);
+    mGatheredAppliedThetas.resize(num_indices);
+    mGatheredAppliedPhis.resize(num_indices);
+    mGatheredAppliedTorqueYs.resize(num_indices);
+    if (mCalculateContactStatistics)
+    {
+        mContactCounts.resize(num_indices);
+        mTotalOverlaps.resize(num_indices);
+        mVirials.resize(num_indices);
+    }
+
+    std::atomic<unsigned> num_rejected(0u);
+    std::atomic<unsigned> num_in_contact(0u);
+    CapsuleParallelFor::Run(num_indices, mNumThreads, 1u,
+                            [&](unsigned begin, unsigned end)
+                            {
+                                unsigned block_rejected = 0u;
+                                unsigned block_in_contact = 0u;
+                                switch (mContactLaw)
+                                {
+                                    case CCL_LINEAR_SPRING:
+                                        GatherNodeContributions(begin, end, LinearSpringContactLaw(mSpringStiffness),
+                                                                block_rejected, block_in_contact);
+                                        break;
+                                    case CCL_HERTZ_WITH_ADHESION:
+                                        GatherNodeContributions(begin, end,
+                                                                HertzWithAdhesionContactLaw(mYoungModulus, mAdhesionStrength, mAdhesionRange),
+                                                                block_rejected, block_in_contact);
+                                        break;
+                                    default:
+                                        GatherNodeContributions(begin, end, HertzContactLaw(mYoungModulus),
+                                                                block_rejected, block_in_contact);
+                                }
+                                num_rejected += block_rejected;
+                                num_in_contact += block_in_contact;
+
+                                // Each node is only written to by the thread that owns its index
+                                for (unsigned index = begin; index < end; index++)
+                                {
+                                    if (mNodesByIndex[index] != nullptr)
+                                    {
+                                        AddAppliedAngles(*mNodesByIndex[index], mGatheredAppliedThetas[index], mGatheredAppliedPhis[index],
+                                                         mGatheredAppliedTorqueYs[index]);
+                                        mNodesByIndex[index]->AddAppliedForceContribution(mGatheredForces[index]);
+                                    }
+                                }
+                            });
+
+    mNumPairsTested += num_pairs;
+    mNumPairsRejectedByBoundingSpheres += num_rejected;
+    mNumPairsOverlapping += num_in_contact;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+template<class CONTACT_LAW>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::GatherNodeContributions(unsigned firstIndex,
+                                                                  unsigned endIndex,
+                                                                  const CONTACT_LAW& rContactLaw,
+                                                                  unsigned& rNumRejected,
+                                                                  unsigned& rNumInContact)
+{
+    for (unsigned index = firstIndex; index < endIndex; index++)
     {
-        iter->rGetNodeAttributes()[NA_APPLIED_THETA] = 0.0;
-        if (SPACE_DIM==3u)
+        mGatheredForces[index] = zero_vector<double>(SPACE_DIM);
+        mGatheredAppliedThetas[index] = 0.0;
+        mGatheredAppliedPhis[index] = 0.0;
+        mGatheredAppliedTorqueYs[index] = 0.0;
+        if (mCalculateContactStatistics)
         {
-        	iter->rGetNodeAttributes()[NA_APPLIED_PHI] = 0.0;
+            mContactCounts[index] = 0u;
+            mTotalOverlaps[index] = 0.0;
+            mVirials[index] = zero_matrix<double>(SPACE_DIM, SPACE_DIM);
         }
     }
 
-    // Calculate force and applied angle contributions from each pair
-    for (auto& node_pair : p_cell_population->rGetNodePairs())
+    const double interaction_range = rContactLaw.GetInteractionRange();
+    double prefactor_radius_a = -1.0;
+    double prefactor_radius_b = -1.0;
+    double prefactor = 0.0;
+
+    CapsuleContactBatch<SPACE_DIM> batch;
+    unsigned batch_indices_a[CAPSULE_CONTACT_BATCH_SIZE];
+    unsigned batch_indices_b[CAPSULE_CONTACT_BATCH_SIZE];
+    unsigned batch_size = 0;
+
+    // Each lane is a capsule A and one of its neighbours B, and only A's side of the contact is kept
+    auto process_batch = [&]()
     {
-        Node<SPACE_DIM>& r_node_a = *(node_pair.first);
-        Node<SPACE_DIM>& r_node_b = *(node_pair.second);
+        CalculateContactBatch(batch_indices_a, batch_indices_b, batch_size, batch);
+        for (unsigned lane = 0; lane < batch_size; lane++)
+        {
+            const unsigned index_a = batch_indices_a[lane];
+            const unsigned index_b = batch_indices_b[lane];
+
+            const double radius_a = mGeometryCache.GetRadius(index_a);
+            const double radius_b = mGeometryCache.GetRadius(index_b);
+
+            const double overlap = radius_a + radius_b - batch.mDistance[lane];
+            if (overlap > -interaction_range)
+            {
+                if (index_a < index_b)
+                {
+                    rNumInContact++;
+                }
+
+                // The overlap limit comes from the capsule with the lower index, so that both sides agree on it
+                if (overlap > 0.5 * mGeometryCache.GetRadius(std::min(index_a, index_b)))
+                {
+                    EXCEPTION("Capsules are overlapping too much.");
+                }
+
+                if (radius_a != prefactor_radius_a || radius_b != prefactor_radius_b)
+                {
+                    prefactor = rContactLaw.CalculatePrefactor(radius_a, radius_b);
+                    prefactor_radius_a = radius_a;
+                    prefactor_radius_b = radius_b;
+                }
+                const double force_magnitude = mUseSinglePrecision
+                    ? rContactLaw.CalculateForceMagnitude(static_cast<float>(overlap), static_cast<float>(prefactor))
+                    : rContactLaw.CalculateForceMagnitude(overlap, prefactor);
+
+                c_vector<double, SPACE_DIM> force_b_a;
+                for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+                {
+                    force_b_a[dim] = -force_magnitude * batch.mDirection[dim][lane];
+                }
+                c_vector<double, SPACE_DIM> torque_vec_a = batch.mContactDistA[lane] * mGeometryCache.GetAxis(index_a);
+
+                double applied_theta;
+                double applied_phi;
+                double applied_torque_y;
+                CalculateAppliedAngles(torque_vec_a, force_b_a, applied_theta, applied_phi, applied_torque_y);
+
+                mGatheredForces[index_a] += force_b_a;
+                mGatheredAppliedThetas[index_a] += applied_theta;
+                mGatheredAppliedPhis[index_a] += applied_phi;
+                mGatheredAppliedTorqueYs[index_a] += applied_torque_y;
+
+                if (mCalculateContactStatistics)
+                {
+                    if (overlap > 0.0)
+                    {
+                        mContactCounts[index_a]++;
+                        mTotalOverlaps[index_a] += overlap;
+                    }
+                    mVirials[index_a] += CalculateContactVirial(index_a, batch.mContactDistA[lane], overlap, force_b_a);
+                }
+            }
+        }
+        batch_size = 0;
+    };
 
-        c_vector<double, SPACE_DIM> force_direction_a_to_b;
-		double contact_dist_a;
-		double contact_dist_b;
+    for (unsigned index_a = firstIndex; index_a < endIndex; index_a++)
+    {
+        for (unsigned neighbour = mNeighbourOffsets[index_a]; neighbour < mNeighbourOffsets[index_a + 1u]; neighbour++)
+        {
+            const unsigned index_b = mNeighbourIndices[neighbour];
 
+            // The same bounding sphere test as the pair loop
+            const double reach = mGeometryCache.GetHalfLength(index_a) + mGeometryCache.GetRadius(index_a)
+                                 + mGeometryCache.GetHalfLength(index_b) + mGeometryCache.GetRadius(index_b) + interaction_range;
+            double centre_distance_squared = 0.0;
+            for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+            {
+                const double difference = mGeometryCache.rGetCentres(dim)[index_b] - mGeometryCache.rGetCentres(dim)[index_a];
+                centre_distance_squared += difference * difference;
+            }
 
+            if (centre_distance_squared > reach * reach)
+            {
+                if (index_a < index_b)
+                {
+                    rNumRejected++;
+                }
+            }
+            else
+            {
+                batch_indices_a[batch_size] = index_a;
+                batch_indices_b[batch_size] = index_b;
+                batch_size++;
+                if (batch_size == CAPSULE_CONTACT_BATCH_SIZE)
+                {
+                    process_batch();
+                }
+            }
+        }
+    }
+    if (batch_size > 0u)
+    {
+        process_batch();
+    }
+}
 
-		double overlap = CalculateForceDirectionAndContactPoints(r_node_a,
-																 r_node_b,
-																 force_direction_a_to_b,
-																 contact_dist_a,
-																 contact_dist_b);
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::StoreContactStatisticsInCellData(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation)
+{
+    const char axis_names[] = "xyz";
 
-		if (overlap > 0.0)
-		{
+    for (auto cell_iter = rCellPopulation.Begin(); cell_iter != rCellPopulation.End(); ++cell_iter)
+    {
+        const unsigned index = rCellPopulation.GetLocationIndexUsingCell(*cell_iter);
 
-            const double radius_a = r_node_a.rGetNodeAttributes()[NA_RADIUS];
-            const double radius_b = r_node_b.rGetNodeAttributes()[NA_RADIUS];
-            double force_magnitude = CalculateForceMagnitude(overlap, radius_a, radius_b);
+        cell_iter->GetCellData()->SetItem("contact_count", mContactCounts[index]);
+        cell_iter->GetCellData()->SetItem("total_overlap", mTotalOverlaps[index]);
+        for (unsigned i = 0; i < SPACE_DIM; i++)
+        {
+            for (unsigned j = 0; j < SPACE_DIM; j++)
+            {
+                const std::string name = std::string("virial_") + axis_names[i] + axis_names[j];
+                cell_iter->GetCellData()->SetItem(name, mVirials[index](i, j));
+            }
+        }
+    }
+}
 
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::RecoverFromOverlapViolations(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs)
+{
+    const unsigned num_pairs = rNodePairs.size();
+    const unsigned num_indices = mGeometryCache.GetSize();
 
-            c_vector<double, SPACE_DIM> force_a_b = force_direction_a_to_b * force_magnitude;
-            c_vector<double, SPACE_DIM> force_b_a = -1.0 * force_a_b;
+    // Record the violations, and mark the capsules involved as the cluster to relax
+    std::vector<bool> is_in_cluster(num_indices, false);
+    bool any_violations = false;
 
-            const double angle_theta_a = r_node_a.rGetNodeAttributes()[NA_THETA];
-            const double angle_theta_b = r_node_b.rGetNodeAttributes()[NA_THETA];
+    unsigned time_step = 0u;
+    if (SimulationTime::Instance()->IsEndTimeAndNumberOfTimeStepsSetUp())
+    {
+        time_step = SimulationTime::Instance()->GetTimeStepsElapsed();
+    }
 
-            c_vector<double, SPACE_DIM> torque_vec_a;
-            c_vector<double, SPACE_DIM> torque_vec_b;
-            c_vector<double, SPACE_DIM> cross_torque_vec;
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        if (mPairContributions[pair].mIsOverlapViolation)
+        {
+            const unsigned index_a = rNodePairs[pair].first->GetIndex();
+            const unsigned index_b = rNodePairs[pair].second->GetIndex();
+            const double overlap_ratio = mPairContributions[pair].mOverlap / mGeometryCache.GetRadius(index_a);
 
-            if (SPACE_DIM==2u)
+            mNumOverlapViolations++;
+            mMaxOverlapViolationRatio = std::max(mMaxOverlapViolationRatio, overlap_ratio);
+            if (mOverlapViolations.size() < MAX_NUM_RECORDED_OVERLAP_VIOLATIONS)
             {
-				torque_vec_a[0] = contact_dist_a * cos(angle_theta_a);
-				torque_vec_a[1] = contact_dist_a * sin(angle_theta_a);
-				torque_vec_b[0] = contact_dist_b * cos(angle_theta_b);
-				torque_vec_b[1] = contact_dist_b * sin(angle_theta_b);
+                OverlapViolation violation = {time_step, index_a, index_b, overlap_ratio};
+                mOverlapViolations.push_back(violation);
             }
-            else
-            {
-            	const double angle_phi_a = r_node_a.rGetNodeAttributes()[NA_PHI];
-            	const double angle_phi_b = r_node_b.rGetNodeAttributes()[NA_PHI];
 
-        		torque_vec_a[0] = contact_dist_a * cos(angle_theta_a) * sin(angle_phi_a);
-				torque_vec_a[1] = contact_dist_a * sin(angle_theta_a) * sin(angle_phi_a);
-				torque_vec_a[2] = contact_dist_a * cos(angle_phi_a);
+            is_in_cluster[index_a] = true;
+            is_in_cluster[index_b] = true;
+            any_violations = true;
+        }
+    }
+
+    if (!any_violations)
+    {
+        return;
+    }
+    mNumStepsWithOverlapViolations++;
+
+    // Relax every candidate pair between capsules of the cluster, so that pushing one pair apart cannot simply push
+    // a capsule deeper into a neighbour that is also in trouble
+    std::vector<unsigned> cluster_pairs;
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        if (is_in_cluster[rNodePairs[pair].first->GetIndex()] && is_in_cluster[rNodePairs[pair].second->GetIndex()])
+        {
+            cluster_pairs.push_back(pair);
+        }
+    }
 
-				torque_vec_b[0] = contact_dist_b * cos(angle_theta_b) * sin(angle_phi_b);
-				torque_vec_b[1] = contact_dist_b * sin(angle_theta_b) * sin(angle_phi_b);
-				torque_vec_b[2] = contact_dist_b * cos(angle_phi_b);
+    std::vector<bool> is_moved(num_indices, false);
+    for (unsigned iteration = 0; iteration < mMaxNumOverlapRelaxationIterations; iteration++)
+    {
+        bool any_moved = false;
+        for (unsigned i = 0; i < cluster_pairs.size(); i++)
+        {
+            Node<SPACE_DIM>& r_node_a = *(rNodePairs[cluster_pairs[i]].first);
+            Node<SPACE_DIM>& r_node_b = *(rNodePairs[cluster_pairs[i]].second);
+            const unsigned index_a = r_node_a.GetIndex();
+            const unsigned index_b = r_node_b.GetIndex();
+
+            c_vector<double, SPACE_DIM> direction_a_to_b;
+            double contact_dist_a;
+            double contact_dist_b;
+            const double overlap = CalculateForceDirectionAndContactPoints(r_node_a, r_node_b, direction_a_to_b,
+                                                                           contact_dist_a, contact_dist_b);
+            const double relaxed_overlap = 0.25 * std::min(mGeometryCache.GetRadius(index_a), mGeometryCache.GetRadius(index_b));
+
+            if (overlap > relaxed_overlap)
+            {
+                // Crossing axes have no contact normal, and the direction found is then not a unit vector, so push
+                // apart across the axis of the first capsule instead
+                if (norm_2(direction_a_to_b) < 0.5)
+                {
+                    const c_vector<double, SPACE_DIM> axis = mGeometryCache.GetAxis(index_a);
+                    unsigned across_dim = 0u;
+                    for (unsigned dim = 1; dim < SPACE_DIM; dim++)
+                    {
+                        if (std::fabs(axis[dim]) < std::fabs(axis[across_dim]))
+                        {
+                            across_dim = dim;
+                        }
+                    }
+                    direction_a_to_b = -axis[across_dim] * axis;
+                    direction_a_to_b[across_dim] += 1.0;
+                    direction_a_to_b /= norm_2(direction_a_to_b);
+                }
+
+                const c_vector<double, SPACE_DIM> half_shift = 0.5 * (overlap - relaxed_overlap) * direction_a_to_b;
+                r_node_a.rGetModifiableLocation() -= half_shift;
+                r_node_b.rGetModifiableLocation() += half_shift;
+                is_moved[index_a] = true;
+                is_moved[index_b] = true;
+                any_moved = true;
             }
+        }
 
-			// Calculate the 2D cross product of two vectors
-        	//cross_torque_vec = torque_vec_a[0]*torque_vec_b[1]-torque_vec_b[0]*torque_vec_a[1];
-			auto cross_product = [](c_vector<double, SPACE_DIM> u, c_vector<double, SPACE_DIM> v) -> double
-			{
-				return u[0] * v[1] - u[1] * v[0];
-			};
-
-			// Calculate the 3D cross product of two vectors
-			auto cross_product_3d = [](c_vector<double, SPACE_DIM> u, c_vector<double, SPACE_DIM> v) -> c_vector<double, SPACE_DIM>
-			{
-            	//Standard cross product where u={u1,u2,u3} and v={v1,v2,v3}
-            	//uxv = {u2v3-u3v2,u3v1-u1v3,u1v2-u2v1}
-//            	cross_torque_vec[0] = torque_vec_a[1]*torque_vec_b[2] - torque_vec_a[2]*torque_vec_b[1];
-//            	cross_torque_vec[1] = torque_vec_a[2]*torque_vec_b[0] - torque_vec_a[0]*torque_vec_b[2];
-//            	cross_torque_vec[2] = torque_vec_a[0]*torque_vec_b[1] - torque_vec_a[1]*torque_vec_b[0];
-					c_vector<double, SPACE_DIM> c;
-					c[0] = u[1]*v[2]-u[2]*v[1];
-					c[1] = u[2]*v[0]-u[0]*v[2];
-					c[2] = u[0]*v[1]-u[1]*v[0];
-					return c;
-			};
-
-
-			if (SPACE_DIM==2u)
-			{
-				r_node_a.rGetNodeAttributes()[NA_APPLIED_THETA] += cross_product(torque_vec_a, force_b_a);
-		        //TRACE("Capsule A Applied Theta");
-		        //PRINT_VARIABLE(NA_APPLIED_THETA);
-
-				r_node_b.rGetNodeAttributes()[NA_APPLIED_THETA] += cross_product(torque_vec_b, force_a_b);
-		        //TRACE("Capsule B Applied Theta");
-		        //PRINT_VARIABLE(NA_APPLIED_THETA);
-			}
-			else
-			{
-				r_node_a.rGetNodeAttributes()[NA_APPLIED_THETA] += cross_product_3d(torque_vec_a, force_b_a)[2];
-				r_node_b.rGetNodeAttributes()[NA_APPLIED_THETA] += cross_product_3d(torque_vec_b, force_a_b)[2];
-				r_node_a.rGetNodeAttributes()[NA_APPLIED_PHI] -= cross_product_3d(torque_vec_a, force_b_a)[0];
-				r_node_b.rGetNodeAttributes()[NA_APPLIED_PHI] -= cross_product_3d(torque_vec_b, force_a_b)[0];
-			}
-
-            r_node_b.AddAppliedForceContribution(force_a_b);
-            r_node_a.AddAppliedForceContribution(force_b_a);
-		}
-	}
-}
+        if (!any_moved)
+        {
+            break;
+        }
+    }
 
+    // Bring the geometry of the moved capsules up to date and recalculate every pair that involves one of them
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        Node<SPACE_DIM>& r_node_a = *(rNodePairs[pair].first);
+        Node<SPACE_DIM>& r_node_b = *(rNodePairs[pair].second);
+        if (is_moved[r_node_a.GetIndex()])
+        {
+            mGeometryCache.SetCapsule(r_node_a.GetIndex(), r_node_a);
+        }
+        if (is_moved[r_node_b.GetIndex()])
+        {
+            mGeometryCache.SetCapsule(r_node_b.GetIndex(), r_node_b);
+        }
+    }
+    for (unsigned pair = 0; pair < num_pairs; pair++)
+    {
+        if (is_moved[rNodePairs[pair].first->GetIndex()] || is_moved[rNodePairs[pair].second->GetIndex()])
+        {
+            CalculatePairContributions(rNodePairs, pair, pair + 1u);
+        }
+    }
+}
 
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 void CapsuleForce<ELEMENT_DIM,SPACE_DIM>::OutputForceParameters(out_stream& rParamsFile)
 {
+    *rParamsFile << "\t\t\t<YoungModulus>" << mYoungModulus << "</YoungModulus>\n";
+    *rParamsFile << "\t\t\t<UseSinglePrecision>" << mUseSinglePrecision << "</UseSinglePrecision>\n";
+    *rParamsFile << "\t\t\t<CalculateContactStatistics>" << mCalculateContactStatistics << "</CalculateContactStatistics>\n";
+    *rParamsFile << "\t\t\t<UseGatherForces>" << mUseGatherForces << "</UseGatherForces>\n";
+    *rParamsFile << "\t\t\t<UseSleeping>" << mUseSleeping << "</UseSleeping>\n";
+    *rParamsFile << "\t\t\t<SleepWakeDistance>" << mSleepWakeDistance << "</SleepWakeDistance>\n";
+    *rParamsFile << "\t\t\t<ContactLaw>" << mContactLaw << "</ContactLaw>\n";
+    *rParamsFile << "\t\t\t<SpringStiffness>" << mSpringStiffness << "</SpringStiffness>\n";
+    *rParamsFile << "\t\t\t<AdhesionStrength>" << mAdhesionStrength << "</AdhesionStrength>\n";
+    *rParamsFile << "\t\t\t<AdhesionRange>" << mAdhesionRange << "</AdhesionRange>\n";
+    *rParamsFile << "\t\t\t<UseOverlapRecovery>" << mUseOverlapRecovery << "</UseOverlapRecovery>\n";
+    *rParamsFile << "\t\t\t<MaxNumOverlapRelaxationIterations>" << mMaxNumOverlapRelaxationIterations << "</MaxNumOverlapRelaxationIterations>\n";
+
     // Call method on direct parent class
     AbstractForce<ELEMENT_DIM,SPACE_DIM>::OutputForceParameters(rParamsFile);
 }
 
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+const unsigned CapsuleForce<ELEMENT_DIM,SPACE_DIM>::MAX_NUM_RECORDED_OVERLAP_VIOLATIONS;
+
 // Explicit instantiation
-template class CapsuleForce<1,1>;
-template class CapsuleForce<1,2>;
 template class CapsuleForce<2,2>;
-template class CapsuleForce<1,3>;
-template class CapsuleForce<2,3>;
 template class CapsuleForce<3,3>;
 
 // Serialization for Boost >= 1.36
 #include "SerializationExportWrapperForCpp.hpp"
-EXPORT_TEMPLATE_CLASS_ALL_DIMS(CapsuleForce)
+EXPORT_TEMPLATE_CLASS2(CapsuleForce, 2, 2)
+EXPORT_TEMPLATE_CLASS2(CapsuleForce, 3, 3)
@@ -3,7 +3,13 @@
 #define CAPSULEFORCE_HPP_
 
 #include "AbstractForce.hpp"
+#include "CapsuleCellList.hpp"
+#include "CapsuleContactKernel.hpp"
+#include "CapsuleContactLaws.hpp"
+#include "CapsuleGeometryCache.hpp"
 #include "ChasteSerialization.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "UblasMatrixInclude.hpp"
 #include <boost/serialization/base_object.hpp>
 
 /**
@@ -13,14 +19,317 @@
 template<unsigned  ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
 class CapsuleForce : public AbstractForce<ELEMENT_DIM, SPACE_DIM>
 {
+    static_assert((ELEMENT_DIM == 2u && SPACE_DIM == 2u) || (ELEMENT_DIM == 3u && SPACE_DIM == 3u),
+                  "CapsuleForce is only defined for 2D capsules in 2D or 3D capsules in 3D");
+
 
 	friend class TestCapsuleForce;
+	friend class TestCapsuleContactKernel;
+
+public:
+
+    /** A record of a pair of capsules found overlapping by more than half the radius of the first. */
+    struct OverlapViolation
+    {
+        /** The number of time steps elapsed when the violation was found, or 0 without a simulation. */
+        unsigned mTimeStep;
+
+        /** The index of the first node of the pair. */
+        unsigned mNodeIndexA;
+
+        /** The index of the second node of the pair. */
+        unsigned mNodeIndexB;
+
+        /** The overlap, as a multiple of the radius of the first capsule. */
+        double mOverlapRatio;
+    };
+
+    /** The number of overlap violations kept by rGetOverlapViolations(); later ones are only counted. */
+    static const unsigned MAX_NUM_RECORDED_OVERLAP_VIOLATIONS = 1000u;
 
 private:
 
     /** The elastic modulus of both cells (Farrell et al) */
     double mYoungModulus;
 
+    /** The force law between two capsules. Defaults to CCL_HERTZ. */
+    CapsuleContactLawType mContactLaw;
+
+    /** The spring stiffness of the CCL_LINEAR_SPRING law. Defaults to 100.0. */
+    double mSpringStiffness;
+
+    /** The largest attractive force of the CCL_HERTZ_WITH_ADHESION law. Defaults to 1.0. */
+    double mAdhesionStrength;
+
+    /** The largest gap at which capsules attract under the CCL_HERTZ_WITH_ADHESION law. Defaults to 0.1. */
+    double mAdhesionRange;
+
+    /** Segment end points, axes and radii of every capsule, rebuilt at the start of each AddForceContribution() call. */
+    CapsuleGeometryCache<SPACE_DIM> mGeometryCache;
+
+    /**
+     * Whether the closest points and force magnitudes are calculated in single precision. Forces and applied angles
+     * are still summed in double precision. Defaults to false.
+     */
+    bool mUseSinglePrecision;
+
+    /** The number of threads used by AddForceContribution(). Defaults to 1. */
+    unsigned mNumThreads;
+
+    /** What one node pair adds to the applied forces and angles of its two nodes. */
+    struct PairContribution
+    {
+        /** Whether the capsules interact; if not, the remaining members are not set. */
+        bool mInContact;
+
+        /** Whether the overlap exceeded the allowed limit, in which case the force was calculated at the limit. */
+        bool mIsOverlapViolation;
+
+        /** The uncapped overlap, which is negative for capsules attracting across a gap. */
+        double mOverlap;
+
+        /** The distance from the centre of the first capsule to its contact point, along its axis. */
+        double mContactDistA;
+
+        /** The distance from the centre of the second capsule to its contact point, along its axis. */
+        double mContactDistB;
+
+        /** The force on the second node of the pair; the first node receives minus this. */
+        c_vector<double, SPACE_DIM> mForceAToB;
+
+        /** Contribution to NA_APPLIED_THETA of the first node. */
+        double mAppliedThetaA;
+
+        /** Contribution to NA_APPLIED_THETA of the second node. */
+        double mAppliedThetaB;
+
+        /** Contribution to NA_APPLIED_PHI of the first node (3D only). */
+        double mAppliedPhiA;
+
+        /** Contribution to NA_APPLIED_PHI of the second node (3D only). */
+        double mAppliedPhiB;
+
+        /** Contribution to NA_APPLIED_TORQUE_Y of the first node (3D only). */
+        double mAppliedTorqueYA;
+
+        /** Contribution to NA_APPLIED_TORQUE_Y of the second node (3D only). */
+        double mAppliedTorqueYB;
+    };
+
+    /** The contribution of each node pair, indexed as in rGetNodePairs(). */
+    std::vector<PairContribution> mPairContributions;
+
+    /** Entries mNodeContactOffsets[i] to mNodeContactOffsets[i+1] of mNodeContacts belong to node index i. */
+    std::vector<unsigned> mNodeContactOffsets;
+
+    /** For each node, 2*pair (first node of the pair) or 2*pair+1 (second node) for each overlapping pair, ascending. */
+    std::vector<unsigned> mNodeContacts;
+
+    /**
+     * Whether each call to AddForceContribution() also sums the contact count, total overlap and virial of each
+     * capsule, and stores them as cell data. Defaults to false.
+     */
+    bool mCalculateContactStatistics;
+
+    /** The number of overlapping contacts of each node index, when mCalculateContactStatistics is set. */
+    std::vector<unsigned> mContactCounts;
+
+    /** The summed positive overlap of each node index, when mCalculateContactStatistics is set. */
+    std::vector<double> mTotalOverlaps;
+
+    /**
+     * The virial of each node index, the sum over its contacts of the arm from its centre to the contact point times
+     * the contact force on it, when mCalculateContactStatistics is set.
+     */
+    std::vector<c_matrix<double, SPACE_DIM, SPACE_DIM> > mVirials;
+
+    /** The contribution to a sleeping capsule of its contact with another sleeping capsule. */
+    struct SleepingContact
+    {
+        /** The node index of the other capsule. */
+        unsigned mOtherIndex;
+
+        /** The force. */
+        c_vector<double, SPACE_DIM> mForce;
+
+        /** The contribution to NA_APPLIED_THETA. */
+        double mAppliedTheta;
+
+        /** The contribution to NA_APPLIED_PHI (3D only). */
+        double mAppliedPhi;
+
+        /** The contribution to NA_APPLIED_TORQUE_Y (3D only). */
+        double mAppliedTorqueY;
+
+        /** Whether the capsules overlap, if mCalculateContactStatistics is set. */
+        unsigned mContactCount;
+
+        /** The positive overlap, if mCalculateContactStatistics is set. */
+        double mOverlap;
+
+        /** The virial, if mCalculateContactStatistics is set. */
+        c_matrix<double, SPACE_DIM, SPACE_DIM> mVirial;
+    };
+
+    /**
+     * Whether the contacts between two capsules asleep in their NA_ASLEEP attribute are reused from the step at
+     * which they fell asleep rather than recalculated. Defaults to false.
+     */
+    bool mUseSleeping;
+
+    /** How far a capsule may move, after its sleeping neighbours' contacts were cached, before it wakes them. */
+    double mSleepWakeDistance;
+
+    /** Whether each node index is asleep in the current call to AddForceContribution(). */
+    std::vector<char> mIsAsleep;
+
+    /** The node with each index, in the current call to AddForceContribution(). */
+    std::vector<Node<SPACE_DIM>*> mNodesByIndex;
+
+    /**
+     * Whether each node index is in the sleeping cache, so that mSleepingContacts holds its contacts with every
+     * other node index in the cache. A capsule joins when it is found asleep and leaves when it is found awake.
+     */
+    std::vector<char> mIsInSleepingCache;
+
+    /** The cached contacts of each node index in the sleeping cache with the others in it. */
+    std::vector<std::vector<SleepingContact> > mSleepingContacts;
+
+    /**
+     * The geometry of each capsule when it joined the sleeping cache or, for an awake capsule, when it last woke
+     * its sleeping neighbours or was first seen.
+     */
+    CapsuleGeometryCache<SPACE_DIM> mSleepingReferenceGeometry;
+
+    /** The population's number of node reorderings when the sleeping cache was last emptied. */
+    unsigned mSleepingCacheNumNodeReorderings;
+
+    /** Whether the sleeping cache may be used; cleared when the settings change and after loading from an archive. */
+    bool mSleepingCacheIsValid;
+
+    /** Whether the current pair loop skips the pairs of capsules that are both in the sleeping cache. */
+    bool mSkipSleepingPairs;
+
+    /** The number of pairs skipped because both capsules were asleep, since the counters were last reset. */
+    unsigned long mNumPairsSkippedAsleep;
+
+    /** The number of times the whole sleeping cache has been emptied and built again. */
+    unsigned mNumSleepingCacheRebuilds;
+
+    /** The number of times a capsule has joined the sleeping cache. */
+    unsigned long mNumCapsulesCachedAsleep;
+
+    /** The number of times a capsule has left the sleeping cache. */
+    unsigned long mNumCapsulesUncachedAsleep;
+
+    /** The number of sleeping capsules woken because they or a neighbour moved further than mSleepWakeDistance. */
+    unsigned long mNumCapsulesWokenByMovement;
+
+    /** Whether the contacts are weighted node by node, as set by SetNodeContactWeights(). Defaults to false. */
+    bool mUseNodeContactWeights;
+
+    /** The contact weight of each node index, when mUseNodeContactWeights is set. */
+    std::vector<double> mNodeContactWeights;
+
+    /** Whether each node index is active, when mUseNodeContactWeights is set. */
+    std::vector<char> mIsNodeActive;
+
+    /** Whether the current pair loop skips pairs of which neither capsule is active. */
+    bool mSkipInactivePairs;
+
+    /** The number of pairs skipped because neither capsule was active, since the counters were last reset. */
+    unsigned long mNumPairsSkippedInactive;
+
+    /**
+     * Whether each capsule gathers its own force and torque over its full neighbour list, rather than each pair being
+     * calculated once and scattered to both capsules. Defaults to false.
+     */
+    bool mUseGatherForces;
+
+    /** Entries mNeighbourOffsets[i] to mNeighbourOffsets[i+1] of mNeighbourIndices are the neighbours of node index i. */
+    std::vector<unsigned> mNeighbourOffsets;
+
+    /** The node index of each neighbour of each node, in the order of the candidate pairs. */
+    std::vector<unsigned> mNeighbourIndices;
+
+    /** The force gathered by each node index. */
+    std::vector<c_vector<double, SPACE_DIM> > mGatheredForces;
+
+    /** The contribution to NA_APPLIED_THETA gathered by each node index. */
+    std::vector<double> mGatheredAppliedThetas;
+
+    /** The contribution to NA_APPLIED_PHI gathered by each node index (3D only). */
+    std::vector<double> mGatheredAppliedPhis;
+
+    /** The contribution to NA_APPLIED_TORQUE_Y gathered by each node index (3D only). */
+    std::vector<double> mGatheredAppliedTorqueYs;
+
+    /** Whether contacts are found from a Verlet list rather than from every node pair of the population. Defaults to false. */
+    bool mUseVerletList;
+
+    /** How far beyond touching a pair may be and still be kept in the Verlet list. Defaults to 0.5. */
+    double mVerletSkin;
+
+    /** The skin used for the current Verlet list, which may be limited by the mesh's maximum interaction distance. */
+    double mVerletEffectiveSkin;
+
+    /** Whether mVerletPairs may be used; cleared when the settings change and after loading from an archive. */
+    bool mVerletListIsValid;
+
+    /** The population's topology version when the Verlet list was built. */
+    unsigned mVerletTopologyVersion;
+
+    /** The pairs within the interaction range plus the effective skin when the Verlet list was built. */
+    std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> > mVerletPairs;
+
+    /** The capsule geometry when the Verlet list was built, to measure how far each capsule has moved since. */
+    CapsuleGeometryCache<SPACE_DIM> mVerletReferenceGeometry;
+
+    /** The number of times the Verlet list has been built. */
+    unsigned mNumVerletListRebuilds;
+
+    /** The number of calls to AddForceContribution() that used the Verlet list. */
+    unsigned mNumVerletListSteps;
+
+    /**
+     * Whether candidate pairs come from mCapsuleCellList rather than from the population's node pairs. Defaults to
+     * false.
+     */
+    bool mUseCapsuleCellList;
+
+    /** The capsule-aware broad phase used when mUseCapsuleCellList is set. */
+    CapsuleCellList<SPACE_DIM> mCapsuleCellList;
+
+    /** The number of pairs considered by AddForceContribution() since the counters were last reset. */
+    unsigned long mNumPairsTested;
+
+    /** How many of those were rejected by the bounding sphere test, without a closest point calculation. */
+    unsigned long mNumPairsRejectedByBoundingSpheres;
+
+    /** How many of those were found to overlap. */
+    unsigned long mNumPairsOverlapping;
+
+    /**
+     * Whether an overlap of more than half a capsule's radius is recovered from, rather than throwing an exception.
+     * Defaults to false.
+     */
+    bool mUseOverlapRecovery;
+
+    /** The largest number of relaxation sweeps over the offending cluster after an overlap violation. Defaults to 10. */
+    unsigned mMaxNumOverlapRelaxationIterations;
+
+    /** The number of overlap violations recovered from. */
+    unsigned long mNumOverlapViolations;
+
+    /** The number of calls to AddForceContribution() with at least one overlap violation. */
+    unsigned mNumStepsWithOverlapViolations;
+
+    /** The largest overlap of any violation, as a multiple of the radius of the first capsule of the pair. */
+    double mMaxOverlapViolationRatio;
+
+    /** The first MAX_NUM_RECORDED_OVERLAP_VIOLATIONS overlap violations. */
+    std::vector<OverlapViolation> mOverlapViolations;
+
     /** Needed for serialization. */
     friend class boost::serialization::access;
 
@@ -38,6 +347,22 @@ private:
     {
         archive & boost::serialization::base_object<AbstractForce<ELEMENT_DIM, SPACE_DIM> >(*this);
         archive & mYoungModulus;
+        archive & mContactLaw;
+        archive & mSpringStiffness;
+        archive & mAdhesionStrength;
+        archive & mAdhesionRange;
+        archive & mNumThreads;
+        archive & mUseSinglePrecision;
+        archive & mCalculateContactStatistics;
+        archive & mUseSleeping;
+        archive & mSleepWakeDistance;
+        archive & mUseGatherForces;
+        archive & mUseVerletList;
+        archive & mVerletSkin;
+        archive & mUseCapsuleCellList;
+        archive & mCapsuleCellList;
+        archive & mUseOverlapRecovery;
+        archive & mMaxNumOverlapRelaxationIterations;
     }
 
     /**
@@ -69,14 +394,233 @@ private:
                                                    double& rContactDistB);
 
     /**
-     * Calculate the magnitude of the repulsion force given the overlap and capsule radii
+     * Calculate the shortest distance between the line segments at the centre of two capsules, the direction
+     * between the closest points, and the distance along each rod from its centre of mass to its closest point.
+     * This is the reference scalar routine; the pair loop in AddForceContribution() uses the batched
+     * CapsuleContactKernel, which reproduces it pair by pair.
+     *
+     * @param rSegmentAPoint1 the end point of capsule A at centre + half-length * axis
+     * @param rSegmentAPoint2 the end point of capsule A at centre - half-length * axis
+     * @param rSegmentBPoint1 the end point of capsule B at centre + half-length * axis
+     * @param rSegmentBPoint2 the end point of capsule B at centre - half-length * axis
+     * @param lengthA the length of capsule A
+     * @param lengthB the length of capsule B
+     * @param rVecAToB filled in as a unit vector from the contact point on capsule A to that on capsule B
+     * @param rContactDistA filled in as the distance from the centre of mass of capsule A to contact point
+     * @param rContactDistB filled in as the distance from the centre of mass of capsule B to contact point
+     *
+     * @return the shortest distance between the two line segments
+     */
+    double CalculateShortestDistanceBetweenSegments(const c_vector<double, SPACE_DIM>& rSegmentAPoint1,
+                                                    const c_vector<double, SPACE_DIM>& rSegmentAPoint2,
+                                                    const c_vector<double, SPACE_DIM>& rSegmentBPoint1,
+                                                    const c_vector<double, SPACE_DIM>& rSegmentBPoint2,
+                                                    const double lengthA,
+                                                    const double lengthB,
+                                                    c_vector<double, SPACE_DIM>& rVecAToB,
+                                                    double& rContactDistA,
+                                                    double& rContactDistB);
+
+    /**
+     * Calculate the magnitude of the force given the overlap and capsule radii, using the current contact law
      * @param overlap the overlap between capsules
      * @param radiusA the radius of capsule A
      * @param radiusB the radius of capsule B
-     * @return the magnitude of the repulsion force
+     * @return the magnitude of the force, positive if repulsive
      */
     double CalculateForceMagnitude(const double overlap, const double radiusA, const double radiusB);
 
+    /**
+     * @return how far apart two capsules may be and still interact under the current contact law
+     */
+    double GetInteractionRange();
+
+    /**
+     * Rebuild the Verlet list if the population has gained or lost cells, or if any capsule has moved, rotated or
+     * grown by more than half the effective skin since the list was built. Each point of a segment moves no further
+     * than the further of its end points, so until then no pair left out of the list can come into contact.
+     *
+     * @param rCellPopulation the cell population, which must be a NodeBasedCellPopulationWithCapsules
+     */
+    void UpdateVerletList(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation);
+
+    /**
+     * Get the pairs that may be in contact: the population's node pairs, or those found by the capsule cell list if
+     * that is in use.
+     *
+     * @param rCellPopulation the cell population
+     * @param extraReach how far beyond touching pairs must still be found (only honoured by the capsule cell list)
+     * @return the candidate pairs
+     */
+    std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rGetCandidatePairs(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation,
+                                                                                      double extraReach);
+
+    /**
+     * Build the Verlet list from the candidate pairs, keeping those closer than the contact law's interaction range
+     * plus the skin. The population's node pairs only include pairs of centres within the mesh's maximum interaction
+     * distance, so unless the capsule cell list is in use the skin is limited to the amount by which that distance
+     * exceeds twice the largest L/2 + R plus the interaction range.
+     *
+     * @param rCellPopulation the cell population
+     * @param topologyVersion the population's current topology version
+     */
+    void BuildVerletList(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation, unsigned topologyVersion);
+
+    /**
+     * Gather the segment end points and lengths of a batch of capsule pairs from the geometry cache, and run the
+     * contact kernel on them, in single precision if mUseSinglePrecision is set.
+     *
+     * @param pIndicesA the node index of capsule A of each pair in the batch
+     * @param pIndicesB the node index of capsule B of each pair in the batch
+     * @param batchSize the number of pairs in the batch, at most CAPSULE_CONTACT_BATCH_SIZE
+     * @param rBatch the batch to fill in
+     */
+    void CalculateContactBatch(const unsigned* pIndicesA,
+                               const unsigned* pIndicesB,
+                               unsigned batchSize,
+                               CapsuleContactBatch<SPACE_DIM>& rBatch);
+
+    /**
+     * Run the contact kernel on every pair in a contiguous range whose bounding spheres, of radius L/2 + R about
+     * each centre and enlarged by extraReach, intersect, and call contactFunction(pair, rBatch, lane) for each in
+     * ascending pair order.
+     *
+     * @param rNodePairs the node pairs
+     * @param firstPair the first pair in the range
+     * @param endPair one past the last pair in the range
+     * @param extraReach the distance beyond touching at which pairs are still of interest
+     * @param contactFunction called with the pair index, and the batch and lane holding its closest points
+     *
+     * @return the number of pairs rejected by the bounding sphere test
+     */
+    template<class CONTACT_FUNCTION>
+    unsigned ForEachCandidateContact(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                     unsigned firstPair,
+                                     unsigned endPair,
+                                     double extraReach,
+                                     CONTACT_FUNCTION contactFunction);
+
+    /**
+     * Fill in mPairContributions for a contiguous range of node pairs, with the current contact law. Only reads the
+     * geometry cache and writes to the range's own entries, so disjoint ranges may be processed on different threads.
+     *
+     * @param rNodePairs the node pairs of the population
+     * @param firstPair the first pair in the range
+     * @param endPair one past the last pair in the range
+     *
+     * @return the number of pairs rejected by the bounding sphere test
+     */
+    unsigned CalculatePairContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                    unsigned firstPair,
+                                    unsigned endPair);
+
+    /**
+     * Fill in mPairContributions for a contiguous range of node pairs with a given contact law, which is a template
+     * parameter so that it is inlined into the pair loop.
+     *
+     * @param rNodePairs the node pairs of the population
+     * @param firstPair the first pair in the range
+     * @param endPair one past the last pair in the range
+     * @param rContactLaw the contact law, one of the classes in CapsuleContactLaws.hpp
+     *
+     * @return the number of pairs rejected by the bounding sphere test
+     */
+    template<class CONTACT_LAW>
+    unsigned CalculatePairContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                        unsigned firstPair,
+                                        unsigned endPair,
+                                        const CONTACT_LAW& rContactLaw);
+
+    /**
+     * Add the contributions of every overlapping pair to the applied forces and angles of the nodes with indices in
+     * a contiguous range, taking the pairs of each node in ascending order.
+     *
+     * @param rNodePairs the node pairs of the population
+     * @param firstIndex the first node index in the range
+     * @param endIndex one past the last node index in the range
+     */
+    void ApplyPairContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs,
+                                unsigned firstIndex,
+                                unsigned endIndex);
+
+    /**
+     * Build the neighbour lists from the candidate pairs, then have each capsule gather the force and applied angles
+     * from all its neighbours, and add them to its node. Each pair is calculated once from each side, but the work
+     * for different capsules is independent, so it spreads over mNumThreads threads with no shared writes.
+     *
+     * @param rNodePairs the candidate pairs
+     */
+    void GatherForceContributions(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs);
+
+    /**
+     * Fill in mGatheredForces, mGatheredAppliedThetas, mGatheredAppliedPhis and mGatheredAppliedTorqueYs, and the
+     * contact statistics if they are calculated, for a contiguous range of node indices with a given contact law.
+     *
+     * @param firstIndex the first node index in the range
+     * @param endIndex one past the last node index in the range
+     * @param rContactLaw the contact law
+     * @param rNumRejected incremented by the number of pairs, counted from their lower index, rejected by the
+     *     bounding sphere test
+     * @param rNumInContact incremented by the number of pairs, counted from their lower index, that interact
+     */
+    template<class CONTACT_LAW>
+    void GatherNodeContributions(unsigned firstIndex,
+                                 unsigned endIndex,
+                                 const CONTACT_LAW& rContactLaw,
+                                 unsigned& rNumRejected,
+                                 unsigned& rNumInContact);
+
+    /**
+     * Calculate what one contact adds to the virial of a capsule.
+     *
+     * @param index the node index of the capsule
+     * @param contactDist the distance from the capsule's centre to its contact point, along its axis
+     * @param overlap the overlap of the pair (negative across a gap)
+     * @param rForce the contact force on the capsule
+     *
+     * @return the contribution to the capsule's virial
+     */
+    c_matrix<double, SPACE_DIM, SPACE_DIM> CalculateContactVirial(unsigned index,
+                                                                  double contactDist,
+                                                                  double overlap,
+                                                                  const c_vector<double, SPACE_DIM>& rForce);
+
+    /**
+     * Read which capsules are asleep, and wake any sleeping capsule that has moved, or has a neighbour that has moved,
+     * further than mSleepWakeDistance since its reference geometry was taken. Then drop the cached contacts of every
+     * capsule in the sleeping cache that is no longer asleep, or empty the whole cache if the nodes were reordered.
+     *
+     * @param rCellPopulation the cell population
+     * @param rNodePairs the candidate pairs for this call
+     */
+    void UpdateSleepingCapsules(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation,
+                                std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs);
+
+    /**
+     * Empty the sleeping cache, so that every sleeping capsule joins it again in this call, and take the reference
+     * geometry of every capsule from where it is now.
+     */
+    void EmptySleepingCache();
+
+    /**
+     * Copy the contact statistics of each capsule into the cell data of its cell, under the names "contact_count",
+     * "total_overlap" and "virial_xx", "virial_xy" and so on.
+     *
+     * @param rCellPopulation the cell population
+     */
+    void StoreContactStatisticsInCellData(NodeBasedCellPopulation<SPACE_DIM>& rCellPopulation);
+
+    /**
+     * Record the overlap violations found by CalculatePairContributions(), then relax the cluster of capsules
+     * involved: every candidate pair between them is pushed apart along its contact normal, sweeping up to
+     * mMaxNumOverlapRelaxationIterations times until no such pair overlaps by more than a quarter of the smaller
+     * radius. Only the capsule centres move. The contributions of every pair involving a moved capsule are then
+     * recalculated, so the global step continues from the relaxed positions.
+     *
+     * @param rNodePairs the node pairs of the population
+     */
+    void RecoverFromOverlapViolations(std::vector<std::pair<Node<SPACE_DIM>*, Node<SPACE_DIM>*> >& rNodePairs);
+
 public:
 
     /**
@@ -103,12 +647,369 @@ public:
      */
     virtual void OutputForceParameters(out_stream& rParamsFile);
 
+    /**
+     * Linearise the contact between two capsules about their current positions, for implicit numerical methods. The
+     * force on each capsule acts along the contact normal with a magnitude depending only on the overlap, so to first
+     * order it changes by the stiffness times the change in overlap; the change in the normal and the contact points
+     * is neglected, which leaves a symmetric, stable contact Jacobian.
+     *
+     * @param rNodeA the node at the centre of mass of the first capsule
+     * @param rNodeB the node at the centre of mass of the second capsule
+     * @param rVecAToB filled in as a unit vector from the contact point on capsule A to that on capsule B
+     * @param rContactDistA filled in as the distance from the centre of mass of capsule A to contact point
+     * @param rContactDistB filled in as the distance from the centre of mass of capsule B to contact point
+     * @param rStiffness filled in as the derivative of the force magnitude with respect to the overlap, with the
+     *     current contact law, or zero where the force softens as the overlap grows. An overlap of more than half
+     *     the radius of capsule A throws, as in AddForceContribution(), unless overlap recovery is on, in which case
+     *     the stiffness is taken at that largest overlap.
+     *
+     * @return whether the capsules are close enough to interact; if not, the stiffness is zero
+     */
+    bool CalculateContactStiffness(Node<SPACE_DIM>& rNodeA,
+                                   Node<SPACE_DIM>& rNodeB,
+                                   c_vector<double, SPACE_DIM>& rVecAToB,
+                                   double& rContactDistA,
+                                   double& rContactDistB,
+                                   double& rStiffness);
+
     void SetYoungModulus(double youngModulus);
     double GetYoungModulus();
 
+    /**
+     * Set the force law between two capsules. The law is chosen once per call to AddForceContribution(), and the
+     * pair loop is compiled separately for each law.
+     *
+     * @param contactLaw the contact law
+     */
+    void SetContactLaw(CapsuleContactLawType contactLaw);
+
+    /**
+     * @return the force law between two capsules
+     */
+    CapsuleContactLawType GetContactLaw();
+
+    /**
+     * Set the spring stiffness of the CCL_LINEAR_SPRING law.
+     *
+     * @param springStiffness the spring stiffness
+     */
+    void SetSpringStiffness(double springStiffness);
+
+    /**
+     * @return the spring stiffness of the CCL_LINEAR_SPRING law
+     */
+    double GetSpringStiffness();
+
+    /**
+     * Set the largest attractive force of the CCL_HERTZ_WITH_ADHESION law.
+     *
+     * @param adhesionStrength the adhesion strength
+     */
+    void SetAdhesionStrength(double adhesionStrength);
+
+    /**
+     * @return the largest attractive force of the CCL_HERTZ_WITH_ADHESION law
+     */
+    double GetAdhesionStrength();
+
+    /**
+     * Set the largest gap at which capsules attract under the CCL_HERTZ_WITH_ADHESION law. Unless the capsule cell
+     * list is used, the mesh's maximum interaction distance must also cover this range.
+     *
+     * @param adhesionRange the adhesion range (positive)
+     */
+    void SetAdhesionRange(double adhesionRange);
+
+    /**
+     * @return the largest gap at which capsules attract under the CCL_HERTZ_WITH_ADHESION law
+     */
+    double GetAdhesionRange();
+
+    /**
+     * Set the number of threads used to calculate the pair contributions and add them to the nodes. The forces and
+     * applied angles are bitwise identical for any number of threads.
+     *
+     * @param numThreads the number of threads (at least one)
+     */
+    void SetNumThreads(unsigned numThreads);
+
+    /**
+     * @return the number of threads used by AddForceContribution()
+     */
+    unsigned GetNumThreads();
+
+    /**
+     * Set whether to find the closest points of each pair and evaluate the contact law in single precision, for
+     * throughput in large exploratory runs. Forces and applied angles are still summed in double precision.
+     * Trajectories drift slowly away from those in double precision; see TestCapsuleForce for a measure of this.
+     *
+     * @param useSinglePrecision whether to use single precision
+     */
+    void SetUseSinglePrecision(bool useSinglePrecision);
+
+    /**
+     * @return whether the closest points and force magnitudes are calculated in single precision
+     */
+    bool GetUseSinglePrecision();
+
+    /**
+     * Set whether to sum, in the same pass as the forces, the number of overlapping contacts, the total overlap and
+     * the virial W = sum r (x) f of each capsule, where r runs from the capsule's centre to a contact point and f is
+     * the contact force there. The virial has a negative trace under compression; dividing it by the cell's volume
+     * gives its mean stress. The statistics are stored as cell data, for CapsuleContactStatisticsWriter.
+     *
+     * @param calculateContactStatistics whether to calculate the contact statistics
+     */
+    void SetCalculateContactStatistics(bool calculateContactStatistics);
+
+    /**
+     * @return whether the contact statistics are calculated
+     */
+    bool GetCalculateContactStatistics();
+
+    /**
+     * @param index a node index
+     * @return the number of overlapping contacts of the node at the last call to AddForceContribution()
+     */
+    unsigned GetContactCount(unsigned index);
+
+    /**
+     * @param index a node index
+     * @return the summed positive overlap of the node at the last call to AddForceContribution()
+     */
+    double GetTotalOverlap(unsigned index);
+
+    /**
+     * @param index a node index
+     * @return the virial of the node at the last call to AddForceContribution()
+     */
+    const c_matrix<double, SPACE_DIM, SPACE_DIM>& rGetVirial(unsigned index);
+
+    /**
+     * Set whether each capsule gathers its own force and torque over its full neighbour list, held in compressed
+     * rows over the node indices. This calculates every pair twice, once from each side, but the capsules are then
+     * independent of each other, which suits many threads. Cannot be combined with overlap recovery or sleeping.
+     *
+     * @param useGatherForces whether to gather forces per capsule
+     */
+    void SetUseGatherForces(bool useGatherForces);
+
+    /**
+     * @return whether each capsule gathers its own force and torque over its neighbour list
+     */
+    bool GetUseGatherForces();
+
+    /**
+     * Set whether to reuse the contacts between sleeping capsules, as put to sleep by a
+     * ForwardEulerNumericalMethodForCapsules with SetUseSleeping(true). A capsule joins the sleeping cache when it is
+     * found asleep, caching its contacts with the capsules already in it, and leaves when it is found awake, dropping
+     * only its own cached contacts, so pairs of cached capsules are skipped however the sleepers change elsewhere. A
+     * sleeping capsule is woken when it has moved further than the wake distance since it joined the cache, or when a
+     * capsule whose bounding sphere reaches it has. Reordering the nodes empties the whole cache. Requires a
+     * NodeBasedCellPopulationWithCapsules.
+     *
+     * @param useSleeping whether to reuse the contacts between sleeping capsules
+     */
+    void SetUseSleeping(bool useSleeping);
+
+    /**
+     * @return whether the contacts between sleeping capsules are reused
+     */
+    bool GetUseSleeping();
+
+    /**
+     * Set how far a capsule may move, after the contacts of its sleeping neighbours were cached, before it wakes them.
+     *
+     * @param wakeDistance the wake distance (positive)
+     */
+    void SetSleepWakeDistance(double wakeDistance);
+
+    /**
+     * @return how far a capsule may move before it wakes its sleeping neighbours
+     */
+    double GetSleepWakeDistance();
+
+    /**
+     * @return the number of pairs skipped because both capsules were asleep, since the counters were last reset
+     */
+    unsigned long GetNumPairsSkippedAsleep();
+
+    /**
+     * @return the number of times the whole sleeping cache has been emptied and built again
+     */
+    unsigned GetNumSleepingCacheRebuilds();
+
+    /**
+     * @return the number of times a capsule has joined the sleeping cache
+     */
+    unsigned long GetNumCapsulesCachedAsleep();
+
+    /**
+     * @return the number of times a capsule has left the sleeping cache
+     */
+    unsigned long GetNumCapsulesUncachedAsleep();
+
+    /**
+     * @return the number of sleeping capsules woken because they or a neighbour moved too far
+     */
+    unsigned long GetNumCapsulesWokenByMovement();
+
+    /**
+     * Weight the contacts node by node in the following calls to AddForceContribution(), for numerical methods that
+     * move capsules at different rates. Pairs of which neither capsule is active are skipped, and the force and applied
+     * angles of every other pair are scaled by the smaller weight of its two capsules. Contact statistics are not
+     * weighted. Cannot be combined with gathered forces or sleeping.
+     *
+     * @param rWeights the weight of each node index
+     * @param rIsActive whether each node index is active
+     */
+    void SetNodeContactWeights(const std::vector<double>& rWeights, const std::vector<char>& rIsActive);
+
+    /**
+     * Go back to unweighted contacts.
+     */
+    void ClearNodeContactWeights();
+
+    /**
+     * @return whether the contacts are weighted node by node
+     */
+    bool GetUseNodeContactWeights();
+
+    /**
+     * @return the number of pairs skipped because neither capsule was active, since the counters were last reset
+     */
+    unsigned long GetNumPairsSkippedInactive();
+
+    /**
+     * Set whether to find contacts from a Verlet list, which is only rebuilt from the candidate pairs when the
+     * capsules have moved far enough to make it out of date. Requires a NodeBasedCellPopulationWithCapsules.
+     *
+     * @param useVerletList whether to use a Verlet list
+     */
+    void SetUseVerletList(bool useVerletList);
+
+    /**
+     * @return whether contacts are found from a Verlet list
+     */
+    bool GetUseVerletList();
+
+    /**
+     * Set the Verlet skin. A larger skin means longer lists but fewer rebuilds.
+     *
+     * @param verletSkin the skin (non-negative)
+     */
+    void SetVerletSkin(double verletSkin);
+
+    /**
+     * @return the Verlet skin
+     */
+    double GetVerletSkin();
+
+    /**
+     * @return the number of times the Verlet list has been built
+     */
+    unsigned GetNumVerletListRebuilds();
+
+    /**
+     * @return the number of calls to AddForceContribution() that used the Verlet list
+     */
+    unsigned GetNumVerletListSteps();
+
+    /**
+     * @return the number of pairs in the current Verlet list
+     */
+    unsigned GetVerletListSize();
+
+    /**
+     * Set whether to find candidate pairs with a CapsuleCellList instead of the population's node pairs. The cell
+     * list places capsules by samples along their axes, so it does not depend on the mesh's maximum interaction
+     * distance covering the longest capsule.
+     *
+     * @param useCapsuleCellList whether to use the capsule cell list
+     */
+    void SetUseCapsuleCellList(bool useCapsuleCellList);
+
+    /**
+     * @return whether candidate pairs are found with the capsule cell list
+     */
+    bool GetUseCapsuleCellList();
+
+    /**
+     * @return the capsule cell list, for example to set its sample spacing
+     */
+    CapsuleCellList<SPACE_DIM>& rGetCapsuleCellList();
+
+    /**
+     * @return the number of pairs considered by AddForceContribution() since the counters were last reset
+     */
+    unsigned long GetNumPairsTested();
+
+    /**
+     * @return the number of pairs rejected by the bounding sphere test since the counters were last reset
+     */
+    unsigned long GetNumPairsRejectedByBoundingSpheres();
+
+    /**
+     * @return the number of overlapping pairs found since the counters were last reset
+     */
+    unsigned long GetNumPairsOverlapping();
+
+    /**
+     * Set the pair counters back to zero.
+     */
+    void ResetPairCounters();
+
+    /**
+     * Set whether to recover from capsules overlapping by more than half a radius, which otherwise throws an
+     * exception. In recovery mode the force of such a pair is capped at that overlap, the violation is recorded,
+     * and the capsules involved are relaxed apart before the step continues. Frequent violations suggest that the
+     * time step is too large.
+     *
+     * @param useOverlapRecovery whether to recover from overlap violations
+     */
+    void SetUseOverlapRecovery(bool useOverlapRecovery);
+
+    /**
+     * @return whether overlap violations are recovered from
+     */
+    bool GetUseOverlapRecovery();
+
+    /**
+     * Set the largest number of relaxation sweeps over the capsules involved in an overlap violation.
+     *
+     * @param maxNumIterations the number of sweeps
+     */
+    void SetMaxNumOverlapRelaxationIterations(unsigned maxNumIterations);
+
+    /**
+     * @return the largest number of relaxation sweeps after an overlap violation
+     */
+    unsigned GetMaxNumOverlapRelaxationIterations();
+
+    /**
+     * @return the number of overlap violations recovered from
+     */
+    unsigned long GetNumOverlapViolations();
+
+    /**
+     * @return the number of calls to AddForceContribution() with at least one overlap violation
+     */
+    unsigned GetNumStepsWithOverlapViolations();
+
+    /**
+     * @return the largest overlap of any violation, as a multiple of the radius of the first capsule of the pair
+     */
+    double GetMaxOverlapViolationRatio();
+
+    /**
+     * @return the first MAX_NUM_RECORDED_OVERLAP_VIOLATIONS overlap violations, in the order found
+     */
+    const std::vector<OverlapViolation>& rGetOverlapViolations();
+
 };
 
 #include "SerializationExportWrapper.hpp"
-EXPORT_TEMPLATE_CLASS_ALL_DIMS(CapsuleForce)
+EXPORT_TEMPLATE_CLASS2(CapsuleForce, 2, 2)
+EXPORT_TEMPLATE_CLASS2(CapsuleForce, 3, 3)
 
 #endif /*CAPSULEFORCE_HPP_*/
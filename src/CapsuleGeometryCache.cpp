@@ -0,0 +1,197 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleGeometryCache.hpp"
+#include "CapsuleOrientation.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+template<unsigned SPACE_DIM>
+CapsuleGeometryCache<SPACE_DIM>::CapsuleGeometryCache()
+{
+}
+
+template<unsigned SPACE_DIM>
+void CapsuleGeometryCache<SPACE_DIM>::EnsureSize(unsigned index)
+{
+    if (index >= mRadii.size())
+    {
+        for (unsigned dim=0; dim<SPACE_DIM; dim++)
+        {
+            mCentres[dim].resize(index + 1, 0.0);
+            mAxes[dim].resize(index + 1, 0.0);
+            mEndPointsOne[dim].resize(index + 1, 0.0);
+            mEndPointsTwo[dim].resize(index + 1, 0.0);
+        }
+        mHalfLengths.resize(index + 1, 0.0);
+        mRadii.resize(index + 1, 0.0);
+    }
+}
+
+template<unsigned SPACE_DIM>
+void CapsuleGeometryCache<SPACE_DIM>::Update(NodesOnlyMesh<SPACE_DIM>& rMesh)
+{
+    for (auto iter = rMesh.GetNodeIteratorBegin();
+         iter != rMesh.GetNodeIteratorEnd();
+         ++iter)
+    {
+        SetCapsule(iter->GetIndex(), *iter);
+    }
+}
+
+template<unsigned SPACE_DIM>
+void CapsuleGeometryCache<SPACE_DIM>::SetCapsule(unsigned index, Node<SPACE_DIM>& rNode)
+{
+    EnsureSize(index);
+
+    const std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    const c_vector<double, SPACE_DIM>& r_location = rNode.rGetLocation();
+
+    const double half_length = 0.5 * r_attributes[NA_LENGTH];
+
+    c_vector<double, SPACE_DIM> axis;
+    CapsuleOrientation::GetAxis(r_attributes, axis);
+
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        mCentres[dim][index] = r_location[dim];
+        mAxes[dim][index] = axis[dim];
+        mEndPointsOne[dim][index] = r_location[dim] + half_length * axis[dim];
+        mEndPointsTwo[dim][index] = r_location[dim] - half_length * axis[dim];
+    }
+    mHalfLengths[index] = half_length;
+    mRadii[index] = r_attributes[NA_RADIUS];
+}
+
+template<unsigned SPACE_DIM>
+unsigned CapsuleGeometryCache<SPACE_DIM>::GetSize() const
+{
+    return mRadii.size();
+}
+
+template<unsigned SPACE_DIM>
+c_vector<double, SPACE_DIM> CapsuleGeometryCache<SPACE_DIM>::GetCentre(unsigned index) const
+{
+    c_vector<double, SPACE_DIM> centre;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        centre[dim] = mCentres[dim][index];
+    }
+    return centre;
+}
+
+template<unsigned SPACE_DIM>
+c_vector<double, SPACE_DIM> CapsuleGeometryCache<SPACE_DIM>::GetAxis(unsigned index) const
+{
+    c_vector<double, SPACE_DIM> axis;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        axis[dim] = mAxes[dim][index];
+    }
+    return axis;
+}
+
+template<unsigned SPACE_DIM>
+c_vector<double, SPACE_DIM> CapsuleGeometryCache<SPACE_DIM>::GetEndPointOne(unsigned index) const
+{
+    c_vector<double, SPACE_DIM> point;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        point[dim] = mEndPointsOne[dim][index];
+    }
+    return point;
+}
+
+template<unsigned SPACE_DIM>
+c_vector<double, SPACE_DIM> CapsuleGeometryCache<SPACE_DIM>::GetEndPointTwo(unsigned index) const
+{
+    c_vector<double, SPACE_DIM> point;
+    for (unsigned dim=0; dim<SPACE_DIM; dim++)
+    {
+        point[dim] = mEndPointsTwo[dim][index];
+    }
+    return point;
+}
+
+template<unsigned SPACE_DIM>
+double CapsuleGeometryCache<SPACE_DIM>::GetHalfLength(unsigned index) const
+{
+    return mHalfLengths[index];
+}
+
+template<unsigned SPACE_DIM>
+double CapsuleGeometryCache<SPACE_DIM>::GetRadius(unsigned index) const
+{
+    return mRadii[index];
+}
+
+template<unsigned SPACE_DIM>
+const std::vector<double>& CapsuleGeometryCache<SPACE_DIM>::rGetCentres(unsigned dim) const
+{
+    return mCentres[dim];
+}
+
+template<unsigned SPACE_DIM>
+const std::vector<double>& CapsuleGeometryCache<SPACE_DIM>::rGetAxes(unsigned dim) const
+{
+    return mAxes[dim];
+}
+
+template<unsigned SPACE_DIM>
+const std::vector<double>& CapsuleGeometryCache<SPACE_DIM>::rGetEndPointsOne(unsigned dim) const
+{
+    return mEndPointsOne[dim];
+}
+
+template<unsigned SPACE_DIM>
+const std::vector<double>& CapsuleGeometryCache<SPACE_DIM>::rGetEndPointsTwo(unsigned dim) const
+{
+    return mEndPointsTwo[dim];
+}
+
+template<unsigned SPACE_DIM>
+const std::vector<double>& CapsuleGeometryCache<SPACE_DIM>::rGetHalfLengths() const
+{
+    return mHalfLengths;
+}
+
+template<unsigned SPACE_DIM>
+const std::vector<double>& CapsuleGeometryCache<SPACE_DIM>::rGetRadii() const
+{
+    return mRadii;
+}
+
+// Explicit instantiation
+template class CapsuleGeometryCache<2>;
+template class CapsuleGeometryCache<3>;
@@ -0,0 +1,186 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEGEOMETRYCACHE_HPP_
+#define CAPSULEGEOMETRYCACHE_HPP_
+
+#include <array>
+#include <vector>
+
+#include "UblasVectorInclude.hpp"
+#include "NodesOnlyMesh.hpp"
+
+/**
+ * A structure-of-arrays store of the geometry of every capsule in a population: centre, unit axis, half-length,
+ * radius and the two end points of the central line segment.
+ *
+ * The cache is filled once per time step from each capsule's orientation (see CapsuleOrientation) and its NA_LENGTH
+ * and NA_RADIUS node attributes, so that any trigonometry needed to place each capsule is done once per capsule
+ * rather than once per node pair, and none at all for capsules that hold a director.
+ * Entries are indexed by node index.
+ *
+ * The axis points from the second end point to the first, i.e. end point 1 is centre + half-length * axis.
+ */
+template<unsigned SPACE_DIM>
+class CapsuleGeometryCache
+{
+    static_assert(SPACE_DIM == 2u || SPACE_DIM == 3u, "Capsules are only defined in 2D and 3D");
+
+private:
+
+    /** Centre of each capsule, one array per coordinate. */
+    std::array<std::vector<double>, SPACE_DIM> mCentres;
+
+    /** Unit axis of each capsule, one array per coordinate. */
+    std::array<std::vector<double>, SPACE_DIM> mAxes;
+
+    /** First end point of each capsule's line segment (centre + half-length * axis), one array per coordinate. */
+    std::array<std::vector<double>, SPACE_DIM> mEndPointsOne;
+
+    /** Second end point of each capsule's line segment (centre - half-length * axis), one array per coordinate. */
+    std::array<std::vector<double>, SPACE_DIM> mEndPointsTwo;
+
+    /** Half the length of each capsule's line segment. */
+    std::vector<double> mHalfLengths;
+
+    /** Radius of each capsule. */
+    std::vector<double> mRadii;
+
+    /**
+     * Make sure every array can hold an entry for the given node index.
+     *
+     * @param index the node index
+     */
+    void EnsureSize(unsigned index);
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleGeometryCache();
+
+    /**
+     * Rebuild the cache from the node attributes of every node in a mesh.
+     *
+     * @param rMesh the nodes-only mesh holding the capsules
+     */
+    void Update(NodesOnlyMesh<SPACE_DIM>& rMesh);
+
+    /**
+     * Compute and store the geometry of a single capsule.
+     *
+     * @param index the entry to fill, usually the node index
+     * @param rNode the node at the centre of mass of the capsule
+     */
+    void SetCapsule(unsigned index, Node<SPACE_DIM>& rNode);
+
+    /**
+     * @return the number of entries in the cache (one more than the largest node index stored)
+     */
+    unsigned GetSize() const;
+
+    /**
+     * @param index the node index
+     * @return the centre of the capsule
+     */
+    c_vector<double, SPACE_DIM> GetCentre(unsigned index) const;
+
+    /**
+     * @param index the node index
+     * @return the unit axis of the capsule
+     */
+    c_vector<double, SPACE_DIM> GetAxis(unsigned index) const;
+
+    /**
+     * @param index the node index
+     * @return the first end point of the capsule's line segment
+     */
+    c_vector<double, SPACE_DIM> GetEndPointOne(unsigned index) const;
+
+    /**
+     * @param index the node index
+     * @return the second end point of the capsule's line segment
+     */
+    c_vector<double, SPACE_DIM> GetEndPointTwo(unsigned index) const;
+
+    /**
+     * @param index the node index
+     * @return half the length of the capsule's line segment
+     */
+    double GetHalfLength(unsigned index) const;
+
+    /**
+     * @param index the node index
+     * @return the radius of the capsule
+     */
+    double GetRadius(unsigned index) const;
+
+    /**
+     * @param dim the coordinate
+     * @return the array of centre coordinates in direction dim
+     */
+    const std::vector<double>& rGetCentres(unsigned dim) const;
+
+    /**
+     * @param dim the coordinate
+     * @return the array of unit axis components in direction dim
+     */
+    const std::vector<double>& rGetAxes(unsigned dim) const;
+
+    /**
+     * @param dim the coordinate
+     * @return the array of first end point coordinates in direction dim
+     */
+    const std::vector<double>& rGetEndPointsOne(unsigned dim) const;
+
+    /**
+     * @param dim the coordinate
+     * @return the array of second end point coordinates in direction dim
+     */
+    const std::vector<double>& rGetEndPointsTwo(unsigned dim) const;
+
+    /**
+     * @return the array of half-lengths
+     */
+    const std::vector<double>& rGetHalfLengths() const;
+
+    /**
+     * @return the array of radii
+     */
+    const std::vector<double>& rGetRadii() const;
+};
+
+#endif /*CAPSULEGEOMETRYCACHE_HPP_*/
@@ -0,0 +1,136 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleGrowthRegistry.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+CapsuleGrowthRegistry::CapsuleGrowthRegistry()
+{
+}
+
+void CapsuleGrowthRegistry::EnsureSize(unsigned index)
+{
+    if (index >= mIsResolved.size())
+    {
+        mIsResolved.resize(index + 1, 0u);
+        mGrowthLaws.resize(index + 1, CGL_LINEAR);
+        mBirthTimes.resize(index + 1, 0.0);
+        mBirthLengths.resize(index + 1, 0.0);
+        mDivisionLengths.resize(index + 1, 0.0);
+        mCycleDurations.resize(index + 1, 0.0);
+    }
+}
+
+void CapsuleGrowthRegistry::SetCapsule(unsigned index,
+                                       CapsuleGrowthLawType growthLaw,
+                                       double birthTime,
+                                       double birthLength,
+                                       double divisionLength,
+                                       double cycleDuration)
+{
+    EnsureSize(index);
+    mIsResolved[index] = 1u;
+    mGrowthLaws[index] = growthLaw;
+    mBirthTimes[index] = birthTime;
+    mBirthLengths[index] = birthLength;
+    mDivisionLengths[index] = divisionLength;
+    mCycleDurations[index] = cycleDuration;
+}
+
+void CapsuleGrowthRegistry::SetNotGrowing(unsigned index)
+{
+    EnsureSize(index);
+    mIsResolved[index] = 1u;
+    mCycleDurations[index] = 0.0;
+}
+
+void CapsuleGrowthRegistry::Clear()
+{
+    std::fill(mIsResolved.begin(), mIsResolved.end(), 0u);
+}
+
+double CapsuleGrowthRegistry::CalculateLength(unsigned index, double time) const
+{
+    const double age = std::max(0.0, time - mBirthTimes[index]);
+    return CalculateLength(mGrowthLaws[index], mBirthLengths[index], mDivisionLengths[index], age, mCycleDurations[index]);
+}
+
+double CapsuleGrowthRegistry::CalculateLength(CapsuleGrowthLawType growthLaw,
+                                              double birthLength,
+                                              double divisionLength,
+                                              double age,
+                                              double cycleDuration)
+{
+    if (growthLaw == CGL_LINEAR)
+    {
+        return birthLength + (divisionLength - birthLength) * age / cycleDuration;
+    }
+
+    // The exponential and adder laws both grow at the constant relative rate that takes the birth length to the
+    // division length over one cell cycle
+    return birthLength * std::pow(divisionLength / birthLength, age / cycleDuration);
+}
+
+unsigned CapsuleGrowthRegistry::GetSize() const
+{
+    return mIsResolved.size();
+}
+
+CapsuleGrowthLawType CapsuleGrowthRegistry::GetGrowthLaw(unsigned index) const
+{
+    return mGrowthLaws[index];
+}
+
+double CapsuleGrowthRegistry::GetBirthTime(unsigned index) const
+{
+    return mBirthTimes[index];
+}
+
+double CapsuleGrowthRegistry::GetBirthLength(unsigned index) const
+{
+    return mBirthLengths[index];
+}
+
+double CapsuleGrowthRegistry::GetDivisionLength(unsigned index) const
+{
+    return mDivisionLengths[index];
+}
+
+double CapsuleGrowthRegistry::GetCycleDuration(unsigned index) const
+{
+    return mCycleDurations[index];
+}
@@ -0,0 +1,197 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEGROWTHREGISTRY_HPP_
+#define CAPSULEGROWTHREGISTRY_HPP_
+
+#include <vector>
+
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * A structure-of-arrays store of the growth law and its parameters for every capsule in a population: the law, the
+ * birth time of the cell, its birth and division lengths and its cell cycle duration.
+ *
+ * Each capsule's entry is resolved once, when its cell is born (or when the registry first sees it), from its cell
+ * cycle model and node attributes, so that the length of every capsule can be set each time step by one loop over the
+ * nodes with no look-ups and no casts. Entries are indexed by node index. A capsule whose cell cycle model has no
+ * fixed duration is registered as not growing, and its length is left alone.
+ */
+class CapsuleGrowthRegistry
+{
+private:
+
+    /** Whether each entry has been resolved (one byte each rather than std::vector<bool>, so reads are plain loads). */
+    std::vector<unsigned char> mIsResolved;
+
+    /** The growth law of each capsule. */
+    std::vector<CapsuleGrowthLawType> mGrowthLaws;
+
+    /** The birth time of each capsule's cell. */
+    std::vector<double> mBirthTimes;
+
+    /** The length of each capsule when its cell was born. */
+    std::vector<double> mBirthLengths;
+
+    /** The length each capsule reaches at the end of its cell cycle. */
+    std::vector<double> mDivisionLengths;
+
+    /** The cell cycle duration of each capsule's cell, or zero for a capsule that does not grow. */
+    std::vector<double> mCycleDurations;
+
+    /**
+     * Make sure every array can hold an entry for the given node index.
+     *
+     * @param index the node index
+     */
+    void EnsureSize(unsigned index);
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleGrowthRegistry();
+
+    /**
+     * Resolve the entry for a growing capsule.
+     *
+     * @param index the node index
+     * @param growthLaw the law by which the capsule grows
+     * @param birthTime the birth time of the capsule's cell
+     * @param birthLength the length of the capsule at the birth time
+     * @param divisionLength the length of the capsule at the end of its cell cycle
+     * @param cycleDuration the duration of the cell's cycle (positive)
+     */
+    void SetCapsule(unsigned index,
+                    CapsuleGrowthLawType growthLaw,
+                    double birthTime,
+                    double birthLength,
+                    double divisionLength,
+                    double cycleDuration);
+
+    /**
+     * Resolve the entry for a capsule that does not grow.
+     *
+     * @param index the node index
+     */
+    void SetNotGrowing(unsigned index);
+
+    /**
+     * Mark every entry as unresolved, for when capsules have moved to other node indices.
+     */
+    void Clear();
+
+    /**
+     * @param index the node index
+     * @return whether the entry has been resolved
+     */
+    bool IsResolved(unsigned index) const
+    {
+        return index < mIsResolved.size() && mIsResolved[index] != 0u;
+    }
+
+    /**
+     * @param index the node index of a resolved entry
+     * @return whether the capsule grows
+     */
+    bool IsGrowing(unsigned index) const
+    {
+        return mCycleDurations[index] > 0.0;
+    }
+
+    /**
+     * Calculate the length of a growing capsule. The age of its cell is clamped at zero, and the length carries on
+     * along its law past the end of the cell cycle if the cell has not divided.
+     *
+     * @param index the node index of a resolved, growing entry
+     * @param time the time at which to calculate the length
+     * @return the length of the capsule
+     */
+    double CalculateLength(unsigned index, double time) const;
+
+    /**
+     * Calculate the length of a capsule under a growth law.
+     *
+     * @param growthLaw the growth law
+     * @param birthLength the length at birth
+     * @param divisionLength the length at the end of the cell cycle
+     * @param age the age of the cell
+     * @param cycleDuration the duration of the cell's cycle
+     * @return the length of the capsule
+     */
+    static double CalculateLength(CapsuleGrowthLawType growthLaw,
+                                  double birthLength,
+                                  double divisionLength,
+                                  double age,
+                                  double cycleDuration);
+
+    /**
+     * @return the number of entries in the registry (one more than the largest node index stored)
+     */
+    unsigned GetSize() const;
+
+    /**
+     * @param index the node index of a resolved entry
+     * @return the growth law of the capsule
+     */
+    CapsuleGrowthLawType GetGrowthLaw(unsigned index) const;
+
+    /**
+     * @param index the node index of a resolved entry
+     * @return the birth time of the capsule's cell
+     */
+    double GetBirthTime(unsigned index) const;
+
+    /**
+     * @param index the node index of a resolved entry
+     * @return the length of the capsule when its cell was born
+     */
+    double GetBirthLength(unsigned index) const;
+
+    /**
+     * @param index the node index of a resolved entry
+     * @return the length of the capsule at the end of its cell cycle
+     */
+    double GetDivisionLength(unsigned index) const;
+
+    /**
+     * @param index the node index of a resolved entry
+     * @return the cell cycle duration of the capsule's cell, or zero if the capsule does not grow
+     */
+    double GetCycleDuration(unsigned index) const;
+};
+
+#endif /*CAPSULEGROWTHREGISTRY_HPP_*/
@@ -0,0 +1,207 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEORIENTATION_HPP_
+#define CAPSULEORIENTATION_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "UblasVectorInclude.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * The orientation of a capsule, read from and written to its node attributes.
+ *
+ * A capsule's axis is given either by the NA_THETA (and, in 3D, NA_PHI) angles, or by a unit director stored in
+ * NA_DIRECTOR_X, NA_DIRECTOR_Y and NA_DIRECTOR_Z. A non-zero director takes precedence, so that consumers of the
+ * orientation need no trigonometry and a capsule standing along the z axis has a well defined axis. Whatever writes
+ * the director keeps the angles in step with it, for output and for code that needs the angles themselves; the
+ * angles are not read back while the director is set.
+ */
+class CapsuleOrientation
+{
+public:
+
+    /**
+     * @param rAttributes the node attributes of a capsule
+     * @return whether the capsule's orientation is given by its director
+     */
+    static bool HasDirector(const std::vector<double>& rAttributes)
+    {
+        return rAttributes.size() > NA_DIRECTOR_Z
+               && (rAttributes[NA_DIRECTOR_X] != 0.0 || rAttributes[NA_DIRECTOR_Y] != 0.0 || rAttributes[NA_DIRECTOR_Z] != 0.0);
+    }
+
+    /**
+     * The unit axis of a 1D capsule, which lies along the x axis. Capsules are only simulated in 2D and 3D; this is
+     * here so that classes instantiated for every dimension compile.
+     *
+     * @param rAxis filled in with the unit axis
+     */
+    static void GetAxis(const std::vector<double>&, c_vector<double, 1>& rAxis)
+    {
+        rAxis[0] = 1.0;
+    }
+
+    /**
+     * The unit axis of a 2D capsule: its director, if set, or at angle theta to the x axis.
+     *
+     * @param rAttributes the node attributes of a capsule
+     * @param rAxis filled in with the unit axis
+     */
+    static void GetAxis(const std::vector<double>& rAttributes, c_vector<double, 2>& rAxis)
+    {
+        if (HasDirector(rAttributes))
+        {
+            rAxis[0] = rAttributes[NA_DIRECTOR_X];
+            rAxis[1] = rAttributes[NA_DIRECTOR_Y];
+        }
+        else
+        {
+            const double theta = rAttributes[NA_THETA];
+            rAxis[0] = cos(theta);
+            rAxis[1] = sin(theta);
+        }
+    }
+
+    /**
+     * The unit axis of a 3D capsule: its director, if set, or with azimuth theta and polar angle phi.
+     *
+     * @param rAttributes the node attributes of a capsule
+     * @param rAxis filled in with the unit axis
+     */
+    static void GetAxis(const std::vector<double>& rAttributes, c_vector<double, 3>& rAxis)
+    {
+        if (HasDirector(rAttributes))
+        {
+            rAxis[0] = rAttributes[NA_DIRECTOR_X];
+            rAxis[1] = rAttributes[NA_DIRECTOR_Y];
+            rAxis[2] = rAttributes[NA_DIRECTOR_Z];
+        }
+        else
+        {
+            const double theta = rAttributes[NA_THETA];
+            const double phi = rAttributes[NA_PHI];
+            const double sin_phi = sin(phi);
+            rAxis[0] = cos(theta) * sin_phi;
+            rAxis[1] = sin(theta) * sin_phi;
+            rAxis[2] = cos(phi);
+        }
+    }
+
+    /**
+     * Set the director of a 1D capsule, which lies along the x axis. As for GetAxis(), this is only here so that
+     * classes instantiated for every dimension compile.
+     *
+     * @param rAttributes the node attributes of a capsule
+     */
+    static void SetDirector(std::vector<double>& rAttributes, const c_vector<double, 1>&)
+    {
+        rAttributes[NA_DIRECTOR_X] = 1.0;
+        rAttributes[NA_DIRECTOR_Y] = 0.0;
+        rAttributes[NA_DIRECTOR_Z] = 0.0;
+    }
+
+    /**
+     * Set the director of a 2D capsule to the given axis, normalised, and theta to match.
+     *
+     * @param rAttributes the node attributes of a capsule
+     * @param rAxis the new axis, which must be non-zero
+     */
+    static void SetDirector(std::vector<double>& rAttributes, const c_vector<double, 2>& rAxis)
+    {
+        const double inverse_norm = 1.0 / std::sqrt(rAxis[0] * rAxis[0] + rAxis[1] * rAxis[1]);
+        rAttributes[NA_DIRECTOR_X] = rAxis[0] * inverse_norm;
+        rAttributes[NA_DIRECTOR_Y] = rAxis[1] * inverse_norm;
+        rAttributes[NA_DIRECTOR_Z] = 0.0;
+        rAttributes[NA_THETA] = atan2(rAxis[1], rAxis[0]);
+    }
+
+    /**
+     * Set the director of a 3D capsule to the given axis, normalised, and theta and phi to match. Theta is left as
+     * it was for an axis along z, where it is undefined.
+     *
+     * @param rAttributes the node attributes of a capsule
+     * @param rAxis the new axis, which must be non-zero
+     */
+    static void SetDirector(std::vector<double>& rAttributes, const c_vector<double, 3>& rAxis)
+    {
+        const double inverse_norm = 1.0 / std::sqrt(rAxis[0] * rAxis[0] + rAxis[1] * rAxis[1] + rAxis[2] * rAxis[2]);
+        rAttributes[NA_DIRECTOR_X] = rAxis[0] * inverse_norm;
+        rAttributes[NA_DIRECTOR_Y] = rAxis[1] * inverse_norm;
+        rAttributes[NA_DIRECTOR_Z] = rAxis[2] * inverse_norm;
+        if (rAxis[0] != 0.0 || rAxis[1] != 0.0)
+        {
+            rAttributes[NA_THETA] = atan2(rAxis[1], rAxis[0]);
+        }
+        rAttributes[NA_PHI] = acos(std::max(-1.0, std::min(1.0, rAttributes[NA_DIRECTOR_Z])));
+    }
+
+    /**
+     * Unset the director, so that the capsule's orientation is given by its angles again.
+     *
+     * @param rAttributes the node attributes of a capsule
+     */
+    static void ClearDirector(std::vector<double>& rAttributes)
+    {
+        rAttributes[NA_DIRECTOR_X] = 0.0;
+        rAttributes[NA_DIRECTOR_Y] = 0.0;
+        rAttributes[NA_DIRECTOR_Z] = 0.0;
+    }
+
+    /**
+     * Get the torque applied to a capsule as a vector. In 3D its x, y and z components are -NA_APPLIED_PHI,
+     * NA_APPLIED_TORQUE_Y and NA_APPLIED_THETA; in 2D only the z component, NA_APPLIED_THETA, is set.
+     *
+     * @param rAttributes the node attributes of a capsule
+     * @return the applied torque
+     */
+    template<unsigned SPACE_DIM>
+    static c_vector<double, 3> GetAppliedTorque(const std::vector<double>& rAttributes)
+    {
+        c_vector<double, 3> torque = zero_vector<double>(3);
+        if (SPACE_DIM == 3u)
+        {
+            torque[0] = -rAttributes[NA_APPLIED_PHI];
+            torque[1] = rAttributes[NA_APPLIED_TORQUE_Y];
+        }
+        torque[2] = rAttributes[NA_APPLIED_THETA];
+        return torque;
+    }
+};
+
+#endif // CAPSULEORIENTATION_HPP_
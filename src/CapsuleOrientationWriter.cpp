@@ -34,7 +34,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "CapsuleOrientationWriter.hpp"
-#include "TypeSixSecretionEnumerations.hpp"
+#include "CapsuleOrientation.hpp"
 #include "NodeBasedCellPopulation.hpp"
 #include "Debug.hpp"
 
@@ -59,21 +59,7 @@ c_vector<double, SPACE_DIM> CapsuleOrientationWriter<ELEMENT_DIM, SPACE_DIM>::Ge
     if (dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(pCellPopulation))
     {
         unsigned node_index = pCellPopulation->GetLocationIndexUsingCell(pCell);
-        double theta = pCellPopulation->GetNode(node_index)->rGetNodeAttributes()[NA_THETA];
-
-        if (SPACE_DIM==3u)
-        {
-        	double phi = pCellPopulation->GetNode(node_index)->rGetNodeAttributes()[NA_PHI];
-        	orientation[0] = cos(theta)*sin(phi);
-        	orientation[1] = sin(theta)*sin(phi);
-        	orientation[2] = cos(phi);
-
-        }
-        else
-        {
-        	orientation[0] = cos(theta);
-        	orientation[1] = sin(theta);
-        }
+        CapsuleOrientation::GetAxis(pCellPopulation->GetNode(node_index)->rGetNodeAttributes(), orientation);
     }
 
 
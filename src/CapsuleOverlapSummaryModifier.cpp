@@ -0,0 +1,113 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "CapsuleOverlapSummaryModifier.hpp"
+#include "Exception.hpp"
+#include "OutputFileHandler.hpp"
+
+template<unsigned DIM>
+CapsuleOverlapSummaryModifier<DIM>::CapsuleOverlapSummaryModifier()
+    : AbstractCellBasedSimulationModifier<DIM>(),
+      mOutputDirectory("")
+{
+}
+
+template<unsigned DIM>
+CapsuleOverlapSummaryModifier<DIM>::~CapsuleOverlapSummaryModifier()
+{
+}
+
+template<unsigned DIM>
+void CapsuleOverlapSummaryModifier<DIM>::SetCapsuleForce(boost::shared_ptr<CapsuleForce<DIM,DIM> > pCapsuleForce)
+{
+    mpCapsuleForce = pCapsuleForce;
+}
+
+template<unsigned DIM>
+boost::shared_ptr<CapsuleForce<DIM,DIM> > CapsuleOverlapSummaryModifier<DIM>::GetCapsuleForce()
+{
+    return mpCapsuleForce;
+}
+
+template<unsigned DIM>
+void CapsuleOverlapSummaryModifier<DIM>::UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+{
+}
+
+template<unsigned DIM>
+void CapsuleOverlapSummaryModifier<DIM>::SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory)
+{
+    if (!mpCapsuleForce)
+    {
+        EXCEPTION("SetCapsuleForce() must be called on a CapsuleOverlapSummaryModifier before it is passed to a simulation");
+    }
+    mOutputDirectory = outputDirectory;
+}
+
+template<unsigned DIM>
+void CapsuleOverlapSummaryModifier<DIM>::UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+{
+    OutputFileHandler output_file_handler(mOutputDirectory, false);
+    out_stream p_summary_file = output_file_handler.OpenOutputFile("capsuleoverlapsummary.dat");
+
+    *p_summary_file << "NumOverlapViolations " << mpCapsuleForce->GetNumOverlapViolations() << "\n";
+    *p_summary_file << "NumStepsWithOverlapViolations " << mpCapsuleForce->GetNumStepsWithOverlapViolations() << "\n";
+    *p_summary_file << "MaxOverlapViolationRatio " << mpCapsuleForce->GetMaxOverlapViolationRatio() << "\n";
+
+    const std::vector<typename CapsuleForce<DIM,DIM>::OverlapViolation>& r_violations = mpCapsuleForce->rGetOverlapViolations();
+    for (unsigned i = 0; i < r_violations.size(); i++)
+    {
+        *p_summary_file << r_violations[i].mTimeStep << "\t"
+                        << r_violations[i].mNodeIndexA << "\t"
+                        << r_violations[i].mNodeIndexB << "\t"
+                        << r_violations[i].mOverlapRatio << "\n";
+    }
+    p_summary_file->close();
+}
+
+template<unsigned DIM>
+void CapsuleOverlapSummaryModifier<DIM>::OutputSimulationModifierParameters(out_stream& rParamsFile)
+{
+    AbstractCellBasedSimulationModifier<DIM>::OutputSimulationModifierParameters(rParamsFile);
+}
+
+// Explicit instantiation
+template class CapsuleOverlapSummaryModifier<2>;
+template class CapsuleOverlapSummaryModifier<3>;
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapperForCpp.hpp"
+EXPORT_TEMPLATE_CLASS1(CapsuleOverlapSummaryModifier, 2)
+EXPORT_TEMPLATE_CLASS1(CapsuleOverlapSummaryModifier, 3)
@@ -0,0 +1,140 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEOVERLAPSUMMARYMODIFIER_HPP_
+#define CAPSULEOVERLAPSUMMARYMODIFIER_HPP_
+
+#include "ChasteSerialization.hpp"
+#include <boost/serialization/base_object.hpp>
+#include <boost/serialization/shared_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "AbstractCellBasedSimulationModifier.hpp"
+#include "CapsuleForce.hpp"
+
+/**
+ * A modifier that writes a summary of the overlap violations a CapsuleForce in overlap recovery mode has recovered
+ * from to capsuleoverlapsummary.dat in the simulation's output directory at the end of the run: the number of
+ * violations, the number of time steps with any, the largest overlap ratio, then one line per recorded violation
+ * giving the time step, the two node indices and the overlap as a multiple of the first capsule's radius. Many
+ * violations suggest that the time step is too large for the parameters.
+ */
+template<unsigned DIM>
+class CapsuleOverlapSummaryModifier : public AbstractCellBasedSimulationModifier<DIM,DIM>
+{
+private:
+
+    /** The force whose overlap violations are summarised. */
+    boost::shared_ptr<CapsuleForce<DIM,DIM> > mpCapsuleForce;
+
+    /** The simulation's output directory, set in SetupSolve(). */
+    std::string mOutputDirectory;
+
+    /** Needed for serialization. */
+    friend class boost::serialization::access;
+
+    /**
+     * Archive the object and its member variables.
+     *
+     * @param archive the archive
+     * @param version the current version of this class
+     */
+    template<class Archive>
+    void serialize(Archive & archive, const unsigned int version)
+    {
+        archive & boost::serialization::base_object<AbstractCellBasedSimulationModifier<DIM,DIM> >(*this);
+        archive & mpCapsuleForce;
+    }
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleOverlapSummaryModifier();
+
+    /**
+     * Destructor.
+     */
+    virtual ~CapsuleOverlapSummaryModifier();
+
+    /**
+     * Set the force whose overlap violations are summarised. This should be the force passed to the simulation.
+     *
+     * @param pCapsuleForce the capsule force
+     */
+    void SetCapsuleForce(boost::shared_ptr<CapsuleForce<DIM,DIM> > pCapsuleForce);
+
+    /**
+     * @return the force whose overlap violations are summarised
+     */
+    boost::shared_ptr<CapsuleForce<DIM,DIM> > GetCapsuleForce();
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method. Does nothing, as the force keeps its own counts.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation);
+
+    /**
+     * Overridden SetupSolve() method. Stores the output directory.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param outputDirectory the output directory, relative to where Chaste output is stored
+     */
+    virtual void SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory);
+
+    /**
+     * Overridden UpdateAtEndOfSolve() method. Writes the summary.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation);
+
+    /**
+     * Overridden OutputSimulationModifierParameters() method.
+     * Output any simulation modifier parameters to file.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationModifierParameters(out_stream& rParamsFile);
+};
+
+#include "SerializationExportWrapper.hpp"
+EXPORT_TEMPLATE_CLASS1(CapsuleOverlapSummaryModifier, 2)
+EXPORT_TEMPLATE_CLASS1(CapsuleOverlapSummaryModifier, 3)
+
+#endif /*CAPSULEOVERLAPSUMMARYMODIFIER_HPP_*/
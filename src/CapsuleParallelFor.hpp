@@ -0,0 +1,125 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEPARALLELFOR_HPP_
+#define CAPSULEPARALLELFOR_HPP_
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal fork-join helper for the threaded loops over capsules and capsule pairs.
+ *
+ * The range [0, numItems) is cut into contiguous blocks of whole chunks, one per thread, so that which thread handles
+ * an item depends only on the thread count and never on scheduling. Callers that write each item's result to its own
+ * slot, and combine the slots in a fixed order afterwards, therefore get the same answer for any number of threads.
+ */
+class CapsuleParallelFor
+{
+public:
+
+    /**
+     * Call body(begin, end) on contiguous blocks covering [0, numItems), each block on its own thread. The first block
+     * runs on the calling thread, and the call returns once every block has finished.
+     *
+     * If any block throws, the exception from the block covering the lowest items is rethrown on the calling thread,
+     * which is the same error a serial loop would have hit first.
+     *
+     * @param numItems the number of items
+     * @param numThreads the maximum number of threads to use (including the calling thread)
+     * @param chunkSize block boundaries are multiples of this, so that batched loops see whole batches
+     * @param body callable taking (unsigned begin, unsigned end)
+     */
+    template<class BODY>
+    static void Run(unsigned numItems, unsigned numThreads, unsigned chunkSize, BODY body)
+    {
+        const unsigned num_chunks = (numItems + chunkSize - 1u) / chunkSize;
+        const unsigned num_blocks = std::min(std::max(numThreads, 1u), num_chunks);
+
+        if (num_blocks <= 1u)
+        {
+            if (numItems > 0u)
+            {
+                body(0u, numItems);
+            }
+            return;
+        }
+
+        // Spread the chunks as evenly as possible, earlier blocks taking any remainder
+        std::vector<unsigned> block_starts(num_blocks + 1u);
+        for (unsigned block = 0; block <= num_blocks; block++)
+        {
+            const unsigned first_chunk = block * (num_chunks / num_blocks) + std::min(block, num_chunks % num_blocks);
+            block_starts[block] = std::min(first_chunk * chunkSize, numItems);
+        }
+
+        std::vector<std::exception_ptr> errors(num_blocks);
+        auto run_block = [&](unsigned block)
+        {
+            try
+            {
+                body(block_starts[block], block_starts[block + 1u]);
+            }
+            catch (...)
+            {
+                errors[block] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(num_blocks - 1u);
+        for (unsigned block = 1; block < num_blocks; block++)
+        {
+            threads.emplace_back(run_block, block);
+        }
+        run_block(0u);
+        for (auto& r_thread : threads)
+        {
+            r_thread.join();
+        }
+
+        for (unsigned block = 0; block < num_blocks; block++)
+        {
+            if (errors[block])
+            {
+                std::rethrow_exception(errors[block]);
+            }
+        }
+    }
+};
+
+#endif /*CAPSULEPARALLELFOR_HPP_*/
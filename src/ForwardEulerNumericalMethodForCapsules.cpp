@@ -36,7 +36,11 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ForwardEulerNumericalMethodForCapsules.hpp"
 #include "RandomNumberGenerator.hpp"
 #include "TypeSixSecretionEnumerations.hpp"
+#include "CapsuleOrientation.hpp"
+#include "CapsuleParallelFor.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
 #include "UblasCustomFunctions.hpp"
+#include "Exception.hpp"
 
 #include "UniformCellCycleModel.hpp"
 #include "FixedG1GenerationalCellCycleModel.hpp"
@@ -48,74 +52,372 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "Debug.hpp"
-#include "NodeBasedCellPopulation.hpp"
+#include "SimulationTime.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
 
+namespace
+{
+
+/** Turn a 2D capsule through its applied angle; a 2D capsule has no phi. */
+inline void UpdateOrientation(Node<2>& rNode, double dt, double rotationalMobility)
+{
+	std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+	r_attributes[NA_THETA] += dt * rotationalMobility * r_attributes[NA_APPLIED_THETA];
+}
+
+/** Turn a 3D capsule through its applied angles. */
+inline void UpdateOrientation(Node<3>& rNode, double dt, double rotationalMobility)
+{
+	std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+	r_attributes[NA_THETA] += dt * rotationalMobility * r_attributes[NA_APPLIED_THETA];
+	r_attributes[NA_PHI] += dt * rotationalMobility * r_attributes[NA_APPLIED_PHI];
+}
+
+/** Turn the director of a 2D capsule through its applied angle, keeping theta in step. */
+inline void UpdateDirector(Node<2>& rNode, double dt, double rotationalMobility)
+{
+	std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+
+	c_vector<double, 2> director;
+	CapsuleOrientation::GetAxis(r_attributes, director);
+
+	const double angular_velocity = rotationalMobility * r_attributes[NA_APPLIED_THETA];
+	c_vector<double, 2> new_director;
+	new_director[0] = director[0] - dt * angular_velocity * director[1];
+	new_director[1] = director[1] + dt * angular_velocity * director[0];
+	CapsuleOrientation::SetDirector(r_attributes, new_director);
+}
+
+/** Turn the director of a 3D capsule by its applied torque, keeping theta and phi in step. */
+inline void UpdateDirector(Node<3>& rNode, double dt, double rotationalMobility)
+{
+	std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+
+	c_vector<double, 3> director;
+	CapsuleOrientation::GetAxis(r_attributes, director);
+
+	const c_vector<double, 3> angular_velocity = rotationalMobility * CapsuleOrientation::GetAppliedTorque<3>(r_attributes);
+
+	c_vector<double, 3> new_director = director + dt * VectorProduct(angular_velocity, director);
+	CapsuleOrientation::SetDirector(r_attributes, new_director);
+}
 
+/** @return the magnitude of the applied torque on a 2D capsule */
+inline double CalculateAppliedTorqueMagnitude(Node<2>& rNode)
+{
+	return std::fabs(rNode.rGetNodeAttributes()[NA_APPLIED_THETA]);
+}
+
+/** @return the magnitude of the applied torques on a 3D capsule */
+inline double CalculateAppliedTorqueMagnitude(Node<3>& rNode)
+{
+	const double applied_theta = rNode.rGetNodeAttributes()[NA_APPLIED_THETA];
+	const double applied_phi = rNode.rGetNodeAttributes()[NA_APPLIED_PHI];
+	const double applied_torque_y = rNode.rGetNodeAttributes()[NA_APPLIED_TORQUE_Y];
+	return std::sqrt(applied_theta * applied_theta + applied_phi * applied_phi + applied_torque_y * applied_torque_y);
+}
+
+} // namespace
 
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::ForwardEulerNumericalMethodForCapsules()
-    : AbstractNumericalMethod<ELEMENT_DIM,SPACE_DIM>(),mAxialCapsuleGrowth(true)
+    : AbstractNumericalMethod<ELEMENT_DIM,SPACE_DIM>(),
+      mUseSleeping(false),
+      mSleepForceThreshold(1e-3),
+      mSleepTorqueThreshold(1e-3),
+      mSleepGrowthRateThreshold(1e-3),
+      mNumQuietStepsBeforeSleeping(10u),
+      mNumSleepingCells(0u),
+      mNumCells(0u),
+      mTotalNumSleepingCellSteps(0u),
+      mTotalNumCellSteps(0u),
+      mUseDirectorOrientation(false),
+      mUseAdaptiveTimeStepping(false),
+      mMaxDisplacementPerStep(0.05),
+      mMaxRotationPerStep(0.05),
+      mMaxOverlapChangePerStep(0.02),
+      mMinimumTimeStep(1e-6),
+      mNumSubsteps(0u),
+      mNumMobilityUpdates(0u),
+      mAxialCapsuleGrowth(true),
+      mGrowthLaw(CGL_LINEAR),
+      mInitialCapsuleLength(2.0),
+      mAdderAddedLength(4.0),
+      mGrowthRegistryNumNodeReorderings(0u),
+      mNumGrowthResolutions(0u),
+      mNumThreads(1u)
 {
 }
 
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::UpdateAllNodePositions(double dt)
 {
-
-	NodeBasedCellPopulation<SPACE_DIM>* p_node_population= dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(this->mpCellPopulation);
-
-	for (auto cell_iter = p_node_population->Begin();
-			cell_iter != p_node_population->End();
-			++cell_iter)
+	// The rate of change of length of each capsule, which can keep it awake
+	std::vector<double> growth_rates;
+	UpdateCapsuleLengths(dt, growth_rates);
+	UpdateMobilities();
+
+	mNumSubsteps = 0u;
+	double time_remaining = dt;
+	while (time_remaining > 0.0)
 	{
-		if (dynamic_cast<UniformCellCycleModel*>(cell_iter->GetCellCycleModel()) != nullptr)
+		// Apply forces to each cell, and save a vector of net forces F
+		this->ComputeForcesIncludingDamping();
+
+		double substep = time_remaining;
+		if (mUseAdaptiveTimeStepping)
 		{
-			if (dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(this->mpCellPopulation))
+			substep = CalculateAdaptiveTimeStep();
+
+			// Finish the outer step rather than leave a sliver of it for a substep of its own
+			if (substep >= time_remaining * (1.0 - 1e-3))
 			{
+				substep = time_remaining;
+			}
+			mDtHistory.push_back(substep);
+		}
 
-				double cell_age  = cell_iter->GetAge();//+SimulationTime::Instance()->GetTimeStep();
+		MoveNodes(substep, growth_rates);
+		mNumSubsteps++;
 
-				UniformCellCycleModel* p_model = (static_cast<UniformCellCycleModel*>(cell_iter->GetCellCycleModel()));
+		time_remaining = (substep == time_remaining) ? 0.0 : time_remaining - substep;
+	}
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::UpdateCapsuleLengths(double dt, std::vector<double>& rGrowthRates, double ageOffset)
+{
+	if (!mAxialCapsuleGrowth)
+	{
+		return;
+	}
 
-				const double cell_cycle_time =  p_model->GetCellCycleDuration() ;
+	std::vector<Node<SPACE_DIM>*>& r_nodes = rGatherNodes();
 
-				double initial_length = 2.0;
+	// Reordering the nodes hands each capsule's attributes and cell to another node index, so the registry's entries
+	// no longer match them
+	auto p_capsule_population = dynamic_cast<NodeBasedCellPopulationWithCapsules<SPACE_DIM>*>(this->mpCellPopulation);
+	if (p_capsule_population != nullptr && p_capsule_population->GetNumNodeReorderings() != mGrowthRegistryNumNodeReorderings)
+	{
+		mGrowthRegistry.Clear();
+		mGrowthRegistryNumNodeReorderings = p_capsule_population->GetNumNodeReorderings();
+	}
 
+	// A capsule's growth is resolved once per cell birth; division clears its birth length. Resolving looks up the
+	// cell and may grow the registry, so is done before the threaded loop
+	for (Node<SPACE_DIM>* p_node : r_nodes)
+	{
+		std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+		if (r_attributes.size() < NA_VEC_LENGTH)
+		{
+			r_attributes.resize(NA_VEC_LENGTH);
+		}
+		if (r_attributes[NA_BIRTH_LENGTH] == 0.0 || !mGrowthRegistry.IsResolved(p_node->GetIndex()))
+		{
+			ResolveCapsuleGrowth(*p_node);
+		}
+	}
 
-				Node<SPACE_DIM>* pNodeA = p_node_population->GetNodeCorrespondingToCell(*cell_iter);
+	if (mUseSleeping)
+	{
+		rGrowthRates.assign(mGrowthRegistry.GetSize(), 0.0);
+	}
 
+	// Each capsule is only written to by the thread that owns its index
+	const double time = SimulationTime::Instance()->GetTime() + ageOffset;
+	CapsuleParallelFor::Run(r_nodes.size(), mNumThreads, 1u,
+	                        [&](unsigned begin, unsigned end)
+	                        {
+	                            UpdateCapsuleLengthsInRange(begin, end, dt, time, rGrowthRates);
+	                        });
+}
 
-				double division_length = 2*initial_length + 4*pNodeA->rGetNodeAttributes()[NA_RADIUS];
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::UpdateCapsuleLengthsInRange(unsigned begin,
+                                                                                              unsigned end,
+                                                                                              double dt,
+                                                                                              double time,
+                                                                                              std::vector<double>& rGrowthRates)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		const unsigned index = mNodes[i]->GetIndex();
+		if (!mGrowthRegistry.IsGrowing(index))
+		{
+			continue;
+		}
 
-				double new_length = initial_length + (division_length - initial_length)*cell_age/cell_cycle_time;
-				//double new_length = initial_length*(1.0+cell_age/cell_cycle_time);
+		std::vector<double>& r_attributes = mNodes[i]->rGetNodeAttributes();
+		const double new_length = mGrowthRegistry.CalculateLength(index, time);
+		if (mUseSleeping)
+		{
+			rGrowthRates[index] = std::fabs(new_length - r_attributes[NA_LENGTH]) / dt;
+		}
+		r_attributes[NA_LENGTH] = new_length;
+	}
+}
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::ResolveCapsuleGrowth(Node<SPACE_DIM>& rNode)
+{
+	mNumGrowthResolutions++;
 
+	const unsigned index = rNode.GetIndex();
+	std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+	CellPtr p_cell = this->mpCellPopulation->GetCellUsingLocationIndex(index);
 
-				pNodeA->rGetNodeAttributes()[NA_LENGTH] = new_length;
+	UniformCellCycleModel* p_model = dynamic_cast<UniformCellCycleModel*>(p_cell->GetCellCycleModel());
+	if (p_model == nullptr)
+	{
+		mGrowthRegistry.SetNotGrowing(index);
+		r_attributes[NA_BIRTH_LENGTH] = r_attributes[NA_LENGTH];
+		return;
+	}
 
-			}
+	const double radius = r_attributes[NA_RADIUS];
+	double birth_length = r_attributes[NA_BIRTH_LENGTH];
+	if (birth_length == 0.0)
+	{
+		birth_length = mInitialCapsuleLength;
+		if (mGrowthLaw == CGL_ADDER && r_attributes[NA_MOTHER_LENGTH] > 4.0 * radius)
+		{
+			birth_length = 0.5 * (r_attributes[NA_MOTHER_LENGTH] - 4.0 * radius);
 		}
+		r_attributes[NA_BIRTH_LENGTH] = birth_length;
 	}
 
+	const double division_length = (mGrowthLaw == CGL_ADDER) ? birth_length + mAdderAddedLength
+	                                                          : 2.0 * birth_length + 4.0 * radius;
+
+	mGrowthRegistry.SetCapsule(index, mGrowthLaw, p_cell->GetBirthTime(), birth_length, division_length,
+	                           p_model->GetCellCycleDuration());
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::MoveNodes(double dt, const std::vector<double>& rGrowthRates)
+{
+	std::vector<Node<SPACE_DIM>*>& r_nodes = rGatherNodes();
+
+	// Each capsule is only written to by the thread that owns its index, and each block's counts are summed at its end
+	std::atomic<unsigned> num_sleeping_cells(0u);
+	std::atomic<unsigned long> num_sleeping_cell_steps(0u);
+	CapsuleParallelFor::Run(r_nodes.size(), mNumThreads, 1u,
+	                        [&](unsigned begin, unsigned end)
+	                        {
+	                            unsigned long block_num_sleeping_cell_steps = 0u;
+	                            num_sleeping_cells += MoveNodesInRange(begin, end, dt, rGrowthRates, block_num_sleeping_cell_steps);
+	                            num_sleeping_cell_steps += block_num_sleeping_cell_steps;
+	                        });
+
+	mNumCells = r_nodes.size();
+	mNumSleepingCells = num_sleeping_cells;
+	mTotalNumSleepingCellSteps += num_sleeping_cell_steps;
+	mTotalNumCellSteps += mNumCells;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::MoveNodesInRange(unsigned begin,
+                                                                                       unsigned end,
+                                                                                       double dt,
+                                                                                       const std::vector<double>& rGrowthRates,
+                                                                                       unsigned long& rNumSleepingCellSteps)
+{
+	unsigned num_sleeping_cells = 0u;
+	for (unsigned i = begin; i < end; i++)
+	{
+		Node<SPACE_DIM>& r_node = *mNodes[i];
+		if (mUseSleeping)
+		{
+			std::vector<double>& r_attributes = r_node.rGetNodeAttributes();
+
+			const unsigned index = r_node.GetIndex();
+			const double growth_rate = (index < rGrowthRates.size()) ? rGrowthRates[index] : 0.0;
+
+			// A sleeping capsule is only woken by its own force, torque or growth rate crossing a threshold. This
+			// relies on CapsuleForce dropping a partner's cached sleeping contact once either capsule wakes, so that
+			// contacts with awake neighbours are calculated afresh on every step
+			const bool is_quiet = norm_2(r_node.rGetAppliedForce()) < mSleepForceThreshold
+			                      && CalculateAppliedTorqueMagnitude(r_node) < mSleepTorqueThreshold
+			                      && growth_rate < mSleepGrowthRateThreshold;
 
-	// Apply forces to each cell, and save a vector of net forces F
-	this->ComputeForcesIncludingDamping();
+			r_attributes[NA_NUM_QUIET_STEPS] = is_quiet ? r_attributes[NA_NUM_QUIET_STEPS] + 1.0 : 0.0;
 
+			if (r_attributes[NA_ASLEEP] != 0.0 && is_quiet)
+			{
+				// Sleeping capsules are held still
+				num_sleeping_cells++;
+				rNumSleepingCellSteps++;
+				continue;
+			}
+
+			// A capsule that is not quiet wakes up, and one that has been quiet for long enough falls asleep, from
+			// the next step on
+			r_attributes[NA_ASLEEP] = (r_attributes[NA_NUM_QUIET_STEPS] >= mNumQuietStepsBeforeSleeping) ? 1.0 : 0.0;
+			if (r_attributes[NA_ASLEEP] != 0.0)
+			{
+				num_sleeping_cells++;
+			}
+		}
+
+		const std::vector<double>& r_attributes = r_node.rGetNodeAttributes();
+		r_node.rGetModifiableLocation() += (dt * r_attributes[NA_TRANSLATIONAL_MOBILITY]) * r_node.rGetAppliedForce();
+		if (mUseDirectorOrientation)
+		{
+			UpdateDirector(r_node, dt, r_attributes[NA_ROTATIONAL_MOBILITY]);
+		}
+		else
+		{
+			UpdateOrientation(r_node, dt, r_attributes[NA_ROTATIONAL_MOBILITY]);
+			if (CapsuleOrientation::HasDirector(r_node.rGetNodeAttributes()))
+			{
+				CapsuleOrientation::ClearDirector(r_node.rGetNodeAttributes());
+			}
+		}
+	}
+	return num_sleeping_cells;
+}
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::CalculateAdaptiveTimeStep()
+{
+	double max_speed = 0.0;
+	double max_angular_speed = 0.0;
+	double max_surface_speed = 0.0;
 	for (auto node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
 			node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
 			++node_iter)
 	{
-		double radius = node_iter->rGetNodeAttributes()[NA_RADIUS];
-		double length = node_iter->rGetNodeAttributes()[NA_LENGTH];
+		const double radius = node_iter->rGetNodeAttributes()[NA_RADIUS];
+		const double length = node_iter->rGetNodeAttributes()[NA_LENGTH];
 
-		node_iter->rGetModifiableLocation() += dt * node_iter->rGetAppliedForce() / CalculateMassOfCapsule(length, radius);
-		node_iter->rGetNodeAttributes()[NA_THETA] += dt * node_iter->rGetNodeAttributes()[NA_APPLIED_THETA] / CalculateMomentOfInertiaOfCapsule(length, radius);
-		if (SPACE_DIM==3u)
-		{
-			node_iter->rGetNodeAttributes()[NA_PHI] += dt * node_iter->rGetNodeAttributes()[NA_APPLIED_PHI] / CalculateMomentOfInertiaOfCapsule(length, radius);
-		}
+		const double speed = node_iter->rGetNodeAttributes()[NA_TRANSLATIONAL_MOBILITY] * norm_2(node_iter->rGetAppliedForce());
+		const double angular_speed = node_iter->rGetNodeAttributes()[NA_ROTATIONAL_MOBILITY] * CalculateAppliedTorqueMagnitude(*node_iter);
+
+		// The tips of a capsule move fastest
+		const double surface_speed = speed + angular_speed * (0.5 * length + radius);
+
+		max_speed = std::max(max_speed, speed);
+		max_angular_speed = std::max(max_angular_speed, angular_speed);
+		max_surface_speed = std::max(max_surface_speed, surface_speed);
+	}
+
+	// Two capsules closing on each other change their overlap by at most the sum of their surface displacements
+	double substep = DBL_MAX;
+	if (max_speed > 0.0)
+	{
+		substep = std::min(substep, mMaxDisplacementPerStep / max_speed);
+	}
+	if (max_angular_speed > 0.0)
+	{
+		substep = std::min(substep, mMaxRotationPerStep / max_angular_speed);
+	}
+	if (max_surface_speed > 0.0)
+	{
+		substep = std::min(substep, 0.5 * mMaxOverlapChangePerStep / max_surface_speed);
 	}
+	return std::max(substep, mMinimumTimeStep);
 }
 
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
@@ -124,6 +426,254 @@ void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetAxialCap
 	mAxialCapsuleGrowth = axialCapsuleGrowth;
 }
 
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetAxialCapsuleGrowth()
+{
+	return mAxialCapsuleGrowth;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetGrowthLaw(CapsuleGrowthLawType growthLaw)
+{
+	mGrowthLaw = growthLaw;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+CapsuleGrowthLawType ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetGrowthLaw()
+{
+	return mGrowthLaw;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetInitialCapsuleLength(double initialCapsuleLength)
+{
+	if (initialCapsuleLength <= 0.0)
+	{
+		EXCEPTION("The initial capsule length must be positive.");
+	}
+	mInitialCapsuleLength = initialCapsuleLength;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetInitialCapsuleLength()
+{
+	return mInitialCapsuleLength;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetAdderAddedLength(double adderAddedLength)
+{
+	if (adderAddedLength <= 0.0)
+	{
+		EXCEPTION("The length added under the adder law must be positive.");
+	}
+	mAdderAddedLength = adderAddedLength;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetAdderAddedLength()
+{
+	return mAdderAddedLength;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetNumGrowthResolutions()
+{
+	return mNumGrowthResolutions;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetNumThreads(unsigned numThreads)
+{
+	if (numThreads == 0u)
+	{
+		EXCEPTION("The number of threads must be at least one.");
+	}
+	mNumThreads = numThreads;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetNumThreads()
+{
+	return mNumThreads;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+const CapsuleGrowthRegistry& ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::rGetGrowthRegistry() const
+{
+	return mGrowthRegistry;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetUseSleeping(bool useSleeping)
+{
+	mUseSleeping = useSleeping;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetUseSleeping()
+{
+	return mUseSleeping;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetSleepThresholds(double forceThreshold,
+                                                                                      double torqueThreshold,
+                                                                                      double growthRateThreshold)
+{
+	mSleepForceThreshold = forceThreshold;
+	mSleepTorqueThreshold = torqueThreshold;
+	mSleepGrowthRateThreshold = growthRateThreshold;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetSleepForceThreshold()
+{
+	return mSleepForceThreshold;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetSleepTorqueThreshold()
+{
+	return mSleepTorqueThreshold;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetSleepGrowthRateThreshold()
+{
+	return mSleepGrowthRateThreshold;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetNumQuietStepsBeforeSleeping(unsigned numQuietSteps)
+{
+	if (numQuietSteps == 0u)
+	{
+		EXCEPTION("The number of quiet steps before sleeping must be at least one.");
+	}
+	mNumQuietStepsBeforeSleeping = numQuietSteps;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetNumQuietStepsBeforeSleeping()
+{
+	return mNumQuietStepsBeforeSleeping;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetNumSleepingCells()
+{
+	return mNumSleepingCells;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetFractionOfSleepingCells()
+{
+	return (mNumCells == 0u) ? 0.0 : static_cast<double>(mNumSleepingCells) / mNumCells;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetMeanFractionOfSleepingCells()
+{
+	return (mTotalNumCellSteps == 0u) ? 0.0 : static_cast<double>(mTotalNumSleepingCellSteps) / mTotalNumCellSteps;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetUseDirectorOrientation(bool useDirectorOrientation)
+{
+	mUseDirectorOrientation = useDirectorOrientation;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetUseDirectorOrientation()
+{
+	return mUseDirectorOrientation;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetUseAdaptiveTimeStepping(bool useAdaptiveTimeStepping)
+{
+	mUseAdaptiveTimeStepping = useAdaptiveTimeStepping;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+bool ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetUseAdaptiveTimeStepping()
+{
+	return mUseAdaptiveTimeStepping;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetAdaptiveTimeStepBounds(double maxDisplacement,
+                                                                                             double maxRotation,
+                                                                                             double maxOverlapChange)
+{
+	if (maxDisplacement <= 0.0 || maxRotation <= 0.0 || maxOverlapChange <= 0.0)
+	{
+		EXCEPTION("The adaptive time step bounds must be positive.");
+	}
+	mMaxDisplacementPerStep = maxDisplacement;
+	mMaxRotationPerStep = maxRotation;
+	mMaxOverlapChangePerStep = maxOverlapChange;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetMaxDisplacementPerStep()
+{
+	return mMaxDisplacementPerStep;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetMaxRotationPerStep()
+{
+	return mMaxRotationPerStep;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetMaxOverlapChangePerStep()
+{
+	return mMaxOverlapChangePerStep;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::SetMinimumTimeStep(double minimumTimeStep)
+{
+	if (minimumTimeStep <= 0.0)
+	{
+		EXCEPTION("The minimum time step must be positive.");
+	}
+	mMinimumTimeStep = minimumTimeStep;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetMinimumTimeStep()
+{
+	return mMinimumTimeStep;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+const std::vector<double>& ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::rGetDtHistory() const
+{
+	return mDtHistory;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::ClearDtHistory()
+{
+	mDtHistory.clear();
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetNumSubsteps()
+{
+	return mNumSubsteps;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::GetNumMobilityUpdates()
+{
+	return mNumMobilityUpdates;
+}
+
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::CalculateMassOfCapsule(const double length, const double radius)
 {
@@ -143,21 +693,90 @@ double ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::Calculate
     return M_PI * r * r * (l * (f1_12 * l * l + 0.25 * r * r) + f4_3 * r * (0.4 * r * r + 0.25 * l * l + f3_8 * l * r));
 }
 
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::UpdateMobilities()
+{
+    std::vector<Node<SPACE_DIM>*>& r_nodes = rGatherNodes();
+
+    // Each capsule is only written to by the thread that owns its index
+    std::atomic<unsigned long> num_mobility_updates(0u);
+    CapsuleParallelFor::Run(r_nodes.size(), mNumThreads, 1u,
+                            [&](unsigned begin, unsigned end)
+                            {
+                                num_mobility_updates += UpdateMobilitiesInRange(begin, end);
+                            });
+    mNumMobilityUpdates += num_mobility_updates;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::UpdateMobilitiesInRange(unsigned begin, unsigned end)
+{
+    unsigned num_mobility_updates = 0u;
+    for (unsigned i = begin; i < end; i++)
+    {
+        std::vector<double>& r_attributes = mNodes[i]->rGetNodeAttributes();
+        if (r_attributes.size() < NA_VEC_LENGTH)
+        {
+            r_attributes.resize(NA_VEC_LENGTH);
+        }
+
+        const double length = r_attributes[NA_LENGTH];
+        const double radius = r_attributes[NA_RADIUS];
+        if (r_attributes[NA_TRANSLATIONAL_MOBILITY] == 0.0
+            || r_attributes[NA_MOBILITY_LENGTH] != length
+            || r_attributes[NA_MOBILITY_RADIUS] != radius)
+        {
+            r_attributes[NA_TRANSLATIONAL_MOBILITY] = 1.0 / CalculateMassOfCapsule(length, radius);
+            r_attributes[NA_ROTATIONAL_MOBILITY] = 1.0 / CalculateMomentOfInertiaOfCapsule(length, radius);
+            r_attributes[NA_MOBILITY_LENGTH] = length;
+            r_attributes[NA_MOBILITY_RADIUS] = radius;
+            num_mobility_updates++;
+        }
+    }
+    return num_mobility_updates;
+}
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+std::vector<Node<SPACE_DIM>*>& ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::rGatherNodes()
+{
+    mNodes.clear();
+    for (auto node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+         node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        mNodes.push_back(&(*node_iter));
+    }
+    return mNodes;
+}
+
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
 void ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::OutputNumericalMethodParameters(out_stream& rParamsFile)
 {
-    // No new parameters to output, so just call method on direct parent class
+    *rParamsFile << "\t\t\t<UseSleeping>" << mUseSleeping << "</UseSleeping>\n";
+    *rParamsFile << "\t\t\t<SleepForceThreshold>" << mSleepForceThreshold << "</SleepForceThreshold>\n";
+    *rParamsFile << "\t\t\t<SleepTorqueThreshold>" << mSleepTorqueThreshold << "</SleepTorqueThreshold>\n";
+    *rParamsFile << "\t\t\t<SleepGrowthRateThreshold>" << mSleepGrowthRateThreshold << "</SleepGrowthRateThreshold>\n";
+    *rParamsFile << "\t\t\t<NumQuietStepsBeforeSleeping>" << mNumQuietStepsBeforeSleeping << "</NumQuietStepsBeforeSleeping>\n";
+    *rParamsFile << "\t\t\t<UseDirectorOrientation>" << mUseDirectorOrientation << "</UseDirectorOrientation>\n";
+    *rParamsFile << "\t\t\t<UseAdaptiveTimeStepping>" << mUseAdaptiveTimeStepping << "</UseAdaptiveTimeStepping>\n";
+    *rParamsFile << "\t\t\t<MaxDisplacementPerStep>" << mMaxDisplacementPerStep << "</MaxDisplacementPerStep>\n";
+    *rParamsFile << "\t\t\t<MaxRotationPerStep>" << mMaxRotationPerStep << "</MaxRotationPerStep>\n";
+    *rParamsFile << "\t\t\t<MaxOverlapChangePerStep>" << mMaxOverlapChangePerStep << "</MaxOverlapChangePerStep>\n";
+    *rParamsFile << "\t\t\t<MinimumTimeStep>" << mMinimumTimeStep << "</MinimumTimeStep>\n";
+    *rParamsFile << "\t\t\t<AxialCapsuleGrowth>" << mAxialCapsuleGrowth << "</AxialCapsuleGrowth>\n";
+    *rParamsFile << "\t\t\t<GrowthLaw>" << mGrowthLaw << "</GrowthLaw>\n";
+    *rParamsFile << "\t\t\t<InitialCapsuleLength>" << mInitialCapsuleLength << "</InitialCapsuleLength>\n";
+    *rParamsFile << "\t\t\t<AdderAddedLength>" << mAdderAddedLength << "</AdderAddedLength>\n";
+    *rParamsFile << "\t\t\t<NumThreads>" << mNumThreads << "</NumThreads>\n";
+
+    // Call method on direct parent class
     AbstractNumericalMethod<ELEMENT_DIM,SPACE_DIM>::OutputNumericalMethodParameters(rParamsFile);
 }
 
 // Explicit instantiation
-template class ForwardEulerNumericalMethodForCapsules<1,1>;
-template class ForwardEulerNumericalMethodForCapsules<1,2>;
 template class ForwardEulerNumericalMethodForCapsules<2,2>;
-template class ForwardEulerNumericalMethodForCapsules<1,3>;
-template class ForwardEulerNumericalMethodForCapsules<2,3>;
 template class ForwardEulerNumericalMethodForCapsules<3,3>;
 
 // Serialization for Boost >= 1.36
 #include "SerializationExportWrapperForCpp.hpp"
-EXPORT_TEMPLATE_CLASS_ALL_DIMS(ForwardEulerNumericalMethodForCapsules)
+EXPORT_TEMPLATE_CLASS2(ForwardEulerNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(ForwardEulerNumericalMethodForCapsules, 3, 3)
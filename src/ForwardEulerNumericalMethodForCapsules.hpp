@@ -39,7 +39,11 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ChasteSerialization.hpp"
 #include <boost/serialization/base_object.hpp>
 
+#include <vector>
+
 #include "AbstractNumericalMethod.hpp"
+#include "CapsuleGrowthRegistry.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
 
 /**
  * Implements forward Euler time stepping specific for Capsules,
@@ -47,6 +51,9 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 template<unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
 class ForwardEulerNumericalMethodForCapsules : public AbstractNumericalMethod<ELEMENT_DIM,SPACE_DIM> {
+    static_assert((ELEMENT_DIM == 2u && SPACE_DIM == 2u) || (ELEMENT_DIM == 3u && SPACE_DIM == 3u),
+                  "ForwardEulerNumericalMethodForCapsules is only defined for 2D capsules in 2D or 3D capsules in 3D");
+
 
 private:
 
@@ -64,8 +71,206 @@ private:
     void serialize(Archive & archive, const unsigned int version)
     {
         archive & boost::serialization::base_object<AbstractNumericalMethod<ELEMENT_DIM,SPACE_DIM> >(*this);
+        archive & mUseSleeping;
+        archive & mSleepForceThreshold;
+        archive & mSleepTorqueThreshold;
+        archive & mSleepGrowthRateThreshold;
+        archive & mNumQuietStepsBeforeSleeping;
+        archive & mUseDirectorOrientation;
+        archive & mUseAdaptiveTimeStepping;
+        archive & mMaxDisplacementPerStep;
+        archive & mMaxRotationPerStep;
+        archive & mMaxOverlapChangePerStep;
+        archive & mMinimumTimeStep;
+        archive & mAxialCapsuleGrowth;
+        archive & mGrowthLaw;
+        archive & mInitialCapsuleLength;
+        archive & mAdderAddedLength;
+        archive & mNumThreads;
     }
 
+    /** Whether quiet capsules are put to sleep and held still. Defaults to false. */
+    bool mUseSleeping;
+
+    /** The net force below which a capsule is quiet. Defaults to 1e-3. */
+    double mSleepForceThreshold;
+
+    /** The applied torque below which a capsule is quiet. Defaults to 1e-3. */
+    double mSleepTorqueThreshold;
+
+    /** The rate of change of length below which a capsule is quiet. Defaults to 1e-3. */
+    double mSleepGrowthRateThreshold;
+
+    /** The number of consecutive quiet steps after which a capsule falls asleep. Defaults to 10. */
+    unsigned mNumQuietStepsBeforeSleeping;
+
+    /** The number of capsules asleep after the last call to UpdateAllNodePositions(). */
+    unsigned mNumSleepingCells;
+
+    /** The number of capsules updated by the last call to UpdateAllNodePositions(). */
+    unsigned mNumCells;
+
+    /** The number of capsule updates skipped because the capsule was asleep, over every call to UpdateAllNodePositions(). */
+    unsigned long mTotalNumSleepingCellSteps;
+
+    /** The sum of mNumCells over every call to UpdateAllNodePositions(). */
+    unsigned long mTotalNumCellSteps;
+
+    /** Whether each capsule's orientation is held and integrated as a unit director. Defaults to false. */
+    bool mUseDirectorOrientation;
+
+    /** Whether each call to UpdateAllNodePositions() is split into adaptively sized substeps. Defaults to false. */
+    bool mUseAdaptiveTimeStepping;
+
+    /** The largest distance a capsule centre may move in one substep. Defaults to 0.05. */
+    double mMaxDisplacementPerStep;
+
+    /** The largest angle, in radians, a capsule may turn through in one substep. Defaults to 0.05. */
+    double mMaxRotationPerStep;
+
+    /** The largest change in the overlap of any two capsules in one substep. Defaults to 0.02. */
+    double mMaxOverlapChangePerStep;
+
+    /** The smallest substep, whatever the bounds say. Defaults to 1e-6. */
+    double mMinimumTimeStep;
+
+    /** The size of every substep taken with adaptive time stepping, in order. */
+    std::vector<double> mDtHistory;
+
+    /** The number of substeps taken by the last call to UpdateAllNodePositions(). */
+    unsigned mNumSubsteps;
+
+    /** The number of times a capsule's mobilities have been recomputed, over every call to UpdateMobilities(). */
+    unsigned long mNumMobilityUpdates;
+
+    /** Whether capsules grow along their axes as their cells age. Defaults to true. */
+    bool mAxialCapsuleGrowth;
+
+    /** The law by which capsules grow. Defaults to CGL_LINEAR. */
+    CapsuleGrowthLawType mGrowthLaw;
+
+    /** The birth length of a capsule whose birth length is not otherwise known. Defaults to 2.0. */
+    double mInitialCapsuleLength;
+
+    /** The length a capsule adds over its cell cycle under the adder law. Defaults to 4.0. */
+    double mAdderAddedLength;
+
+    /**
+     * The growth law and parameters of each capsule, by node index, resolved once per cell birth. This is not
+     * archived; it is rebuilt from the cells and the NA_BIRTH_LENGTH node attributes on the first step after a load.
+     */
+    CapsuleGrowthRegistry mGrowthRegistry;
+
+    /**
+     * The number of times a NodeBasedCellPopulationWithCapsules had reordered its nodes when mGrowthRegistry was last
+     * checked; reordering moves capsules to other node indices, so every entry is then resolved again.
+     */
+    unsigned mGrowthRegistryNumNodeReorderings;
+
+    /** The number of times a capsule's growth has been resolved, over every call to UpdateCapsuleLengths(). */
+    unsigned long mNumGrowthResolutions;
+
+    /** The number of threads used by the loops over capsules. Defaults to 1. */
+    unsigned mNumThreads;
+
+    /** The nodes of the population, gathered by rGatherNodes() so that the threaded loops can split them by position. */
+    std::vector<Node<SPACE_DIM>*> mNodes;
+
+    /**
+     * Resolve a capsule's growth law and parameters from its cell's cycle model and its node attributes, and store
+     * them in mGrowthRegistry. A capsule grows only if its cell has a UniformCellCycleModel, over that model's cell
+     * cycle duration. Its birth length is its NA_BIRTH_LENGTH node attribute if that is set, and is otherwise
+     * mInitialCapsuleLength or, under the adder law for a capsule born by division, its share of its mother's length
+     * (half of the mother's length less four radii); NA_BIRTH_LENGTH is then set to it.
+     *
+     * @param rNode the node at the centre of mass of the capsule
+     */
+    void ResolveCapsuleGrowth(Node<SPACE_DIM>& rNode);
+
+    /**
+     * Move and turn the capsules in one block of mNodes, as MoveNodes().
+     *
+     * @param begin the position in mNodes of the first capsule
+     * @param end one past the position in mNodes of the last capsule
+     * @param dt the (sub)step size
+     * @param rGrowthRates the rate of change of length of each growing capsule, by node index
+     * @param rNumSleepingCellSteps incremented for each capsule that is held still because it is asleep
+     * @return the number of capsules in the block that are asleep after the (sub)step
+     */
+    unsigned MoveNodesInRange(unsigned begin,
+                              unsigned end,
+                              double dt,
+                              const std::vector<double>& rGrowthRates,
+                              unsigned long& rNumSleepingCellSteps);
+
+    /**
+     * Set the lengths of the growing capsules in one block of mNodes, whose growth has been resolved.
+     *
+     * @param begin the position in mNodes of the first capsule
+     * @param end one past the position in mNodes of the last capsule
+     * @param dt the time step, over which the growth rates are measured
+     * @param time the time at which to set the lengths
+     * @param rGrowthRates filled in with the rate of change of length of each growing capsule, by node index, if
+     *     mUseSleeping is set
+     */
+    void UpdateCapsuleLengthsInRange(unsigned begin, unsigned end, double dt, double time, std::vector<double>& rGrowthRates);
+
+    /**
+     * Cache the mobilities of the capsules in one block of mNodes, as UpdateMobilities().
+     *
+     * @param begin the position in mNodes of the first capsule
+     * @param end one past the position in mNodes of the last capsule
+     * @return the number of capsules whose mobilities were recomputed
+     */
+    unsigned UpdateMobilitiesInRange(unsigned begin, unsigned end);
+
+    /**
+     * @return the largest substep for which no capsule moves, turns or changes its overlaps by more than the
+     *     adaptive time step bounds, under the forces and torques currently applied, but no less than
+     *     mMinimumTimeStep
+     */
+    double CalculateAdaptiveTimeStep();
+
+protected:
+
+    /**
+     * Move and turn each capsule by its applied force and torque over one (sub)step, putting quiet capsules to
+     * sleep if mUseSleeping is set. The capsules are split over mNumThreads threads.
+     *
+     * @param dt the (sub)step size
+     * @param rGrowthRates the rate of change of length of each growing capsule, by node index (empty unless
+     *     mUseSleeping is set)
+     */
+    void MoveNodes(double dt, const std::vector<double>& rGrowthRates);
+
+    /**
+     * Set the length of each growing capsule from the age of its cell, under its growth law, in one loop over the
+     * nodes, split over mNumThreads threads. A capsule's growth is resolved on the first step after its cell is
+     * born, or after the registry first sees it, and the lengths are left alone if axial capsule growth is turned off.
+     *
+     * @param dt the time step, over which the growth rates are measured
+     * @param rGrowthRates filled in with the rate of change of length of each capsule, by node index (zero for a
+     *     capsule that does not grow), if mUseSleeping is set
+     * @param ageOffset added to the age of each cell, to set the lengths at a time other than the end of the step
+     *     (defaults to 0.0)
+     */
+    void UpdateCapsuleLengths(double dt, std::vector<double>& rGrowthRates, double ageOffset=0.0);
+
+    /**
+     * Cache each capsule's translational and rotational mobilities, the reciprocals of its mass and moment of inertia,
+     * in its node attributes, recomputing them only for capsules whose length or radius has changed since they were
+     * last cached. This is called whenever the lengths may have changed, so that moving the capsules needs only
+     * multiplications. The capsules are split over mNumThreads threads.
+     */
+    void UpdateMobilities();
+
+    /**
+     * Gather the nodes of the population into mNodes, in the order of the mesh's node iterator.
+     *
+     * @return mNodes
+     */
+    std::vector<Node<SPACE_DIM>*>& rGatherNodes();
+
     /**
      * Calculate the 3D mass per unit volume of a 2D capsule (a cylinder capped by two hemispheres).
      * @param length the length of the cylinder
@@ -108,13 +313,254 @@ public:
      */
     virtual void OutputNumericalMethodParameters(out_stream& rParamsFile);
 
-    bool mAxialCapsuleGrowth;
+    /**
+     * Set whether capsules grow along their axes as their cells age. When this is not set, every capsule keeps the
+     * length it has.
+     *
+     * @param axialCapsuleGrowth whether capsules grow
+     */
+    void SetAxialCapsuleGrowth(bool axialCapsuleGrowth);
+
+    /**
+     * @return whether capsules grow along their axes as their cells age
+     */
+    bool GetAxialCapsuleGrowth();
+
+    /**
+     * Set the law by which capsules grow from their birth length to their division length over their cell cycle
+     * (see CapsuleGrowthLawType). This applies to capsules whose growth is resolved after the call, so it should be
+     * set before the simulation runs.
+     *
+     * @param growthLaw the growth law
+     */
+    void SetGrowthLaw(CapsuleGrowthLawType growthLaw);
+
+    /**
+     * @return the law by which capsules grow
+     */
+    CapsuleGrowthLawType GetGrowthLaw();
+
+    /**
+     * Set the birth length of a capsule whose birth length is not otherwise known: every capsule under the linear
+     * and exponential laws, and the first generation under the adder law.
+     *
+     * @param initialCapsuleLength the birth length (positive)
+     */
+    void SetInitialCapsuleLength(double initialCapsuleLength);
+
+    /**
+     * @return the birth length of a capsule whose birth length is not otherwise known
+     */
+    double GetInitialCapsuleLength();
+
+    /**
+     * Set the length a capsule adds over its cell cycle under the adder law. Since each daughter starts from half
+     * its mother's length less four radii, birth lengths tend to this length less four radii over the generations.
+     *
+     * @param adderAddedLength the added length (positive)
+     */
+    void SetAdderAddedLength(double adderAddedLength);
+
+    /**
+     * @return the length a capsule adds over its cell cycle under the adder law
+     */
+    double GetAdderAddedLength();
 
-    void SetAxialCapsuleGrowth(bool);
+    /**
+     * @return the number of times a capsule's growth has been resolved, over every call to UpdateAllNodePositions()
+     */
+    unsigned long GetNumGrowthResolutions();
+
+    /**
+     * Set the number of threads used by the loops over capsules that grow them, cache their mobilities and move
+     * them. Each thread handles a fixed, contiguous block of nodes and writes only to its own capsules, so the
+     * results are bitwise identical for any number of threads. The force calculation has its own thread count (see
+     * CapsuleForce::SetNumThreads()).
+     *
+     * @param numThreads the number of threads (at least one)
+     */
+    void SetNumThreads(unsigned numThreads);
+
+    /**
+     * @return the number of threads used by the loops over capsules
+     */
+    unsigned GetNumThreads();
+
+    /**
+     * @return the growth law and parameters of each capsule, by node index
+     */
+    const CapsuleGrowthRegistry& rGetGrowthRegistry() const;
+
+    /**
+     * Set whether to put quiet capsules to sleep. A capsule is quiet in a step if its net force, applied torque and
+     * rate of growth are all below their thresholds, and falls asleep after mNumQuietStepsBeforeSleeping quiet steps
+     * in a row. A sleeping capsule is not moved or turned, and a CapsuleForce with SetUseSleeping(true) reuses the
+     * contacts between two sleeping capsules rather than recalculating them. It wakes as soon as a step is not quiet,
+     * when it or a neighbour moves further than the force's wake distance, when it divides, or when a neighbour dies.
+     *
+     * Holding a quiet capsule still moves it by at most dt * (force threshold) / mass per step, and turns it by at
+     * most dt * (torque threshold) / (moment of inertia), compared with a step that was not skipped.
+     *
+     * @param useSleeping whether to put quiet capsules to sleep
+     */
+    void SetUseSleeping(bool useSleeping);
+
+    /**
+     * @return whether quiet capsules are put to sleep
+     */
+    bool GetUseSleeping();
+
+    /**
+     * Set the net force, applied torque and rate of change of length below which a capsule is quiet.
+     *
+     * @param forceThreshold the force threshold
+     * @param torqueThreshold the torque threshold
+     * @param growthRateThreshold the growth rate threshold
+     */
+    void SetSleepThresholds(double forceThreshold, double torqueThreshold, double growthRateThreshold);
+
+    /**
+     * @return the net force below which a capsule is quiet
+     */
+    double GetSleepForceThreshold();
+
+    /**
+     * @return the applied torque below which a capsule is quiet
+     */
+    double GetSleepTorqueThreshold();
+
+    /**
+     * @return the rate of change of length below which a capsule is quiet
+     */
+    double GetSleepGrowthRateThreshold();
+
+    /**
+     * Set the number of consecutive quiet steps after which a capsule falls asleep.
+     *
+     * @param numQuietSteps the number of steps (at least one)
+     */
+    void SetNumQuietStepsBeforeSleeping(unsigned numQuietSteps);
+
+    /**
+     * @return the number of consecutive quiet steps after which a capsule falls asleep
+     */
+    unsigned GetNumQuietStepsBeforeSleeping();
+
+    /**
+     * @return the number of capsules asleep after the last call to UpdateAllNodePositions()
+     */
+    unsigned GetNumSleepingCells();
+
+    /**
+     * @return the fraction of capsules asleep after the last call to UpdateAllNodePositions()
+     */
+    double GetFractionOfSleepingCells();
+
+    /**
+     * @return the fraction of capsule updates, over every call to UpdateAllNodePositions(), that were skipped
+     *     because the capsule was asleep
+     */
+    double GetMeanFractionOfSleepingCells();
+
+    /**
+     * Set whether to hold each capsule's orientation as a unit director in its NA_DIRECTOR_X, NA_DIRECTOR_Y and
+     * NA_DIRECTOR_Z node attributes, rather than as its angles. A capsule without a director is given one along its
+     * angles on its first step. The director is turned by the full applied torque, dd/dt = (torque x d) / (moment
+     * of inertia), and renormalised, so in 3D there is no singularity at phi = 0 and a capsule standing along the z
+     * axis stays stable. The angles are kept in step with the director, for output and for code that reads them.
+     *
+     * When this is not set, the angles are integrated and any director is cleared, so that the angles are used.
+     *
+     * @param useDirectorOrientation whether to integrate a director
+     */
+    void SetUseDirectorOrientation(bool useDirectorOrientation);
+
+    /**
+     * @return whether each capsule's orientation is held and integrated as a unit director
+     */
+    bool GetUseDirectorOrientation();
+
+    /**
+     * Set whether to split each call to UpdateAllNodePositions() into substeps, recalculating the forces for each,
+     * so that the simulation's time step (which SimulationTime keeps fixed) can be much larger than the step that
+     * keeps the capsules stable just after a division. Each substep is the largest for which no capsule centre moves
+     * further than the maximum displacement, no capsule turns through more than the maximum rotation, and no point
+     * on a capsule's surface moves more than half the maximum overlap change (so no overlap changes by more than it),
+     * under the forces at the start of the substep. Growth is still applied once per call.
+     *
+     * Neighbours are still found once per simulation time step, so the cut-off length must allow for how far
+     * capsules move in a whole step, as it must without substeps.
+     *
+     * @param useAdaptiveTimeStepping whether to take adaptive substeps
+     */
+    void SetUseAdaptiveTimeStepping(bool useAdaptiveTimeStepping);
+
+    /**
+     * @return whether each call to UpdateAllNodePositions() is split into adaptive substeps
+     */
+    bool GetUseAdaptiveTimeStepping();
+
+    /**
+     * Set the bounds that pick the size of each adaptive substep.
+     *
+     * @param maxDisplacement the largest distance a capsule centre may move in one substep
+     * @param maxRotation the largest angle, in radians, a capsule may turn through in one substep
+     * @param maxOverlapChange the largest change in the overlap of any two capsules in one substep
+     */
+    void SetAdaptiveTimeStepBounds(double maxDisplacement, double maxRotation, double maxOverlapChange);
+
+    /**
+     * @return the largest distance a capsule centre may move in one adaptive substep
+     */
+    double GetMaxDisplacementPerStep();
+
+    /**
+     * @return the largest angle a capsule may turn through in one adaptive substep
+     */
+    double GetMaxRotationPerStep();
+
+    /**
+     * @return the largest change in the overlap of any two capsules in one adaptive substep
+     */
+    double GetMaxOverlapChangePerStep();
+
+    /**
+     * Set the smallest adaptive substep, which is taken whatever the bounds say so that a run always finishes.
+     *
+     * @param minimumTimeStep the smallest substep
+     */
+    void SetMinimumTimeStep(double minimumTimeStep);
+
+    /**
+     * @return the smallest adaptive substep
+     */
+    double GetMinimumTimeStep();
+
+    /**
+     * @return the size of every substep taken with adaptive time stepping since the history was last cleared, in order
+     */
+    const std::vector<double>& rGetDtHistory() const;
+
+    /**
+     * Forget the substeps taken so far.
+     */
+    void ClearDtHistory();
+
+    /**
+     * @return the number of substeps taken by the last call to UpdateAllNodePositions()
+     */
+    unsigned GetNumSubsteps();
+
+    /**
+     * @return the number of times a capsule's mobilities have been recomputed, over every call to
+     *     UpdateAllNodePositions()
+     */
+    unsigned long GetNumMobilityUpdates();
 };
 
 // Serialization for Boost >= 1.36
 #include "SerializationExportWrapper.hpp"
-EXPORT_TEMPLATE_CLASS_ALL_DIMS(ForwardEulerNumericalMethodForCapsules)
+EXPORT_TEMPLATE_CLASS2(ForwardEulerNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(ForwardEulerNumericalMethodForCapsules, 3, 3)
 
 #endif /*FORWARDEULERNUMERICALMETHODFORCAPSULES_HPP_*/
@@ -0,0 +1,289 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "MultirateNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleParallelFor.hpp"
+#include "Exception.hpp"
+
+#include <atomic>
+#include <cmath>
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::MultirateNumericalMethodForCapsules()
+    : ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>(),
+      mNumRateClasses(4u),
+      mMaxDisplacementPerUpdate(0.01),
+      mNumSteps(0u),
+      mNumActiveCapsules(0u),
+      mNumCapsuleUpdates(0u),
+      mNumCapsuleSteps(0u)
+{
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::UpdateAllNodePositions(double dt)
+{
+    if (this->GetUseSleeping() || this->GetUseAdaptiveTimeStepping())
+    {
+        EXCEPTION("MultirateNumericalMethodForCapsules does not support sleeping or adaptive time stepping");
+    }
+
+    // Every force must weight its pairs by the rates of their capsules
+    std::vector<boost::shared_ptr<CapsuleForce<ELEMENT_DIM,SPACE_DIM> > > capsule_forces;
+    for (auto& rp_force : *(this->mpForceCollection))
+    {
+        auto p_capsule_force = boost::dynamic_pointer_cast<CapsuleForce<ELEMENT_DIM,SPACE_DIM> >(rp_force);
+        if (!p_capsule_force)
+        {
+            EXCEPTION("MultirateNumericalMethodForCapsules only supports CapsuleForces in the force collection");
+        }
+        capsule_forces.push_back(p_capsule_force);
+    }
+
+    std::vector<double> growth_rates;
+    this->UpdateCapsuleLengths(dt, growth_rates);
+    this->UpdateMobilities();
+
+    std::vector<Node<SPACE_DIM>*>& r_nodes = this->rGatherNodes();
+    unsigned num_indices = 0u;
+    for (Node<SPACE_DIM>* p_node : r_nodes)
+    {
+        if (p_node->rGetNodeAttributes().size() < NA_VEC_LENGTH)
+        {
+            p_node->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+        }
+        num_indices = std::max(num_indices, p_node->GetIndex() + 1u);
+    }
+
+    // Count a step for every capsule, and pick out those whose class moves on it
+    mNumSteps++;
+    mContactWeights.assign(num_indices, 0.0);
+    mIsActive.assign(num_indices, 0);
+    std::atomic<unsigned> num_active(0u);
+    CapsuleParallelFor::Run(r_nodes.size(), this->GetNumThreads(), 1u,
+                            [&](unsigned begin, unsigned end)
+                            {
+                                num_active += MarkActiveCapsulesInRange(r_nodes, begin, end);
+                            });
+
+    for (auto& rp_capsule_force : capsule_forces)
+    {
+        rp_capsule_force->SetNodeContactWeights(mContactWeights, mIsActive);
+    }
+    this->ComputeForcesIncludingDamping();
+    for (auto& rp_capsule_force : capsule_forces)
+    {
+        rp_capsule_force->ClearNodeContactWeights();
+    }
+
+    // Each capsule is only written to by the thread that owns its index
+    CapsuleParallelFor::Run(r_nodes.size(), this->GetNumThreads(), 1u,
+                            [&](unsigned begin, unsigned end)
+                            {
+                                AccumulateForcesInRange(r_nodes, begin, end, dt);
+                            });
+
+    // The held capsules have no applied force or torque, so stay where they are
+    this->MoveNodes(dt, growth_rates);
+
+    mNumActiveCapsules = num_active;
+    mNumCapsuleUpdates += mNumActiveCapsules;
+    mNumCapsuleSteps += r_nodes.size();
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::MarkActiveCapsulesInRange(std::vector<Node<SPACE_DIM>*>& rNodes,
+                                                                                            unsigned begin,
+                                                                                            unsigned end)
+{
+    unsigned num_active = 0u;
+    for (unsigned i = begin; i < end; i++)
+    {
+        std::vector<double>& r_attributes = rNodes[i]->rGetNodeAttributes();
+        const unsigned index = rNodes[i]->GetIndex();
+
+        const double num_steps_since_update = r_attributes[NA_STEPS_SINCE_UPDATE] + 1.0;
+        r_attributes[NA_STEPS_SINCE_UPDATE] = num_steps_since_update;
+
+        const unsigned rate_class = std::min(static_cast<unsigned>(r_attributes[NA_RATE_CLASS]), mNumRateClasses - 1u);
+        mContactWeights[index] = num_steps_since_update;
+        mIsActive[index] = (num_steps_since_update >= static_cast<double>(1u << rate_class));
+        if (mIsActive[index])
+        {
+            num_active++;
+        }
+    }
+    return num_active;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::AccumulateForcesInRange(std::vector<Node<SPACE_DIM>*>& rNodes,
+                                                                                      unsigned begin,
+                                                                                      unsigned end,
+                                                                                      double dt)
+{
+    for (unsigned i = begin; i < end; i++)
+    {
+        Node<SPACE_DIM>& r_node = *rNodes[i];
+        std::vector<double>& r_attributes = r_node.rGetNodeAttributes();
+
+        c_vector<double, SPACE_DIM> accumulated_force;
+        for (unsigned dim = 0; dim < SPACE_DIM; dim++)
+        {
+            r_attributes[NA_ACCUMULATED_FORCE_X + dim] += r_node.rGetAppliedForce()[dim];
+            accumulated_force[dim] = r_attributes[NA_ACCUMULATED_FORCE_X + dim];
+        }
+        r_attributes[NA_ACCUMULATED_THETA] += r_attributes[NA_APPLIED_THETA];
+        r_attributes[NA_ACCUMULATED_PHI] += r_attributes[NA_APPLIED_PHI];
+        r_attributes[NA_ACCUMULATED_TORQUE_Y] += r_attributes[NA_APPLIED_TORQUE_Y];
+
+        // How far the capsule's tips would move if it moved now
+        const double accumulated_torque = std::sqrt(r_attributes[NA_ACCUMULATED_THETA] * r_attributes[NA_ACCUMULATED_THETA]
+                                                    + r_attributes[NA_ACCUMULATED_PHI] * r_attributes[NA_ACCUMULATED_PHI]
+                                                    + r_attributes[NA_ACCUMULATED_TORQUE_Y] * r_attributes[NA_ACCUMULATED_TORQUE_Y]);
+        const double tip_distance = 0.5 * r_attributes[NA_LENGTH] + r_attributes[NA_RADIUS];
+        const double tip_displacement = dt * (r_attributes[NA_TRANSLATIONAL_MOBILITY] * norm_2(accumulated_force)
+                                              + r_attributes[NA_ROTATIONAL_MOBILITY] * accumulated_torque * tip_distance);
+
+        r_node.ClearAppliedForce();
+        if (mIsActive[r_node.GetIndex()])
+        {
+            r_node.AddAppliedForceContribution(accumulated_force);
+            r_attributes[NA_APPLIED_THETA] = r_attributes[NA_ACCUMULATED_THETA];
+            r_attributes[NA_APPLIED_PHI] = r_attributes[NA_ACCUMULATED_PHI];
+            r_attributes[NA_APPLIED_TORQUE_Y] = r_attributes[NA_ACCUMULATED_TORQUE_Y];
+
+            // The slowest class whose step keeps the tips within the maximum displacement at their average speed
+            // since the capsule last moved, and whose steps line up with this one
+            const double tip_speed = tip_displacement / (dt * r_attributes[NA_STEPS_SINCE_UPDATE]);
+            unsigned rate_class = 0u;
+            while (rate_class + 1u < mNumRateClasses
+                   && mNumSteps % (1ul << (rate_class + 1u)) == 0u
+                   && static_cast<double>(1u << (rate_class + 1u)) * dt * tip_speed <= mMaxDisplacementPerUpdate)
+            {
+                rate_class++;
+            }
+            r_attributes[NA_RATE_CLASS] = rate_class;
+
+            r_attributes[NA_STEPS_SINCE_UPDATE] = 0.0;
+            for (unsigned attribute = NA_ACCUMULATED_FORCE_X; attribute <= NA_ACCUMULATED_TORQUE_Y; attribute++)
+            {
+                r_attributes[attribute] = 0.0;
+            }
+        }
+        else
+        {
+            r_attributes[NA_APPLIED_THETA] = 0.0;
+            r_attributes[NA_APPLIED_PHI] = 0.0;
+            r_attributes[NA_APPLIED_TORQUE_Y] = 0.0;
+
+            // A held capsule pushed hard enough since it last moved moves on the next step
+            if (tip_displacement > mMaxDisplacementPerUpdate)
+            {
+                r_attributes[NA_RATE_CLASS] = 0.0;
+            }
+        }
+    }
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::OutputNumericalMethodParameters(out_stream& rParamsFile)
+{
+    *rParamsFile << "\t\t\t<NumRateClasses>" << mNumRateClasses << "</NumRateClasses>\n";
+    *rParamsFile << "\t\t\t<MaxDisplacementPerUpdate>" << mMaxDisplacementPerUpdate << "</MaxDisplacementPerUpdate>\n";
+
+    // Call method on direct parent class
+    ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::OutputNumericalMethodParameters(rParamsFile);
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::SetNumRateClasses(unsigned numRateClasses)
+{
+    if (numRateClasses == 0u)
+    {
+        EXCEPTION("There must be at least one rate class.");
+    }
+    mNumRateClasses = numRateClasses;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetNumRateClasses()
+{
+    return mNumRateClasses;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::SetMaxDisplacementPerUpdate(double maxDisplacementPerUpdate)
+{
+    if (maxDisplacementPerUpdate <= 0.0)
+    {
+        EXCEPTION("The maximum displacement per update must be positive.");
+    }
+    mMaxDisplacementPerUpdate = maxDisplacementPerUpdate;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetMaxDisplacementPerUpdate()
+{
+    return mMaxDisplacementPerUpdate;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetNumActiveCapsules()
+{
+    return mNumActiveCapsules;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetNumCapsuleUpdates()
+{
+    return mNumCapsuleUpdates;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+double MultirateNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetMeanFractionOfActiveCapsules()
+{
+    return (mNumCapsuleSteps == 0u) ? 1.0 : static_cast<double>(mNumCapsuleUpdates) / static_cast<double>(mNumCapsuleSteps);
+}
+
+// Explicit instantiation
+template class MultirateNumericalMethodForCapsules<2,2>;
+template class MultirateNumericalMethodForCapsules<3,3>;
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapperForCpp.hpp"
+EXPORT_TEMPLATE_CLASS2(MultirateNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(MultirateNumericalMethodForCapsules, 3, 3)
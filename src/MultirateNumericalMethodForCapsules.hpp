@@ -0,0 +1,202 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef MULTIRATENUMERICALMETHODFORCAPSULES_HPP_
+#define MULTIRATENUMERICALMETHODFORCAPSULES_HPP_
+
+#include "ChasteSerialization.hpp"
+#include <boost/serialization/base_object.hpp>
+
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+
+/**
+ * Forward Euler time stepping in which each capsule moves at its own rate: the fast capsules at the growing front of
+ * a colony every step, and the slow ones in its jammed interior only every few steps, with proportionally longer
+ * steps.
+ *
+ * Each capsule is in a rate class k, held in its NA_RATE_CLASS attribute, and moves every 2^k steps. Between its
+ * moves it is held still, and the applied force and torque it receives are summed, weighted by the number of steps
+ * each stands for, in its NA_ACCUMULATED_* attributes; when it next moves, it moves by their sum over one step. The
+ * force pass skips the pairs of which neither capsule moves this step, and weights every other pair by the number of
+ * steps since the pair was last evaluated, the fewer of the steps since either capsule last moved. Each pair thus
+ * contributes once for every step, equal and opposite on its two capsules, whichever their classes.
+ *
+ * After it moves, a capsule is put in the slowest class whose step, at the average speed of the capsule's tips since
+ * it last moved, moves them no further than the maximum displacement. It is
+ * only promoted to a class on a step that is a multiple of that class's period, so that the capsules of a class
+ * move together. A held capsule whose summed forces would move it further than the maximum displacement moves on the
+ * next step instead.
+ *
+ * Every force must be a CapsuleForce, so that its pairs can be weighted. With a single rate class this is the forward
+ * Euler method. Sleeping and adaptive substeps are not supported.
+ */
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class MultirateNumericalMethodForCapsules : public ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>
+{
+private:
+
+    /** Needed for serialization. */
+    friend class boost::serialization::access;
+
+    /**
+     * Save or restore the simulation.
+     *
+     * @param archive the archive
+     * @param version the current version of this class
+     */
+    template<class Archive>
+    void serialize(Archive & archive, const unsigned int version)
+    {
+        archive & boost::serialization::base_object<ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM> >(*this);
+        archive & mNumRateClasses;
+        archive & mMaxDisplacementPerUpdate;
+        archive & mNumSteps;
+    }
+
+    /** The number of rate classes; the slowest class moves every 2^(mNumRateClasses-1) steps. Defaults to 4. */
+    unsigned mNumRateClasses;
+
+    /** The furthest a capsule's tips may be expected to move each time it moves. Defaults to 0.01. */
+    double mMaxDisplacementPerUpdate;
+
+    /** The number of calls to UpdateAllNodePositions(), which sets the steps on which each class moves. */
+    unsigned long mNumSteps;
+
+    /** The number of capsules moved by the last call to UpdateAllNodePositions(). */
+    unsigned mNumActiveCapsules;
+
+    /** The number of capsules moved, summed over every call to UpdateAllNodePositions(). */
+    unsigned long mNumCapsuleUpdates;
+
+    /** The number of capsules, summed over every call to UpdateAllNodePositions(). */
+    unsigned long mNumCapsuleSteps;
+
+    /** The contact weight of each node index, the number of steps since the capsule last moved. */
+    std::vector<double> mContactWeights;
+
+    /** Whether the capsule of each node index moves this step. */
+    std::vector<char> mIsActive;
+
+    /**
+     * Count a step for each capsule in one block of nodes, and mark the capsules that move this step.
+     *
+     * @param rNodes the nodes
+     * @param begin the position in rNodes of the first capsule
+     * @param end one past the position in rNodes of the last capsule
+     * @return the number of capsules in the block that move this step
+     */
+    unsigned MarkActiveCapsulesInRange(std::vector<Node<SPACE_DIM>*>& rNodes, unsigned begin, unsigned end);
+
+    /**
+     * Add the applied force and torque of each capsule in one block of nodes to its sums. Capsules that move this
+     * step are given their sums as their applied force and torque, and put in a new rate class; the others are
+     * given none.
+     *
+     * @param rNodes the nodes
+     * @param begin the position in rNodes of the first capsule
+     * @param end one past the position in rNodes of the last capsule
+     * @param dt the step size
+     */
+    void AccumulateForcesInRange(std::vector<Node<SPACE_DIM>*>& rNodes, unsigned begin, unsigned end, double dt);
+
+public:
+
+    /**
+     * Constructor.
+     */
+    MultirateNumericalMethodForCapsules();
+
+    /**
+     * Destructor.
+     */
+    virtual ~MultirateNumericalMethodForCapsules() = default;
+
+    /**
+     * Overridden UpdateAllNodePositions() method.
+     *
+     * @param dt Time step size
+     */
+    void UpdateAllNodePositions(double dt);
+
+    /**
+     * Overridden OutputNumericalMethodParameters() method.
+     *
+     * @param rParamsFile Reference to the parameter output filestream
+     */
+    virtual void OutputNumericalMethodParameters(out_stream& rParamsFile);
+
+    /**
+     * @param numRateClasses the number of rate classes, at least one
+     */
+    void SetNumRateClasses(unsigned numRateClasses);
+
+    /**
+     * @return the number of rate classes
+     */
+    unsigned GetNumRateClasses();
+
+    /**
+     * @param maxDisplacementPerUpdate the furthest a capsule's tips may be expected to move each time it moves
+     */
+    void SetMaxDisplacementPerUpdate(double maxDisplacementPerUpdate);
+
+    /**
+     * @return the furthest a capsule's tips may be expected to move each time it moves
+     */
+    double GetMaxDisplacementPerUpdate();
+
+    /**
+     * @return the number of capsules moved by the last call to UpdateAllNodePositions()
+     */
+    unsigned GetNumActiveCapsules();
+
+    /**
+     * @return the number of capsules moved, summed over every call to UpdateAllNodePositions()
+     */
+    unsigned long GetNumCapsuleUpdates();
+
+    /**
+     * @return the fraction of capsules moved per step, over every call to UpdateAllNodePositions(), or 1.0 before
+     *     the first
+     */
+    double GetMeanFractionOfActiveCapsules();
+};
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapper.hpp"
+EXPORT_TEMPLATE_CLASS2(MultirateNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(MultirateNumericalMethodForCapsules, 3, 3)
+
+#endif /*MULTIRATENUMERICALMETHODFORCAPSULES_HPP_*/
@@ -37,6 +37,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "OdeLinearSystemSolver.hpp"
 #include "UniformCellCycleModel.hpp"
 #include "TypeSixSecretionEnumerations.hpp"
+#include "CapsuleOrientation.hpp"
 
 #include "Debug.hpp"
 #include "AbstractCentreBasedDivisionRule.hpp"
@@ -45,19 +46,38 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "RandomNumberGenerator.hpp"
 #include "TypeSixMachineProperty.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <set>
+
 template<unsigned DIM>
 NodeBasedCellPopulationWithCapsules<DIM>::NodeBasedCellPopulationWithCapsules(NodesOnlyMesh<DIM>& rMesh,
                                       std::vector<CellPtr>& rCells,
                                       const std::vector<unsigned> locationIndices,
                                       bool deleteMesh)
-    : NodeBasedCellPopulation<DIM>(rMesh, rCells, locationIndices, deleteMesh)
+    : NodeBasedCellPopulation<DIM>(rMesh, rCells, locationIndices, deleteMesh),
+      mUseAutomaticInteractionCutoff(false),
+      mInteractionCutoffMargin(0.25),
+      mNumInteractionCutoffUpdates(0u),
+      mTopologyVersion(0u),
+      mNodeReorderingInterval(0u),
+      mNumUpdatesSinceNodeReordering(0u),
+      mNumNodeReorderings(0u)
 {
 
 }
 
 template<unsigned DIM>
 NodeBasedCellPopulationWithCapsules<DIM>::NodeBasedCellPopulationWithCapsules(NodesOnlyMesh<DIM>& rMesh)
-    : NodeBasedCellPopulation<DIM>(rMesh)
+    : NodeBasedCellPopulation<DIM>(rMesh),
+      mUseAutomaticInteractionCutoff(false),
+      mInteractionCutoffMargin(0.25),
+      mNumInteractionCutoffUpdates(0u),
+      mTopologyVersion(0u),
+      mNodeReorderingInterval(0u),
+      mNumUpdatesSinceNodeReordering(0u),
+      mNumNodeReorderings(0u)
 {
     // No Validate() because the cells are not associated with the cell population yet in archiving
 }
@@ -115,6 +135,32 @@ CellPtr NodeBasedCellPopulationWithCapsules<DIM>::AddCell(CellPtr pNewCell, Cell
 {
 
 	auto pNewCellTemp=NodeBasedCellPopulation<DIM>::AddCell(pNewCell, pParentCell);
+	mTopologyVersion++;
+
+	// Division wakes the parent, if it was asleep; the daughter starts awake
+	std::vector<double>& r_parent_attributes = this->GetNodeCorrespondingToCell(pParentCell)->rGetNodeAttributes();
+	if (r_parent_attributes.size() > NA_NUM_QUIET_STEPS)
+	{
+		r_parent_attributes[NA_ASLEEP] = 0.0;
+		r_parent_attributes[NA_NUM_QUIET_STEPS] = 0.0;
+	}
+
+	// Division starts a new cell cycle for the parent, so its growth is resolved again, and both cells record the
+	// length of their mother for growth laws that depend on it
+	if (r_parent_attributes.size() < NA_VEC_LENGTH)
+	{
+		r_parent_attributes.resize(NA_VEC_LENGTH);
+	}
+	const double mother_length = r_parent_attributes[NA_LENGTH];
+	r_parent_attributes[NA_BIRTH_LENGTH] = 0.0;
+	r_parent_attributes[NA_MOTHER_LENGTH] = mother_length;
+
+	// The parent's forces since it last moved no longer apply, so the multirate numerical method starts it again in
+	// the fastest rate class, as it does the daughter
+	for (unsigned attribute = NA_RATE_CLASS; attribute <= NA_ACCUMULATED_TORQUE_Y; attribute++)
+	{
+		r_parent_attributes[attribute] = 0.0;
+	}
 
 
 	// Get new node
@@ -130,12 +176,22 @@ CellPtr NodeBasedCellPopulationWithCapsules<DIM>::AddCell(CellPtr pNewCell, Cell
 	//double radius = (this->GetNodeCorrespondingToCell(pParentCell))->rGetNodeAttributes()[NA_RADIUS];
 
 	p_new_node->rGetNodeAttributes()[NA_THETA] =  angle;
+	p_new_node->rGetNodeAttributes()[NA_MOTHER_LENGTH] = mother_length;
 	if (DIM==3)
 	{
 		double phi = (this->GetNodeCorrespondingToCell(pParentCell))->rGetNodeAttributes()[NA_PHI];
 		p_new_node->rGetNodeAttributes()[NA_PHI] =  phi;
 	}
 
+	// A daughter of a capsule whose orientation is held as a director gets one too, along its perturbed angles
+	if (CapsuleOrientation::HasDirector(this->GetNodeCorrespondingToCell(pParentCell)->rGetNodeAttributes()))
+	{
+		c_vector<double, DIM> daughter_axis;
+		CapsuleOrientation::ClearDirector(p_new_node->rGetNodeAttributes());
+		CapsuleOrientation::GetAxis(p_new_node->rGetNodeAttributes(), daughter_axis);
+		CapsuleOrientation::SetDirector(p_new_node->rGetNodeAttributes(), daughter_axis);
+	}
+
 	//p_new_node->rGetNodeAttributes()[NA_LENGTH] = length;
 	//p_new_node->rGetNodeAttributes()[NA_RADIUS] = radius;
 
@@ -396,10 +452,311 @@ std::vector<unsigned> NodeBasedCellPopulationWithCapsules<DIM>::GetMachineData(C
 
 
 
+template<unsigned DIM>
+unsigned NodeBasedCellPopulationWithCapsules<DIM>::RemoveDeadCells()
+{
+    // Wake the neighbours of dying capsules, whose contacts are about to change
+    std::set<unsigned> dead_indices;
+    for (auto cell_iter = this->Begin(); cell_iter != this->End(); ++cell_iter)
+    {
+        if (cell_iter->IsDead())
+        {
+            dead_indices.insert(this->GetLocationIndexUsingCell(*cell_iter));
+        }
+    }
+    if (!dead_indices.empty())
+    {
+        for (auto& r_pair : this->rGetNodePairs())
+        {
+            const bool first_is_dead = (dead_indices.count(r_pair.first->GetIndex()) > 0u);
+            const bool second_is_dead = (dead_indices.count(r_pair.second->GetIndex()) > 0u);
+            if (first_is_dead != second_is_dead)
+            {
+                std::vector<double>& r_attributes = first_is_dead ? r_pair.second->rGetNodeAttributes() : r_pair.first->rGetNodeAttributes();
+                if (r_attributes.size() > NA_NUM_QUIET_STEPS)
+                {
+                    r_attributes[NA_ASLEEP] = 0.0;
+                    r_attributes[NA_NUM_QUIET_STEPS] = 0.0;
+                }
+            }
+        }
+    }
+
+    unsigned num_removed = NodeBasedCellPopulation<DIM>::RemoveDeadCells();
+    if (num_removed > 0u)
+    {
+        mTopologyVersion++;
+    }
+    return num_removed;
+}
+
+template<unsigned DIM>
+unsigned NodeBasedCellPopulationWithCapsules<DIM>::GetTopologyVersion()
+{
+    return mTopologyVersion;
+}
+
+template<unsigned DIM>
+void NodeBasedCellPopulationWithCapsules<DIM>::Update(bool hasHadBirthsOrDeaths)
+{
+    if (mUseAutomaticInteractionCutoff)
+    {
+        UpdateInteractionCutoff();
+    }
+
+    // Reordering moves capsules between nodes, so must come before the node pairs are recalculated
+    if (mNodeReorderingInterval > 0u)
+    {
+        mNumUpdatesSinceNodeReordering++;
+        if (mNumUpdatesSinceNodeReordering >= mNodeReorderingInterval)
+        {
+            ReorderNodesAlongSpaceFillingCurve();
+        }
+    }
+
+    NodeBasedCellPopulation<DIM>::Update(hasHadBirthsOrDeaths);
+}
+
+template<unsigned DIM>
+void NodeBasedCellPopulationWithCapsules<DIM>::ReorderNodesAlongSpaceFillingCurve()
+{
+    mNumUpdatesSinceNodeReordering = 0u;
+
+    // The nodes in index order, which is the order the capsules will be laid out along the curve
+    std::vector<Node<DIM>*> nodes;
+    for (auto node_iter = this->rGetMesh().GetNodeIteratorBegin();
+         node_iter != this->rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        // Every node must carry capsule attributes for them to be moved with the capsule
+        if (node_iter->GetNumNodeAttributes() <= NA_RADIUS)
+        {
+            return;
+        }
+        nodes.push_back(&(*node_iter));
+    }
+    std::sort(nodes.begin(), nodes.end(),
+              [](Node<DIM>* pNodeA, Node<DIM>* pNodeB)
+              {
+                  return pNodeA->GetIndex() < pNodeB->GetIndex();
+              });
+
+    const unsigned num_nodes = nodes.size();
+    if (num_nodes < 2u)
+    {
+        return;
+    }
+
+    // Quantise each coordinate within the bounding box of the nodes
+    c_vector<double, DIM> lower;
+    c_vector<double, DIM> upper;
+    for (unsigned dim=0; dim<DIM; dim++)
+    {
+        lower[dim] = DBL_MAX;
+        upper[dim] = -DBL_MAX;
+    }
+    for (unsigned i=0; i<num_nodes; i++)
+    {
+        const c_vector<double, DIM>& r_location = nodes[i]->rGetLocation();
+        for (unsigned dim=0; dim<DIM; dim++)
+        {
+            lower[dim] = std::min(lower[dim], r_location[dim]);
+            upper[dim] = std::max(upper[dim], r_location[dim]);
+        }
+    }
+
+    const unsigned bits_per_dim = std::min(31u, 63u / DIM);
+    const double max_cell = double((uint64_t(1) << bits_per_dim) - 1u);
+
+    // The Morton code of each capsule interleaves the bits of its quantised coordinates, x in the lowest bit
+    std::vector<std::pair<uint64_t, unsigned> > codes(num_nodes);
+    for (unsigned i=0; i<num_nodes; i++)
+    {
+        uint64_t cells[DIM];
+        for (unsigned dim=0; dim<DIM; dim++)
+        {
+            const double extent = upper[dim] - lower[dim];
+            const double scaled = (extent > 0.0) ? (nodes[i]->rGetLocation()[dim] - lower[dim]) / extent : 0.0;
+            cells[dim] = uint64_t(scaled * max_cell);
+        }
+
+        uint64_t code = 0u;
+        for (unsigned bit=0; bit<bits_per_dim; bit++)
+        {
+            for (unsigned dim=0; dim<DIM; dim++)
+            {
+                code |= ((cells[dim] >> bit) & uint64_t(1)) << (bit * DIM + dim);
+            }
+        }
+        codes[i] = std::make_pair(code, i);
+    }
+
+    // Ties keep their current order, so the reordering is deterministic
+    std::sort(codes.begin(), codes.end());
+
+    bool is_identity = true;
+    for (unsigned i=0; i<num_nodes; i++)
+    {
+        is_identity = is_identity && (codes[i].second == i);
+    }
+    if (is_identity)
+    {
+        return;
+    }
+
+    // Take a copy of everything that belongs to a capsule rather than to a node index...
+    std::vector<c_vector<double, DIM> > locations(num_nodes);
+    std::vector<std::vector<double> > attributes(num_nodes);
+    std::vector<double> radii(num_nodes);
+    std::vector<CellPtr> cells(num_nodes);
+    for (unsigned i=0; i<num_nodes; i++)
+    {
+        locations[i] = nodes[i]->rGetLocation();
+        attributes[i].swap(nodes[i]->rGetNodeAttributes());
+        radii[i] = nodes[i]->GetRadius();
+        cells[i] = this->GetCellUsingLocationIndex(nodes[i]->GetIndex());
+    }
+
+    // ...and hand it out again in curve order, keeping the maps between cells and location indices consistent
+    for (unsigned i=0; i<num_nodes; i++)
+    {
+        const unsigned old_position = codes[i].second;
+        nodes[i]->rGetModifiableLocation() = locations[old_position];
+        nodes[i]->rGetNodeAttributes().swap(attributes[old_position]);
+        nodes[i]->SetRadius(radii[old_position]);
+        this->SetCellUsingLocationIndex(nodes[i]->GetIndex(), cells[old_position]);
+    }
+
+    // Node pointers held elsewhere now refer to different capsules
+    mTopologyVersion++;
+    mNumNodeReorderings++;
+}
+
+template<unsigned DIM>
+void NodeBasedCellPopulationWithCapsules<DIM>::SetNodeReorderingInterval(unsigned nodeReorderingInterval)
+{
+    mNodeReorderingInterval = nodeReorderingInterval;
+}
+
+template<unsigned DIM>
+unsigned NodeBasedCellPopulationWithCapsules<DIM>::GetNodeReorderingInterval()
+{
+    return mNodeReorderingInterval;
+}
+
+template<unsigned DIM>
+unsigned NodeBasedCellPopulationWithCapsules<DIM>::GetNumNodeReorderings()
+{
+    return mNumNodeReorderings;
+}
+
+template<unsigned DIM>
+double NodeBasedCellPopulationWithCapsules<DIM>::CalculateRequiredInteractionCutoff()
+{
+    double max_half_extent = 0.0;
+    for (auto node_iter = this->rGetMesh().GetNodeIteratorBegin();
+         node_iter != this->rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        // Nodes whose capsule attributes have not been set yet cannot contribute
+        if (node_iter->GetNumNodeAttributes() > NA_RADIUS)
+        {
+            const std::vector<double>& r_attributes = node_iter->rGetNodeAttributes();
+            max_half_extent = std::max(max_half_extent, 0.5 * r_attributes[NA_LENGTH] + r_attributes[NA_RADIUS]);
+        }
+    }
+
+    return 2.0 * max_half_extent;
+}
+
+template<unsigned DIM>
+void NodeBasedCellPopulationWithCapsules<DIM>::UpdateInteractionCutoff()
+{
+    NodesOnlyMesh<DIM>& r_mesh = this->rGetMesh();
+
+    const double required_cutoff = CalculateRequiredInteractionCutoff();
+    if (required_cutoff <= 0.0)
+    {
+        return;
+    }
+
+    // A capsule that has grown past the cutoff must be caught before the node pairs are calculated. Shrinking is
+    // only worthwhile once the cutoff is well above what is needed, which stops the boxes being rebuilt every step.
+    const double current_cutoff = r_mesh.GetMaximumInteractionDistance();
+    const bool too_small = (current_cutoff < required_cutoff);
+    const bool too_large = (current_cutoff > required_cutoff * (1.0 + 2.0 * mInteractionCutoffMargin));
+
+    if (too_small || too_large)
+    {
+        const double new_cutoff = required_cutoff * (1.0 + mInteractionCutoffMargin);
+
+        // The new boxes cover the current extent of the nodes, plus one box on every side
+        c_vector<double, 2*DIM> domain_size;
+        for (unsigned dim=0; dim<DIM; dim++)
+        {
+            domain_size[2*dim] = DBL_MAX;
+            domain_size[2*dim + 1] = -DBL_MAX;
+        }
+        for (auto node_iter = r_mesh.GetNodeIteratorBegin();
+             node_iter != r_mesh.GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            const c_vector<double, DIM>& r_location = node_iter->rGetLocation();
+            for (unsigned dim=0; dim<DIM; dim++)
+            {
+                domain_size[2*dim] = std::min(domain_size[2*dim], r_location[dim] - new_cutoff);
+                domain_size[2*dim + 1] = std::max(domain_size[2*dim + 1], r_location[dim] + new_cutoff);
+            }
+        }
+
+        r_mesh.SetMaximumInteractionDistance(new_cutoff);
+        r_mesh.ClearBoxCollection();
+        r_mesh.SetUpBoxCollection(new_cutoff, domain_size);
+
+        mNumInteractionCutoffUpdates++;
+    }
+}
+
+template<unsigned DIM>
+void NodeBasedCellPopulationWithCapsules<DIM>::SetUseAutomaticInteractionCutoff(bool useAutomaticInteractionCutoff)
+{
+    mUseAutomaticInteractionCutoff = useAutomaticInteractionCutoff;
+}
+
+template<unsigned DIM>
+bool NodeBasedCellPopulationWithCapsules<DIM>::GetUseAutomaticInteractionCutoff()
+{
+    return mUseAutomaticInteractionCutoff;
+}
+
+template<unsigned DIM>
+void NodeBasedCellPopulationWithCapsules<DIM>::SetInteractionCutoffMargin(double interactionCutoffMargin)
+{
+    if (interactionCutoffMargin < 0.0)
+    {
+        EXCEPTION("The interaction cutoff margin must be non-negative.");
+    }
+    mInteractionCutoffMargin = interactionCutoffMargin;
+}
+
+template<unsigned DIM>
+double NodeBasedCellPopulationWithCapsules<DIM>::GetInteractionCutoffMargin()
+{
+    return mInteractionCutoffMargin;
+}
+
+template<unsigned DIM>
+unsigned NodeBasedCellPopulationWithCapsules<DIM>::GetNumInteractionCutoffUpdates()
+{
+    return mNumInteractionCutoffUpdates;
+}
+
 template<unsigned DIM>
 void NodeBasedCellPopulationWithCapsules<DIM>::OutputCellPopulationParameters(out_stream& rParamsFile)
 {
-    // Currently no specific parameters to output all come from parent classes
+    *rParamsFile << "\t\t<UseAutomaticInteractionCutoff>" << mUseAutomaticInteractionCutoff << "</UseAutomaticInteractionCutoff>\n";
+    *rParamsFile << "\t\t<InteractionCutoffMargin>" << mInteractionCutoffMargin << "</InteractionCutoffMargin>\n";
+    *rParamsFile << "\t\t<NodeReorderingInterval>" << mNodeReorderingInterval << "</NodeReorderingInterval>\n";
 
     // Call method on direct parent class
     NodeBasedCellPopulation<DIM>::OutputCellPopulationParameters(rParamsFile);
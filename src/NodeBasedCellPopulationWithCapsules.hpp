@@ -49,10 +49,40 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 template<unsigned DIM>
 class NodeBasedCellPopulationWithCapsules : public NodeBasedCellPopulation<DIM>
 {
-    //friend class TestNodeBasedCellPopulationWithCapsules;
+    friend class TestNodeBasedCellPopulationWithCapsules;
 
 private:
 
+    /** Whether to keep the mesh's maximum interaction distance matched to the capsule sizes. Defaults to false. */
+    bool mUseAutomaticInteractionCutoff;
+
+    /**
+     * Relative margin added to the required interaction cutoff when it is reset, so that the box collection is not
+     * rebuilt every time a capsule grows. Defaults to 0.25.
+     */
+    double mInteractionCutoffMargin;
+
+    /** The number of times the box collection has been rebuilt with a new interaction cutoff. */
+    unsigned mNumInteractionCutoffUpdates;
+
+    /**
+     * Incremented whenever cells are added or removed or the nodes are reordered, so that anything holding node
+     * pointers (such as the Verlet list in CapsuleForce) knows to rebuild. Not archived.
+     */
+    unsigned mTopologyVersion;
+
+    /**
+     * Every how many calls to Update() the nodes are reordered along a space-filling curve, or zero for never.
+     * Defaults to 0.
+     */
+    unsigned mNodeReorderingInterval;
+
+    /** The number of calls to Update() since the nodes were last reordered. Not archived. */
+    unsigned mNumUpdatesSinceNodeReordering;
+
+    /** The number of times the nodes have been reordered. Not archived. */
+    unsigned mNumNodeReorderings;
+
     /** Needed for serialization. */
     friend class boost::serialization::access;
     /**
@@ -68,8 +98,18 @@ private:
     void serialize(Archive & archive, const unsigned int version)
     {
         archive & boost::serialization::base_object<NodeBasedCellPopulation<DIM> >(*this);
+        archive & mUseAutomaticInteractionCutoff;
+        archive & mInteractionCutoffMargin;
+        archive & mNumInteractionCutoffUpdates;
+        archive & mNodeReorderingInterval;
     }
 
+    /**
+     * If the largest capsule no longer fits within the maximum interaction distance, or the distance is much
+     * larger than needed, reset it to the required cutoff plus the margin and rebuild the box collection.
+     */
+    void UpdateInteractionCutoff();
+
 public:
 
     /**
@@ -101,11 +141,101 @@ public:
      //void UpdateNodeLocations(double dt);
     CellPtr AddCell(CellPtr pNewCell, CellPtr pParentCell);
 
+    /**
+     * Overridden RemoveDeadCells() method, which also increments the topology version if any cells were removed,
+     * and wakes any sleeping capsules that were paired with a dead one.
+     *
+     * @return the number of cells removed
+     */
+    unsigned RemoveDeadCells();
+
+    /**
+     * @return a counter that changes whenever cells are added or removed or the nodes are reordered, invalidating
+     * stored node pointers
+     */
+    unsigned GetTopologyVersion();
+
 
      c_vector<double, DIM> GetMachineCoords(unsigned node_index,std::vector<double> machine_angles,c_vector<double,DIM> cell_centre,double L);
 
      std::vector<unsigned> GetMachineData(CellPtr pCell);
 
+    /**
+     * Overridden Update() method. When the automatic interaction cutoff is in use, the maximum interaction distance
+     * of the mesh is brought up to date with the capsule sizes before the node pairs are recalculated, and the
+     * nodes are reordered every mNodeReorderingInterval calls.
+     *
+     * @param hasHadBirthsOrDeaths whether there have been any births or deaths
+     */
+    void Update(bool hasHadBirthsOrDeaths=true);
+
+    /**
+     * Calculate the smallest interaction distance for which the box collection still finds every pair of capsules
+     * that may overlap. Two capsules can only touch if their centres are closer than La/2 + Lb/2 + Ra + Rb, so
+     * this is twice the largest value of L/2 + R.
+     *
+     * @return the required interaction cutoff, or zero if no node has capsule attributes
+     */
+    double CalculateRequiredInteractionCutoff();
+
+    /**
+     * Set whether the maximum interaction distance of the mesh should follow the capsule sizes. When set, the cutoff
+     * passed to NodesOnlyMesh::ConstructNodesWithoutMesh() is only used until the first call to Update().
+     *
+     * @param useAutomaticInteractionCutoff whether to use the automatic interaction cutoff
+     */
+    void SetUseAutomaticInteractionCutoff(bool useAutomaticInteractionCutoff);
+
+    /**
+     * @return whether the automatic interaction cutoff is in use
+     */
+    bool GetUseAutomaticInteractionCutoff();
+
+    /**
+     * Set the relative margin added to the required interaction cutoff. The cutoff is grown as soon as it is too
+     * small, and shrunk once it exceeds the required cutoff by more than twice the margin.
+     *
+     * @param interactionCutoffMargin the margin (non-negative)
+     */
+    void SetInteractionCutoffMargin(double interactionCutoffMargin);
+
+    /**
+     * @return the relative margin added to the required interaction cutoff
+     */
+    double GetInteractionCutoffMargin();
+
+    /**
+     * @return the number of times the box collection has been rebuilt with a new interaction cutoff
+     */
+    unsigned GetNumInteractionCutoffUpdates();
+
+    /**
+     * Renumber the capsules so that their node indices follow a Morton (Z-order) curve through space, so that
+     * capsules that are close together are also close together in memory. The location, node attributes and
+     * radius of each capsule move to its new node, and its cell is moved to the new location index.
+     *
+     * Nothing is done unless every node has capsule attributes. Node pairs are stale until the next call to
+     * Update(), and the topology version is incremented so that stored node pointers are discarded.
+     */
+    void ReorderNodesAlongSpaceFillingCurve();
+
+    /**
+     * Set every how many calls to Update() the nodes are reordered along a space-filling curve.
+     *
+     * @param nodeReorderingInterval the interval, or zero (the default) to only reorder on demand
+     */
+    void SetNodeReorderingInterval(unsigned nodeReorderingInterval);
+
+    /**
+     * @return every how many calls to Update() the nodes are reordered, or zero for never
+     */
+    unsigned GetNodeReorderingInterval();
+
+    /**
+     * @return the number of times the nodes have actually been reordered
+     */
+    unsigned GetNumNodeReorderings();
+
 
 
     /**
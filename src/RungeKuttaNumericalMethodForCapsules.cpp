@@ -0,0 +1,259 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "RungeKuttaNumericalMethodForCapsules.hpp"
+#include "CapsuleOrientation.hpp"
+#include "Exception.hpp"
+#include "UblasCustomFunctions.hpp"
+
+#include <vector>
+
+namespace
+{
+
+/** The number of stages of each scheme. */
+inline unsigned GetNumStages(CapsuleRungeKuttaScheme scheme)
+{
+    return (scheme == CRK_HEUN) ? 2u : 4u;
+}
+
+/**
+ * Fill in the Butcher tableau of a scheme.
+ *
+ * @param scheme the scheme
+ * @param rA filled in with the weights of the earlier stages in each stage
+ * @param rB filled in with the weights of the stages in the step
+ * @param rC filled in with the time of each stage, as a fraction of the step
+ */
+inline void GetButcherTableau(CapsuleRungeKuttaScheme scheme,
+                              std::vector<std::vector<double> >& rA,
+                              std::vector<double>& rB,
+                              std::vector<double>& rC)
+{
+    if (scheme == CRK_HEUN)
+    {
+        rA = {{}, {1.0}};
+        rB = {0.5, 0.5};
+        rC = {0.0, 1.0};
+    }
+    else
+    {
+        rA = {{}, {0.5}, {0.0, 0.5}, {0.0, 0.0, 1.0}};
+        rB = {1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0};
+        rC = {0.0, 0.5, 0.5, 1.0};
+    }
+}
+
+/** @return the rate of change of the angle theta of a 2D capsule, in the z component, from its cached mobility */
+inline c_vector<double, 3> CalculateOrientationRate(Node<2>& rNode)
+{
+    const std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    c_vector<double, 3> rate = zero_vector<double>(3);
+    rate[2] = r_attributes[NA_ROTATIONAL_MOBILITY] * r_attributes[NA_APPLIED_THETA];
+    return rate;
+}
+
+/**
+ * @return the rate of change of the axis of a 3D capsule, the cross product of its angular velocity with the axis,
+ *     from its cached mobility
+ */
+inline c_vector<double, 3> CalculateOrientationRate(Node<3>& rNode)
+{
+    const std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    const c_vector<double, 3> angular_velocity = r_attributes[NA_ROTATIONAL_MOBILITY] * CapsuleOrientation::GetAppliedTorque<3>(r_attributes);
+
+    c_vector<double, 3> axis;
+    CapsuleOrientation::GetAxis(r_attributes, axis);
+    return VectorProduct(angular_velocity, axis);
+}
+
+/** Set the angle theta of a 2D capsule to that at the start of the step plus the z component of rIncrement. */
+inline void SetOrientation(Node<2>& rNode,
+                           const std::vector<double>& rStartAttributes,
+                           const c_vector<double, 3>& rIncrement,
+                           bool useDirector)
+{
+    std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    r_attributes[NA_THETA] = rStartAttributes[NA_THETA] + rIncrement[2];
+    if (useDirector)
+    {
+        c_vector<double, 2> axis;
+        axis[0] = cos(r_attributes[NA_THETA]);
+        axis[1] = sin(r_attributes[NA_THETA]);
+        CapsuleOrientation::SetDirector(r_attributes, axis);
+    }
+    else
+    {
+        CapsuleOrientation::ClearDirector(r_attributes);
+    }
+}
+
+/** Set the axis of a 3D capsule to that at the start of the step plus rIncrement, renormalised. */
+inline void SetOrientation(Node<3>& rNode,
+                           const std::vector<double>& rStartAttributes,
+                           const c_vector<double, 3>& rIncrement,
+                           bool useDirector)
+{
+    std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+    c_vector<double, 3> axis;
+    CapsuleOrientation::GetAxis(rStartAttributes, axis);
+    CapsuleOrientation::SetDirector(r_attributes, c_vector<double, 3>(axis + rIncrement));
+    if (!useDirector)
+    {
+        CapsuleOrientation::ClearDirector(r_attributes);
+    }
+}
+
+} // namespace
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+RungeKuttaNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::RungeKuttaNumericalMethodForCapsules()
+    : ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>(),
+      mScheme(CRK_CLASSIC_RK4),
+      mNumForceEvaluations(0u)
+{
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void RungeKuttaNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::UpdateAllNodePositions(double dt)
+{
+    if (this->GetUseSleeping() || this->GetUseAdaptiveTimeStepping())
+    {
+        EXCEPTION("RungeKuttaNumericalMethodForCapsules does not support sleeping or adaptive time stepping");
+    }
+
+    std::vector<std::vector<double> > a;
+    std::vector<double> b;
+    std::vector<double> c;
+    GetButcherTableau(mScheme, a, b, c);
+    const unsigned num_stages = GetNumStages(mScheme);
+
+    // The state of each capsule at the start of the step
+    std::vector<Node<SPACE_DIM>*> nodes;
+    std::vector<c_vector<double, SPACE_DIM> > start_locations;
+    std::vector<std::vector<double> > start_attributes;
+    for (auto node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+         node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+         ++node_iter)
+    {
+        nodes.push_back(&(*node_iter));
+        start_locations.push_back(node_iter->rGetLocation());
+        start_attributes.push_back(node_iter->rGetNodeAttributes());
+    }
+
+    // The velocity and rate of change of orientation of each capsule at each stage
+    std::vector<std::vector<c_vector<double, SPACE_DIM> > > velocities(num_stages);
+    std::vector<std::vector<c_vector<double, 3> > > orientation_rates(num_stages);
+
+    const bool use_director = this->GetUseDirectorOrientation();
+    std::vector<double> growth_rates;
+    for (unsigned stage = 0; stage <= num_stages; stage++)
+    {
+        // Place each capsule at the stage point, or at the end of the step once every stage is done
+        const bool is_end_of_step = (stage == num_stages);
+        if (stage > 0)
+        {
+            const std::vector<double>& r_weights = is_end_of_step ? b : a[stage];
+            for (unsigned capsule = 0; capsule < nodes.size(); capsule++)
+            {
+                c_vector<double, SPACE_DIM> displacement = zero_vector<double>(SPACE_DIM);
+                c_vector<double, 3> orientation_increment = zero_vector<double>(3);
+                for (unsigned earlier_stage = 0; earlier_stage < r_weights.size(); earlier_stage++)
+                {
+                    displacement += dt * r_weights[earlier_stage] * velocities[earlier_stage][capsule];
+                    orientation_increment += dt * r_weights[earlier_stage] * orientation_rates[earlier_stage][capsule];
+                }
+                nodes[capsule]->rGetModifiableLocation() = start_locations[capsule] + displacement;
+                SetOrientation(*nodes[capsule], start_attributes[capsule], orientation_increment, use_director);
+            }
+        }
+
+        // The lengths are set from the cell ages, which are those at the end of the step
+        this->UpdateCapsuleLengths(dt, growth_rates, is_end_of_step ? 0.0 : (c[stage] - 1.0) * dt);
+        if (is_end_of_step)
+        {
+            break;
+        }
+        this->UpdateMobilities();
+
+        this->ComputeForcesIncludingDamping();
+        mNumForceEvaluations++;
+
+        velocities[stage].resize(nodes.size());
+        orientation_rates[stage].resize(nodes.size());
+        for (unsigned capsule = 0; capsule < nodes.size(); capsule++)
+        {
+            velocities[stage][capsule] = nodes[capsule]->rGetNodeAttributes()[NA_TRANSLATIONAL_MOBILITY]
+                                         * nodes[capsule]->rGetAppliedForce();
+            orientation_rates[stage][capsule] = CalculateOrientationRate(*nodes[capsule]);
+        }
+    }
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void RungeKuttaNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::OutputNumericalMethodParameters(out_stream& rParamsFile)
+{
+    *rParamsFile << "\t\t\t<Scheme>" << mScheme << "</Scheme>\n";
+
+    // Call method on direct parent class
+    ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::OutputNumericalMethodParameters(rParamsFile);
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+void RungeKuttaNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::SetScheme(CapsuleRungeKuttaScheme scheme)
+{
+    mScheme = scheme;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+CapsuleRungeKuttaScheme RungeKuttaNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetScheme()
+{
+    return mScheme;
+}
+
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+unsigned long RungeKuttaNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>::GetNumForceEvaluations()
+{
+    return mNumForceEvaluations;
+}
+
+// Explicit instantiation
+template class RungeKuttaNumericalMethodForCapsules<2,2>;
+template class RungeKuttaNumericalMethodForCapsules<3,3>;
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapperForCpp.hpp"
+EXPORT_TEMPLATE_CLASS2(RungeKuttaNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(RungeKuttaNumericalMethodForCapsules, 3, 3)
@@ -0,0 +1,132 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef RUNGEKUTTANUMERICALMETHODFORCAPSULES_HPP_
+#define RUNGEKUTTANUMERICALMETHODFORCAPSULES_HPP_
+
+#include "ChasteSerialization.hpp"
+#include <boost/serialization/base_object.hpp>
+
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * Explicit Runge-Kutta time stepping for capsules, of second (Heun) or fourth (classic RK4) order.
+ *
+ * Each capsule's centre, axis and length are advanced together. The force pass is re-run at every stage point, with
+ * the capsules placed at their stage positions and orientations and grown to their lengths at the stage time; only
+ * the forces are recomputed there, so cell division, machine updates and the rest of the simulation step happen once
+ * per step as usual. The axis moves with the angular velocity, torque over moment of inertia: in 2D the angle theta
+ * is integrated, and in 3D the axis itself, with the whole torque turning it as in the director orientation of the
+ * forward Euler method. The applied forces and torques left on the nodes are those of the last stage.
+ *
+ * Sleeping and adaptive substeps are not supported.
+ */
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class RungeKuttaNumericalMethodForCapsules : public ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM>
+{
+private:
+
+    /** Needed for serialization. */
+    friend class boost::serialization::access;
+
+    /**
+     * Save or restore the simulation.
+     *
+     * @param archive the archive
+     * @param version the current version of this class
+     */
+    template<class Archive>
+    void serialize(Archive & archive, const unsigned int version)
+    {
+        archive & boost::serialization::base_object<ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM,SPACE_DIM> >(*this);
+        archive & mScheme;
+    }
+
+    /** The Runge-Kutta scheme. Defaults to CRK_CLASSIC_RK4. */
+    CapsuleRungeKuttaScheme mScheme;
+
+    /** The number of force passes over every call to UpdateAllNodePositions(). */
+    unsigned long mNumForceEvaluations;
+
+public:
+
+    /**
+     * Constructor.
+     */
+    RungeKuttaNumericalMethodForCapsules();
+
+    /**
+     * Destructor.
+     */
+    virtual ~RungeKuttaNumericalMethodForCapsules() = default;
+
+    /**
+     * Overridden UpdateAllNodePositions() method.
+     *
+     * @param dt Time step size
+     */
+    void UpdateAllNodePositions(double dt);
+
+    /**
+     * Overridden OutputNumericalMethodParameters() method.
+     *
+     * @param rParamsFile Reference to the parameter output filestream
+     */
+    virtual void OutputNumericalMethodParameters(out_stream& rParamsFile);
+
+    /**
+     * @param scheme the Runge-Kutta scheme
+     */
+    void SetScheme(CapsuleRungeKuttaScheme scheme);
+
+    /**
+     * @return the Runge-Kutta scheme
+     */
+    CapsuleRungeKuttaScheme GetScheme();
+
+    /**
+     * @return the number of force passes over every call to UpdateAllNodePositions(): two a step for Heun's method
+     *     and four for the classic RK4 method
+     */
+    unsigned long GetNumForceEvaluations();
+};
+
+// Serialization for Boost >= 1.36
+#include "SerializationExportWrapper.hpp"
+EXPORT_TEMPLATE_CLASS2(RungeKuttaNumericalMethodForCapsules, 2, 2)
+EXPORT_TEMPLATE_CLASS2(RungeKuttaNumericalMethodForCapsules, 3, 3)
+
+#endif /*RUNGEKUTTANUMERICALMETHODFORCAPSULES_HPP_*/
@@ -6,6 +6,7 @@
 #include "TypeSixMachineCellKiller.hpp"
 #include "TypeSixMachineProperty.hpp"
 #include "TypeSixSecretionEnumerations.hpp"
+#include "CapsuleOrientation.hpp"
 #include "NodeBasedCellPopulation.hpp"
 #include "Debug.hpp"
 
@@ -76,31 +77,18 @@ void TypeSixMachineCellKiller<DIM>::CheckAndLabelCellsForApoptosisOrDeath()
                     Node<DIM>* p_neighbour = p_population->GetNode(*it);
 
                     // Compute distance between (X,Y) and this neighbouring cell's line segment
-				    const double neighbour_angle = p_neighbour->rGetNodeAttributes()[NA_THETA];
 				    const double neighbour_length = p_neighbour->rGetNodeAttributes()[NA_LENGTH];
 				    double R = p_neighbour->rGetNodeAttributes()[NA_RADIUS];
 
+				    c_vector<double, DIM> neighbour_axis_vector;
+				    CapsuleOrientation::GetAxis(p_neighbour->rGetNodeAttributes(), neighbour_axis_vector);
+				    c_vector<double, DIM> neighbour_plus_end_global = p_neighbour->rGetLocation() + 0.5*neighbour_length*neighbour_axis_vector;
+				    c_vector<double, DIM> neighbour_min_end_global = p_neighbour->rGetLocation() - 0.5*neighbour_length*neighbour_axis_vector;
+
 				    double distance_to_neighbour =0.0;
 				    if (DIM==2u)
 				    {
 				    	geom_point machine_point(machine_coords[0], machine_coords[1]);
-
-				    	c_vector<double, DIM> neighbour_plus_end_local;
-				    	neighbour_plus_end_local(0)=neighbour_length/2.0;
-				    	neighbour_plus_end_local(1)=0;
-				    	c_vector<double, DIM> neighbour_min_end_local;
-				    	neighbour_min_end_local(0)=-neighbour_length/2.0;
-				    	neighbour_min_end_local(1)=0;
-
-						c_matrix<double,2,2> rotation_matrix_theta = identity_matrix<double>(2);
-						rotation_matrix_theta(0,0)=cos(neighbour_angle);
-						rotation_matrix_theta(0,1)=-sin(neighbour_angle);
-						rotation_matrix_theta(1,0)=sin(neighbour_angle);
-						rotation_matrix_theta(1,1)=cos(neighbour_angle);
-
-						c_vector<double, DIM> neighbour_plus_end_global=p_neighbour->rGetLocation() + prod(rotation_matrix_theta, neighbour_plus_end_local);
-						c_vector<double, DIM> neighbour_min_end_global=p_neighbour->rGetLocation() + prod(rotation_matrix_theta, neighbour_min_end_local);
-
 				    	geom_point neighbour_end_1(neighbour_plus_end_global[0],neighbour_plus_end_global[1]);
 				    	geom_point neighbour_end_2(neighbour_min_end_global[0],neighbour_min_end_global[1]);
 				    	geom_segment neighbour_axis(neighbour_end_1, neighbour_end_2);
@@ -108,36 +96,7 @@ void TypeSixMachineCellKiller<DIM>::CheckAndLabelCellsForApoptosisOrDeath()
 				    }
 				    else if (DIM==3u)
 				    {
-					    const double neighbour_phi = p_neighbour->rGetNodeAttributes()[NA_PHI];
-
 				    	geom_point machine_point(machine_coords[0], machine_coords[1], machine_coords[2]);
-
-				    	c_vector<double, DIM> neighbour_plus_end_local;
-						neighbour_plus_end_local(0)=neighbour_length/2.0;
-						neighbour_plus_end_local(1)=0.0;
-						neighbour_plus_end_local(2)=0.0;
-
-						c_vector<double, DIM> neighbour_min_end_local;
-						neighbour_min_end_local(0)=-neighbour_length/2.0;
-						neighbour_min_end_local(1)=0.0;
-						neighbour_min_end_local(2)=0.0;
-
-						c_matrix<double,3,3> rotation_matrix_theta = identity_matrix<double>(3);
-						rotation_matrix_theta(0,0)=cos(neighbour_angle);
-						rotation_matrix_theta(0,1)=-sin(neighbour_angle);
-						rotation_matrix_theta(1,0)=sin(neighbour_angle);
-						rotation_matrix_theta(1,1)=cos(neighbour_angle);
-
-						c_matrix<double,3,3> rotation_matrix_phi = identity_matrix<double>(3);
-						rotation_matrix_phi(1,1)=cos(neighbour_phi);
-						rotation_matrix_phi(1,2)=-sin(neighbour_phi);
-						rotation_matrix_phi(2,1)=sin(neighbour_phi);
-						rotation_matrix_phi(2,2)=cos(neighbour_phi);
-
-						c_vector<double, DIM> neighbour_plus_end_global=p_neighbour->rGetLocation() + prod(prod(rotation_matrix_theta,rotation_matrix_phi), neighbour_plus_end_local);
-
-						c_vector<double, DIM> neighbour_min_end_global=p_neighbour->rGetLocation() + prod(prod(rotation_matrix_theta,rotation_matrix_phi), neighbour_min_end_local);
-
 						geom_point neighbour_end_1(neighbour_plus_end_global[0],neighbour_plus_end_global[1],neighbour_plus_end_global[2]);
 						geom_point neighbour_end_2(neighbour_min_end_global[0],neighbour_min_end_global[1], neighbour_min_end_global[2]);
 
@@ -12,11 +12,14 @@
 #include "Debug.hpp"
 #include "NodeBasedCellPopulationWithCapsules.hpp"
 
+#include <cmath>
+
 
 template<unsigned DIM>
 TypeSixMachineModifier<DIM>::TypeSixMachineModifier()
     : AbstractCellBasedSimulationModifier<DIM>(),
       mOutputDirectory(""),
+      mMachineUpdateInterval(1u),
 	  mk_1(0.4),
 	  mk_2(0.0),
 	  mk_3(1.1),
@@ -125,6 +128,22 @@ void TypeSixMachineModifier<DIM>::SetContactDependentFiring()
 	mk_7=0.0;
 }
 
+template<unsigned DIM>
+void TypeSixMachineModifier<DIM>::SetMachineUpdateInterval(unsigned machineUpdateInterval)
+{
+    if (machineUpdateInterval == 0u)
+    {
+        EXCEPTION("The machine update interval must be at least one time step.");
+    }
+    mMachineUpdateInterval = machineUpdateInterval;
+}
+
+template<unsigned DIM>
+unsigned TypeSixMachineModifier<DIM>::GetMachineUpdateInterval()
+{
+    return mMachineUpdateInterval;
+}
+
 template<unsigned DIM>
 TypeSixMachineModifier<DIM>::~TypeSixMachineModifier()
 {
@@ -139,7 +158,16 @@ void TypeSixMachineModifier<DIM>::SetOutputDirectory(std::string directory)
 template<unsigned DIM>
 void TypeSixMachineModifier<DIM>::UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
 {
-    UpdateCellData(rCellPopulation);
+    const unsigned time_steps_since_update = SimulationTime::Instance()->GetTimeStepsElapsed() % mMachineUpdateInterval;
+    if (time_steps_since_update == 0u)
+    {
+        UpdateCellData(rCellPopulation);
+    }
+    else if (time_steps_since_update == 1u)
+    {
+        // The fires counted at the last update belong to that step alone
+        ResetMachineFires(rCellPopulation);
+    }
 }
 
 template<unsigned DIM>
@@ -267,9 +295,17 @@ void TypeSixMachineModifier<DIM>::SetupSolve(AbstractCellPopulation<DIM,DIM>& rC
 
     /*
      * We must update CellData in SetupSolve(), otherwise it will not have been
-     * fully initialised by the time we enter the main time loop.
+     * fully initialised by the time we enter the main time loop. Updates over an
+     * interval cover the time since the last update, of which there is none yet.
      */
-    UpdateCellData(rCellPopulation);
+    if (mMachineUpdateInterval > 1u)
+    {
+        ResetMachineFires(rCellPopulation);
+    }
+    else
+    {
+        UpdateCellData(rCellPopulation);
+    }
 }
 
 template<unsigned DIM>
@@ -319,6 +355,11 @@ void TypeSixMachineModifier<DIM>::UpdateCellData(AbstractCellPopulation<DIM,DIM>
     //rCellPopulation.Update();
     double dt = SimulationTime::Instance()->GetTimeStep();
 
+    if (mMachineUpdateInterval > 1u)
+    {
+        UpdateMachinesOverInterval(rCellPopulation, mMachineUpdateInterval * dt);
+        return;
+    }
 
     // Iterate over cell population and update machines
 	for (typename AbstractCellPopulation<DIM>::Iterator cell_iter = rCellPopulation.Begin();
@@ -419,34 +460,7 @@ void TypeSixMachineModifier<DIM>::UpdateCellData(AbstractCellPopulation<DIM,DIM>
 
 			if (r < mk_1*dt)
 			{
-                std::vector<double> machine_coordinates;
-
-                Node<DIM>* p_node = rcapsule_pop.GetNodeCorrespondingToCell(*cell_iter);
-                double L = p_node->rGetNodeAttributes()[NA_LENGTH];
-                double radius = p_node->rGetNodeAttributes()[NA_RADIUS];
-
-
-                double 	vertical_coordinate=(L+2.0*radius)*(RandomNumberGenerator::Instance()->ranf()-0.5);
-                machine_coordinates.push_back(vertical_coordinate);
-
-			    if (DIM==2)
-			    {
-
-			    	double r2 =RandomNumberGenerator::Instance()->ranf();
-
-			    	double azimuthal_coordinate=M_PI;
-			    	if (r2>0.5)
-			    	{
-			    		azimuthal_coordinate=-M_PI;
-			    	}
-			    	machine_coordinates.push_back(azimuthal_coordinate);
-			    }
-			    if (DIM ==3)
-				{
-			        double azimuthal_coordinate =  2*M_PI*RandomNumberGenerator::Instance()->ranf();
-			        machine_coordinates.push_back(azimuthal_coordinate);
-
-				}
+                std::vector<double> machine_coordinates = GetNewMachineCoordinates(rcapsule_pop.GetNodeCorrespondingToCell(*cell_iter));
 
 				r_data.emplace_back(std::pair<unsigned, std::vector<double> >(1u, machine_coordinates));
 			}
@@ -492,6 +506,209 @@ void TypeSixMachineModifier<DIM>::UpdateCellData(AbstractCellPopulation<DIM,DIM>
 
 }
 
+template<unsigned DIM>
+c_matrix<double, 5, 5> TypeSixMachineModifier<DIM>::GetMachineRateMatrix()
+{
+    c_matrix<double, 5, 5> rates = zero_matrix<double>(5, 5);
+    rates(1, 0) = mk_2;
+    rates(1, 2) = mk_3;
+    rates(2, 1) = mk_4;
+    rates(2, 3) = mk_5;
+    rates(3, 2) = mk_6;
+    rates(3, 4) = mk_7; // Aggressive type VI fires without any neighbour contact
+    for (unsigned state=1; state<4; state++)
+    {
+        for (unsigned other_state=0; other_state<5; other_state++)
+        {
+            if (other_state != state)
+            {
+                rates(state, state) -= rates(state, other_state);
+            }
+        }
+    }
+    return rates;
+}
+
+template<unsigned DIM>
+c_matrix<double, 5, 5> TypeSixMachineModifier<DIM>::CalculateMachineTransitionProbabilities(const c_matrix<double, 5, 5>& rRates,
+                                                                                             double interval)
+{
+    // Halve the interval until the Taylor series of the exponential converges quickly, then square back up
+    unsigned num_squarings = 0u;
+    double scaled_interval = interval;
+    while (norm_inf(rRates) * scaled_interval > 0.5)
+    {
+        scaled_interval *= 0.5;
+        num_squarings++;
+    }
+
+    const c_matrix<double, 5, 5> scaled_rates = scaled_interval * rRates;
+    c_matrix<double, 5, 5> term = identity_matrix<double>(5);
+    c_matrix<double, 5, 5> probabilities = identity_matrix<double>(5);
+    for (unsigned order=1; order<=12u; order++)
+    {
+        term = prod(term, scaled_rates) / double(order);
+        probabilities += term;
+    }
+    for (unsigned squaring=0; squaring<num_squarings; squaring++)
+    {
+        probabilities = prod(probabilities, probabilities);
+    }
+    return probabilities;
+}
+
+template<unsigned DIM>
+unsigned TypeSixMachineModifier<DIM>::EvolveMachine(const c_matrix<double, 5, 5>& rRates, unsigned state, double duration)
+{
+    double time_left = duration;
+    while (-rRates(state, state) > 0.0)
+    {
+        const double total_rate = -rRates(state, state);
+        time_left -= -log(1.0 - RandomNumberGenerator::Instance()->ranf()) / total_rate;
+        if (time_left <= 0.0)
+        {
+            break;
+        }
+
+        // Jump to another state in proportion to the rates out of this one
+        const double r = total_rate * RandomNumberGenerator::Instance()->ranf();
+        double cumulative_rate = 0.0;
+        unsigned new_state = state;
+        for (unsigned other_state=0; other_state<5; other_state++)
+        {
+            if (other_state != state && rRates(state, other_state) > 0.0)
+            {
+                new_state = other_state;
+                cumulative_rate += rRates(state, other_state);
+                if (r < cumulative_rate)
+                {
+                    break;
+                }
+            }
+        }
+        state = new_state;
+    }
+    return state;
+}
+
+template<unsigned DIM>
+std::vector<double> TypeSixMachineModifier<DIM>::GetNewMachineCoordinates(Node<DIM>* pNode)
+{
+    std::vector<double> machine_coordinates;
+
+    double L = pNode->rGetNodeAttributes()[NA_LENGTH];
+    double radius = pNode->rGetNodeAttributes()[NA_RADIUS];
+
+    double vertical_coordinate=(L+2.0*radius)*(RandomNumberGenerator::Instance()->ranf()-0.5);
+    machine_coordinates.push_back(vertical_coordinate);
+
+    if (DIM==2)
+    {
+        double r2 =RandomNumberGenerator::Instance()->ranf();
+
+        double azimuthal_coordinate=M_PI;
+        if (r2>0.5)
+        {
+            azimuthal_coordinate=-M_PI;
+        }
+        machine_coordinates.push_back(azimuthal_coordinate);
+    }
+    if (DIM ==3)
+    {
+        double azimuthal_coordinate =  2*M_PI*RandomNumberGenerator::Instance()->ranf();
+        machine_coordinates.push_back(azimuthal_coordinate);
+    }
+    return machine_coordinates;
+}
+
+template<unsigned DIM>
+void TypeSixMachineModifier<DIM>::UpdateMachinesOverInterval(AbstractCellPopulation<DIM,DIM>& rCellPopulation, double interval)
+{
+    // The chain is the same for every machine, so its exponential is taken once per update
+    const c_matrix<double, 5, 5> rates = GetMachineRateMatrix();
+    const c_matrix<double, 5, 5> probabilities = CalculateMachineTransitionProbabilities(rates, interval);
+
+    NodeBasedCellPopulationWithCapsules<DIM>& rcapsule_pop=(static_cast<NodeBasedCellPopulationWithCapsules<DIM>&>(rCellPopulation));
+
+    for (typename AbstractCellPopulation<DIM>::Iterator cell_iter = rCellPopulation.Begin();
+         cell_iter != rCellPopulation.End();
+         ++cell_iter)
+    {
+        // Get this cell's type six machine property data
+        CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        if (collection.GetSize() != 1)
+        {
+            EXCEPTION("TypeSixMachineModifier cannot be used unless each cell has a TypeSixMachineProperty");
+        }
+        boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+        std::vector<std::pair<unsigned, std::vector<double>> >& r_data = p_property->rGetMachineData();
+
+        unsigned numMachineFiresInThisTimeStep=0;
+
+        // Keep the machines that are not in state 0 at the end of the interval
+        std::vector<std::pair<unsigned, std::vector<double>> > new_data;
+        new_data.reserve(r_data.size());
+        for (auto& r_pair : r_data)
+        {
+            const double r = RandomNumberGenerator::Instance()->ranf();
+            unsigned new_state = 0u;
+            double cumulative_probability = probabilities(r_pair.first, 0u);
+            while (new_state < 4u && r >= cumulative_probability)
+            {
+                new_state++;
+                cumulative_probability += probabilities(r_pair.first, new_state);
+            }
+
+            if (new_state == 4u)
+            {
+                numMachineFiresInThisTimeStep++;
+            }
+            else if (new_state != 0u)
+            {
+                new_data.emplace_back(std::pair<unsigned, std::vector<double>>(new_state, r_pair.second));
+            }
+        }
+
+        // Machines are created at rate k_1, and followed from their arrival to the end of the interval
+        if (mk_1 > 0.0)
+        {
+            double arrival_time = -log(1.0 - RandomNumberGenerator::Instance()->ranf()) / mk_1;
+            while (arrival_time < interval)
+            {
+                const unsigned new_state = EvolveMachine(rates, 1u, interval - arrival_time);
+                if (new_state == 4u)
+                {
+                    numMachineFiresInThisTimeStep++;
+                }
+                else if (new_state != 0u)
+                {
+                    new_data.emplace_back(std::pair<unsigned, std::vector<double>>(new_state, GetNewMachineCoordinates(rcapsule_pop.GetNodeCorrespondingToCell(*cell_iter))));
+                }
+                arrival_time += -log(1.0 - RandomNumberGenerator::Instance()->ranf()) / mk_1;
+            }
+        }
+
+        r_data = new_data;
+        p_property->SetNumMachineFiresInThisTimeStep(numMachineFiresInThisTimeStep);
+    }
+}
+
+template<unsigned DIM>
+void TypeSixMachineModifier<DIM>::ResetMachineFires(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+{
+    for (typename AbstractCellPopulation<DIM>::Iterator cell_iter = rCellPopulation.Begin();
+         cell_iter != rCellPopulation.End();
+         ++cell_iter)
+    {
+        CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        if (collection.GetSize() != 1)
+        {
+            EXCEPTION("TypeSixMachineModifier cannot be used unless each cell has a TypeSixMachineProperty");
+        }
+        boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty())->SetNumMachineFiresInThisTimeStep(0u);
+    }
+}
+
 template<unsigned DIM>
 void TypeSixMachineModifier<DIM>::UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
 {
@@ -505,6 +722,9 @@ void TypeSixMachineModifier<DIM>::UpdateAtEndOfSolve(AbstractCellPopulation<DIM,
 template<unsigned DIM>
 void TypeSixMachineModifier<DIM>::OutputSimulationModifierParameters(out_stream& rParamsFile)
 {
+    *rParamsFile << "\t\t\t<MachineUpdateInterval>" << mMachineUpdateInterval << "</MachineUpdateInterval>\n";
+
+    // Call method on direct parent class
     AbstractCellBasedSimulationModifier<DIM>::OutputSimulationModifierParameters(rParamsFile);
 }
 
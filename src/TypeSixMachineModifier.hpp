@@ -6,6 +6,7 @@
 #include <boost/serialization/base_object.hpp>
 
 #include "AbstractCellBasedSimulationModifier.hpp"
+#include "UblasMatrixInclude.hpp"
 
 /**
  * \todo Document class
@@ -23,6 +24,64 @@ private:
     /** Meta results file for VTK. */
     out_stream mpVtkMetaFile;
 
+    /**
+     * The number of mechanics time steps between updates of the machines. Defaults to 1, which updates them every
+     * step with the original first-order scheme; larger intervals integrate the machine rates exactly over the
+     * interval.
+     */
+    unsigned mMachineUpdateInterval;
+
+    /**
+     * @return the generator of the machine state chain, between states 0 to 3 and a fifth state for machines that
+     *     fired from state 3; both states 0 and 4 are absorbing
+     */
+    c_matrix<double, 5, 5> GetMachineRateMatrix();
+
+    /**
+     * Calculate the probabilities of each machine state after an interval, from each state at its start, as the
+     * matrix exponential of the generator by scaling and squaring.
+     *
+     * @param rRates the generator, from GetMachineRateMatrix()
+     * @param interval the interval
+     * @return the transition probabilities, with rows for the state at the start
+     */
+    c_matrix<double, 5, 5> CalculateMachineTransitionProbabilities(const c_matrix<double, 5, 5>& rRates, double interval);
+
+    /**
+     * Follow a machine jump by jump over a given duration.
+     *
+     * @param rRates the generator, from GetMachineRateMatrix()
+     * @param state the state of the machine at the start
+     * @param duration the duration
+     * @return the state of the machine at the end, 4 if it fired
+     */
+    unsigned EvolveMachine(const c_matrix<double, 5, 5>& rRates, unsigned state, double duration);
+
+    /**
+     * Place a new machine at random on the surface of a capsule.
+     *
+     * @param pNode the node of the capsule
+     * @return the coordinates of the machine along and around the capsule
+     */
+    std::vector<double> GetNewMachineCoordinates(Node<DIM>* pNode);
+
+    /**
+     * Update the machines of every cell over mMachineUpdateInterval time steps at once. Each existing machine jumps
+     * straight to its state at the end of the interval, new machines arrive at exponentially distributed intervals
+     * and are followed from their arrival, and machines that end in state 0 are removed.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param interval the time since the last update
+     */
+    void UpdateMachinesOverInterval(AbstractCellPopulation<DIM,DIM>& rCellPopulation, double interval);
+
+    /**
+     * Set the number of machine fires of every cell to zero, without updating the machines.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void ResetMachineFires(AbstractCellPopulation<DIM,DIM>& rCellPopulation);
+
 public:
 
     /**
@@ -108,6 +167,22 @@ public:
     void SetMachineParametersFromGercEtAl();
     void SetContactDependentFiring();
 
+    /**
+     * Set the number of mechanics time steps between updates of the machines. With an interval of more than one,
+     * the machines are updated on every time step that is a multiple of it, exactly over the time since the last
+     * update, so the rates need not be small compared to the inverse time step; the number of machine fires of a
+     * cell then counts those over the whole interval on the step of the update, and is zero on the steps between.
+     * The machines are not updated in SetupSolve(), so the first update covers the first interval.
+     *
+     * @param machineUpdateInterval the number of time steps
+     */
+    void SetMachineUpdateInterval(unsigned machineUpdateInterval);
+
+    /**
+     * @return the number of mechanics time steps between updates of the machines
+     */
+    unsigned GetMachineUpdateInterval();
+
 
 
 
@@ -47,7 +47,54 @@ enum NodeAttributeVectorPositions : std::size_t
     NA_RADIUS,
     NA_APPLIED_THETA, // For 2D and 3D
     NA_APPLIED_PHI, // For 3D
+    NA_ASLEEP, // Non-zero while the capsule is held still by the numerical method's sleeping scheme
+    NA_NUM_QUIET_STEPS, // The number of consecutive steps the capsule has been below the sleeping thresholds
+    NA_DIRECTOR_X, // The unit axis, when the orientation is held as a director rather than as angles; zero otherwise
+    NA_DIRECTOR_Y,
+    NA_DIRECTOR_Z, // For 3D
+    NA_APPLIED_TORQUE_Y, // For 3D: the y component of the applied torque, whose z and -x components are NA_APPLIED_THETA and NA_APPLIED_PHI
+    NA_TRANSLATIONAL_MOBILITY, // The reciprocal of the capsule's mass, cached by the numerical method
+    NA_ROTATIONAL_MOBILITY, // The reciprocal of the capsule's moment of inertia, cached by the numerical method
+    NA_MOBILITY_LENGTH, // The length for which the mobilities were cached
+    NA_MOBILITY_RADIUS, // The radius for which the mobilities were cached
+    NA_BIRTH_LENGTH, // The length of the capsule when its cell was born, set by the numerical method's growth law; zero until set
+    NA_MOTHER_LENGTH, // The length of the capsule's mother when it divided; zero for a capsule that was not born by division
+    NA_RATE_CLASS, // The multirate numerical method's rate class; a capsule of class k moves every 2^k steps
+    NA_STEPS_SINCE_UPDATE, // The number of steps since the multirate numerical method last moved the capsule
+    NA_ACCUMULATED_FORCE_X, // The applied force summed over the steps since the capsule last moved, under the multirate numerical method
+    NA_ACCUMULATED_FORCE_Y,
+    NA_ACCUMULATED_FORCE_Z, // For 3D
+    NA_ACCUMULATED_THETA, // NA_APPLIED_THETA summed over the same steps
+    NA_ACCUMULATED_PHI, // For 3D: NA_APPLIED_PHI summed over the same steps
+    NA_ACCUMULATED_TORQUE_Y, // For 3D: NA_APPLIED_TORQUE_Y summed over the same steps
     NA_VEC_LENGTH
 };
 
+/**
+ *  The force laws that CapsuleForce can use between two capsules.
+ */
+enum CapsuleContactLawType
+{
+    CCL_HERTZ,                // Hertz repulsion (Farrell et al)
+    CCL_LINEAR_SPRING,        // Repulsion proportional to the overlap
+    CCL_HERTZ_WITH_ADHESION   // Hertz repulsion plus a short-range attraction between nearly touching capsules
+};
+
+enum CapsuleRungeKuttaScheme
+{
+    CRK_HEUN,        // The second order trapezoidal predictor-corrector, with two force evaluations per step
+    CRK_CLASSIC_RK4  // The classic fourth order Runge-Kutta method, with four force evaluations per step
+};
+
+/**
+ *  The laws by which the numerical method grows each capsule from its birth length to its division length over its
+ *  cell cycle.
+ */
+enum CapsuleGrowthLawType
+{
+    CGL_LINEAR,       // Length grows at a constant rate, and division length is twice the birth length plus four radii
+    CGL_EXPONENTIAL,  // Length grows at a constant relative rate, with the same division length as CGL_LINEAR
+    CGL_ADDER         // Length grows at a constant relative rate, and division length is the birth length plus a fixed increment
+};
+
 #endif // TYPESIXSECRETIONENUMERATIONS_HPP_
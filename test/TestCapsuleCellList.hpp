@@ -0,0 +1,276 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULECELLLIST_HPP_
+#define _TESTCAPSULECELLLIST_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CapsuleCellList.hpp"
+#include "CapsuleContactKernel.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleGeometryCache.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+#include <set>
+
+class TestCapsuleCellList : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * Scatter long, thin capsules at random and check that the cell list finds every pair within extraReach of
+     * touching, with no pair listed twice.
+     */
+    template<unsigned DIM>
+    void CheckCandidatePairs(unsigned numCapsules, double boxSize, double extraReach)
+    {
+        RandomNumberGenerator* p_gen = RandomNumberGenerator::Instance();
+
+        std::vector<Node<DIM>*> nodes;
+        for (unsigned index=0; index<numCapsules; index++)
+        {
+            c_vector<double, DIM> location;
+            for (unsigned dim=0; dim<DIM; dim++)
+            {
+                location[dim] = boxSize * p_gen->ranf();
+            }
+            nodes.push_back(new Node<DIM>(index, location, false));
+        }
+
+        NodesOnlyMesh<DIM> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 1.0);
+
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = mesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = 2.0 * M_PI * p_gen->ranf();
+            attributes[NA_PHI] = M_PI * p_gen->ranf();
+            attributes[NA_LENGTH] = 2.0 + 8.0 * p_gen->ranf();
+            attributes[NA_RADIUS] = 0.2 + 0.3 * p_gen->ranf();
+        }
+
+        CapsuleGeometryCache<DIM> geometry;
+        geometry.Update(mesh);
+
+        CapsuleCellList<DIM> cell_list;
+        cell_list.Build(mesh, geometry, extraReach);
+
+        std::set<std::pair<unsigned, unsigned> > candidates;
+        for (auto& r_pair : cell_list.rGetNodePairs())
+        {
+            unsigned index_a = r_pair.first->GetIndex();
+            unsigned index_b = r_pair.second->GetIndex();
+            TS_ASSERT_DIFFERS(index_a, index_b);
+            candidates.insert(std::make_pair(std::min(index_a, index_b), std::max(index_a, index_b)));
+        }
+        TS_ASSERT_EQUALS(candidates.size(), cell_list.rGetNodePairs().size());
+
+        // Every pair within reach, found by brute force, must be a candidate
+        unsigned num_within_reach = 0;
+        for (unsigned index_a=0; index_a<numCapsules; index_a++)
+        {
+            for (unsigned index_b=index_a+1; index_b<numCapsules; index_b++)
+            {
+                CapsuleContactBatch<DIM> batch;
+                for (unsigned dim=0; dim<DIM; dim++)
+                {
+                    batch.mPointA1[dim][0] = geometry.rGetEndPointsOne(dim)[index_a];
+                    batch.mPointA2[dim][0] = geometry.rGetEndPointsTwo(dim)[index_a];
+                    batch.mPointB1[dim][0] = geometry.rGetEndPointsOne(dim)[index_b];
+                    batch.mPointB2[dim][0] = geometry.rGetEndPointsTwo(dim)[index_b];
+                }
+                batch.mLengthA[0] = 2.0 * geometry.GetHalfLength(index_a);
+                batch.mLengthB[0] = 2.0 * geometry.GetHalfLength(index_b);
+                CapsuleContactKernel<DIM>::CalculateBatch(batch, 1u);
+
+                if (batch.mDistance[0] < geometry.GetRadius(index_a) + geometry.GetRadius(index_b) + extraReach)
+                {
+                    num_within_reach++;
+                    TS_ASSERT_EQUALS(candidates.count(std::make_pair(index_a, index_b)), 1u);
+                }
+            }
+        }
+
+        // The test means nothing unless some pairs are in reach, and the cell list is only useful if it rules out
+        // most of the rest
+        TS_ASSERT_LESS_THAN(0u, num_within_reach);
+        TS_ASSERT_LESS_THAN(candidates.size(), numCapsules * (numCapsules - 1u) / 8u);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+public:
+
+    void TestCandidatePairs2d()
+    {
+        CheckCandidatePairs<2>(400u, 60.0, 0.0);
+        CheckCandidatePairs<2>(400u, 60.0, 0.5);
+    }
+
+    void TestCandidatePairs3d()
+    {
+        CheckCandidatePairs<3>(400u, 25.0, 0.0);
+        CheckCandidatePairs<3>(400u, 25.0, 0.5);
+    }
+
+    void TestSampleSpacing()
+    {
+        CapsuleCellList<2> cell_list;
+        TS_ASSERT_DELTA(cell_list.GetSampleSpacing(), 1.0, 1e-12);
+        TS_ASSERT_THROWS_THIS(cell_list.SetSampleSpacing(0.0), "The sample spacing of a capsule cell list must be positive.");
+
+        cell_list.SetSampleSpacing(0.5);
+        TS_ASSERT_DELTA(cell_list.GetSampleSpacing(), 0.5, 1e-12);
+
+        // A single capsule of radius 0.5 gives cells of side 2R + extra reach + sample spacing
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, false, 0.0, 0.0));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 1.0);
+        mesh.GetNode(0u)->AddNodeAttribute(0.0);
+        mesh.GetNode(0u)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+
+        CapsuleGeometryCache<2> geometry;
+        geometry.Update(mesh);
+        cell_list.Build(mesh, geometry, 0.25);
+
+        TS_ASSERT_DELTA(cell_list.GetCellSize(), 1.75, 1e-12);
+        TS_ASSERT_EQUALS(cell_list.GetNumCells(), 2u);
+        TS_ASSERT_EQUALS(cell_list.rGetNodePairs().size(), 0u);
+
+        delete nodes[0];
+    }
+
+    void TestCapsuleForceWithCellList()
+    {
+        // Rows of long capsules touching end to end and side by side
+        std::vector<Node<2>*> nodes;
+        for (unsigned i=0; i<8; i++)
+        {
+            for (unsigned j=0; j<16; j++)
+            {
+                nodes.push_back(new Node<2>(16u*i + j, false, 6.4 * i, 0.45 * j));
+            }
+        }
+
+        // The population's node pairs need a cutoff that covers the whole length of two capsules
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 7.0);
+
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->AddNodeAttribute(0.0);
+            mesh.GetNode(index)->ClearAppliedForce();
+            std::vector<double>& attributes = mesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = 0.01 * sin(double(index));
+            attributes[NA_LENGTH] = 6.0;
+            attributes[NA_RADIUS] = 0.25;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        force.AddForceContribution(population);
+
+        std::vector<c_vector<double, 2> > reference_forces;
+        std::vector<double> reference_angles;
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            reference_forces.push_back(mesh.GetNode(index)->rGetAppliedForce());
+            reference_angles.push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_APPLIED_THETA]);
+        }
+        TS_ASSERT_LESS_THAN(0.0, norm_2(reference_forces[9]));
+
+        TS_ASSERT_EQUALS(force.GetUseCapsuleCellList(), false);
+        force.SetUseCapsuleCellList(true);
+        TS_ASSERT_EQUALS(force.GetUseCapsuleCellList(), true);
+
+        // The same forces, with and without a Verlet list on top
+        for (unsigned use_verlet=0; use_verlet<2; use_verlet++)
+        {
+            force.SetUseVerletList(use_verlet == 1u);
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                mesh.GetNode(index)->ClearAppliedForce();
+            }
+            force.AddForceContribution(population);
+
+            // Candidates are listed by the cell list in a different order, so contributions are summed differently
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[0], reference_forces[index][0], 1e-10);
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[1], reference_forces[index][1], 1e-10);
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetNodeAttributes()[NA_APPLIED_THETA], reference_angles[index], 1e-10);
+            }
+
+            // Without the Verlet skin, the cell list is more selective than the node pairs
+            if (use_verlet == 0u)
+            {
+                TS_ASSERT_LESS_THAN(force.rGetCapsuleCellList().rGetNodePairs().size(), population.rGetNodePairs().size());
+            }
+        }
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+};
+
+#endif /*_TESTCAPSULECELLLIST_HPP_*/
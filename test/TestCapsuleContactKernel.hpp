@@ -0,0 +1,242 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULECONTACTKERNEL_HPP_
+#define _TESTCAPSULECONTACTKERNEL_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "CheckpointArchiveTypes.hpp"
+
+#include "CapsuleContactKernel.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleGeometryCache.hpp"
+#include "Node.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestCapsuleContactKernel : public CxxTest::TestSuite
+{
+private:
+
+    /**
+     * Give a node the attributes of a capsule.
+     */
+    template<unsigned DIM>
+    void SetUpCapsule(Node<DIM>& rNode, double theta, double phi, double length, double radius)
+    {
+        rNode.AddNodeAttribute(0.0);
+        std::vector<double>& attributes = rNode.rGetNodeAttributes();
+        attributes.resize(NA_VEC_LENGTH);
+        attributes[NA_THETA] = theta;
+        attributes[NA_PHI] = phi;
+        attributes[NA_LENGTH] = length;
+        attributes[NA_RADIUS] = radius;
+    }
+
+    /**
+     * Run each pair through the kernel, in batches of every possible size, and check that the results agree with the
+     * scalar routine in CapsuleForce. In single precision the distances must agree closely, but the direction and
+     * contact points are only compared for pairs that are clearly apart and far from parallel, as elsewhere they are
+     * ill-conditioned.
+     */
+    template<unsigned DIM>
+    void CompareWithScalarRoutine(std::vector<Node<DIM>*>& rNodesA, std::vector<Node<DIM>*>& rNodesB, bool singlePrecision=false)
+    {
+        CapsuleForce<DIM, DIM> force;
+
+        for (unsigned batch_size=1; batch_size<=CAPSULE_CONTACT_BATCH_SIZE; batch_size++)
+        {
+            for (unsigned batch_start=0; batch_start<rNodesA.size(); batch_start+=batch_size)
+            {
+                const unsigned num_pairs = std::min(batch_size, unsigned(rNodesA.size()) - batch_start);
+
+                CapsuleContactBatch<DIM> batch;
+                for (unsigned lane=0; lane<num_pairs; lane++)
+                {
+                    CapsuleGeometryCache<DIM> geometry;
+                    geometry.SetCapsule(0u, *rNodesA[batch_start + lane]);
+                    geometry.SetCapsule(1u, *rNodesB[batch_start + lane]);
+
+                    for (unsigned dim=0; dim<DIM; dim++)
+                    {
+                        batch.mPointA1[dim][lane] = geometry.GetEndPointOne(0u)[dim];
+                        batch.mPointA2[dim][lane] = geometry.GetEndPointTwo(0u)[dim];
+                        batch.mPointB1[dim][lane] = geometry.GetEndPointOne(1u)[dim];
+                        batch.mPointB2[dim][lane] = geometry.GetEndPointTwo(1u)[dim];
+                    }
+                    batch.mLengthA[lane] = rNodesA[batch_start + lane]->rGetNodeAttributes()[NA_LENGTH];
+                    batch.mLengthB[lane] = rNodesB[batch_start + lane]->rGetNodeAttributes()[NA_LENGTH];
+                }
+
+                if (singlePrecision)
+                {
+                    CapsuleContactKernel<DIM>::CalculateBatchInSinglePrecision(batch, num_pairs);
+                }
+                else
+                {
+                    CapsuleContactKernel<DIM>::CalculateBatch(batch, num_pairs);
+                }
+
+                for (unsigned lane=0; lane<num_pairs; lane++)
+                {
+                    Node<DIM>& r_node_a = *rNodesA[batch_start + lane];
+                    Node<DIM>& r_node_b = *rNodesB[batch_start + lane];
+
+                    c_vector<double, DIM> vec_a_to_b;
+                    double contact_dist_a;
+                    double contact_dist_b;
+                    double overlap = force.CalculateForceDirectionAndContactPoints(r_node_a, r_node_b, vec_a_to_b,
+                                                                                   contact_dist_a, contact_dist_b);
+
+                    double distance = r_node_a.rGetNodeAttributes()[NA_RADIUS] + r_node_b.rGetNodeAttributes()[NA_RADIUS] - overlap;
+
+                    if (!singlePrecision)
+                    {
+                        TS_ASSERT_DELTA(batch.mDistance[lane], distance, 1e-12);
+                        for (unsigned dim=0; dim<DIM; dim++)
+                        {
+                            TS_ASSERT_DELTA(batch.mDirection[dim][lane], vec_a_to_b[dim], 1e-12);
+                        }
+                        TS_ASSERT_DELTA(batch.mContactDistA[lane], contact_dist_a, 1e-12);
+                        TS_ASSERT_DELTA(batch.mContactDistB[lane], contact_dist_b, 1e-12);
+                    }
+                    else
+                    {
+                        TS_ASSERT_DELTA(batch.mDistance[lane], distance, 1e-5);
+
+                        CapsuleGeometryCache<DIM> geometry;
+                        geometry.SetCapsule(0u, r_node_a);
+                        geometry.SetCapsule(1u, r_node_b);
+                        const double cos_angle = inner_prod(geometry.GetAxis(0u), geometry.GetAxis(1u));
+
+                        if (distance > 1e-3 && cos_angle * cos_angle < 0.99)
+                        {
+                            for (unsigned dim=0; dim<DIM; dim++)
+                            {
+                                TS_ASSERT_DELTA(batch.mDirection[dim][lane], vec_a_to_b[dim], 1e-3);
+                            }
+                            TS_ASSERT_DELTA(batch.mContactDistA[lane], contact_dist_a, 1e-3);
+                            TS_ASSERT_DELTA(batch.mContactDistB[lane], contact_dist_b, 1e-3);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+public:
+
+    void TestKernelAgreesWithScalarRoutineIn2d()
+    {
+        std::cout << "Capsule contact kernel compiled for " << CapsuleContactKernel<2>::GetInstructionSet() << std::endl;
+
+        RandomNumberGenerator* p_gen = RandomNumberGenerator::Instance();
+
+        std::vector<Node<2>*> nodes_a;
+        std::vector<Node<2>*> nodes_b;
+
+        // Special cases: parallel and side by side, parallel and in line, parallel and coincident, crossing, T shape
+        const double special_cases[5][6] = {{0.0, 0.0, 0.0, 0.0, 0.8, 0.0},
+                                            {0.0, 0.0, 0.0, 3.0, 0.0, 0.0},
+                                            {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+                                            {0.0, 0.0, 0.0, 0.0, 0.0, 0.5 * M_PI},
+                                            {0.0, 0.0, 0.0, 0.0, 1.5, 0.5 * M_PI}};
+        for (unsigned i=0; i<5; i++)
+        {
+            nodes_a.push_back(new Node<2>(0u, std::vector<double>{special_cases[i][0], special_cases[i][1]}));
+            nodes_b.push_back(new Node<2>(1u, std::vector<double>{special_cases[i][3], special_cases[i][4]}));
+            SetUpCapsule(*nodes_a.back(), special_cases[i][2], 0.0, 2.0, 0.5);
+            SetUpCapsule(*nodes_b.back(), special_cases[i][5], 0.0, 2.0, 0.5);
+        }
+
+        // Random configurations, some of which overlap
+        for (unsigned i=0; i<200; i++)
+        {
+            nodes_a.push_back(new Node<2>(0u, std::vector<double>{4.0 * p_gen->ranf(), 4.0 * p_gen->ranf()}));
+            nodes_b.push_back(new Node<2>(1u, std::vector<double>{4.0 * p_gen->ranf(), 4.0 * p_gen->ranf()}));
+            SetUpCapsule(*nodes_a.back(), 2.0 * M_PI * p_gen->ranf(), 0.0, 1.0 + 3.0 * p_gen->ranf(), 0.5);
+            SetUpCapsule(*nodes_b.back(), 2.0 * M_PI * p_gen->ranf(), 0.0, 1.0 + 3.0 * p_gen->ranf(), 0.5);
+        }
+
+        CompareWithScalarRoutine(nodes_a, nodes_b);
+        CompareWithScalarRoutine(nodes_a, nodes_b, true);
+
+        for (unsigned i=0; i<nodes_a.size(); i++)
+        {
+            delete nodes_a[i];
+            delete nodes_b[i];
+        }
+    }
+
+    void TestKernelAgreesWithScalarRoutineIn3d()
+    {
+        RandomNumberGenerator* p_gen = RandomNumberGenerator::Instance();
+
+        std::vector<Node<3>*> nodes_a;
+        std::vector<Node<3>*> nodes_b;
+
+        // Parallel capsules standing side by side, and two perpendicular capsules one above the other
+        nodes_a.push_back(new Node<3>(0u, std::vector<double>{0.0, 0.0, 0.0}));
+        nodes_b.push_back(new Node<3>(1u, std::vector<double>{0.7, 0.0, 0.0}));
+        SetUpCapsule(*nodes_a.back(), 0.0, 0.0, 2.0, 0.5);
+        SetUpCapsule(*nodes_b.back(), 0.0, 0.0, 2.0, 0.5);
+
+        nodes_a.push_back(new Node<3>(0u, std::vector<double>{0.0, 0.0, 0.0}));
+        nodes_b.push_back(new Node<3>(1u, std::vector<double>{0.0, 0.0, 0.9}));
+        SetUpCapsule(*nodes_a.back(), 0.0, 0.5 * M_PI, 2.0, 0.5);
+        SetUpCapsule(*nodes_b.back(), 0.5 * M_PI, 0.5 * M_PI, 2.0, 0.5);
+
+        for (unsigned i=0; i<200; i++)
+        {
+            nodes_a.push_back(new Node<3>(0u, std::vector<double>{3.0 * p_gen->ranf(), 3.0 * p_gen->ranf(), 3.0 * p_gen->ranf()}));
+            nodes_b.push_back(new Node<3>(1u, std::vector<double>{3.0 * p_gen->ranf(), 3.0 * p_gen->ranf(), 3.0 * p_gen->ranf()}));
+            SetUpCapsule(*nodes_a.back(), 2.0 * M_PI * p_gen->ranf(), M_PI * p_gen->ranf(), 1.0 + 3.0 * p_gen->ranf(), 0.5);
+            SetUpCapsule(*nodes_b.back(), 2.0 * M_PI * p_gen->ranf(), M_PI * p_gen->ranf(), 1.0 + 3.0 * p_gen->ranf(), 0.5);
+        }
+
+        CompareWithScalarRoutine(nodes_a, nodes_b);
+        CompareWithScalarRoutine(nodes_a, nodes_b, true);
+
+        for (unsigned i=0; i<nodes_a.size(); i++)
+        {
+            delete nodes_a[i];
+            delete nodes_b[i];
+        }
+    }
+};
+
+#endif /*_TESTCAPSULECONTACTKERNEL_HPP_*/
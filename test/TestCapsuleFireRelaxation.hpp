@@ -0,0 +1,343 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULEFIRERELAXATION_HPP_
+#define _TESTCAPSULEFIRERELAXATION_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include <cfloat>
+
+#include "CheckpointArchiveTypes.hpp"
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CapsuleFireRelaxation.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleOrientation.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "SmartPointers.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+#include "PetscSetupAndFinalize.hpp"
+
+class TestCapsuleFireRelaxation : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * Give every node of a mesh the attributes of a capsule of length 2 and radius 0.5.
+     *
+     * @param rMesh the mesh
+     * @param rThetas the angle theta of each capsule
+     */
+    template<unsigned DIM>
+    void SetUpCapsules(NodesOnlyMesh<DIM>& rMesh, const std::vector<double>& rThetas)
+    {
+        for (unsigned index=0; index<rMesh.GetNumNodes(); index++)
+        {
+            rMesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = rMesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = rThetas[index];
+            attributes[NA_PHI] = 0.5 * M_PI;
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+    }
+
+public:
+
+    void TestParameters()
+    {
+        CapsuleFireRelaxation<2> relaxation;
+        TS_ASSERT_DELTA(relaxation.GetForceTolerance(), 1e-3, 1e-12);
+        TS_ASSERT_EQUALS(relaxation.GetMaxNumIterations(), 10000u);
+        TS_ASSERT_DELTA(relaxation.GetMaxStep(), 0.05, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetInitialTimeStep(), 0.05, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetMaxTimeStep(), 0.5, 1e-12);
+        TS_ASSERT_EQUALS(relaxation.GetNumForceEvaluations(), 0u);
+        TS_ASSERT_EQUALS(relaxation.GetNumIterations(), 0u);
+        TS_ASSERT_EQUALS(relaxation.GetNumNeighbourUpdates(), 0u);
+
+        relaxation.SetForceTolerance(1e-4);
+        TS_ASSERT_DELTA(relaxation.GetForceTolerance(), 1e-4, 1e-12);
+        relaxation.SetMaxNumIterations(500u);
+        TS_ASSERT_EQUALS(relaxation.GetMaxNumIterations(), 500u);
+        relaxation.SetMaxStep(0.1);
+        TS_ASSERT_DELTA(relaxation.GetMaxStep(), 0.1, 1e-12);
+
+        // Setting the initial step resets the longest one to ten times it
+        relaxation.SetInitialTimeStep(0.02);
+        TS_ASSERT_DELTA(relaxation.GetInitialTimeStep(), 0.02, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetMaxTimeStep(), 0.2, 1e-12);
+        relaxation.SetMaxTimeStep(0.3);
+        TS_ASSERT_DELTA(relaxation.GetMaxTimeStep(), 0.3, 1e-12);
+
+        TS_ASSERT_THROWS_THIS(relaxation.SetForceTolerance(0.0), "The force tolerance must be positive.");
+        TS_ASSERT_THROWS_THIS(relaxation.SetMaxStep(-1.0), "The maximum step must be positive.");
+        TS_ASSERT_THROWS_THIS(relaxation.SetInitialTimeStep(0.0), "The initial time step must be positive.");
+        TS_ASSERT_THROWS_THIS(relaxation.SetMaxTimeStep(0.01),
+                              "The maximum time step must be no shorter than the initial time step.");
+    }
+
+    void TestRelaxOverlappingPair()
+    {
+        // Two parallel capsules overlapping by 0.2, offset along their axes
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, false, 0.0, 0.0));
+        nodes.push_back(new Node<2>(1u, false, 0.3, 0.8));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 4.0);
+        SetUpCapsules(mesh, std::vector<double>{0.0, 0.0});
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        const std::vector<c_vector<double, 2> > start_locations = {mesh.GetNode(0)->rGetLocation(), mesh.GetNode(1)->rGetLocation()};
+        const std::vector<std::vector<double> > start_attributes = {mesh.GetNode(0)->rGetNodeAttributes(),
+                                                                    mesh.GetNode(1)->rGetNodeAttributes()};
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        p_force->SetCalculateContactStatistics(true);
+
+        // The capsules are pushed apart until the overlap, and the force it gives rise to, have all but gone
+        CapsuleFireRelaxation<2> relaxation;
+        TS_ASSERT(relaxation.Relax(population, *p_force));
+        TS_ASSERT_LESS_THAN(relaxation.GetMaxForce(), relaxation.GetForceTolerance());
+        TS_ASSERT_EQUALS(relaxation.GetNumForceEvaluations(), relaxation.GetNumIterations() + 1u);
+        TS_ASSERT_LESS_THAN(p_force->GetTotalOverlap(0u), 1e-3);
+        TS_ASSERT_LESS_THAN(p_force->GetTotalOverlap(1u), 1e-3);
+        TS_ASSERT_LESS_THAN(0.99, mesh.GetNode(1)->rGetLocation()[1] - mesh.GetNode(0)->rGetLocation()[1]);
+
+        // The relaxation conserves momentum, so the pair's centre stays put
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetLocation()[0] + mesh.GetNode(1)->rGetLocation()[0], 0.3, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetLocation()[1] + mesh.GetNode(1)->rGetLocation()[1], 0.8, 1e-9);
+
+        const unsigned num_fire_evaluations = relaxation.GetNumForceEvaluations();
+
+        // Relaxing a relaxed packing takes a single force pass
+        TS_ASSERT(relaxation.Relax(population, *p_force));
+        TS_ASSERT_EQUALS(relaxation.GetNumForceEvaluations(), 1u);
+        TS_ASSERT_EQUALS(relaxation.GetNumIterations(), 0u);
+
+        // Overdamped time stepping from the same start slows down as the Hertz force fades with the overlap, and
+        // needs many more force passes to reach the same tolerance
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            mesh.GetNode(i)->rGetModifiableLocation() = start_locations[i];
+            mesh.GetNode(i)->rGetNodeAttributes() = start_attributes[i];
+        }
+        population.Update();
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(p_force);
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+
+        unsigned num_time_steps = 0u;
+        double max_force = DBL_MAX;
+        while (max_force >= relaxation.GetForceTolerance() && num_time_steps < 100000u)
+        {
+            method.UpdateAllNodePositions(0.01);
+            num_time_steps++;
+
+            max_force = 0.0;
+            for (unsigned i=0; i<nodes.size(); i++)
+            {
+                max_force = std::max(max_force, norm_2(mesh.GetNode(i)->rGetAppliedForce()));
+                mesh.GetNode(i)->ClearAppliedForce();
+            }
+        }
+        TS_ASSERT_LESS_THAN(5u * num_fire_evaluations, num_time_steps);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    void TestRelaxDeepOverlap()
+    {
+        // Two parallel capsules overlapping by 0.4, more than half their radius, which a force pass alone rejects
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, false, 0.0, 0.0));
+        nodes.push_back(new Node<2>(1u, false, 0.3, 0.6));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 4.0);
+        SetUpCapsules(mesh, std::vector<double>{0.0, 0.0});
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        p_force->SetCalculateContactStatistics(true);
+        TS_ASSERT_THROWS_THIS(p_force->AddForceContribution(population), "Capsules are overlapping too much.");
+
+        // The relaxation caps the force of the deep overlap and pushes the capsules apart, leaving the force as it was
+        CapsuleFireRelaxation<2> relaxation;
+        TS_ASSERT(relaxation.Relax(population, *p_force));
+        TS_ASSERT_LESS_THAN(relaxation.GetMaxForce(), relaxation.GetForceTolerance());
+        TS_ASSERT_LESS_THAN(p_force->GetTotalOverlap(0u), 1e-3);
+        TS_ASSERT_LESS_THAN(0.99, mesh.GetNode(1)->rGetLocation()[1] - mesh.GetNode(0)->rGetLocation()[1]);
+        TS_ASSERT_LESS_THAN(0u, p_force->GetNumOverlapViolations());
+        TS_ASSERT_EQUALS(p_force->GetUseOverlapRecovery(), false);
+        TS_ASSERT_EQUALS(p_force->GetMaxNumOverlapRelaxationIterations(), 10u);
+
+        // Only the relaxation moved the capsules, so the pair's centre stays put
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetLocation()[0] + mesh.GetNode(1)->rGetLocation()[0], 0.3, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetLocation()[1] + mesh.GetNode(1)->rGetLocation()[1], 0.6, 1e-9);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    void TestRelaxSubCluster()
+    {
+        // A stack of three overlapping capsules, of which the bottom one is held still
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, false, 0.0, 0.0));
+        nodes.push_back(new Node<2>(1u, false, 0.1, 0.85));
+        nodes.push_back(new Node<2>(2u, false, -0.1, 1.7));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 4.0);
+        SetUpCapsules(mesh, std::vector<double>{0.0, 0.05, 0.0});
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        const c_vector<double, 2> fixed_location = mesh.GetNode(0)->rGetLocation();
+        const std::vector<double> fixed_attributes = mesh.GetNode(0)->rGetNodeAttributes();
+
+        CapsuleForce<2, 2> force;
+        CapsuleFireRelaxation<2> relaxation;
+
+        TS_ASSERT_THROWS_THIS(relaxation.Relax(population, force, std::set<unsigned>{1u, 5u}),
+                              "Some of the capsules to relax are not in the population");
+
+        force.SetUseSleeping(true);
+        TS_ASSERT_THROWS_THIS(relaxation.Relax(population, force, std::set<unsigned>{1u, 2u}),
+                              "CapsuleFireRelaxation does not support a CapsuleForce that puts capsules to sleep");
+        force.SetUseSleeping(false);
+
+        TS_ASSERT(relaxation.Relax(population, force, std::set<unsigned>{1u, 2u}));
+
+        // The bottom capsule has not moved, though it is still pushed on, and the others sit clear above it
+        TS_ASSERT_EQUALS(mesh.GetNode(0)->rGetLocation()[0], fixed_location[0]);
+        TS_ASSERT_EQUALS(mesh.GetNode(0)->rGetLocation()[1], fixed_location[1]);
+        TS_ASSERT_EQUALS(mesh.GetNode(0)->rGetNodeAttributes()[NA_THETA], fixed_attributes[NA_THETA]);
+        TS_ASSERT_LESS_THAN(0.99, mesh.GetNode(1)->rGetLocation()[1] - mesh.GetNode(0)->rGetLocation()[1]);
+        TS_ASSERT_LESS_THAN(0.99, mesh.GetNode(2)->rGetLocation()[1] - mesh.GetNode(1)->rGetLocation()[1]);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    void TestRelax3d()
+    {
+        // Two crossed capsules, along x and along y, overlapping by 0.2 in z
+        std::vector<Node<3>*> nodes;
+        nodes.push_back(new Node<3>(0u, false, 0.0, 0.0, 0.0));
+        nodes.push_back(new Node<3>(1u, false, 0.2, -0.3, 0.8));
+
+        NodesOnlyMesh<3> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 4.0);
+        SetUpCapsules(mesh, std::vector<double>{0.0, 0.5 * M_PI});
+
+        // The second capsule holds a director, which is kept in step with its angles
+        c_vector<double, 3> axis;
+        CapsuleOrientation::GetAxis(mesh.GetNode(1)->rGetNodeAttributes(), axis);
+        CapsuleOrientation::SetDirector(mesh.GetNode(1)->rGetNodeAttributes(), axis);
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 3> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<3> population(mesh, cells);
+        population.Update();
+
+        auto p_force = boost::make_shared<CapsuleForce<3, 3> >();
+        p_force->SetCalculateContactStatistics(true);
+
+        CapsuleFireRelaxation<3> relaxation;
+        TS_ASSERT(relaxation.Relax(population, *p_force));
+        TS_ASSERT_LESS_THAN(p_force->GetTotalOverlap(0u), 1e-3);
+        TS_ASSERT_LESS_THAN(p_force->GetTotalOverlap(1u), 1e-3);
+
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            const std::vector<double>& r_attributes = mesh.GetNode(index)->rGetNodeAttributes();
+            CapsuleOrientation::GetAxis(r_attributes, axis);
+            TS_ASSERT_DELTA(norm_2(axis), 1.0, 1e-12);
+            TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(r_attributes), index == 1u);
+        }
+        TS_ASSERT_LESS_THAN(0.99, mesh.GetNode(1)->rGetLocation()[2] - mesh.GetNode(0)->rGetLocation()[2]);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+};
+
+#endif /*_TESTCAPSULEFIRERELAXATION_HPP_*/
@@ -5,6 +5,7 @@
 #include "AbstractCellBasedTestSuite.hpp"
 
 #include "CapsuleForce.hpp"
+#include "CapsuleOverlapSummaryModifier.hpp"
 #include "CellsGenerator.hpp"
 #include "CheckpointArchiveTypes.hpp"
 #include "DifferentiatedCellProliferativeType.hpp"
@@ -12,6 +13,7 @@
 #include "Node.hpp"
 #include "NodeAttributes.hpp"
 #include "NodeBasedCellPopulation.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
 #include "NodesOnlyMesh.hpp"
 #include "OutputFileHandler.hpp"
 #include "PetscTools.hpp"
@@ -22,6 +24,74 @@
 
 class TestCapsuleForce : public AbstractCellBasedTestSuite
 {
+private:
+
+    /**
+     * Set up a mesh of capsules of length 2 and radius 0.5, and a cell for each.
+     *
+     * @param rLocations the centre of each capsule
+     * @param cutOffLength the interaction distance of the mesh
+     * @param rMesh the mesh to construct
+     * @param rCells filled in with a differentiated cell for each capsule
+     * @param rThetas the angle of each capsule; horizontal if empty
+     */
+    void SetUpCapsules(const std::vector<c_vector<double, 2> >& rLocations,
+                       double cutOffLength,
+                       NodesOnlyMesh<2>& rMesh,
+                       std::vector<CellPtr>& rCells,
+                       const std::vector<double>& rThetas=std::vector<double>())
+    {
+        std::vector<Node<2>*> nodes;
+        for (unsigned index=0; index<rLocations.size(); index++)
+        {
+            nodes.push_back(new Node<2>(index, rLocations[index], false));
+        }
+        rMesh.ConstructNodesWithoutMesh(nodes, cutOffLength);
+
+        for (unsigned index=0; index<rMesh.GetNumNodes(); index++)
+        {
+            rMesh.GetNode(index)->AddNodeAttribute(0.0);
+            rMesh.GetNode(index)->ClearAppliedForce();
+            std::vector<double>& attributes = rMesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = rThetas.empty() ? 0.0 : rThetas[index];
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(rCells, rMesh.GetNumNodes(), p_diff_type);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    /**
+     * Set up a square of rows of nearly horizontal capsules, each touching its neighbours above, below and end to
+     * end, as SetUpCapsules().
+     *
+     * @param numRows the number of rows, and of capsules in each
+     * @param rMesh the mesh to construct
+     * @param rCells filled in with a differentiated cell for each capsule
+     */
+    void SetUpRowsOfCapsules(unsigned numRows, NodesOnlyMesh<2>& rMesh, std::vector<CellPtr>& rCells)
+    {
+        std::vector<c_vector<double, 2> > locations;
+        std::vector<double> thetas;
+        for (unsigned i=0; i<numRows; i++)
+        {
+            for (unsigned j=0; j<numRows; j++)
+            {
+                locations.push_back(Create_c_vector(2.9 * i, 0.9 * j));
+                thetas.push_back(0.02 * sin(double(numRows*i + j)));
+            }
+        }
+        SetUpCapsules(locations, 4.0, rMesh, rCells, thetas);
+    }
+
 public:
 
     void TestDistanceBetweenTwoCapsules2d()
@@ -608,6 +678,112 @@ public:
         }
     }
 
+    void TestContactLaws()
+    {
+        CapsuleForce<2, 2> force;
+        TS_ASSERT_EQUALS(force.GetContactLaw(), CCL_HERTZ);
+        TS_ASSERT_DELTA(force.GetInteractionRange(), 0.0, 1e-12);
+
+        // Each law splits the force into a prefactor for the radii and a function of the overlap
+        HertzContactLaw hertz(100.0);
+        TS_ASSERT_DELTA(hertz.CalculateForceMagnitude(1.0, hertz.CalculatePrefactor(4.0, 4.0)), 800.0 / 3.0, 1e-9);
+        TS_ASSERT_DELTA(hertz.CalculateForceMagnitude(0.3, hertz.CalculatePrefactor(0.5, 0.7)),
+                        4.0 * 100.0 * pow(0.3, 1.5) * sqrt(2.0 * 0.5 * 0.7 / 1.2) / 3.0, 1e-9);
+
+        LinearSpringContactLaw linear(20.0);
+        TS_ASSERT_DELTA(linear.CalculateForceMagnitude(0.3, linear.CalculatePrefactor(0.5, 0.7)), 6.0, 1e-12);
+
+        // The adhesive law repels like Hertz when overlapping, and attracts across gaps within its range, most
+        // strongly halfway across
+        HertzWithAdhesionContactLaw adhesive(100.0, 2.0, 0.1);
+        TS_ASSERT_DELTA(adhesive.GetInteractionRange(), 0.1, 1e-12);
+        TS_ASSERT_DELTA(adhesive.CalculateForceMagnitude(0.3, adhesive.CalculatePrefactor(0.5, 0.7)),
+                        hertz.CalculateForceMagnitude(0.3, hertz.CalculatePrefactor(0.5, 0.7)), 1e-9);
+        TS_ASSERT_DELTA(adhesive.CalculateForceMagnitude(-0.05, adhesive.CalculatePrefactor(0.5, 0.5)), -2.0, 1e-12);
+        TS_ASSERT_DELTA(adhesive.CalculateForceMagnitude(-0.1, adhesive.CalculatePrefactor(0.5, 0.5)), 0.0, 1e-12);
+
+        // Each law's stiffness is the derivative of its force with respect to the overlap
+        const double prefactor = hertz.CalculatePrefactor(0.5, 0.7);
+        const double step = 1e-6;
+        TS_ASSERT_DELTA(hertz.CalculateStiffness(0.3, prefactor),
+                        (hertz.CalculateForceMagnitude(0.3 + step, prefactor) - hertz.CalculateForceMagnitude(0.3 - step, prefactor)) / (2.0 * step), 1e-6);
+        TS_ASSERT_DELTA(linear.CalculateStiffness(0.3, linear.CalculatePrefactor(0.5, 0.7)), 20.0, 1e-12);
+        TS_ASSERT_DELTA(adhesive.CalculateStiffness(0.3, prefactor), hertz.CalculateStiffness(0.3, prefactor), 1e-12);
+        TS_ASSERT_DELTA(adhesive.CalculateStiffness(-0.03, prefactor),
+                        (adhesive.CalculateForceMagnitude(-0.03 + step, prefactor) - adhesive.CalculateForceMagnitude(-0.03 - step, prefactor)) / (2.0 * step), 1e-6);
+        TS_ASSERT_DELTA(adhesive.CalculateStiffness(-0.05, prefactor), 0.0, 1e-12);
+        TS_ASSERT_LESS_THAN(adhesive.CalculateStiffness(-0.07, prefactor), 0.0);
+
+        // The force uses the law it is set to
+        force.SetContactLaw(CCL_LINEAR_SPRING);
+        force.SetSpringStiffness(20.0);
+        TS_ASSERT_EQUALS(force.GetContactLaw(), CCL_LINEAR_SPRING);
+        TS_ASSERT_DELTA(force.GetSpringStiffness(), 20.0, 1e-12);
+        TS_ASSERT_DELTA(force.CalculateForceMagnitude(0.2, 0.5, 0.5), 4.0, 1e-12);
+
+        TS_ASSERT_THROWS_THIS(force.SetAdhesionRange(0.0), "The adhesion range must be positive.");
+        force.SetContactLaw(CCL_HERTZ_WITH_ADHESION);
+        force.SetAdhesionStrength(2.0);
+        force.SetAdhesionRange(0.2);
+        TS_ASSERT_DELTA(force.GetAdhesionStrength(), 2.0, 1e-12);
+        TS_ASSERT_DELTA(force.GetAdhesionRange(), 0.2, 1e-12);
+        TS_ASSERT_DELTA(force.GetInteractionRange(), 0.2, 1e-12);
+
+        // Two parallel capsules a gap of 0.1 apart attract each other
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules({Create_c_vector(0.0, 0.0),
+                       Create_c_vector(0.0, 1.1)},
+                      4.0, mesh, cells);
+
+        NodeBasedCellPopulation<2> population(mesh, cells);
+        population.Update();
+
+        force.AddForceContribution(population);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetAppliedForce()[1], 2.0, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetAppliedForce()[1], -2.0, 1e-9);
+
+        // Without adhesion they do not interact
+        force.SetContactLaw(CCL_HERTZ);
+        mesh.GetNode(0)->ClearAppliedForce();
+        mesh.GetNode(1)->ClearAppliedForce();
+        force.AddForceContribution(population);
+        TS_ASSERT_DELTA(norm_2(mesh.GetNode(0)->rGetAppliedForce()), 0.0, 1e-12);
+        TS_ASSERT_DELTA(norm_2(mesh.GetNode(1)->rGetAppliedForce()), 0.0, 1e-12);
+
+        // Nor do they have a contact stiffness, until they overlap
+        c_vector<double, 2> direction_a_to_b;
+        double contact_dist_a;
+        double contact_dist_b;
+        double stiffness;
+        TS_ASSERT_EQUALS(force.CalculateContactStiffness(*mesh.GetNode(0), *mesh.GetNode(1), direction_a_to_b,
+                                                         contact_dist_a, contact_dist_b, stiffness), false);
+        TS_ASSERT_DELTA(stiffness, 0.0, 1e-12);
+
+        mesh.GetNode(1)->rGetModifiableLocation()[1] = 0.9;
+        force.SetContactLaw(CCL_LINEAR_SPRING);
+        TS_ASSERT_EQUALS(force.CalculateContactStiffness(*mesh.GetNode(0), *mesh.GetNode(1), direction_a_to_b,
+                                                         contact_dist_a, contact_dist_b, stiffness), true);
+        TS_ASSERT_DELTA(stiffness, 20.0, 1e-6);
+        TS_ASSERT_DELTA(direction_a_to_b[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(direction_a_to_b[1], 1.0, 1e-12);
+
+        force.SetContactLaw(CCL_HERTZ);
+        TS_ASSERT_EQUALS(force.CalculateContactStiffness(*mesh.GetNode(0), *mesh.GetNode(1), direction_a_to_b,
+                                                         contact_dist_a, contact_dist_b, stiffness), true);
+        TS_ASSERT_DELTA(stiffness, 1.5 * force.CalculateForceMagnitude(0.1, 0.5, 0.5) / 0.1, 1e-4);
+
+        // Overlapping by more than half a radius ends the run, unless overlap recovery caps the overlap
+        mesh.GetNode(1)->rGetModifiableLocation()[1] = 0.6;
+        TS_ASSERT_THROWS_THIS(force.CalculateContactStiffness(*mesh.GetNode(0), *mesh.GetNode(1), direction_a_to_b,
+                                                              contact_dist_a, contact_dist_b, stiffness),
+                              "Capsules are overlapping too much.");
+        force.SetUseOverlapRecovery(true);
+        TS_ASSERT_EQUALS(force.CalculateContactStiffness(*mesh.GetNode(0), *mesh.GetNode(1), direction_a_to_b,
+                                                         contact_dist_a, contact_dist_b, stiffness), true);
+        TS_ASSERT_DELTA(stiffness, 1.5 * force.CalculateForceMagnitude(0.25, 0.5, 0.5) / 0.25, 1e-9);
+    }
+
     void TestAddForceContribution()
     {
         // Create two nodes
@@ -663,6 +839,649 @@ public:
 
         MARK;
     }
+
+    void TestAddForceContributionIsIndependentOfNumThreads()
+    {
+        // Rows of nearly horizontal capsules, each touching its neighbours above, below and end to end
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpRowsOfCapsules(12u, mesh, cells);
+
+        NodeBasedCellPopulation<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        TS_ASSERT_EQUALS(force.GetNumThreads(), 1u);
+        TS_ASSERT_THROWS_THIS(force.SetNumThreads(0u), "The number of threads must be at least one.");
+
+        // Serial reference
+        force.AddForceContribution(population);
+
+        std::vector<c_vector<double, 2> > serial_forces;
+        std::vector<double> serial_angles;
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            serial_forces.push_back(mesh.GetNode(index)->rGetAppliedForce());
+            serial_angles.push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_APPLIED_THETA]);
+        }
+
+        // Some capsules must be in contact for the comparison to mean anything
+        TS_ASSERT_LESS_THAN(0.0, norm_2(serial_forces[13]));
+
+        for (unsigned num_threads=2; num_threads<=5; num_threads++)
+        {
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                mesh.GetNode(index)->ClearAppliedForce();
+            }
+
+            force.SetNumThreads(num_threads);
+            force.AddForceContribution(population);
+
+            // Bitwise identical to the serial result
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                TS_ASSERT_EQUALS(mesh.GetNode(index)->rGetAppliedForce()[0], serial_forces[index][0]);
+                TS_ASSERT_EQUALS(mesh.GetNode(index)->rGetAppliedForce()[1], serial_forces[index][1]);
+                TS_ASSERT_EQUALS(mesh.GetNode(index)->rGetNodeAttributes()[NA_APPLIED_THETA], serial_angles[index]);
+            }
+        }
+    }
+
+    void TestSinglePrecisionDrift()
+    {
+        // The rows of capsules of TestAddForceContributionIsIndependentOfNumThreads, relaxed with the same simple
+        // overdamped scheme in double precision and in single precision
+        NodesOnlyMesh<2> mesh_double;
+        std::vector<CellPtr> cells_double;
+        SetUpRowsOfCapsules(12u, mesh_double, cells_double);
+        NodesOnlyMesh<2> mesh_single;
+        std::vector<CellPtr> cells_single;
+        SetUpRowsOfCapsules(12u, mesh_single, cells_single);
+        NodesOnlyMesh<2>* meshes[2] = {&mesh_double, &mesh_single};
+
+        NodeBasedCellPopulation<2> population_double(mesh_double, cells_double);
+        NodeBasedCellPopulation<2> population_single(mesh_single, cells_single);
+
+        CapsuleForce<2, 2> force_double;
+        CapsuleForce<2, 2> force_single;
+        TS_ASSERT_EQUALS(force_single.GetUseSinglePrecision(), false);
+        force_single.SetUseSinglePrecision(true);
+        TS_ASSERT_EQUALS(force_single.GetUseSinglePrecision(), true);
+
+        std::vector<c_vector<double, 2> > initial_locations;
+        for (unsigned index=0; index<mesh_double.GetNumNodes(); index++)
+        {
+            initial_locations.push_back(mesh_double.GetNode(index)->rGetLocation());
+        }
+
+        const double dt = 0.001;
+        double max_position_drift = 0.0;
+        double max_angle_drift = 0.0;
+        for (unsigned step=1; step<=400; step++)
+        {
+            population_double.Update();
+            population_single.Update();
+            for (unsigned index=0; index<mesh_double.GetNumNodes(); index++)
+            {
+                mesh_double.GetNode(index)->ClearAppliedForce();
+                mesh_single.GetNode(index)->ClearAppliedForce();
+            }
+            force_double.AddForceContribution(population_double);
+            force_single.AddForceContribution(population_single);
+
+            for (unsigned m=0; m<2; m++)
+            {
+                for (unsigned index=0; index<meshes[m]->GetNumNodes(); index++)
+                {
+                    Node<2>* p_node = meshes[m]->GetNode(index);
+                    p_node->rGetModifiableLocation() += dt * p_node->rGetAppliedForce();
+                    p_node->rGetNodeAttributes()[NA_THETA] += dt * p_node->rGetNodeAttributes()[NA_APPLIED_THETA];
+                }
+            }
+
+            for (unsigned index=0; index<mesh_double.GetNumNodes(); index++)
+            {
+                max_position_drift = std::max(max_position_drift,
+                                              norm_2(mesh_double.GetNode(index)->rGetLocation() - mesh_single.GetNode(index)->rGetLocation()));
+                max_angle_drift = std::max(max_angle_drift,
+                                           std::fabs(mesh_double.GetNode(index)->rGetNodeAttributes()[NA_THETA]
+                                                     - mesh_single.GetNode(index)->rGetNodeAttributes()[NA_THETA]));
+            }
+
+            if (step % 100u == 0u)
+            {
+                std::cout << "Single precision drift after " << step << " steps: position " << max_position_drift
+                          << ", angle " << max_angle_drift << std::endl;
+            }
+        }
+
+        // The capsules must have moved for the comparison to mean anything
+        double max_displacement = 0.0;
+        for (unsigned index=0; index<mesh_double.GetNumNodes(); index++)
+        {
+            max_displacement = std::max(max_displacement, norm_2(mesh_double.GetNode(index)->rGetLocation() - initial_locations[index]));
+        }
+        TS_ASSERT_LESS_THAN(1e-2, max_displacement);
+
+        TS_ASSERT_LESS_THAN(max_position_drift, 1e-6);
+        TS_ASSERT_LESS_THAN(max_angle_drift, 1e-6);
+    }
+
+    void TestVerletList()
+    {
+        // Two horizontal capsules just apart, and a third well away from both
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules({Create_c_vector(0.0, 0.0),
+                       Create_c_vector(0.0, 1.2),
+                       Create_c_vector(0.0, 3.0)},
+                      6.0, mesh, cells);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        TS_ASSERT_EQUALS(force.GetUseVerletList(), false);
+        TS_ASSERT_DELTA(force.GetVerletSkin(), 0.5, 1e-12);
+        TS_ASSERT_THROWS_THIS(force.SetVerletSkin(-1.0), "The Verlet skin must be non-negative.");
+
+        force.SetUseVerletList(true);
+        force.SetVerletSkin(0.5);
+
+        // The first call builds the list, keeping only the pair within the skin of touching
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumVerletListRebuilds(), 1u);
+        TS_ASSERT_EQUALS(force.GetNumVerletListSteps(), 1u);
+        TS_ASSERT_EQUALS(force.GetVerletListSize(), 1u);
+        TS_ASSERT_DELTA(norm_2(mesh.GetNode(1u)->rGetAppliedForce()), 0.0, 1e-12);
+
+        // Moving by less than half the skin keeps the list
+        mesh.GetNode(1u)->rGetModifiableLocation()[1] = 1.1;
+        population.Update();
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumVerletListRebuilds(), 1u);
+        TS_ASSERT_EQUALS(force.GetNumVerletListSteps(), 2u);
+
+        // Moving further rebuilds it, and the overlapping pair gives the same force as without the list
+        mesh.GetNode(1u)->rGetModifiableLocation()[1] = 0.9;
+        population.Update();
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->ClearAppliedForce();
+        }
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumVerletListRebuilds(), 2u);
+
+        c_vector<double, 2> verlet_force = mesh.GetNode(1u)->rGetAppliedForce();
+        TS_ASSERT_LESS_THAN(0.0, verlet_force[1]);
+
+        mesh.GetNode(1u)->ClearAppliedForce();
+        CapsuleForce<2, 2> direct_force;
+        direct_force.AddForceContribution(population);
+        TS_ASSERT_DELTA(mesh.GetNode(1u)->rGetAppliedForce()[0], verlet_force[0], 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(1u)->rGetAppliedForce()[1], verlet_force[1], 1e-12);
+    }
+
+    void TestBoundingSphereCounters()
+    {
+        // Capsules 0 and 1 overlap, 3 sits just clear of 1, and 2 is too far from the others for its bounding
+        // sphere to reach theirs
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules({Create_c_vector(0.0, 0.0),
+                       Create_c_vector(0.0, 0.9),
+                       Create_c_vector(3.5, 0.0),
+                       Create_c_vector(0.0, 2.3)},
+                      4.0, mesh, cells);
+
+        NodeBasedCellPopulation<2> population(mesh, cells);
+        population.Update();
+
+        const unsigned long num_pairs = population.rGetNodePairs().size();
+
+        CapsuleForce<2, 2> force;
+        TS_ASSERT_EQUALS(force.GetNumPairsTested(), 0u);
+        TS_ASSERT_EQUALS(force.GetNumPairsRejectedByBoundingSpheres(), 0u);
+        TS_ASSERT_EQUALS(force.GetNumPairsOverlapping(), 0u);
+
+        force.AddForceContribution(population);
+
+        // Only pairs (0,1), (0,3) and (1,3) survive the bounding sphere test, and only (0,1) overlap
+        TS_ASSERT_EQUALS(force.GetNumPairsTested(), num_pairs);
+        TS_ASSERT_EQUALS(force.GetNumPairsRejectedByBoundingSpheres(), num_pairs - 3u);
+        TS_ASSERT_EQUALS(force.GetNumPairsOverlapping(), 1u);
+
+        // The rejected capsule feels no force
+        TS_ASSERT_DELTA(norm_2(mesh.GetNode(2)->rGetAppliedForce()), 0.0, 1e-12);
+        TS_ASSERT_DELTA(norm_2(mesh.GetNode(3)->rGetAppliedForce()), 0.0, 1e-12);
+        TS_ASSERT_LESS_THAN(0.0, norm_2(mesh.GetNode(0)->rGetAppliedForce()));
+
+        // The counters accumulate until reset
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumPairsTested(), 2u * num_pairs);
+        TS_ASSERT_EQUALS(force.GetNumPairsOverlapping(), 2u);
+
+        force.ResetPairCounters();
+        TS_ASSERT_EQUALS(force.GetNumPairsTested(), 0u);
+        TS_ASSERT_EQUALS(force.GetNumPairsRejectedByBoundingSpheres(), 0u);
+        TS_ASSERT_EQUALS(force.GetNumPairsOverlapping(), 0u);
+    }
+
+    void TestOverlapRecovery()
+    {
+        // Capsules 0 and 1 overlap by more than half a radius, and 2 is well clear of both
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules({Create_c_vector(0.0, 0.0),
+                       Create_c_vector(0.0, 0.4),
+                       Create_c_vector(5.0, 0.0)},
+                      10.0, mesh, cells);
+
+        NodeBasedCellPopulation<2> population(mesh, cells);
+        population.Update();
+
+        // By default the run is aborted
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        TS_ASSERT_EQUALS(p_force->GetUseOverlapRecovery(), false);
+        TS_ASSERT_THROWS_THIS(p_force->AddForceContribution(population), "Capsules are overlapping too much.");
+
+        p_force->SetUseOverlapRecovery(true);
+        TS_ASSERT_EQUALS(p_force->GetUseOverlapRecovery(), true);
+        TS_ASSERT_EQUALS(p_force->GetMaxNumOverlapRelaxationIterations(), 10u);
+        TS_ASSERT_THROWS_NOTHING(p_force->AddForceContribution(population));
+
+        // The violation is counted and recorded
+        TS_ASSERT_EQUALS(p_force->GetNumOverlapViolations(), 1u);
+        TS_ASSERT_EQUALS(p_force->GetNumStepsWithOverlapViolations(), 1u);
+        TS_ASSERT_DELTA(p_force->GetMaxOverlapViolationRatio(), 1.2, 1e-9);
+        TS_ASSERT_EQUALS(p_force->rGetOverlapViolations().size(), 1u);
+        TS_ASSERT_EQUALS(p_force->rGetOverlapViolations()[0].mTimeStep, 0u);
+        TS_ASSERT_EQUALS(p_force->rGetOverlapViolations()[0].mNodeIndexA, 0u);
+        TS_ASSERT_EQUALS(p_force->rGetOverlapViolations()[0].mNodeIndexB, 1u);
+
+        // The pair is pushed apart symmetrically until it overlaps by a quarter of a radius, and its force is that of
+        // the relaxed overlap
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetLocation()[1], -0.2375, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetLocation()[1], 0.6375, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(2)->rGetLocation()[0], 5.0, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(2)->rGetLocation()[1], 0.0, 1e-12);
+
+        const double relaxed_force = p_force->CalculateForceMagnitude(0.125, 0.5, 0.5);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetAppliedForce()[0], 0.0, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetAppliedForce()[1], relaxed_force, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetAppliedForce()[1], -relaxed_force, 1e-9);
+
+        // Crossing capsules have no contact normal, but are still pushed apart
+        mesh.GetNode(1)->rGetModifiableLocation()[1] = mesh.GetNode(0)->rGetLocation()[1];
+        mesh.GetNode(1)->rGetNodeAttributes()[NA_THETA] = 0.5 * M_PI;
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->ClearAppliedForce();
+        }
+        TS_ASSERT_THROWS_NOTHING(p_force->AddForceContribution(population));
+        TS_ASSERT_EQUALS(p_force->GetNumOverlapViolations(), 2u);
+        TS_ASSERT_EQUALS(p_force->GetNumStepsWithOverlapViolations(), 2u);
+        TS_ASSERT_DELTA(p_force->GetMaxOverlapViolationRatio(), 2.0, 1e-9);
+
+        c_vector<double, 2> direction;
+        double contact_dist_a;
+        double contact_dist_b;
+        double overlap = p_force->CalculateForceDirectionAndContactPoints(*mesh.GetNode(0), *mesh.GetNode(1), direction, contact_dist_a, contact_dist_b);
+        TS_ASSERT_LESS_THAN_EQUALS(overlap, 0.125 + 1e-9);
+
+        // The modifier writes the counts and the recorded violations at the end of the run
+        CapsuleOverlapSummaryModifier<2> modifier;
+        TS_ASSERT_THROWS_THIS(modifier.SetupSolve(population, "TestCapsuleOverlapRecovery"),
+                              "SetCapsuleForce() must be called on a CapsuleOverlapSummaryModifier before it is passed to a simulation");
+        modifier.SetCapsuleForce(p_force);
+        TS_ASSERT(modifier.GetCapsuleForce() == p_force);
+        modifier.SetupSolve(population, "TestCapsuleOverlapRecovery");
+        modifier.UpdateAtEndOfSolve(population);
+
+        OutputFileHandler handler("TestCapsuleOverlapRecovery", false);
+        std::ifstream summary_file((handler.GetOutputDirectoryFullPath() + "capsuleoverlapsummary.dat").c_str());
+        TS_ASSERT(summary_file.is_open());
+
+        std::string name;
+        unsigned long num_violations;
+        summary_file >> name >> num_violations;
+        TS_ASSERT_EQUALS(name, "NumOverlapViolations");
+        TS_ASSERT_EQUALS(num_violations, 2u);
+
+        unsigned num_steps;
+        summary_file >> name >> num_steps;
+        TS_ASSERT_EQUALS(name, "NumStepsWithOverlapViolations");
+        TS_ASSERT_EQUALS(num_steps, 2u);
+
+        double max_ratio;
+        summary_file >> name >> max_ratio;
+        TS_ASSERT_EQUALS(name, "MaxOverlapViolationRatio");
+        TS_ASSERT_DELTA(max_ratio, 2.0, 1e-6);
+
+        unsigned num_records = 0;
+        unsigned time_step, index_a, index_b;
+        double ratio;
+        while (summary_file >> time_step >> index_a >> index_b >> ratio)
+        {
+            num_records++;
+        }
+        TS_ASSERT_EQUALS(num_records, 2u);
+    }
+
+    void TestContactStatistics()
+    {
+        // A horizontal capsule with a vertical one resting on it, overlapping by 0.1, and a third out of contact
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules({Create_c_vector(0.0, 0.0),
+                       Create_c_vector(0.5, 1.9),
+                       Create_c_vector(3.5, 0.0)},
+                      4.0, mesh, cells, {0.0, 0.5 * M_PI, 0.0});
+
+        NodeBasedCellPopulation<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        TS_ASSERT_EQUALS(force.GetCalculateContactStatistics(), false);
+        force.SetCalculateContactStatistics(true);
+        TS_ASSERT_EQUALS(force.GetCalculateContactStatistics(), true);
+
+        force.AddForceContribution(population);
+
+        const double force_magnitude = force.CalculateForceMagnitude(0.1, 0.5, 0.5);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetAppliedForce()[1], force_magnitude, 1e-9);
+
+        TS_ASSERT_EQUALS(force.GetContactCount(0u), 1u);
+        TS_ASSERT_EQUALS(force.GetContactCount(1u), 1u);
+        TS_ASSERT_EQUALS(force.GetContactCount(2u), 0u);
+        TS_ASSERT_DELTA(force.GetTotalOverlap(0u), 0.1, 1e-9);
+        TS_ASSERT_DELTA(force.GetTotalOverlap(1u), 0.1, 1e-9);
+        TS_ASSERT_DELTA(force.GetTotalOverlap(2u), 0.0, 1e-12);
+
+        // The arm of the lower capsule runs from its centre to (0.5, 0.5) on its surface, and that of the upper one
+        // to (0.5, 0.4), and both are compressed by a vertical force
+        const c_matrix<double, 2, 2>& r_virial_0 = force.rGetVirial(0u);
+        TS_ASSERT_DELTA(r_virial_0(0, 0), 0.0, 1e-9);
+        TS_ASSERT_DELTA(r_virial_0(0, 1), -0.5 * force_magnitude, 1e-9);
+        TS_ASSERT_DELTA(r_virial_0(1, 0), 0.0, 1e-9);
+        TS_ASSERT_DELTA(r_virial_0(1, 1), -0.5 * force_magnitude, 1e-9);
+
+        const c_matrix<double, 2, 2>& r_virial_1 = force.rGetVirial(1u);
+        TS_ASSERT_DELTA(r_virial_1(0, 0), 0.0, 1e-9);
+        TS_ASSERT_DELTA(r_virial_1(0, 1), 0.0, 1e-9);
+        TS_ASSERT_DELTA(r_virial_1(1, 0), 0.0, 1e-9);
+        TS_ASSERT_DELTA(r_virial_1(1, 1), -1.5 * force_magnitude, 1e-9);
+
+        for (unsigned i=0; i<2; i++)
+        {
+            for (unsigned j=0; j<2; j++)
+            {
+                TS_ASSERT_DELTA(force.rGetVirial(2u)(i, j), 0.0, 1e-12);
+            }
+        }
+
+        // The statistics are also stored as cell data
+        CellPtr p_cell_1 = population.GetCellUsingLocationIndex(1u);
+        TS_ASSERT_DELTA(p_cell_1->GetCellData()->GetItem("contact_count"), 1.0, 1e-12);
+        TS_ASSERT_DELTA(p_cell_1->GetCellData()->GetItem("total_overlap"), 0.1, 1e-9);
+        TS_ASSERT_DELTA(p_cell_1->GetCellData()->GetItem("virial_yy"), -1.5 * force_magnitude, 1e-9);
+        TS_ASSERT_DELTA(p_cell_1->GetCellData()->GetItem("virial_xy"), 0.0, 1e-9);
+
+        CellPtr p_cell_2 = population.GetCellUsingLocationIndex(2u);
+        TS_ASSERT_DELTA(p_cell_2->GetCellData()->GetItem("contact_count"), 0.0, 1e-12);
+    }
+
+    void TestSleepingCapsules()
+    {
+        // A stack of four horizontal capsules, each overlapping the next by 0.1, and a fifth well away from them
+        std::vector<c_vector<double, 2> > locations;
+        for (unsigned index=0; index<4u; index++)
+        {
+            locations.push_back(Create_c_vector(0.0, 0.9 * index));
+        }
+        locations.push_back(Create_c_vector(10.0, 0.0));
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules(locations, 4.0, mesh, cells);
+
+        // Sleeping needs the topology version of a NodeBasedCellPopulationWithCapsules
+        {
+            NodeBasedCellPopulation<2> plain_population(mesh, cells);
+            plain_population.Update();
+            CapsuleForce<2, 2> force;
+            force.SetUseSleeping(true);
+            TS_ASSERT_THROWS_THIS(force.AddForceContribution(plain_population),
+                                  "Sleeping in CapsuleForce needs a NodeBasedCellPopulationWithCapsules to track births and deaths");
+        }
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        TS_ASSERT_EQUALS(force.GetUseSleeping(), false);
+        TS_ASSERT_DELTA(force.GetSleepWakeDistance(), 0.01, 1e-12);
+        TS_ASSERT_THROWS_THIS(force.SetSleepWakeDistance(0.0), "The sleep wake distance must be positive.");
+        force.SetUseSleeping(true);
+        TS_ASSERT_EQUALS(force.GetUseSleeping(), true);
+
+        // The forces without sleeping, to compare against
+        CapsuleForce<2, 2> direct_force;
+        direct_force.AddForceContribution(population);
+        std::vector<double> direct_forces;
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            direct_forces.push_back(mesh.GetNode(index)->rGetAppliedForce()[1]);
+        }
+
+        // The two lowest capsules are asleep; the first call caches their contact, and the second reuses it
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_ASLEEP] = 1.0;
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_ASLEEP] = 1.0;
+        for (unsigned call=0; call<2u; call++)
+        {
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                mesh.GetNode(index)->ClearAppliedForce();
+            }
+            force.AddForceContribution(population);
+
+            TS_ASSERT_EQUALS(force.GetNumSleepingCacheRebuilds(), 1u);
+            TS_ASSERT_EQUALS(force.GetNumPairsSkippedAsleep(), call);
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[1], direct_forces[index], 1e-12);
+            }
+        }
+
+        // Moving a capsule out of reach of the sleeping ones does not wake them
+        mesh.GetNode(4u)->rGetModifiableLocation()[1] = 1.0;
+        population.Update();
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumCapsulesWokenByMovement(), 0u);
+        TS_ASSERT_EQUALS(force.GetNumPairsSkippedAsleep(), 2u);
+
+        // Moving one within reach does, and the woken capsules leave the cache, taking their contact with them
+        mesh.GetNode(3u)->rGetModifiableLocation()[1] = 2.75;
+        population.Update();
+        force.AddForceContribution(population);
+        TS_ASSERT_LESS_THAN_EQUALS(1u, force.GetNumCapsulesWokenByMovement());
+        TS_ASSERT_DELTA(mesh.GetNode(1u)->rGetNodeAttributes()[NA_ASLEEP], 0.0, 1e-12);
+        TS_ASSERT_EQUALS(force.GetNumSleepingCacheRebuilds(), 1u);
+        TS_ASSERT_EQUALS(force.GetNumCapsulesUncachedAsleep(), force.GetNumCapsulesWokenByMovement());
+        TS_ASSERT_EQUALS(force.GetNumPairsSkippedAsleep(), 2u);
+
+        // The two lowest capsules fall asleep again and rejoin the cache; then their cached contact is reused while the
+        // distant capsule falls asleep and wakes again, without the cache being built again
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_ASLEEP] = 1.0;
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_ASLEEP] = 1.0;
+        const unsigned long num_cached = force.GetNumCapsulesCachedAsleep();
+        const unsigned long num_uncached = force.GetNumCapsulesUncachedAsleep();
+        direct_forces.clear();
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->ClearAppliedForce();
+        }
+        direct_force.AddForceContribution(population);
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            direct_forces.push_back(mesh.GetNode(index)->rGetAppliedForce()[1]);
+        }
+
+        const double distant_capsule_asleep[4] = {0.0, 0.0, 1.0, 0.0};
+        for (unsigned call=0; call<4u; call++)
+        {
+            mesh.GetNode(4u)->rGetNodeAttributes()[NA_ASLEEP] = distant_capsule_asleep[call];
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                mesh.GetNode(index)->ClearAppliedForce();
+            }
+            force.AddForceContribution(population);
+
+            TS_ASSERT_EQUALS(force.GetNumPairsSkippedAsleep(), 2u + call);
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[1], direct_forces[index], 1e-12);
+            }
+        }
+        TS_ASSERT_EQUALS(force.GetNumSleepingCacheRebuilds(), 1u);
+        TS_ASSERT_EQUALS(force.GetNumCapsulesCachedAsleep(), num_cached + 3u);
+        TS_ASSERT_EQUALS(force.GetNumCapsulesUncachedAsleep(), num_uncached + 1u);
+
+        // Reordering the nodes moves capsules to other indices, so the whole cache is built again
+        population.ReorderNodesAlongSpaceFillingCurve();
+        population.Update();
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumSleepingCacheRebuilds(), 2u);
+    }
+
+    void TestGatherForces()
+    {
+        // Rows of nearly horizontal capsules, each touching its neighbours above, below and end to end
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpRowsOfCapsules(10u, mesh, cells);
+
+        NodeBasedCellPopulation<2> population(mesh, cells);
+        population.Update();
+
+        // The scattered pair loop as a reference
+        CapsuleForce<2, 2> scatter_force;
+        scatter_force.SetCalculateContactStatistics(true);
+        scatter_force.AddForceContribution(population);
+
+        std::vector<c_vector<double, 2> > scatter_forces;
+        std::vector<double> scatter_angles;
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            scatter_forces.push_back(mesh.GetNode(index)->rGetAppliedForce());
+            scatter_angles.push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_APPLIED_THETA]);
+        }
+        TS_ASSERT_LESS_THAN(0.0, norm_2(scatter_forces[11]));
+
+        CapsuleForce<2, 2> gather_force;
+        TS_ASSERT_EQUALS(gather_force.GetUseGatherForces(), false);
+        gather_force.SetUseGatherForces(true);
+        TS_ASSERT_EQUALS(gather_force.GetUseGatherForces(), true);
+        gather_force.SetCalculateContactStatistics(true);
+
+        std::vector<c_vector<double, 2> > serial_gather_forces;
+        for (unsigned num_threads=1; num_threads<=3; num_threads+=2)
+        {
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                mesh.GetNode(index)->ClearAppliedForce();
+            }
+            gather_force.SetNumThreads(num_threads);
+            gather_force.ResetPairCounters();
+            gather_force.AddForceContribution(population);
+
+            // Each pair is calculated from both sides, so only agrees with the scattered loop to rounding
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[0], scatter_forces[index][0], 1e-10);
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[1], scatter_forces[index][1], 1e-10);
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetNodeAttributes()[NA_APPLIED_THETA], scatter_angles[index], 1e-10);
+                TS_ASSERT_EQUALS(gather_force.GetContactCount(index), scatter_force.GetContactCount(index));
+                TS_ASSERT_DELTA(gather_force.GetTotalOverlap(index), scatter_force.GetTotalOverlap(index), 1e-12);
+                TS_ASSERT_DELTA(gather_force.rGetVirial(index)(1, 1), scatter_force.rGetVirial(index)(1, 1), 1e-10);
+            }
+
+            // The pair counters count each pair once
+            TS_ASSERT_EQUALS(gather_force.GetNumPairsTested(), scatter_force.GetNumPairsTested());
+            TS_ASSERT_EQUALS(gather_force.GetNumPairsRejectedByBoundingSpheres(), scatter_force.GetNumPairsRejectedByBoundingSpheres());
+            TS_ASSERT_EQUALS(gather_force.GetNumPairsOverlapping(), scatter_force.GetNumPairsOverlapping());
+
+            // and the result does not depend on the number of threads
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                if (num_threads == 1u)
+                {
+                    serial_gather_forces.push_back(mesh.GetNode(index)->rGetAppliedForce());
+                }
+                TS_ASSERT_EQUALS(mesh.GetNode(index)->rGetAppliedForce()[0], serial_gather_forces[index][0]);
+                TS_ASSERT_EQUALS(mesh.GetNode(index)->rGetAppliedForce()[1], serial_gather_forces[index][1]);
+            }
+        }
+
+        gather_force.SetUseOverlapRecovery(true);
+        TS_ASSERT_THROWS_THIS(gather_force.AddForceContribution(population),
+                              "Gathered forces in CapsuleForce cannot be combined with overlap recovery or sleeping");
+    }
+
+    void TestNodeContactWeights()
+    {
+        // A stack of four horizontal capsules, each overlapping the next by 0.1
+        std::vector<c_vector<double, 2> > locations;
+        for (unsigned index=0; index<4u; index++)
+        {
+            locations.push_back(Create_c_vector(0.0, 0.9 * index));
+        }
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules(locations, 4.0, mesh, cells);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        force.AddForceContribution(population);
+        const double pair_force = mesh.GetNode(3u)->rGetAppliedForce()[1];
+        TS_ASSERT_LESS_THAN(0.0, pair_force);
+        TS_ASSERT_EQUALS(force.GetUseNodeContactWeights(), false);
+
+        TS_ASSERT_THROWS_THIS(force.SetNodeContactWeights(std::vector<double>(4u, 1.0), std::vector<char>(3u, 1)),
+                              "There must be one contact weight and one active flag for each node index.");
+
+        // Each pair is scaled by the smaller weight of its capsules, and the pair between the two inactive capsules
+        // is not evaluated at all
+        std::vector<double> weights = {1.0, 2.0, 3.0, 1.0};
+        std::vector<char> is_active = {1, 1, 0, 0};
+        force.SetNodeContactWeights(weights, is_active);
+        TS_ASSERT_EQUALS(force.GetUseNodeContactWeights(), true);
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->ClearAppliedForce();
+        }
+        force.AddForceContribution(population);
+        TS_ASSERT_EQUALS(force.GetNumPairsSkippedInactive(), 1u);
+        TS_ASSERT_DELTA(mesh.GetNode(0u)->rGetAppliedForce()[1], -pair_force, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(1u)->rGetAppliedForce()[1], -pair_force, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(2u)->rGetAppliedForce()[1], 2.0 * pair_force, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(3u)->rGetAppliedForce()[1], 0.0, 1e-12);
+
+        // The weights must cover every capsule, and cannot be combined with sleeping
+        force.SetNodeContactWeights(std::vector<double>(2u, 1.0), std::vector<char>(2u, 1));
+        TS_ASSERT_THROWS_THIS(force.AddForceContribution(population), "The contact weights do not cover every node index.");
+        force.SetNodeContactWeights(weights, is_active);
+        force.SetUseSleeping(true);
+        TS_ASSERT_THROWS_THIS(force.AddForceContribution(population),
+                              "Contact weights in CapsuleForce cannot be combined with gathered forces or sleeping");
+
+        force.ClearNodeContactWeights();
+        TS_ASSERT_EQUALS(force.GetUseNodeContactWeights(), false);
+    }
 };
 
 #endif /*_TESTCAPSULEFORCE_HPP_*/
@@ -0,0 +1,277 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULEFORCEPERFORMANCE_HPP_
+#define _TESTCAPSULEFORCEPERFORMANCE_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CapsuleForce.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "Timer.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+/**
+ * Timings of the capsule pair loop, run as part of the Profile test pack rather than the Continuous one.
+ */
+class TestCapsuleForcePerformance : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * Time repeated calls to CapsuleForce::AddForceContribution().
+     *
+     * @param rForce the force
+     * @param rPopulation the population
+     * @param numRepetitions how many times to call AddForceContribution()
+     * @return the time taken per call, in seconds
+     */
+    double TimeForceCalculation(CapsuleForce<2, 2>& rForce,
+                                NodeBasedCellPopulationWithCapsules<2>& rPopulation,
+                                unsigned numRepetitions)
+    {
+        Timer::Reset();
+        for (unsigned repetition=0; repetition<numRepetitions; repetition++)
+        {
+            for (unsigned index=0; index<rPopulation.GetNumNodes(); index++)
+            {
+                rPopulation.GetNode(index)->ClearAppliedForce();
+            }
+            rForce.AddForceContribution(rPopulation);
+        }
+        return Timer::GetElapsedTime() / numRepetitions;
+    }
+
+    /**
+     * Make rows of nearly horizontal capsules touching their neighbours.
+     *
+     * @param numRows the number of rows
+     * @param numColumns the number of capsules in each row
+     * @param shuffle whether to number the capsules in a random order, as after many divisions
+     * @param rMesh the mesh to construct
+     * @return the nodes the mesh was constructed from, to be deleted by the caller
+     */
+    std::vector<Node<2>*> SetUpRowsOfCapsules(unsigned numRows, unsigned numColumns, bool shuffle, NodesOnlyMesh<2>& rMesh)
+    {
+        const unsigned num_nodes = numRows * numColumns;
+
+        std::vector<unsigned> birth_order;
+        if (shuffle)
+        {
+            RandomNumberGenerator::Instance()->Shuffle(num_nodes, birth_order);
+        }
+        else
+        {
+            for (unsigned index=0; index<num_nodes; index++)
+            {
+                birth_order.push_back(index);
+            }
+        }
+
+        std::vector<Node<2>*> nodes;
+        for (unsigned index=0; index<num_nodes; index++)
+        {
+            const unsigned grid_index = birth_order[index];
+            nodes.push_back(new Node<2>(index, false, 2.9 * (grid_index % numColumns), 0.9 * (grid_index / numColumns)));
+        }
+
+        rMesh.ConstructNodesWithoutMesh(nodes, 4.0);
+
+        for (unsigned index=0; index<rMesh.GetNumNodes(); index++)
+        {
+            rMesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = rMesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = 0.02 * sin(double(index));
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+
+        return nodes;
+    }
+
+public:
+
+    void TestPairLoopBeforeAndAfterNodeReordering()
+    {
+        // Rows of capsules numbered in a random order, as after many divisions
+        const unsigned num_nodes = 100u * 60u;
+        NodesOnlyMesh<2> mesh;
+        std::vector<Node<2>*> nodes = SetUpRowsOfCapsules(100u, 60u, true, mesh);
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        const unsigned num_repetitions = 20u;
+
+        const double birth_order_time = TimeForceCalculation(force, population, num_repetitions);
+
+        std::vector<c_vector<double, 2> > birth_order_forces;
+        for (unsigned i=0; i<cells.size(); i++)
+        {
+            birth_order_forces.push_back(population.GetNode(population.GetLocationIndexUsingCell(cells[i]))->rGetAppliedForce());
+        }
+
+        population.ReorderNodesAlongSpaceFillingCurve();
+        population.Update();
+        TS_ASSERT_EQUALS(population.GetNumNodeReorderings(), 1u);
+
+        const double reordered_time = TimeForceCalculation(force, population, num_repetitions);
+
+        std::cout << "CapsuleForce on " << num_nodes << " capsules: " << birth_order_time << " s per call in birth order, "
+                  << reordered_time << " s per call after Morton reordering\n";
+
+        // Each cell feels the same force, up to the order in which its contacts are summed
+        for (unsigned i=0; i<cells.size(); i++)
+        {
+            const c_vector<double, 2>& r_force = population.GetNode(population.GetLocationIndexUsingCell(cells[i]))->rGetAppliedForce();
+            TS_ASSERT_DELTA(r_force[0], birth_order_forces[i][0], 1e-9);
+            TS_ASSERT_DELTA(r_force[1], birth_order_forces[i][1], 1e-9);
+        }
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    void TestPairLoopInDoubleAndSinglePrecision()
+    {
+        NodesOnlyMesh<2> mesh;
+        std::vector<Node<2>*> nodes = SetUpRowsOfCapsules(100u, 60u, false, mesh);
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        const unsigned num_repetitions = 20u;
+
+        const double double_time = TimeForceCalculation(force, population, num_repetitions);
+
+        std::vector<c_vector<double, 2> > double_forces;
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            double_forces.push_back(mesh.GetNode(index)->rGetAppliedForce());
+        }
+
+        force.SetUseSinglePrecision(true);
+        const double single_time = TimeForceCalculation(force, population, num_repetitions);
+
+        std::cout << "CapsuleForce on " << mesh.GetNumNodes() << " capsules with the " << CapsuleContactKernel<2>::GetInstructionSet()
+                  << " kernel: " << double_time << " s per call in double precision, "
+                  << single_time << " s per call in single precision\n";
+
+        // The forces agree to single precision
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[0], double_forces[index][0], 1e-4);
+            TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[1], double_forces[index][1], 1e-4);
+        }
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    void TestPairLoopScatterAndGather()
+    {
+        NodesOnlyMesh<2> mesh;
+        std::vector<Node<2>*> nodes = SetUpRowsOfCapsules(100u, 60u, false, mesh);
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleForce<2, 2> force;
+        const unsigned num_repetitions = 20u;
+
+        for (unsigned num_threads=1; num_threads<=4; num_threads*=4)
+        {
+            force.SetNumThreads(num_threads);
+
+            force.SetUseGatherForces(false);
+            const double scatter_time = TimeForceCalculation(force, population, num_repetitions);
+
+            std::vector<c_vector<double, 2> > scatter_forces;
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                scatter_forces.push_back(mesh.GetNode(index)->rGetAppliedForce());
+            }
+
+            force.SetUseGatherForces(true);
+            const double gather_time = TimeForceCalculation(force, population, num_repetitions);
+
+            std::cout << "CapsuleForce on " << mesh.GetNumNodes() << " capsules with " << num_threads << " thread(s): "
+                      << scatter_time << " s per call scattering pairs, "
+                      << gather_time << " s per call gathering neighbours\n";
+
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[0], scatter_forces[index][0], 1e-10);
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetAppliedForce()[1], scatter_forces[index][1], 1e-10);
+            }
+        }
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+};
+
+#endif /*_TESTCAPSULEFORCEPERFORMANCE_HPP_*/
@@ -0,0 +1,145 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULEGEOMETRYCACHE_HPP_
+#define _TESTCAPSULEGEOMETRYCACHE_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "CheckpointArchiveTypes.hpp"
+
+#include "CapsuleGeometryCache.hpp"
+#include "Node.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestCapsuleGeometryCache : public CxxTest::TestSuite
+{
+public:
+
+    void TestCapsuleGeometry2d()
+    {
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, false, 1.0, 2.0));
+        nodes.push_back(new Node<2>(1u, false, -3.0, 0.5));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 10.0);
+
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            mesh.GetNode(i)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = mesh.GetNode(i)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_LENGTH] = 2.0 + i;
+            attributes[NA_RADIUS] = 0.5;
+        }
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_THETA] = 0.0;
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_THETA] = 0.5 * M_PI;
+
+        CapsuleGeometryCache<2> cache;
+        cache.Update(mesh);
+
+        TS_ASSERT_EQUALS(cache.GetSize(), 2u);
+
+        // Horizontal capsule of length 2 centred at (1,2)
+        TS_ASSERT_DELTA(cache.GetCentre(0u)[0], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetCentre(0u)[1], 2.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(0u)[0], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(0u)[1], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetHalfLength(0u), 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetRadius(0u), 0.5, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(0u)[0], 2.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(0u)[1], 2.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointTwo(0u)[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointTwo(0u)[1], 2.0, 1e-12);
+
+        // Vertical capsule of length 3 centred at (-3,0.5)
+        TS_ASSERT_DELTA(cache.GetAxis(1u)[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(1u)[1], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetHalfLength(1u), 1.5, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(1u)[0], -3.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(1u)[1], 2.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointTwo(1u)[0], -3.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointTwo(1u)[1], -1.0, 1e-12);
+
+        // The structure-of-arrays views agree with the per-capsule accessors
+        TS_ASSERT_DELTA(cache.rGetEndPointsOne(0u)[1], -3.0, 1e-12);
+        TS_ASSERT_DELTA(cache.rGetHalfLengths()[1], 1.5, 1e-12);
+        TS_ASSERT_DELTA(cache.rGetRadii()[0], 0.5, 1e-12);
+    }
+
+    void TestCapsuleGeometry3d()
+    {
+        // index, {x, y, z}
+        Node<3> node(0u, std::vector<double>{0.0, 0.0, 1.0});
+        node.AddNodeAttribute(0.0);
+
+        std::vector<double>& attributes = node.rGetNodeAttributes();
+        attributes.resize(NA_VEC_LENGTH);
+        attributes[NA_THETA] = 0.5 * M_PI;
+        attributes[NA_PHI] = 0.5 * M_PI;
+        attributes[NA_LENGTH] = 4.0;
+        attributes[NA_RADIUS] = 0.25;
+
+        // Store the capsule in an entry other than its node index
+        CapsuleGeometryCache<3> cache;
+        cache.SetCapsule(3u, node);
+
+        TS_ASSERT_EQUALS(cache.GetSize(), 4u);
+
+        // Capsule lies along the y axis
+        TS_ASSERT_DELTA(cache.GetAxis(3u)[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(3u)[1], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(3u)[2], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(3u)[1], 2.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointTwo(3u)[1], -2.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(3u)[2], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetRadius(3u), 0.25, 1e-12);
+
+        // Standing vertically
+        attributes[NA_PHI] = 0.0;
+        cache.SetCapsule(3u, node);
+
+        TS_ASSERT_DELTA(cache.GetAxis(3u)[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(3u)[1], 0.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetAxis(3u)[2], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(3u)[2], 3.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointTwo(3u)[2], -1.0, 1e-12);
+    }
+};
+
+#endif /*_TESTCAPSULEGEOMETRYCACHE_HPP_*/
@@ -0,0 +1,104 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULEGROWTHREGISTRY_HPP_
+#define _TESTCAPSULEGROWTHREGISTRY_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include <cmath>
+
+#include "CapsuleGrowthRegistry.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+class TestCapsuleGrowthRegistry : public CxxTest::TestSuite
+{
+public:
+
+    void TestGrowthLaws()
+    {
+        // Linear growth from 2 to 6 over a cycle of 4 hours
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_LINEAR, 2.0, 6.0, 0.0, 4.0), 2.0, 1e-12);
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_LINEAR, 2.0, 6.0, 1.0, 4.0), 3.0, 1e-12);
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_LINEAR, 2.0, 6.0, 4.0, 4.0), 6.0, 1e-12);
+
+        // Exponential growth over the same lengths doubles the length every half cycle when it quadruples it
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_EXPONENTIAL, 2.0, 8.0, 0.0, 4.0), 2.0, 1e-12);
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_EXPONENTIAL, 2.0, 8.0, 2.0, 4.0), 4.0, 1e-12);
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_EXPONENTIAL, 2.0, 8.0, 4.0, 4.0), 8.0, 1e-12);
+
+        // The adder grows exponentially too; only how its division length is chosen differs
+        TS_ASSERT_DELTA(CapsuleGrowthRegistry::CalculateLength(CGL_ADDER, 3.0, 7.0, 1.0, 4.0),
+                        3.0 * std::pow(7.0 / 3.0, 0.25), 1e-12);
+    }
+
+    void TestRegistry()
+    {
+        CapsuleGrowthRegistry registry;
+        TS_ASSERT_EQUALS(registry.GetSize(), 0u);
+        TS_ASSERT(!registry.IsResolved(0u));
+
+        // Entries are indexed by node index, so there may be gaps
+        registry.SetCapsule(3u, CGL_LINEAR, -1.0, 2.0, 6.0, 4.0);
+        registry.SetNotGrowing(1u);
+        TS_ASSERT_EQUALS(registry.GetSize(), 4u);
+        TS_ASSERT(!registry.IsResolved(0u));
+        TS_ASSERT(registry.IsResolved(1u));
+        TS_ASSERT(!registry.IsResolved(2u));
+        TS_ASSERT(registry.IsResolved(3u));
+        TS_ASSERT(!registry.IsResolved(4u));
+
+        TS_ASSERT(!registry.IsGrowing(1u));
+        TS_ASSERT_DELTA(registry.GetCycleDuration(1u), 0.0, 1e-12);
+
+        TS_ASSERT(registry.IsGrowing(3u));
+        TS_ASSERT_EQUALS(registry.GetGrowthLaw(3u), CGL_LINEAR);
+        TS_ASSERT_DELTA(registry.GetBirthTime(3u), -1.0, 1e-12);
+        TS_ASSERT_DELTA(registry.GetBirthLength(3u), 2.0, 1e-12);
+        TS_ASSERT_DELTA(registry.GetDivisionLength(3u), 6.0, 1e-12);
+        TS_ASSERT_DELTA(registry.GetCycleDuration(3u), 4.0, 1e-12);
+
+        // The age is measured from the birth time, and clamped at zero
+        TS_ASSERT_DELTA(registry.CalculateLength(3u, 1.0), 4.0, 1e-12);
+        TS_ASSERT_DELTA(registry.CalculateLength(3u, -2.0), 2.0, 1e-12);
+
+        // Resolving an entry again, as after a division, replaces it
+        registry.SetCapsule(3u, CGL_EXPONENTIAL, 1.0, 3.0, 12.0, 2.0);
+        TS_ASSERT_EQUALS(registry.GetGrowthLaw(3u), CGL_EXPONENTIAL);
+        TS_ASSERT_DELTA(registry.CalculateLength(3u, 2.0), 6.0, 1e-12);
+    }
+};
+
+#endif /*_TESTCAPSULEGROWTHREGISTRY_HPP_*/
@@ -0,0 +1,457 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULENUMERICALMETHODSPERFORMANCE_HPP_
+#define _TESTCAPSULENUMERICALMETHODSPERFORMANCE_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include <cfloat>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "BackwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleFireRelaxation.hpp"
+#include "CapsuleForce.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "MultirateNumericalMethodForCapsules.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "SimulationTime.hpp"
+#include "SmartPointers.hpp"
+#include "Timer.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+/**
+ * Timings of the capsule numerical methods, run as part of the Profile test pack rather than the Continuous one.
+ */
+class TestCapsuleNumericalMethodsPerformance : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * Set up a population of capsules of length 2 and radius 0.5 in a grid, numbered row by row.
+     *
+     * @param numColumns the number of capsules in each row
+     * @param columnSpacing the distance between the centres of neighbouring capsules in a row
+     * @param rRowHeights the height of the centres in each row
+     * @param tilt the amplitude of the angles theta, which follow the sine of each capsule's index
+     * @param rMesh the mesh to construct
+     * @param rCells the cells of the capsules; if empty, filled in with a differentiated cell for each capsule
+     * @return the population, updated
+     */
+    boost::shared_ptr<NodeBasedCellPopulationWithCapsules<2> > SetUpGridOfCapsules(unsigned numColumns,
+                                                                                  double columnSpacing,
+                                                                                  const std::vector<double>& rRowHeights,
+                                                                                  double tilt,
+                                                                                  NodesOnlyMesh<2>& rMesh,
+                                                                                  std::vector<CellPtr>& rCells)
+    {
+        std::vector<Node<2>*> nodes;
+        for (unsigned index=0; index<rRowHeights.size()*numColumns; index++)
+        {
+            nodes.push_back(new Node<2>(index, false, columnSpacing * (index % numColumns), rRowHeights[index / numColumns]));
+        }
+        rMesh.ConstructNodesWithoutMesh(nodes, 4.0);
+
+        for (unsigned index=0; index<rMesh.GetNumNodes(); index++)
+        {
+            rMesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = rMesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = tilt * sin(double(index));
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+
+        if (rCells.empty())
+        {
+            auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+            CellsGenerator<NoCellCycleModel, 2> cells_generator;
+            cells_generator.GenerateBasicRandom(rCells, rMesh.GetNumNodes(), p_diff_type);
+        }
+
+        auto p_population = boost::make_shared<NodeBasedCellPopulationWithCapsules<2> >(rMesh, rCells);
+        p_population->Update();
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+        return p_population;
+    }
+
+    /**
+     * Set up the rows of overlapping, nearly horizontal capsules relaxed by the benchmarks below: 15 rows of 10
+     * capsules, 0.95 apart vertically.
+     *
+     * @param rMesh the mesh to construct
+     * @param rCells filled in with a differentiated cell for each capsule
+     * @return the population, updated
+     */
+    boost::shared_ptr<NodeBasedCellPopulationWithCapsules<2> > SetUpRowsOfCapsules(NodesOnlyMesh<2>& rMesh,
+                                                                                  std::vector<CellPtr>& rCells)
+    {
+        std::vector<double> row_heights;
+        for (unsigned row=0; row<15u; row++)
+        {
+            row_heights.push_back(0.95 * row);
+        }
+        return SetUpGridOfCapsules(10u, 2.95, row_heights, 0.02, rMesh, rCells);
+    }
+
+    /**
+     * Relax rows of overlapping, nearly horizontal capsules with a numerical method.
+     *
+     * @param rMethod the numerical method
+     * @param dt the time step
+     * @param rWallTime set to the time taken per simulated hour, in seconds
+     * @return the largest overlap between vertical neighbours at the end of the hour
+     */
+    double RelaxRowsOfCapsules(ForwardEulerNumericalMethodForCapsules<2, 2>& rMethod, double dt, double& rWallTime)
+    {
+        const unsigned num_columns = 10u;
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpRowsOfCapsules(mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(p_force);
+
+        rMethod.SetCellPopulation(&population);
+        rMethod.SetForceCollection(&force_collection);
+
+        const unsigned num_steps = unsigned(1.0 / dt + 0.5);
+        Timer::Reset();
+        for (unsigned step=0; step<num_steps; step++)
+        {
+            rMethod.UpdateAllNodePositions(dt);
+            population.Update();
+        }
+        rWallTime = Timer::GetElapsedTime() / (num_steps * dt);
+
+        double max_overlap = 0.0;
+        for (unsigned index=num_columns; index<mesh.GetNumNodes(); index++)
+        {
+            const double separation = norm_2(mesh.GetNode(index)->rGetLocation()
+                                             - mesh.GetNode(index - num_columns)->rGetLocation());
+            max_overlap = std::max(max_overlap, 1.0 - separation);
+        }
+
+        return max_overlap;
+    }
+
+    /**
+     * Relax the rows of overlapping capsules of RelaxRowsOfCapsules() until no capsule has a force, or torque over the
+     * distance from its centre to its tips, of 1e-3 or more, either with FIRE or by forward Euler steps of 1/120 h.
+     *
+     * @param useFire whether to relax with FIRE rather than by time stepping
+     * @param rWallTime set to the time taken, in seconds
+     * @return the number of force passes taken
+     */
+    unsigned RelaxRowsOfCapsulesToTolerance(bool useFire, double& rWallTime)
+    {
+        const double tolerance = 1e-3;
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpRowsOfCapsules(mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        unsigned num_force_evaluations = 0u;
+
+        Timer::Reset();
+        if (useFire)
+        {
+            CapsuleFireRelaxation<2> relaxation;
+            relaxation.SetForceTolerance(tolerance);
+            relaxation.SetMaxNumIterations(100000u);
+            TS_ASSERT(relaxation.Relax(population, *p_force));
+            num_force_evaluations = relaxation.GetNumForceEvaluations();
+        }
+        else
+        {
+            std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+            force_collection.push_back(p_force);
+
+            ForwardEulerNumericalMethodForCapsules<2, 2> method;
+            method.SetCellPopulation(&population);
+            method.SetForceCollection(&force_collection);
+
+            double max_force = DBL_MAX;
+            while (max_force >= tolerance && num_force_evaluations < 100000u)
+            {
+                method.UpdateAllNodePositions(1.0 / 120.0);
+                population.Update();
+                num_force_evaluations++;
+
+                // The forces the step was taken with
+                max_force = 0.0;
+                for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+                {
+                    Node<2>* p_node = mesh.GetNode(index);
+                    const std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+                    const double tip_force = r_attributes[NA_APPLIED_THETA] / (0.5 * r_attributes[NA_LENGTH] + r_attributes[NA_RADIUS]);
+                    max_force = std::max(max_force, sqrt(inner_prod(p_node->rGetAppliedForce(), p_node->rGetAppliedForce())
+                                                         + tip_force * tip_force));
+                    p_node->ClearAppliedForce();
+                }
+            }
+        }
+        rWallTime = Timer::GetElapsedTime();
+
+        return num_force_evaluations;
+    }
+
+    /**
+     * Grow and move a large population of capsules, with no forces, so that only the loops over capsules in the
+     * numerical method are timed.
+     *
+     * @param numThreads the number of threads for the numerical method
+     * @param numSteps the number of steps
+     * @param rLengths filled in with the length of each capsule at the end
+     * @return the time taken per step, in seconds
+     */
+    double TimeGrowthAndIntegration(unsigned numThreads, unsigned numSteps, std::vector<double>& rLengths)
+    {
+        const unsigned num_rows = 250u;
+        const unsigned num_columns = 200u;
+        const double dt = 1.0 / 120.0;
+
+        SimulationTime::Destroy();
+        SimulationTime::Instance()->SetStartTime(0.0);
+        SimulationTime::Instance()->SetEndTimeAndNumberOfTimeSteps(numSteps * dt, numSteps);
+
+        std::vector<double> row_heights;
+        for (unsigned row=0; row<num_rows; row++)
+        {
+            row_heights.push_back(1.5 * row);
+        }
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned index=0; index<num_rows*num_columns; index++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(2.0);
+            p_model->SetMaxCellCycleDuration(2.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+            p_cell->SetBirthTime(-0.5 * (index % 3));
+            cells.push_back(p_cell);
+        }
+
+        NodesOnlyMesh<2> mesh;
+        auto p_population = SetUpGridOfCapsules(num_columns, 4.0, row_heights, 0.02, mesh, cells);
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetNumThreads(numThreads);
+        method.SetCellPopulation(p_population.get());
+        method.SetForceCollection(&force_collection);
+
+        Timer::Reset();
+        for (unsigned step=0; step<numSteps; step++)
+        {
+            method.UpdateAllNodePositions(dt);
+            SimulationTime::Instance()->IncrementTimeOneStep();
+        }
+        const double wall_time = Timer::GetElapsedTime() / numSteps;
+
+        rLengths.clear();
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            rLengths.push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_LENGTH]);
+        }
+
+        return wall_time;
+    }
+
+    /**
+     * Relax a colony whose interior rests in a loose grid while the capsules along one edge are crowded together, as
+     * at a growing front.
+     *
+     * @param rMethod the numerical method
+     * @param rNumPairsEvaluated set to the number of candidate pairs whose contact was evaluated
+     * @param rLocations filled in with the coordinates of each capsule at the end
+     * @return the time taken, in seconds
+     */
+    double RelaxColonyWithCrowdedFront(ForwardEulerNumericalMethodForCapsules<2, 2>& rMethod,
+                                       unsigned long& rNumPairsEvaluated,
+                                       std::vector<double>& rLocations)
+    {
+        const unsigned num_rows = 30u;
+        const unsigned num_front_rows = 5u;
+        const unsigned num_columns = 40u;
+
+        std::vector<double> row_heights;
+        for (unsigned row=0; row<num_rows; row++)
+        {
+            row_heights.push_back((row < num_front_rows) ? 0.9 * row : 0.9 * num_front_rows + 1.05 * (row - num_front_rows));
+        }
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpGridOfCapsules(num_columns, 3.05, row_heights, 0.0, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(p_force);
+
+        rMethod.SetCellPopulation(&population);
+        rMethod.SetForceCollection(&force_collection);
+
+        Timer::Reset();
+        for (unsigned step=0; step<120u; step++)
+        {
+            rMethod.UpdateAllNodePositions(1.0 / 120.0);
+            population.Update();
+        }
+        const double wall_time = Timer::GetElapsedTime();
+        rNumPairsEvaluated = p_force->GetNumPairsTested() - p_force->GetNumPairsSkippedInactive();
+
+        rLocations.clear();
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            rLocations.push_back(mesh.GetNode(index)->rGetLocation()[0]);
+            rLocations.push_back(mesh.GetNode(index)->rGetLocation()[1]);
+        }
+
+        return wall_time;
+    }
+
+public:
+
+    void TestExplicitAndImplicitWallTimePerSimulatedHour()
+    {
+        ForwardEulerNumericalMethodForCapsules<2, 2> explicit_method;
+        double explicit_wall_time;
+        const double explicit_overlap = RelaxRowsOfCapsules(explicit_method, 1.0 / 120.0, explicit_wall_time);
+
+        BackwardEulerNumericalMethodForCapsules<2, 2> implicit_method;
+        double implicit_wall_time;
+        const double implicit_overlap = RelaxRowsOfCapsules(implicit_method, 1.0 / 12.0, implicit_wall_time);
+
+        std::cout << "Relaxing 150 capsules: forward Euler at dt = 1/120 h takes " << explicit_wall_time
+                  << " s per simulated hour, leaving an overlap of " << explicit_overlap << "; backward Euler at dt = 1/12 h takes "
+                  << implicit_wall_time << " s per simulated hour, leaving an overlap of " << implicit_overlap << "\n";
+
+        /*
+         * The explicit method fails with too large an overlap at steps of 1/48 h or more, while the implicit one
+         * stays close to the initial overlap of 0.05 at ten times the explicit step
+         */
+        TS_ASSERT_LESS_THAN(explicit_overlap, 0.05);
+        TS_ASSERT_LESS_THAN(implicit_overlap, 0.1);
+    }
+
+    void TestThreadedGrowthAndIntegration()
+    {
+        std::vector<double> serial_lengths;
+        const double serial_time = TimeGrowthAndIntegration(1u, 20u, serial_lengths);
+        std::cout << "Growing and moving 50000 capsules on 1 thread takes " << serial_time << " s per step\n";
+
+        for (unsigned num_threads=2; num_threads<=8; num_threads*=2)
+        {
+            std::vector<double> lengths;
+            const double time = TimeGrowthAndIntegration(num_threads, 20u, lengths);
+            std::cout << "Growing and moving 50000 capsules on " << num_threads << " threads takes " << time
+                      << " s per step, a speed-up of " << serial_time / time << "\n";
+
+            // Each thread only writes to its own capsules, so the results do not depend on the number of threads
+            TS_ASSERT_EQUALS(lengths.size(), serial_lengths.size());
+            for (unsigned i=0; i<lengths.size(); i++)
+            {
+                TS_ASSERT_EQUALS(lengths[i], serial_lengths[i]);
+            }
+        }
+    }
+
+    void TestFireRelaxationForceEvaluations()
+    {
+        double fire_wall_time;
+        const unsigned fire_evaluations = RelaxRowsOfCapsulesToTolerance(true, fire_wall_time);
+
+        double explicit_wall_time;
+        const unsigned explicit_evaluations = RelaxRowsOfCapsulesToTolerance(false, explicit_wall_time);
+
+        std::cout << "Relaxing 150 capsules to a force tolerance of 1e-3: FIRE takes " << fire_evaluations
+                  << " force passes in " << fire_wall_time << " s; forward Euler at dt = 1/120 h takes "
+                  << explicit_evaluations << " force passes in " << explicit_wall_time << " s\n";
+
+        TS_ASSERT_LESS_THAN(fire_evaluations, explicit_evaluations);
+    }
+
+    void TestMultirateContactEvaluations()
+    {
+        ForwardEulerNumericalMethodForCapsules<2, 2> explicit_method;
+        unsigned long explicit_pairs;
+        std::vector<double> explicit_locations;
+        const double explicit_wall_time = RelaxColonyWithCrowdedFront(explicit_method, explicit_pairs, explicit_locations);
+
+        MultirateNumericalMethodForCapsules<2, 2> multirate_method;
+        unsigned long multirate_pairs;
+        std::vector<double> multirate_locations;
+        const double multirate_wall_time = RelaxColonyWithCrowdedFront(multirate_method, multirate_pairs, multirate_locations);
+
+        double max_difference = 0.0;
+        for (unsigned i=0; i<explicit_locations.size(); i++)
+        {
+            max_difference = std::max(max_difference, fabs(multirate_locations[i] - explicit_locations[i]));
+        }
+
+        std::cout << "Relaxing 1200 capsules with a crowded front for an hour: forward Euler evaluates " << explicit_pairs
+                  << " pairs in " << explicit_wall_time << " s; multirate evaluates " << multirate_pairs << " pairs in "
+                  << multirate_wall_time << " s, moving " << multirate_method.GetMeanFractionOfActiveCapsules()
+                  << " of the capsules per step, to within " << max_difference << " of forward Euler\n";
+
+        TS_ASSERT_LESS_THAN(multirate_pairs, explicit_pairs);
+        TS_ASSERT_LESS_THAN(max_difference, 0.05);
+    }
+};
+
+#endif /*_TESTCAPSULENUMERICALMETHODSPERFORMANCE_HPP_*/
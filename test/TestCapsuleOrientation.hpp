@@ -0,0 +1,153 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTCAPSULEORIENTATION_HPP_
+#define _TESTCAPSULEORIENTATION_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "CheckpointArchiveTypes.hpp"
+
+#include "CapsuleGeometryCache.hpp"
+#include "CapsuleOrientation.hpp"
+#include "Node.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestCapsuleOrientation : public CxxTest::TestSuite
+{
+public:
+
+    void TestOrientation2d()
+    {
+        std::vector<double> attributes(NA_VEC_LENGTH, 0.0);
+        attributes[NA_THETA] = 0.25 * M_PI;
+
+        // Without a director, the axis comes from theta
+        TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(attributes), false);
+        c_vector<double, 2> axis;
+        CapsuleOrientation::GetAxis(attributes, axis);
+        TS_ASSERT_DELTA(axis[0], sqrt(0.5), 1e-12);
+        TS_ASSERT_DELTA(axis[1], sqrt(0.5), 1e-12);
+
+        // Setting the director normalises it and brings theta into step
+        CapsuleOrientation::SetDirector(attributes, Create_c_vector(0.0, -3.0));
+        TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(attributes), true);
+        TS_ASSERT_DELTA(attributes[NA_DIRECTOR_X], 0.0, 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_DIRECTOR_Y], -1.0, 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_THETA], -0.5 * M_PI, 1e-12);
+
+        // The director takes precedence over theta
+        attributes[NA_THETA] = 0.0;
+        CapsuleOrientation::GetAxis(attributes, axis);
+        TS_ASSERT_DELTA(axis[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(axis[1], -1.0, 1e-12);
+
+        CapsuleOrientation::ClearDirector(attributes);
+        TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(attributes), false);
+        CapsuleOrientation::GetAxis(attributes, axis);
+        TS_ASSERT_DELTA(axis[0], 1.0, 1e-12);
+        TS_ASSERT_DELTA(axis[1], 0.0, 1e-12);
+
+        // Node attributes from before there were directors have none
+        std::vector<double> short_attributes(NA_DIRECTOR_X, 0.0);
+        TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(short_attributes), false);
+    }
+
+    void TestOrientation3d()
+    {
+        std::vector<double> attributes(NA_VEC_LENGTH, 0.0);
+        attributes[NA_THETA] = 0.5 * M_PI;
+        attributes[NA_PHI] = 0.25 * M_PI;
+
+        c_vector<double, 3> axis;
+        CapsuleOrientation::GetAxis(attributes, axis);
+        TS_ASSERT_DELTA(axis[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(axis[1], sqrt(0.5), 1e-12);
+        TS_ASSERT_DELTA(axis[2], sqrt(0.5), 1e-12);
+
+        // Setting the director from the angles' own axis leaves the angles as they were
+        CapsuleOrientation::SetDirector(attributes, axis);
+        TS_ASSERT_DELTA(attributes[NA_THETA], 0.5 * M_PI, 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_PHI], 0.25 * M_PI, 1e-12);
+
+        CapsuleOrientation::SetDirector(attributes, Create_c_vector(2.0, 0.0, -2.0));
+        TS_ASSERT_DELTA(attributes[NA_DIRECTOR_X], sqrt(0.5), 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_DIRECTOR_Z], -sqrt(0.5), 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_THETA], 0.0, 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_PHI], 0.75 * M_PI, 1e-12);
+
+        // Along z theta is undefined, and is left alone
+        attributes[NA_THETA] = 1.23;
+        CapsuleOrientation::SetDirector(attributes, Create_c_vector(0.0, 0.0, 1.0));
+        TS_ASSERT_DELTA(attributes[NA_THETA], 1.23, 1e-12);
+        TS_ASSERT_DELTA(attributes[NA_PHI], 0.0, 1e-12);
+
+        // The geometry cache places a capsule along its director
+        Node<3> node(0u, std::vector<double>{0.0, 0.0, 1.0});
+        node.AddNodeAttribute(0.0);
+        node.rGetNodeAttributes() = attributes;
+        node.rGetNodeAttributes()[NA_LENGTH] = 2.0;
+        node.rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        node.rGetNodeAttributes()[NA_PHI] = 0.5 * M_PI;
+
+        CapsuleGeometryCache<3> cache;
+        cache.SetCapsule(0u, node);
+        TS_ASSERT_DELTA(cache.GetAxis(0u)[2], 1.0, 1e-12);
+        TS_ASSERT_DELTA(cache.GetEndPointOne(0u)[2], 2.0, 1e-12);
+    }
+
+    void TestAppliedTorque()
+    {
+        std::vector<double> attributes(NA_VEC_LENGTH, 0.0);
+        attributes[NA_APPLIED_THETA] = 1.0;
+        attributes[NA_APPLIED_PHI] = 2.0;
+        attributes[NA_APPLIED_TORQUE_Y] = 3.0;
+
+        // In 3D the torque is (-NA_APPLIED_PHI, NA_APPLIED_TORQUE_Y, NA_APPLIED_THETA)
+        c_vector<double, 3> torque = CapsuleOrientation::GetAppliedTorque<3>(attributes);
+        TS_ASSERT_DELTA(torque[0], -2.0, 1e-12);
+        TS_ASSERT_DELTA(torque[1], 3.0, 1e-12);
+        TS_ASSERT_DELTA(torque[2], 1.0, 1e-12);
+
+        // In 2D only NA_APPLIED_THETA turns a capsule, about z
+        torque = CapsuleOrientation::GetAppliedTorque<2>(attributes);
+        TS_ASSERT_DELTA(torque[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(torque[1], 0.0, 1e-12);
+        TS_ASSERT_DELTA(torque[2], 1.0, 1e-12);
+    }
+};
+
+#endif /*_TESTCAPSULEORIENTATION_HPP_*/
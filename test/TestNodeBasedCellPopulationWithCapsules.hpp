@@ -0,0 +1,234 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef _TESTNODEBASEDCELLPOPULATIONWITHCAPSULES_HPP_
+#define _TESTNODEBASEDCELLPOPULATIONWITHCAPSULES_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CellsGenerator.hpp"
+#include "CheckpointArchiveTypes.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestNodeBasedCellPopulationWithCapsules : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestAutomaticInteractionCutoff()
+    {
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, false, 0.0, 0.0));
+        nodes.push_back(new Node<2>(1u, false, 5.0, 0.0));
+        nodes.push_back(new Node<2>(2u, false, 10.0, 0.0));
+
+        // The sort of cutoff used in the simulation tests, far larger than the capsules
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 150.5);
+
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = mesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = 0.0;
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        TS_ASSERT_EQUALS(population.GetUseAutomaticInteractionCutoff(), false);
+        TS_ASSERT_DELTA(population.GetInteractionCutoffMargin(), 0.25, 1e-12);
+        TS_ASSERT_THROWS_THIS(population.SetInteractionCutoffMargin(-0.1), "The interaction cutoff margin must be non-negative.");
+
+        // Twice the largest L/2 + R
+        TS_ASSERT_DELTA(population.CalculateRequiredInteractionCutoff(), 3.0, 1e-12);
+
+        // Switched off, the cutoff is left alone
+        population.Update();
+        TS_ASSERT_DELTA(mesh.GetMaximumInteractionDistance(), 150.5, 1e-12);
+        TS_ASSERT_EQUALS(population.GetNumInteractionCutoffUpdates(), 0u);
+
+        // Switched on, it is brought down to the required cutoff plus the margin
+        population.SetUseAutomaticInteractionCutoff(true);
+        population.Update();
+        TS_ASSERT_DELTA(mesh.GetMaximumInteractionDistance(), 3.75, 1e-12);
+        TS_ASSERT_EQUALS(population.GetNumInteractionCutoffUpdates(), 1u);
+
+        // Growth within the margin does not rebuild the boxes
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_LENGTH] = 2.5;
+        population.Update();
+        TS_ASSERT_DELTA(mesh.GetMaximumInteractionDistance(), 3.75, 1e-12);
+        TS_ASSERT_EQUALS(population.GetNumInteractionCutoffUpdates(), 1u);
+
+        // A long capsule makes the cutoff grow straight away
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_LENGTH] = 8.0;
+        TS_ASSERT_DELTA(population.CalculateRequiredInteractionCutoff(), 9.0, 1e-12);
+        population.Update();
+        TS_ASSERT_DELTA(mesh.GetMaximumInteractionDistance(), 11.25, 1e-12);
+        TS_ASSERT_EQUALS(population.GetNumInteractionCutoffUpdates(), 2u);
+
+        // The capsules overlap end to end now, so they must be found as a pair
+        bool found_pair = false;
+        for (auto& r_pair : population.rGetNodePairs())
+        {
+            unsigned index_a = r_pair.first->GetIndex();
+            unsigned index_b = r_pair.second->GetIndex();
+            if (std::min(index_a, index_b) == 0u && std::max(index_a, index_b) == 1u)
+            {
+                found_pair = true;
+            }
+        }
+        TS_ASSERT(found_pair);
+
+        // Once it has gone, the cutoff shrinks again
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+        population.Update();
+        TS_ASSERT_DELTA(mesh.GetMaximumInteractionDistance(), 4.375, 1e-12);
+        TS_ASSERT_EQUALS(population.GetNumInteractionCutoffUpdates(), 3u);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    void TestReorderNodesAlongSpaceFillingCurve()
+    {
+        // A 4 by 4 grid of capsules, numbered in a scrambled order as if by many divisions
+        std::vector<Node<2>*> nodes;
+        for (unsigned index=0; index<16u; index++)
+        {
+            unsigned grid_index = (7u * index) % 16u;
+            nodes.push_back(new Node<2>(index, false, 3.0 * (grid_index % 4u), 3.0 * (grid_index / 4u)));
+        }
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 4.0);
+
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            mesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = mesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = 0.1 * index;
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+        const unsigned num_pairs = population.rGetNodePairs().size();
+
+        std::vector<c_vector<double, 2> > old_locations;
+        std::vector<double> old_thetas;
+        for (unsigned i=0; i<cells.size(); i++)
+        {
+            Node<2>* p_node = population.GetNode(population.GetLocationIndexUsingCell(cells[i]));
+            old_locations.push_back(p_node->rGetLocation());
+            old_thetas.push_back(p_node->rGetNodeAttributes()[NA_THETA]);
+        }
+
+        TS_ASSERT_EQUALS(population.GetNodeReorderingInterval(), 0u);
+        TS_ASSERT_EQUALS(population.GetNumNodeReorderings(), 0u);
+        const unsigned old_topology_version = population.GetTopologyVersion();
+
+        population.ReorderNodesAlongSpaceFillingCurve();
+        population.Update();
+
+        TS_ASSERT_EQUALS(population.GetNumNodeReorderings(), 1u);
+        TS_ASSERT_LESS_THAN(old_topology_version, population.GetTopologyVersion());
+        TS_ASSERT_EQUALS(population.rGetNodePairs().size(), num_pairs);
+
+        // Every cell keeps its capsule
+        for (unsigned i=0; i<cells.size(); i++)
+        {
+            Node<2>* p_node = population.GetNode(population.GetLocationIndexUsingCell(cells[i]));
+            TS_ASSERT_DELTA(p_node->rGetLocation()[0], old_locations[i][0], 1e-12);
+            TS_ASSERT_DELTA(p_node->rGetLocation()[1], old_locations[i][1], 1e-12);
+            TS_ASSERT_DELTA(p_node->rGetNodeAttributes()[NA_THETA], old_thetas[i], 1e-12);
+            TS_ASSERT_EQUALS(population.GetCellUsingLocationIndex(p_node->GetIndex()), cells[i]);
+        }
+
+        // The nodes now follow a Z-order curve through the grid, x first
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[1], 0.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1u)->rGetLocation()[0], 3.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1u)->rGetLocation()[1], 0.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[1], 3.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(3u)->rGetLocation()[0], 3.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(3u)->rGetLocation()[1], 3.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(4u)->rGetLocation()[0], 6.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(4u)->rGetLocation()[1], 0.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(15u)->rGetLocation()[0], 9.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(15u)->rGetLocation()[1], 9.0, 1e-12);
+
+        // Already in order, so nothing more is done
+        population.ReorderNodesAlongSpaceFillingCurve();
+        TS_ASSERT_EQUALS(population.GetNumNodeReorderings(), 1u);
+
+        // With an interval set, Update() reorders every so many calls
+        population.SetNodeReorderingInterval(2u);
+        TS_ASSERT_EQUALS(population.GetNodeReorderingInterval(), 2u);
+        population.Update();
+        TS_ASSERT_EQUALS(population.mNumUpdatesSinceNodeReordering, 1u);
+        population.Update();
+        TS_ASSERT_EQUALS(population.mNumUpdatesSinceNodeReordering, 0u);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+};
+
+#endif /*_TESTNODEBASEDCELLPOPULATIONWITHCAPSULES_HPP_*/
@@ -40,14 +40,115 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "CheckpointArchiveTypes.hpp"
 
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleOrientation.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "SimulationTime.hpp"
+#include "SmartPointers.hpp"
+#include "TransitCellProliferativeType.hpp"
 #include "TypeSixSecretionEnumerations.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "WildTypeCellMutationState.hpp"
 
+#include "BackwardEulerNumericalMethodForCapsules.hpp"
 #include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "MultirateNumericalMethodForCapsules.hpp"
+#include "RungeKuttaNumericalMethodForCapsules.hpp"
 #include "PetscSetupAndFinalize.hpp"
 
-class TestNumericalMethodForCapsules : public CxxTest::TestSuite
+class TestNumericalMethodForCapsules : public AbstractCellBasedTestSuite
 {
+private:
 
+    /**
+     * Set up a population of capsules, one node per capsule.
+     *
+     * @param rLocations the centre of each capsule
+     * @param rMesh the mesh to construct
+     * @param rCells the cells of the capsules; if empty, filled in with a differentiated cell for each capsule
+     * @param rThetas the angle theta of each capsule; zero if empty
+     * @param length the length of each capsule
+     * @param radius the radius of each capsule
+     * @return the population, updated
+     */
+    template<unsigned DIM>
+    boost::shared_ptr<NodeBasedCellPopulationWithCapsules<DIM> > SetUpCapsules(
+        const std::vector<c_vector<double, DIM> >& rLocations,
+        NodesOnlyMesh<DIM>& rMesh,
+        std::vector<CellPtr>& rCells,
+        const std::vector<double>& rThetas=std::vector<double>(),
+        double length=2.0,
+        double radius=0.5)
+    {
+        std::vector<Node<DIM>*> nodes;
+        for (unsigned index=0; index<rLocations.size(); index++)
+        {
+            nodes.push_back(new Node<DIM>(index, rLocations[index], false));
+        }
+        rMesh.ConstructNodesWithoutMesh(nodes, 4.0);
+
+        for (unsigned index=0; index<rMesh.GetNumNodes(); index++)
+        {
+            rMesh.GetNode(index)->AddNodeAttribute(0.0);
+            std::vector<double>& attributes = rMesh.GetNode(index)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = rThetas.empty() ? 0.0 : rThetas[index];
+            attributes[NA_LENGTH] = length;
+            attributes[NA_RADIUS] = radius;
+        }
+
+        if (rCells.empty())
+        {
+            auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+            CellsGenerator<NoCellCycleModel, DIM> cells_generator;
+            cells_generator.GenerateBasicRandom(rCells, rMesh.GetNumNodes(), p_diff_type);
+        }
+
+        auto p_population = boost::make_shared<NodeBasedCellPopulationWithCapsules<DIM> >(rMesh, rCells);
+        p_population->Update();
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+        return p_population;
+    }
+
+    /**
+     * Relax a capsule lying tilted across the end of another, with equal steps.
+     *
+     * @param rMethod the numerical method
+     * @param numSteps the number of steps
+     * @param endTime the time to relax for
+     * @return the centre and angle theta of the tilted capsule at the end
+     */
+    c_vector<double, 3> RelaxTiltedCapsule(AbstractNumericalMethod<2, 2>& rMethod, unsigned numSteps, double endTime)
+    {
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpCapsules<2>({Create_c_vector(0.0, 0.0), Create_c_vector(0.8, 1.45)}, mesh, cells, {0.0, 0.6});
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(boost::make_shared<CapsuleForce<2, 2> >());
+
+        rMethod.SetCellPopulation(p_population.get());
+        rMethod.SetForceCollection(&force_collection);
+        for (unsigned step=0; step<numSteps; step++)
+        {
+            rMethod.UpdateAllNodePositions(endTime / numSteps);
+        }
+
+        c_vector<double, 3> state;
+        state[0] = mesh.GetNode(1)->rGetLocation()[0];
+        state[1] = mesh.GetNode(1)->rGetLocation()[1];
+        state[2] = mesh.GetNode(1)->rGetNodeAttributes()[NA_THETA];
+        return state;
+    }
 
 public:
 
@@ -93,6 +194,709 @@ public:
         TS_ASSERT(method.CalculateMomentOfInertiaOfCapsule(l, r) < upper_bound);
     }
 
+    void TestMobilities()
+    {
+        // Two capsules apart from each other
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpCapsules<2>({Create_c_vector(0.0, 0.0), Create_c_vector(0.0, 2.0)}, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(boost::make_shared<CapsuleForce<2, 2> >());
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+        TS_ASSERT_EQUALS(method.GetNumMobilityUpdates(), 0u);
+
+        // The mobilities are cached on the first step, and kept while the lengths do not change
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_EQUALS(method.GetNumMobilityUpdates(), 2u);
+        for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+        {
+            const std::vector<double>& r_attributes = mesh.GetNode(index)->rGetNodeAttributes();
+            TS_ASSERT_DELTA(r_attributes[NA_TRANSLATIONAL_MOBILITY], 1.0 / method.CalculateMassOfCapsule(2.0, 0.5), 1e-12);
+            TS_ASSERT_DELTA(r_attributes[NA_ROTATIONAL_MOBILITY], 1.0 / method.CalculateMomentOfInertiaOfCapsule(2.0, 0.5), 1e-12);
+        }
+
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_EQUALS(method.GetNumMobilityUpdates(), 2u);
+
+        // Only a capsule whose length changes has its mobilities recomputed
+        mesh.GetNode(0)->rGetNodeAttributes()[NA_LENGTH] = 3.0;
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_EQUALS(method.GetNumMobilityUpdates(), 3u);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_TRANSLATIONAL_MOBILITY],
+                        1.0 / method.CalculateMassOfCapsule(3.0, 0.5), 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_ROTATIONAL_MOBILITY],
+                        1.0 / method.CalculateMomentOfInertiaOfCapsule(3.0, 0.5), 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetNodeAttributes()[NA_TRANSLATIONAL_MOBILITY],
+                        1.0 / method.CalculateMassOfCapsule(2.0, 0.5), 1e-12);
+    }
+
+    void TestGrowthLaws()
+    {
+        // Three capsules far apart, the first two growing over a cell cycle of one hour
+        std::vector<c_vector<double, 2> > locations;
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned index=0; index<3; index++)
+        {
+            AbstractCellCycleModel* p_model;
+            if (index < 2)
+            {
+                UniformCellCycleModel* p_uniform_model = new UniformCellCycleModel();
+                p_uniform_model->SetMinCellCycleDuration(1.0);
+                p_uniform_model->SetMaxCellCycleDuration(1.0);
+                p_model = p_uniform_model;
+            }
+            else
+            {
+                p_model = new NoCellCycleModel();
+            }
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+            p_cell->SetBirthTime(-0.5);
+            cells.push_back(p_cell);
+            locations.push_back(Create_c_vector(20.0 * index, 0.0));
+        }
+
+        NodesOnlyMesh<2> mesh;
+        auto p_population = SetUpCapsules<2>(locations, mesh, cells, std::vector<double>(3, 0.0), 2.5);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(boost::make_shared<CapsuleForce<2, 2> >());
+
+        SimulationTime::Instance()->SetEndTimeAndNumberOfTimeSteps(1.0, 10);
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+        TS_ASSERT(method.GetAxialCapsuleGrowth());
+        TS_ASSERT_EQUALS(method.GetGrowthLaw(), CGL_LINEAR);
+        TS_ASSERT_DELTA(method.GetInitialCapsuleLength(), 2.0, 1e-12);
+        TS_ASSERT_DELTA(method.GetAdderAddedLength(), 4.0, 1e-12);
+
+        // Each capsule's growth is resolved on the first step; the linear law runs from 2 to 2*2+4*0.5 = 6
+        method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_EQUALS(method.GetNumGrowthResolutions(), 3u);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_LENGTH], 4.0, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetNodeAttributes()[NA_LENGTH], 4.0, 1e-9);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_BIRTH_LENGTH], 2.0, 1e-12);
+        TS_ASSERT_DELTA(method.rGetGrowthRegistry().GetDivisionLength(0), 6.0, 1e-12);
+
+        // A capsule without a cell cycle duration keeps its length
+        TS_ASSERT(!method.rGetGrowthRegistry().IsGrowing(2));
+        TS_ASSERT_DELTA(mesh.GetNode(2)->rGetNodeAttributes()[NA_LENGTH], 2.5, 1e-12);
+
+        // Later steps read the registry without resolving again
+        SimulationTime::Instance()->IncrementTimeOneStep();
+        method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_EQUALS(method.GetNumGrowthResolutions(), 3u);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_LENGTH], 4.4, 1e-9);
+
+        // A division, as NodeBasedCellPopulationWithCapsules::AddCell records it, resolves the parent again
+        population.GetCellUsingLocationIndex(0)->SetBirthTime(SimulationTime::Instance()->GetTime());
+        mesh.GetNode(0)->rGetNodeAttributes()[NA_MOTHER_LENGTH] = mesh.GetNode(0)->rGetNodeAttributes()[NA_LENGTH];
+        mesh.GetNode(0)->rGetNodeAttributes()[NA_BIRTH_LENGTH] = 0.0;
+        method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_EQUALS(method.GetNumGrowthResolutions(), 4u);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_LENGTH], 2.0, 1e-9);
+
+        // The exponential law grows at a constant relative rate over the same lengths
+        ForwardEulerNumericalMethodForCapsules<2, 2> exponential_method;
+        exponential_method.SetGrowthLaw(CGL_EXPONENTIAL);
+        exponential_method.SetCellPopulation(&population);
+        exponential_method.SetForceCollection(&force_collection);
+        exponential_method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_EQUALS(exponential_method.GetNumGrowthResolutions(), 3u);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetNodeAttributes()[NA_LENGTH], 2.0 * std::pow(3.0, 0.6), 1e-9);
+
+        // Under the adder law a daughter starts from half its mother less four radii, and adds a fixed length
+        mesh.GetNode(0)->rGetNodeAttributes()[NA_MOTHER_LENGTH] = 7.0;
+        mesh.GetNode(0)->rGetNodeAttributes()[NA_BIRTH_LENGTH] = 0.0;
+        ForwardEulerNumericalMethodForCapsules<2, 2> adder_method;
+        adder_method.SetGrowthLaw(CGL_ADDER);
+        adder_method.SetAdderAddedLength(3.0);
+        adder_method.SetCellPopulation(&population);
+        adder_method.SetForceCollection(&force_collection);
+        adder_method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_DELTA(adder_method.rGetGrowthRegistry().GetBirthLength(0), 2.5, 1e-12);
+        TS_ASSERT_DELTA(adder_method.rGetGrowthRegistry().GetDivisionLength(0), 5.5, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_LENGTH], 2.5, 1e-9);
+
+        // The first generation has no mother, so starts from the initial length
+        TS_ASSERT_DELTA(adder_method.rGetGrowthRegistry().GetBirthLength(1), 2.0, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetNodeAttributes()[NA_LENGTH], 2.0 * std::pow(2.5, 0.6), 1e-9);
+
+        // Without axial growth the lengths are left alone
+        ForwardEulerNumericalMethodForCapsules<2, 2> fixed_length_method;
+        fixed_length_method.SetAxialCapsuleGrowth(false);
+        fixed_length_method.SetCellPopulation(&population);
+        fixed_length_method.SetForceCollection(&force_collection);
+        SimulationTime::Instance()->IncrementTimeOneStep();
+        fixed_length_method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_EQUALS(fixed_length_method.GetNumGrowthResolutions(), 0u);
+        TS_ASSERT_DELTA(mesh.GetNode(1)->rGetNodeAttributes()[NA_LENGTH], 2.0 * std::pow(2.5, 0.6), 1e-9);
+
+        TS_ASSERT_THROWS_THIS(method.SetInitialCapsuleLength(0.0), "The initial capsule length must be positive.");
+        TS_ASSERT_THROWS_THIS(method.SetAdderAddedLength(-1.0), "The length added under the adder law must be positive.");
+    }
+
+    void TestGrowthAcrossNodeReordering()
+    {
+        // Four capsules far apart along a line, numbered against the space-filling curve, each growing linearly from
+        // 2 to 6 over a cell cycle of one hour from a different birth time
+        std::vector<c_vector<double, 2> > locations;
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned index=0; index<4; index++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(1.0);
+            p_model->SetMaxCellCycleDuration(1.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+            p_cell->SetBirthTime(-0.1 * (index + 1.0));
+            cells.push_back(p_cell);
+            locations.push_back(Create_c_vector(20.0 * (3.0 - index), 0.0));
+        }
+
+        NodesOnlyMesh<2> mesh;
+        auto p_population = SetUpCapsules<2>(locations, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(boost::make_shared<CapsuleForce<2, 2> >());
+
+        SimulationTime::Instance()->SetEndTimeAndNumberOfTimeSteps(1.0, 10);
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+        method.UpdateAllNodePositions(0.1);
+        TS_ASSERT_EQUALS(method.GetNumGrowthResolutions(), 4u);
+
+        // Reordering the nodes mid-growth hands the capsules to other node indices...
+        population.ReorderNodesAlongSpaceFillingCurve();
+        TS_ASSERT_EQUALS(population.GetNumNodeReorderings(), 1u);
+        TS_ASSERT_DIFFERS(population.GetLocationIndexUsingCell(cells[0]), 0u);
+
+        // ...and each keeps growing along its own law rather than that of the capsule that had its index
+        for (unsigned step=0; step<2; step++)
+        {
+            SimulationTime::Instance()->IncrementTimeOneStep();
+            method.UpdateAllNodePositions(0.1);
+            const double time = SimulationTime::Instance()->GetTime();
+            for (unsigned i=0; i<cells.size(); i++)
+            {
+                const unsigned index = population.GetLocationIndexUsingCell(cells[i]);
+                const double age = time + 0.1 * (i + 1.0);
+                TS_ASSERT_DELTA(mesh.GetNode(index)->rGetNodeAttributes()[NA_LENGTH], 2.0 + 4.0 * age, 1e-9);
+            }
+        }
+        TS_ASSERT_EQUALS(method.GetNumGrowthResolutions(), 8u);
+    }
+
+    void TestNumThreads()
+    {
+        // Growing rows of overlapping capsules give the same positions, angles and lengths for any number of threads
+        std::vector<std::vector<double> > results(2);
+        const unsigned num_threads[2] = {1u, 3u};
+        for (unsigned run=0; run<2; run++)
+        {
+            std::vector<c_vector<double, 2> > locations;
+            std::vector<double> thetas;
+            std::vector<CellPtr> cells;
+            MAKE_PTR(WildTypeCellMutationState, p_state);
+            MAKE_PTR(TransitCellProliferativeType, p_type);
+            for (unsigned index=0; index<20; index++)
+            {
+                locations.push_back(Create_c_vector(4.0 * (index % 5), 0.95 * (index / 5)));
+                thetas.push_back(0.02 * sin(double(index)));
+
+                UniformCellCycleModel* p_model = new UniformCellCycleModel();
+                p_model->SetMinCellCycleDuration(2.0);
+                p_model->SetMaxCellCycleDuration(2.0);
+                CellPtr p_cell(new Cell(p_state, p_model));
+                p_cell->SetCellProliferativeType(p_type);
+                p_cell->SetBirthTime(-0.02 * index);
+                cells.push_back(p_cell);
+            }
+
+            NodesOnlyMesh<2> mesh;
+            auto p_population = SetUpCapsules<2>(locations, mesh, cells, thetas);
+            NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+            std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+            force_collection.push_back(boost::make_shared<CapsuleForce<2, 2> >());
+
+            ForwardEulerNumericalMethodForCapsules<2, 2> method;
+            TS_ASSERT_EQUALS(method.GetNumThreads(), 1u);
+            method.SetNumThreads(num_threads[run]);
+            TS_ASSERT_EQUALS(method.GetNumThreads(), num_threads[run]);
+            method.SetUseSleeping(true);
+            method.SetCellPopulation(&population);
+            method.SetForceCollection(&force_collection);
+            for (unsigned step=0; step<10; step++)
+            {
+                method.UpdateAllNodePositions(1.0 / 120.0);
+                population.Update();
+            }
+
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                results[run].push_back(mesh.GetNode(index)->rGetLocation()[0]);
+                results[run].push_back(mesh.GetNode(index)->rGetLocation()[1]);
+                results[run].push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_THETA]);
+                results[run].push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_LENGTH]);
+            }
+        }
+
+        TS_ASSERT_EQUALS(results[0].size(), results[1].size());
+        for (unsigned i=0; i<results[0].size(); i++)
+        {
+            TS_ASSERT_EQUALS(results[0][i], results[1][i]);
+        }
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        TS_ASSERT_THROWS_THIS(method.SetNumThreads(0u), "The number of threads must be at least one.");
+    }
+
+    void TestSleeping()
+    {
+        // Two capsules apart from each other, so both are quiet
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpCapsules<2>({Create_c_vector(0.0, 0.0), Create_c_vector(0.0, 2.0)}, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        p_force->SetUseSleeping(true);
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(p_force);
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+
+        TS_ASSERT_EQUALS(method.GetUseSleeping(), false);
+        TS_ASSERT_EQUALS(method.GetNumQuietStepsBeforeSleeping(), 10u);
+        TS_ASSERT_THROWS_THIS(method.SetNumQuietStepsBeforeSleeping(0u),
+                              "The number of quiet steps before sleeping must be at least one.");
+        method.SetUseSleeping(true);
+        method.SetNumQuietStepsBeforeSleeping(3u);
+        method.SetSleepThresholds(1e-2, 2e-2, 3e-2);
+        TS_ASSERT_DELTA(method.GetSleepForceThreshold(), 1e-2, 1e-12);
+        TS_ASSERT_DELTA(method.GetSleepTorqueThreshold(), 2e-2, 1e-12);
+        TS_ASSERT_DELTA(method.GetSleepGrowthRateThreshold(), 3e-2, 1e-12);
+
+        // Both capsules fall asleep after three quiet steps, and are then held still
+        for (unsigned step=0; step<3u; step++)
+        {
+            TS_ASSERT_EQUALS(method.GetNumSleepingCells(), 0u);
+            method.UpdateAllNodePositions(0.01);
+        }
+        TS_ASSERT_EQUALS(method.GetNumSleepingCells(), 2u);
+        TS_ASSERT_DELTA(method.GetFractionOfSleepingCells(), 1.0, 1e-12);
+        TS_ASSERT_DELTA(method.GetMeanFractionOfSleepingCells(), 0.0, 1e-12);
+
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_EQUALS(method.GetNumSleepingCells(), 2u);
+        TS_ASSERT_DELTA(method.GetMeanFractionOfSleepingCells(), 0.25, 1e-12);
+
+        // Pushing one into the other wakes both, and they move apart
+        mesh.GetNode(1u)->rGetModifiableLocation()[1] = 0.9;
+        population.Update();
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_EQUALS(method.GetNumSleepingCells(), 0u);
+        TS_ASSERT_DELTA(mesh.GetNode(0u)->rGetNodeAttributes()[NA_ASLEEP], 0.0, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(1u)->rGetNodeAttributes()[NA_ASLEEP], 0.0, 1e-12);
+        TS_ASSERT_LESS_THAN(0.9, mesh.GetNode(1u)->rGetLocation()[1]);
+        TS_ASSERT_LESS_THAN(mesh.GetNode(0u)->rGetLocation()[1], 0.0);
+
+        // Once both are apart and asleep again, an awake capsule pushing into a sleeping one wakes it, and it moves.
+        // The wake distance is set past the push, so that the sleeping capsule is woken by its own force rather than
+        // by the other's movement, which needs CapsuleForce to evaluate a pair with only one capsule still asleep
+        p_force->SetSleepWakeDistance(2.0);
+        mesh.GetNode(0u)->rGetModifiableLocation() = Create_c_vector(0.0, 0.0);
+        mesh.GetNode(1u)->rGetModifiableLocation() = Create_c_vector(0.0, 2.0);
+        population.Update();
+        for (unsigned step=0; step<4u; step++)
+        {
+            method.UpdateAllNodePositions(0.01);
+        }
+        TS_ASSERT_EQUALS(method.GetNumSleepingCells(), 2u);
+
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_ASLEEP] = 0.0;
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_NUM_QUIET_STEPS] = 0.0;
+        mesh.GetNode(1u)->rGetModifiableLocation()[1] = 0.9;
+        population.Update();
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_DELTA(mesh.GetNode(0u)->rGetNodeAttributes()[NA_ASLEEP], 0.0, 1e-12);
+        TS_ASSERT_LESS_THAN(mesh.GetNode(0u)->rGetLocation()[1], 0.0);
+        TS_ASSERT_LESS_THAN(0.9, mesh.GetNode(1u)->rGetLocation()[1]);
+    }
+
+    void TestDirectorOrientation()
+    {
+        // A capsule standing along z, pushed sideways near its top by a horizontal capsule along y
+        NodesOnlyMesh<3> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpCapsules<3>({Create_c_vector(0.0, 0.0, 0.0), Create_c_vector(0.9, 0.0, 0.8)}, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<3>& population = *p_population;
+
+        auto p_force = boost::make_shared<CapsuleForce<3, 3> >();
+        std::vector<boost::shared_ptr<AbstractForce<3, 3> > > force_collection;
+        force_collection.push_back(p_force);
+
+        ForwardEulerNumericalMethodForCapsules<3, 3> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+        TS_ASSERT_EQUALS(method.GetUseDirectorOrientation(), false);
+
+        for (unsigned use_director=0; use_director<2u; use_director++)
+        {
+            mesh.GetNode(0u)->rGetModifiableLocation() = Create_c_vector(0.0, 0.0, 0.0);
+            mesh.GetNode(1u)->rGetModifiableLocation() = Create_c_vector(0.9, 0.0, 0.8);
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                std::vector<double>& attributes = mesh.GetNode(index)->rGetNodeAttributes();
+                attributes[NA_THETA] = (index == 0u) ? 0.0 : 0.5 * M_PI;
+                attributes[NA_PHI] = (index == 0u) ? 0.0 : 0.5 * M_PI;
+                attributes[NA_LENGTH] = 2.0;
+                attributes[NA_RADIUS] = 0.5;
+            }
+            population.Update();
+
+            method.SetUseDirectorOrientation(use_director == 1u);
+            method.UpdateAllNodePositions(0.01);
+
+            const std::vector<double>& r_attributes = mesh.GetNode(0u)->rGetNodeAttributes();
+            c_vector<double, 3> axis;
+            CapsuleOrientation::GetAxis(r_attributes, axis);
+
+            if (use_director == 0u)
+            {
+                // The torque about y does not show in the angles, so the standing capsule does not tip at the pole
+                TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(r_attributes), false);
+                TS_ASSERT_DELTA(r_attributes[NA_PHI], 0.0, 1e-12);
+                TS_ASSERT_DELTA(axis[2], 1.0, 1e-12);
+            }
+            else
+            {
+                // The director tips away from the push, stays a unit vector, and the angles follow it
+                TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(r_attributes), true);
+                TS_ASSERT_LESS_THAN(axis[0], 0.0);
+                TS_ASSERT_DELTA(axis[1], 0.0, 1e-12);
+                TS_ASSERT_DELTA(norm_2(axis), 1.0, 1e-12);
+                TS_ASSERT_LESS_THAN(0.0, r_attributes[NA_PHI]);
+                TS_ASSERT_DELTA(cos(r_attributes[NA_THETA]) * sin(r_attributes[NA_PHI]), axis[0], 1e-12);
+                TS_ASSERT_DELTA(cos(r_attributes[NA_PHI]), axis[2], 1e-12);
+            }
+        }
+
+        // Going back to the angles clears the director, and they carry on from where it left off
+        const double phi = mesh.GetNode(0u)->rGetNodeAttributes()[NA_PHI];
+        method.SetUseDirectorOrientation(false);
+        method.UpdateAllNodePositions(0.01);
+        TS_ASSERT_EQUALS(CapsuleOrientation::HasDirector(mesh.GetNode(0u)->rGetNodeAttributes()), false);
+        TS_ASSERT_DELTA(mesh.GetNode(0u)->rGetNodeAttributes()[NA_PHI], phi, 0.1);
+    }
+
+    void TestAdaptiveTimeStepping()
+    {
+        // Two capsules overlapping badly, as just after a division
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpCapsules<2>({Create_c_vector(0.0, 0.0), Create_c_vector(0.0, 0.8)}, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+        force_collection.push_back(p_force);
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+
+        TS_ASSERT_EQUALS(method.GetUseAdaptiveTimeStepping(), false);
+        TS_ASSERT_THROWS_THIS(method.SetAdaptiveTimeStepBounds(0.1, 0.0, 0.1),
+                              "The adaptive time step bounds must be positive.");
+        TS_ASSERT_THROWS_THIS(method.SetMinimumTimeStep(0.0), "The minimum time step must be positive.");
+
+        method.SetUseAdaptiveTimeStepping(true);
+        method.SetAdaptiveTimeStepBounds(0.01, 0.02, 0.004);
+        method.SetMinimumTimeStep(1e-8);
+        TS_ASSERT_DELTA(method.GetMaxDisplacementPerStep(), 0.01, 1e-12);
+        TS_ASSERT_DELTA(method.GetMaxRotationPerStep(), 0.02, 1e-12);
+        TS_ASSERT_DELTA(method.GetMaxOverlapChangePerStep(), 0.004, 1e-12);
+        TS_ASSERT_DELTA(method.GetMinimumTimeStep(), 1e-8, 1e-20);
+
+        // The first substep is set by the overlap bound, as the capsules only move apart
+        p_force->AddForceContribution(population);
+        const double speed = norm_2(mesh.GetNode(0u)->rGetAppliedForce()) / method.CalculateMassOfCapsule(2.0, 0.5);
+        const double first_substep = 0.5 * 0.004 / speed;
+
+        // A large outer step is split into substeps that add up to it
+        const double dt = 10.0 * first_substep;
+        method.UpdateAllNodePositions(dt);
+
+        const std::vector<double>& r_history = method.rGetDtHistory();
+        TS_ASSERT_EQUALS(r_history.size(), method.GetNumSubsteps());
+        TS_ASSERT_LESS_THAN(1u, method.GetNumSubsteps());
+        TS_ASSERT_DELTA(r_history[0], first_substep, 1e-12);
+
+        double total_time = 0.0;
+        for (unsigned step=0; step<r_history.size(); step++)
+        {
+            total_time += r_history[step];
+        }
+        TS_ASSERT_DELTA(total_time, dt, 1e-12);
+
+        // The capsules move apart without overshooting
+        const double separation = mesh.GetNode(1u)->rGetLocation()[1] - mesh.GetNode(0u)->rGetLocation()[1];
+        TS_ASSERT_LESS_THAN(0.8, separation);
+        TS_ASSERT_LESS_THAN(separation, 1.0);
+
+        // Once they no longer touch, a whole step is taken at once
+        mesh.GetNode(1u)->rGetModifiableLocation()[1] = 2.0;
+        population.Update();
+        method.ClearDtHistory();
+        method.UpdateAllNodePositions(dt);
+        TS_ASSERT_EQUALS(method.GetNumSubsteps(), 1u);
+        TS_ASSERT_EQUALS(method.rGetDtHistory().size(), 1u);
+        TS_ASSERT_DELTA(method.rGetDtHistory()[0], dt, 1e-12);
+    }
+
+    void TestBackwardEuler()
+    {
+        // Two overlapping capsules, offset along their axes so that they also turn
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        auto p_population = SetUpCapsules<2>({Create_c_vector(0.0, 0.0), Create_c_vector(0.5, 0.9)}, mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+        std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+
+        BackwardEulerNumericalMethodForCapsules<2, 2> method;
+        method.SetCellPopulation(&population);
+        method.SetForceCollection(&force_collection);
+
+        TS_ASSERT_THROWS_THIS(method.UpdateAllNodePositions(0.01),
+                              "BackwardEulerNumericalMethodForCapsules needs a CapsuleForce in the force collection");
+
+        auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+        force_collection.push_back(p_force);
+
+        force_collection.push_back(boost::make_shared<CapsuleForce<2, 2> >());
+        TS_ASSERT_THROWS_THIS(method.UpdateAllNodePositions(0.01),
+                              "BackwardEulerNumericalMethodForCapsules supports only one CapsuleForce in the force collection");
+        force_collection.pop_back();
+
+        method.SetUseSleeping(true);
+        TS_ASSERT_THROWS_THIS(method.UpdateAllNodePositions(0.01),
+                              "BackwardEulerNumericalMethodForCapsules does not support sleeping or adaptive time stepping");
+        method.SetUseSleeping(false);
+
+        ForwardEulerNumericalMethodForCapsules<2, 2> explicit_method;
+        explicit_method.SetCellPopulation(&population);
+        explicit_method.SetForceCollection(&force_collection);
+
+        const std::vector<c_vector<double, 2> > start_locations = {mesh.GetNode(0)->rGetLocation(), mesh.GetNode(1)->rGetLocation()};
+        const std::vector<std::vector<double> > start_attributes = {mesh.GetNode(0)->rGetNodeAttributes(),
+                                                                    mesh.GetNode(1)->rGetNodeAttributes()};
+
+        // Over a short step the two methods agree
+        const double short_dt = 1e-6;
+        explicit_method.UpdateAllNodePositions(short_dt);
+        const c_vector<double, 2> explicit_displacement = mesh.GetNode(1)->rGetLocation() - start_locations[1];
+        const double explicit_rotation = mesh.GetNode(1)->rGetNodeAttributes()[NA_THETA] - start_attributes[1][NA_THETA];
+        TS_ASSERT_LESS_THAN(0.0, explicit_displacement[1]);
+        TS_ASSERT_LESS_THAN(1e-12, std::fabs(explicit_rotation));
+
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            mesh.GetNode(i)->rGetModifiableLocation() = start_locations[i];
+            mesh.GetNode(i)->rGetNodeAttributes() = start_attributes[i];
+        }
+        method.UpdateAllNodePositions(short_dt);
+        TS_ASSERT_EQUALS(method.GetNumContactsInJacobian(), 1u);
+
+        const c_vector<double, 2> implicit_displacement = mesh.GetNode(1)->rGetLocation() - start_locations[1];
+        const double implicit_rotation = mesh.GetNode(1)->rGetNodeAttributes()[NA_THETA] - start_attributes[1][NA_THETA];
+        TS_ASSERT_DELTA(implicit_displacement[0], explicit_displacement[0], 1e-2 * norm_2(explicit_displacement));
+        TS_ASSERT_DELTA(implicit_displacement[1], explicit_displacement[1], 1e-2 * norm_2(explicit_displacement));
+        TS_ASSERT_DELTA(implicit_rotation, explicit_rotation, 1e-2 * std::fabs(explicit_rotation));
+
+        // Capsules stacked end to end, with a step ten times as long as the explicit method needs to remove the overlap
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            mesh.GetNode(i)->rGetModifiableLocation() = start_locations[i];
+            mesh.GetNode(i)->rGetNodeAttributes() = start_attributes[i];
+        }
+        mesh.GetNode(1)->rGetModifiableLocation()[0] = 0.0;
+        population.Update();
+
+        p_force->AddForceContribution(population);
+        const double speed = norm_2(mesh.GetNode(0)->rGetAppliedForce()) / explicit_method.CalculateMassOfCapsule(2.0, 0.5);
+        const double long_dt = 10.0 * 0.1 / (2.0 * speed);
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            mesh.GetNode(i)->ClearAppliedForce();
+        }
+
+        // The explicit method overshoots, pushing the capsules out of contact, while the implicit one reduces the
+        // overlap without removing it
+        explicit_method.UpdateAllNodePositions(long_dt);
+        TS_ASSERT_LESS_THAN(1.0, mesh.GetNode(1)->rGetLocation()[1] - mesh.GetNode(0)->rGetLocation()[1]);
+
+        mesh.GetNode(0)->rGetModifiableLocation() = start_locations[0];
+        mesh.GetNode(1)->rGetModifiableLocation()[1] = 0.9;
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            mesh.GetNode(i)->rGetNodeAttributes() = start_attributes[i];
+        }
+        method.UpdateAllNodePositions(long_dt);
+        const double separation = mesh.GetNode(1)->rGetLocation()[1] - mesh.GetNode(0)->rGetLocation()[1];
+        TS_ASSERT_LESS_THAN(0.9, separation);
+        TS_ASSERT_LESS_THAN(separation, 1.0);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetLocation()[0], 0.0, 1e-12);
+        TS_ASSERT_DELTA(mesh.GetNode(0)->rGetNodeAttributes()[NA_THETA], 0.0, 1e-9);
+    }
+
+    void TestRungeKutta()
+    {
+        RungeKuttaNumericalMethodForCapsules<2, 2> method;
+        TS_ASSERT_EQUALS(method.GetScheme(), CRK_CLASSIC_RK4);
+        TS_ASSERT_EQUALS(method.GetNumForceEvaluations(), 0u);
+
+        const double end_time = 0.2;
+        const c_vector<double, 3> exact_state = RelaxTiltedCapsule(method, 1280u, end_time);
+        TS_ASSERT_EQUALS(method.GetNumForceEvaluations(), 4u * 1280u);
+
+        // The tilted capsule is pushed away and turned back towards the horizontal
+        TS_ASSERT_LESS_THAN(1.45, exact_state[1]);
+        TS_ASSERT_LESS_THAN(exact_state[2], 0.6);
+
+        // Halving the step divides the error by about two, four and sixteen for forward Euler, Heun and RK4
+        std::vector<double> errors;
+        for (unsigned num_steps=20u; num_steps<=40u; num_steps*=2u)
+        {
+            ForwardEulerNumericalMethodForCapsules<2, 2> forward_euler;
+            errors.push_back(norm_2(RelaxTiltedCapsule(forward_euler, num_steps, end_time) - exact_state));
+
+            RungeKuttaNumericalMethodForCapsules<2, 2> heun;
+            heun.SetScheme(CRK_HEUN);
+            TS_ASSERT_EQUALS(heun.GetScheme(), CRK_HEUN);
+            errors.push_back(norm_2(RelaxTiltedCapsule(heun, num_steps, end_time) - exact_state));
+            TS_ASSERT_EQUALS(heun.GetNumForceEvaluations(), 2u * num_steps);
+
+            RungeKuttaNumericalMethodForCapsules<2, 2> rk4;
+            errors.push_back(norm_2(RelaxTiltedCapsule(rk4, num_steps, end_time) - exact_state));
+        }
+        TS_ASSERT_LESS_THAN(1.8, errors[0] / errors[3]);
+        TS_ASSERT_LESS_THAN(3.5, errors[1] / errors[4]);
+        TS_ASSERT_LESS_THAN(12.0, errors[2] / errors[5]);
+
+        // RK4 is more accurate than forward Euler for fewer force evaluations
+        RungeKuttaNumericalMethodForCapsules<2, 2> coarse_rk4;
+        const double coarse_rk4_error = norm_2(RelaxTiltedCapsule(coarse_rk4, 10u, end_time) - exact_state);
+        ForwardEulerNumericalMethodForCapsules<2, 2> fine_forward_euler;
+        const double fine_forward_euler_error = norm_2(RelaxTiltedCapsule(fine_forward_euler, 80u, end_time) - exact_state);
+        TS_ASSERT_LESS_THAN(coarse_rk4_error, fine_forward_euler_error);
+
+        method.SetUseAdaptiveTimeStepping(true);
+        TS_ASSERT_THROWS_THIS(method.UpdateAllNodePositions(0.01),
+                              "RungeKuttaNumericalMethodForCapsules does not support sleeping or adaptive time stepping");
+    }
+
+    void TestMultirate()
+    {
+        MultirateNumericalMethodForCapsules<2, 2> method;
+        TS_ASSERT_EQUALS(method.GetNumRateClasses(), 4u);
+        TS_ASSERT_DELTA(method.GetMaxDisplacementPerUpdate(), 0.01, 1e-12);
+        TS_ASSERT_DELTA(method.GetMeanFractionOfActiveCapsules(), 1.0, 1e-12);
+
+        // With a single rate class every capsule moves on every step, as with forward Euler
+        MultirateNumericalMethodForCapsules<2, 2> single_rate;
+        single_rate.SetNumRateClasses(1u);
+        TS_ASSERT_EQUALS(single_rate.GetNumRateClasses(), 1u);
+        ForwardEulerNumericalMethodForCapsules<2, 2> forward_euler;
+        const c_vector<double, 3> single_rate_state = RelaxTiltedCapsule(single_rate, 20u, 0.2);
+        const c_vector<double, 3> forward_euler_state = RelaxTiltedCapsule(forward_euler, 20u, 0.2);
+        for (unsigned i=0; i<3; i++)
+        {
+            TS_ASSERT_EQUALS(single_rate_state[i], forward_euler_state[i]);
+        }
+        TS_ASSERT_EQUALS(single_rate.GetNumCapsuleUpdates(), 2u * 20u);
+
+        // A pair pushing apart next to a row of resting capsules: the resting capsules move on fewer steps, and
+        // contacts between held capsules are not tested, but the pair moves as with forward Euler
+        std::vector<std::vector<double> > results(2);
+        unsigned long num_pairs_skipped[2];
+        for (unsigned run=0; run<2; run++)
+        {
+            std::vector<c_vector<double, 2> > locations = {Create_c_vector(0.0, 0.0), Create_c_vector(0.0, 0.8)};
+            for (unsigned index=2; index<12; index++)
+            {
+                locations.push_back(Create_c_vector(3.05 * (index - 1), 0.0));
+            }
+
+            NodesOnlyMesh<2> mesh;
+            std::vector<CellPtr> cells;
+            auto p_population = SetUpCapsules<2>(locations, mesh, cells);
+            NodeBasedCellPopulationWithCapsules<2>& population = *p_population;
+
+            auto p_force = boost::make_shared<CapsuleForce<2, 2> >();
+            std::vector<boost::shared_ptr<AbstractForce<2, 2> > > force_collection;
+            force_collection.push_back(p_force);
+
+            ForwardEulerNumericalMethodForCapsules<2, 2> reference;
+            MultirateNumericalMethodForCapsules<2, 2> multirate;
+            AbstractNumericalMethod<2, 2>& r_method = (run == 0) ? static_cast<AbstractNumericalMethod<2, 2>&>(reference)
+                                                                 : static_cast<AbstractNumericalMethod<2, 2>&>(multirate);
+            r_method.SetCellPopulation(&population);
+            r_method.SetForceCollection(&force_collection);
+            for (unsigned step=0; step<40; step++)
+            {
+                r_method.UpdateAllNodePositions(0.005);
+            }
+
+            for (unsigned index=0; index<mesh.GetNumNodes(); index++)
+            {
+                results[run].push_back(mesh.GetNode(index)->rGetLocation()[0]);
+                results[run].push_back(mesh.GetNode(index)->rGetLocation()[1]);
+                results[run].push_back(mesh.GetNode(index)->rGetNodeAttributes()[NA_THETA]);
+            }
+            num_pairs_skipped[run] = p_force->GetNumPairsSkippedInactive();
+
+            if (run == 1)
+            {
+                TS_ASSERT_LESS_THAN(multirate.GetNumCapsuleUpdates(), 40u * mesh.GetNumNodes());
+                TS_ASSERT_LESS_THAN(multirate.GetMeanFractionOfActiveCapsules(), 0.5);
+            }
+        }
+
+        TS_ASSERT_EQUALS(num_pairs_skipped[0], 0u);
+        TS_ASSERT_LESS_THAN(0u, num_pairs_skipped[1]);
+        for (unsigned i=0; i<results[0].size(); i++)
+        {
+            TS_ASSERT_DELTA(results[1][i], results[0][i], 5e-3);
+        }
+        TS_ASSERT_LESS_THAN(0.9, results[1][4] - results[1][1]);
+
+        TS_ASSERT_THROWS_THIS(method.SetNumRateClasses(0u), "There must be at least one rate class.");
+        TS_ASSERT_THROWS_THIS(method.SetMaxDisplacementPerUpdate(0.0), "The maximum displacement per update must be positive.");
+
+        method.SetUseSleeping(true);
+        TS_ASSERT_THROWS_THIS(method.UpdateAllNodePositions(0.01),
+                              "MultirateNumericalMethodForCapsules does not support sleeping or adaptive time stepping");
+    }
 };
 
 #endif /*_TESTCAPSULEFORCE_HPP_*/
@@ -20,6 +20,7 @@
 #include "UniformCellCycleModel.hpp"
 #include "TypeSixMachineProperty.hpp"
 #include "NodeBasedCellPopulation.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
 #include "GeneralisedLinearSpringForce.hpp"
 #include "OffLatticeSimulation.hpp"
 #include "TypeSixMachineModifier.hpp"
@@ -185,6 +186,146 @@ public:
 
         ///\todo Test something
     }
+
+    void TestMachineUpdateInterval()
+    {
+        // A grid of capsules, well apart
+        std::vector<Node<2>*> nodes;
+        for (unsigned index=0; index<1000u; index++)
+        {
+            nodes.push_back(new Node<2>(index, false, 4.0 * (index % 40), 4.0 * (index / 40)));
+        }
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 1.5);
+
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        std::vector<CellPtr> cells;
+        std::vector<boost::shared_ptr<TypeSixMachineProperty> > properties;
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetDimension(2);
+            p_model->SetBirthTime(-1.0);
+
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            properties.push_back(p_property);
+
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+            p_cell->AddCellProperty(p_property);
+            cells.push_back(p_cell);
+
+            std::vector<double>& attributes = mesh.GetNode(i)->rGetNodeAttributes();
+            attributes.resize(NA_VEC_LENGTH);
+            attributes[NA_THETA] = 0.0;
+            attributes[NA_LENGTH] = 2.0;
+            attributes[NA_RADIUS] = 0.5;
+        }
+
+        NodeBasedCellPopulationWithCapsules<2> cell_population(mesh, cells);
+
+        // Updates every ten steps of 0.1 integrate the rates over an interval of 1
+        SimulationTime::Instance()->SetEndTimeAndNumberOfTimeSteps(10.0, 100);
+
+        MAKE_PTR(TypeSixMachineModifier<2>, p_modifier);
+        TS_ASSERT_EQUALS(p_modifier->GetMachineUpdateInterval(), 1u);
+        TS_ASSERT_THROWS_THIS(p_modifier->SetMachineUpdateInterval(0u), "The machine update interval must be at least one time step.");
+        p_modifier->SetMachineUpdateInterval(10u);
+        TS_ASSERT_EQUALS(p_modifier->GetMachineUpdateInterval(), 10u);
+
+        // Machines step through states 1, 2 and 3 and then fire, each at rate 1, far too fast for a time step of 1
+        p_modifier->Setk_1(0.0);
+        p_modifier->Setk_2(0.0);
+        p_modifier->Setk_3(1.0);
+        p_modifier->Setk_4(0.0);
+        p_modifier->Setk_5(1.0);
+        p_modifier->Setk_6(0.0);
+        p_modifier->Setk_7(1.0);
+        for (unsigned i=0; i<properties.size(); i++)
+        {
+            for (unsigned machine=0; machine<20u; machine++)
+            {
+                properties[i]->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(1u, std::vector<double>(2, 0.0)));
+            }
+        }
+        p_modifier->UpdateCellData(cell_population);
+
+        // After a time of 1 a machine is in states 1, 2 and 3 with probabilities 1/e, 1/e and 1/(2e), or has fired
+        std::vector<unsigned> num_in_state(4, 0u);
+        unsigned num_fires = 0u;
+        for (unsigned i=0; i<properties.size(); i++)
+        {
+            for (auto& r_pair : properties[i]->rGetMachineData())
+            {
+                num_in_state[r_pair.first]++;
+            }
+            num_fires += properties[i]->GetNumMachineFiresInThisTimeStep();
+        }
+        TS_ASSERT_EQUALS(num_in_state[0], 0u);
+        TS_ASSERT_EQUALS(num_in_state[1] + num_in_state[2] + num_in_state[3] + num_fires, 20000u);
+        TS_ASSERT_DELTA(num_in_state[1] / 20000.0, exp(-1.0), 0.015);
+        TS_ASSERT_DELTA(num_in_state[2] / 20000.0, exp(-1.0), 0.015);
+        TS_ASSERT_DELTA(num_in_state[3] / 20000.0, 0.5 * exp(-1.0), 0.015);
+        TS_ASSERT_DELTA(num_fires / 20000.0, 1.0 - 2.5 * exp(-1.0), 0.015);
+
+        // On the steps between updates the machines are left alone, and no cell counts the fires of the last update
+        SimulationTime::Instance()->IncrementTimeOneStep();
+        p_modifier->UpdateAtEndOfTimeStep(cell_population);
+        std::vector<unsigned> num_in_state_between_updates(4, 0u);
+        for (unsigned i=0; i<properties.size(); i++)
+        {
+            for (auto& r_pair : properties[i]->rGetMachineData())
+            {
+                num_in_state_between_updates[r_pair.first]++;
+            }
+            TS_ASSERT_EQUALS(properties[i]->GetNumMachineFiresInThisTimeStep(), 0u);
+        }
+        TS_ASSERT(num_in_state_between_updates == num_in_state);
+
+        // Nor does setting up the solve move them on, since no time has passed since the last update
+        p_modifier->SetOutputDirectory("TestMachineUpdateInterval");
+        p_modifier->SetupSolve(cell_population, "TestMachineUpdateInterval");
+        num_in_state_between_updates.assign(4, 0u);
+        for (unsigned i=0; i<properties.size(); i++)
+        {
+            for (auto& r_pair : properties[i]->rGetMachineData())
+            {
+                num_in_state_between_updates[r_pair.first]++;
+            }
+            TS_ASSERT_EQUALS(properties[i]->GetNumMachineFiresInThisTimeStep(), 0u);
+        }
+        TS_ASSERT(num_in_state_between_updates == num_in_state);
+
+        // Machines arrive at rate 2 and move on to state 2 at rate 1, so at the end of an interval of 1 each cell has
+        // two new machines on average, of which a fraction 1/e have moved on
+        p_modifier->Setk_1(2.0);
+        p_modifier->Setk_5(0.0);
+        for (unsigned i=0; i<properties.size(); i++)
+        {
+            properties[i]->rGetMachineData().clear();
+        }
+        p_modifier->UpdateCellData(cell_population);
+
+        num_in_state.assign(4, 0u);
+        for (unsigned i=0; i<properties.size(); i++)
+        {
+            for (auto& r_pair : properties[i]->rGetMachineData())
+            {
+                num_in_state[r_pair.first]++;
+                TS_ASSERT_EQUALS(r_pair.second.size(), 2u);
+            }
+        }
+        const unsigned num_machines = num_in_state[1] + num_in_state[2];
+        TS_ASSERT_EQUALS(num_machines, p_modifier->GetTotalNumberOfMachines(cell_population));
+        TS_ASSERT_DELTA(num_machines / 1000.0, 2.0, 0.2);
+        TS_ASSERT_DELTA(num_in_state[2] / double(num_machines), exp(-1.0), 0.05);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
 ///\todo test archiving and parameter output method
 };
 